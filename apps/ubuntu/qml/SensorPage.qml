@@ -14,6 +14,7 @@ Page {
     property var lights: null
     property var groups: null
     property var scenes: null
+    property int helperSensorRequest: -1
 
     SensorsFilterModel {
         sensors: root.sensors
@@ -44,6 +45,22 @@ Page {
         }
     }
 
+    Connections {
+        target: root.sensors
+        onHelperSensorReady: {
+            if (requestId === root.helperSensorRequest) {
+                root.helperSensorRequest = -1;
+                root.createRules(sensor);
+            }
+        }
+        onHelperSensorFailed: {
+            if (requestId === root.helperSensorRequest) {
+                root.helperSensorRequest = -1;
+                print("No helper sensor found. bailing out...")
+            }
+        }
+    }
+
     Component.onCompleted: loadRules();
 
     function loadRules() {
@@ -122,13 +139,11 @@ Page {
 
         var uniqueId = root.sensor.uniqueId || "000000"
         print("uniqueid is", root.sensor.uniqueId, root.sensor)
-        var helperSensor = root.sensors.findOrCreateHelperSensor("HueTapHelper" + buttonId, uniqueId);
-        if (!helperSensor) {
-            print("No helper sensor found. bailing out...")
-            return;
-        }
-        
+        helperSensorRequest = root.sensors.findOrCreateHelperSensor("HueTapHelper" + buttonId, uniqueId);
+    }
 
+    function createRules(helperSensor) {
+        var buttonId = sensorLoader.item.buttonId;
         var conditions = []
         var actions = []
 
@@ -0,0 +1,623 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+
+#include "automationengine.h"
+#include "sensors.h"
+#include "sensor.h"
+#include "lights.h"
+#include "light.h"
+#include "rulesimulator.h"
+#include "huebridgeconnection.h"
+#include "pollbudget.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QSet>
+
+AutomationEngine::AutomationEngine(QObject *parent):
+    QObject(parent),
+    m_pollInterval(250),
+    m_running(false),
+    m_nextId(0)
+{
+    m_clock.start();
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(runDue()));
+    m_pollTimer.setSingleShot(true);
+    connect(&m_pollTimer, SIGNAL(timeout()), this, SLOT(pollSensors()));
+}
+
+Sensors *AutomationEngine::sensors() const
+{
+    return m_sensors;
+}
+
+void AutomationEngine::setSensors(Sensors *sensors)
+{
+    if (m_sensors == sensors) {
+        return;
+    }
+    if (m_sensors) {
+        disconnect(m_sensors, 0, this, 0);
+    }
+    m_sensors = sensors;
+    if (m_sensors) {
+        connect(m_sensors, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(sensorsDataChanged(QModelIndex,QModelIndex)));
+        connect(m_sensors, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(sensorsInserted(QModelIndex,int,int)));
+        readSensors(0, m_sensors->rowCount(QModelIndex()) - 1, false);
+    }
+    emit sensorsChanged();
+}
+
+Lights *AutomationEngine::lights() const
+{
+    return m_lights;
+}
+
+void AutomationEngine::setLights(Lights *lights)
+{
+    if (m_lights == lights) {
+        return;
+    }
+    if (m_lights) {
+        disconnect(m_lights, 0, this, 0);
+    }
+    m_lights = lights;
+    if (m_lights) {
+        connect(m_lights, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(lightsDataChanged(QModelIndex,QModelIndex)));
+        connect(m_lights, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(lightsInserted(QModelIndex,int,int)));
+        readLights(0, m_lights->rowCount(QModelIndex()) - 1, false);
+    }
+    emit lightsChanged();
+}
+
+SwitchEvents *AutomationEngine::switchEvents() const
+{
+    return m_switchEvents;
+}
+
+void AutomationEngine::setSwitchEvents(SwitchEvents *switchEvents)
+{
+    if (m_switchEvents == switchEvents) {
+        return;
+    }
+    if (m_switchEvents) {
+        disconnect(m_switchEvents, 0, this, 0);
+    }
+    m_switchEvents = switchEvents;
+    if (m_switchEvents) {
+        connect(m_switchEvents, SIGNAL(buttonEvent(QString,int,SwitchEvents::EventType)), this, SLOT(buttonEvent(QString,int,SwitchEvents::EventType)));
+    }
+    emit switchEventsChanged();
+}
+
+int AutomationEngine::pollInterval() const
+{
+    return m_pollInterval;
+}
+
+void AutomationEngine::setPollInterval(int pollInterval)
+{
+    if (m_pollInterval == pollInterval || pollInterval < 100) {
+        return;
+    }
+    m_pollInterval = pollInterval;
+    emit pollIntervalChanged();
+    updatePolling();
+}
+
+bool AutomationEngine::running() const
+{
+    return m_running;
+}
+
+int AutomationEngine::count() const
+{
+    return m_automations.count();
+}
+
+int AutomationEngine::addAutomation(const QVariantMap &automation)
+{
+    Automation a;
+    QVariantMap trigger = automation.value("trigger").toMap();
+    a.trigger.op = OperatorDx;
+    if (trigger.contains("sensor") && trigger.contains("button")) {
+        a.sensorId = trigger.value("sensor").toString();
+        a.button = trigger.value("button").toInt();
+        a.event = trigger.contains("event") ? trigger.value("event").toInt() : -1;
+    } else if (!parseCondition(trigger, &a.trigger) || a.trigger.op == OperatorIn || a.trigger.op == OperatorNotIn) {
+        qWarning() << "AutomationEngine: invalid trigger" << trigger;
+        return -1;
+    }
+    foreach (const QVariant &action, automation.value("actions").toList()) {
+        QString method = action.toMap().value("method", "PUT").toString().toUpper();
+        if (action.toMap().value("address").toString().isEmpty() || (method != "PUT" && method != "POST" && method != "DELETE")) {
+            qWarning() << "AutomationEngine: invalid action" << action;
+            return -1;
+        }
+    }
+    foreach (const QVariant &condition, automation.value("conditions").toList()) {
+        Condition c;
+        if (!parseCondition(condition.toMap(), &c) || c.op == OperatorDx) {
+            qWarning() << "AutomationEngine: invalid condition" << condition;
+            return -1;
+        }
+        a.conditions.append(c);
+    }
+    a.actions = automation.value("actions").toList();
+    a.debounce = automation.value("debounce").toInt();
+    a.delay = automation.value("delay").toInt();
+    a.cooldown = automation.value("cooldown").toInt();
+    a.lastFired = -1;
+    a.triggeredAt = 0;
+    a.generation = 0;
+    // A state which is already true doesn't trigger
+    a.triggerTrue = a.sensorId.isEmpty() && a.trigger.op != OperatorDx && conditionTrue(a.trigger);
+
+    int id = m_nextId++;
+    m_automations.insert(id, a);
+    if (a.sensorId.isEmpty()) {
+        m_byAddress[a.trigger.address].append(id);
+    } else {
+        m_bySensor[a.sensorId].append(id);
+    }
+    emit countChanged();
+    updatePolling();
+    return id;
+}
+
+void AutomationEngine::removeAutomation(int id)
+{
+    if (!m_automations.contains(id)) {
+        return;
+    }
+    Automation a = m_automations.take(id);
+    // Queued deadlines of the automation are skipped when they are due
+    if (a.sensorId.isEmpty()) {
+        m_byAddress[a.trigger.address].removeAll(id);
+    } else {
+        m_bySensor[a.sensorId].removeAll(id);
+    }
+    emit countChanged();
+    updatePolling();
+}
+
+void AutomationEngine::clearAutomations()
+{
+    m_automations.clear();
+    m_byAddress.clear();
+    m_bySensor.clear();
+    m_deadlines.clear();
+    m_timer.stop();
+    emit countChanged();
+    updatePolling();
+}
+
+void AutomationEngine::start()
+{
+    if (m_running) {
+        return;
+    }
+    m_running = true;
+    emit runningChanged();
+    updatePolling();
+}
+
+void AutomationEngine::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+    m_deadlines.clear();
+    m_timer.stop();
+    emit runningChanged();
+    updatePolling();
+}
+
+void AutomationEngine::sensorsDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    readSensors(topLeft.row(), bottomRight.row(), true);
+}
+
+void AutomationEngine::sensorsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+    readSensors(first, last, false);
+}
+
+void AutomationEngine::lightsDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    readLights(topLeft.row(), bottomRight.row(), true);
+}
+
+void AutomationEngine::lightsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+    readLights(first, last, false);
+}
+
+void AutomationEngine::buttonEvent(const QString &sensorId, int button, SwitchEvents::EventType event)
+{
+    if (!m_running) {
+        return;
+    }
+    foreach (int id, m_bySensor.value(sensorId)) {
+        Automation &a = m_automations[id];
+        if (a.button == button && (a.event == -1 || a.event == event)) {
+            a.triggeredAt = m_clock.elapsed() - m_switchEvents->eventLatency(sensorId);
+            proceed(id);
+        }
+    }
+}
+
+void AutomationEngine::runDue()
+{
+    qint64 now = m_clock.elapsed();
+    while (!m_deadlines.isEmpty() && m_deadlines.begin().key() <= now) {
+        qint64 due = m_deadlines.begin().key();
+        Deadline deadline = m_deadlines.take(due);
+        if (!m_automations.contains(deadline.id) || m_automations.value(deadline.id).generation != deadline.generation) {
+            continue;
+        }
+        Automation &a = m_automations[deadline.id];
+        // Timer lateness counts into the reaction time
+        a.triggeredAt = due;
+        if (deadline.debounce) {
+            if (a.triggerTrue) {
+                proceed(deadline.id);
+            }
+            continue;
+        }
+        bool conditionsTrue = true;
+        foreach (const Condition &condition, a.conditions) {
+            conditionsTrue &= conditionTrue(condition);
+        }
+        if (conditionsTrue) {
+            dispatch(deadline.id);
+        }
+    }
+    if (!m_deadlines.isEmpty()) {
+        m_timer.start(qMax<qint64>(0, m_deadlines.begin().key() - m_clock.elapsed()));
+    }
+}
+
+void AutomationEngine::pollSensors()
+{
+    qint64 now = m_clock.elapsed();
+
+    // Longest waiting first, so a tight budget still gets around to every sensor
+    QMultiMap<qint64, QString> due;
+    QHash<QString, SensorPoll>::const_iterator it;
+    for (it = m_sensorPolls.constBegin(); it != m_sensorPolls.constEnd(); ++it) {
+        // One request per sensor at a time, a slow bridge slows down polling
+        if (it.value().requestId == -1 && it.value().nextPoll <= now) {
+            due.insert(it.value().nextPoll, it.key());
+        }
+    }
+
+    foreach (const QString &sensorId, due) {
+        if (!PollBudget::instance()->take()) {
+            break;
+        }
+        SensorPoll &poll = m_sensorPolls[sensorId];
+        poll.requestId = HueBridgeConnection::instance()->get("sensors/" + sensorId, this, "sensorPolled", HueBridgeConnection::PriorityAutomation);
+        poll.pollSent = now;
+        m_pollRequests.insert(poll.requestId, sensorId);
+    }
+
+    schedulePoll();
+}
+
+void AutomationEngine::sensorPolled(int id, const QVariant &response)
+{
+    QString sensorId = m_pollRequests.take(id);
+    if (!m_sensorPolls.contains(sensorId)) {
+        return;
+    }
+    SensorPoll &poll = m_sensorPolls[sensorId];
+    poll.requestId = -1;
+    poll.nextPoll = poll.pollSent + m_pollInterval;
+    schedulePoll();
+    if (response.type() != QVariant::Map) {
+        return;
+    }
+
+    // The change happened somewhere between the previous poll and this one
+    qint64 changedAt = poll.lastPoll >= 0 ? (poll.lastPoll + poll.pollSent) / 2 : m_clock.elapsed();
+    poll.lastPoll = poll.pollSent;
+    updateValues("/sensors/" + sensorId + "/state/", response.toMap().value("state").toMap(), true, changedAt);
+}
+
+void AutomationEngine::schedulePoll()
+{
+    qint64 next = -1;
+    foreach (const SensorPoll &poll, m_sensorPolls) {
+        if (poll.requestId == -1 && (next == -1 || poll.nextPoll < next)) {
+            next = poll.nextPoll;
+        }
+    }
+    if (next == -1) {
+        // Nothing idle, the next reply schedules again
+        m_pollTimer.stop();
+        return;
+    }
+
+    qint64 now = m_clock.elapsed();
+    next = qMax<qint64>(next, now + PollBudget::instance()->wait());
+    m_pollTimer.start(static_cast<int>(qMax<qint64>(0, next - now)));
+}
+
+void AutomationEngine::actionFinished(int id, const QVariant &response)
+{
+    Q_UNUSED(id)
+    foreach (const QVariant &result, response.toList()) {
+        if (result.toMap().contains("error")) {
+            qWarning() << "AutomationEngine: action failed:" << result;
+        }
+    }
+}
+
+bool AutomationEngine::parseCondition(const QVariantMap &map, Condition *condition)
+{
+    condition->address = map.value("address").toString();
+    condition->value = map.value("value");
+    condition->from = 0;
+    condition->to = 0;
+    condition->weekdays = 0x7f;
+
+    QString op = map.value("operator").toString();
+    if (op == "eq") {
+        condition->op = OperatorEq;
+    } else if (op == "gt") {
+        condition->op = OperatorGt;
+    } else if (op == "lt") {
+        condition->op = OperatorLt;
+    } else if (op == "dx") {
+        condition->op = OperatorDx;
+    } else if (op == "in" || op == "not in") {
+        condition->op = op == "in" ? OperatorIn : OperatorNotIn;
+        return RuleSimulator::parseWindow(condition->value.toString(), &condition->from, &condition->to, &condition->weekdays);
+    } else {
+        return false;
+    }
+    return !condition->address.isEmpty();
+}
+
+bool AutomationEngine::conditionTrue(const Condition &condition) const
+{
+    if (condition.op == OperatorIn || condition.op == OperatorNotIn) {
+        bool inside = RuleSimulator::inWindow(QDateTime::currentDateTime(), condition.from, condition.to, condition.weekdays);
+        return condition.op == OperatorIn ? inside : !inside;
+    }
+    if (condition.op == OperatorDx) {
+        return true;
+    }
+
+    QVariant current = value(condition.address);
+    if (!current.isValid()) {
+        return false;
+    }
+    bool currentIsNumber;
+    bool valueIsNumber;
+    double currentNumber = current.toDouble(&currentIsNumber);
+    double valueNumber = condition.value.toDouble(&valueIsNumber);
+    switch (condition.op) {
+    case OperatorEq:
+        if (current.type() == QVariant::Bool) {
+            return current.toBool() == condition.value.toBool();
+        }
+        if (currentIsNumber && valueIsNumber) {
+            return currentNumber == valueNumber;
+        }
+        return current.toString() == condition.value.toString();
+    case OperatorGt:
+        return currentIsNumber && valueIsNumber && currentNumber > valueNumber;
+    case OperatorLt:
+        return currentIsNumber && valueIsNumber && currentNumber < valueNumber;
+    default:
+        break;
+    }
+    return false;
+}
+
+QVariant AutomationEngine::value(const QString &address) const
+{
+    return m_values.value(address);
+}
+
+void AutomationEngine::readSensors(int first, int last, bool notify)
+{
+    if (!m_sensors) {
+        return;
+    }
+    for (int i = first; i <= last; ++i) {
+        Sensor *sensor = m_sensors->get(i);
+        if (sensor) {
+            updateValues("/sensors/" + sensor->id() + "/state/", sensor->stateMap(), notify);
+        }
+    }
+}
+
+void AutomationEngine::readLights(int first, int last, bool notify)
+{
+    if (!m_lights) {
+        return;
+    }
+    for (int i = first; i <= last; ++i) {
+        Light *light = m_lights->get(i);
+        if (!light) {
+            continue;
+        }
+        QVariantMap state;
+        state.insert("on", light->on());
+        state.insert("bri", light->bri());
+        state.insert("hue", light->hue());
+        state.insert("sat", light->sat());
+        state.insert("ct", light->ct());
+        state.insert("reachable", light->reachable());
+        updateValues("/lights/" + QString::number(light->id()) + "/state/", state, notify);
+    }
+}
+
+void AutomationEngine::updateValues(const QString &prefix, const QVariantMap &values, bool notify, qint64 changedAt)
+{
+    if (changedAt < 0) {
+        changedAt = m_clock.elapsed();
+    }
+
+    QStringList changed;
+    foreach (const QString &key, values.keys()) {
+        QString address = prefix + key;
+        QHash<QString, QVariant>::iterator it = m_values.find(address);
+        if (it == m_values.end()) {
+            // Appearing isn't a change
+            m_values.insert(address, values.value(key));
+        } else if (it.value() != values.value(key)) {
+            it.value() = values.value(key);
+            changed.append(address);
+        }
+    }
+    // All values are updated before conditions are checked
+    if (notify) {
+        foreach (const QString &address, changed) {
+            stateChanged(address, changedAt);
+        }
+    }
+}
+
+void AutomationEngine::stateChanged(const QString &address, qint64 changedAt)
+{
+    if (!m_running) {
+        return;
+    }
+    foreach (int id, m_byAddress.value(address)) {
+        Automation &a = m_automations[id];
+        if (a.trigger.op == OperatorDx) {
+            triggered(id, changedAt);
+            continue;
+        }
+        bool isTrue = conditionTrue(a.trigger);
+        if (isTrue && !a.triggerTrue) {
+            a.triggerTrue = true;
+            triggered(id, changedAt);
+        } else if (!isTrue && a.triggerTrue) {
+            // Cancels a running debounce or delay
+            a.triggerTrue = false;
+            a.generation++;
+        }
+    }
+}
+
+void AutomationEngine::triggered(int id, qint64 changedAt)
+{
+    Automation &a = m_automations[id];
+    a.triggeredAt = changedAt;
+    if (a.debounce > 0) {
+        a.generation++;
+        // The debounce runs from the change, not from noticing it
+        schedule(id, qMax<qint64>(0, changedAt + a.debounce - m_clock.elapsed()), true);
+        return;
+    }
+    proceed(id);
+}
+
+void AutomationEngine::proceed(int id)
+{
+    Automation &a = m_automations[id];
+    if (a.lastFired >= 0 && m_clock.elapsed() - a.lastFired < a.cooldown) {
+        return;
+    }
+    foreach (const Condition &condition, a.conditions) {
+        if (!conditionTrue(condition)) {
+            return;
+        }
+    }
+    if (a.delay > 0) {
+        a.generation++;
+        schedule(id, a.delay, false);
+        return;
+    }
+    dispatch(id);
+}
+
+void AutomationEngine::dispatch(int id)
+{
+    Automation &a = m_automations[id];
+    foreach (const QVariant &action, a.actions) {
+        QVariantMap actionMap = action.toMap();
+        QString path = actionMap.value("address").toString();
+        if (path.startsWith('/')) {
+            path = path.mid(1);
+        }
+        QString method = actionMap.value("method", "PUT").toString().toUpper();
+        if (method == "POST") {
+            HueBridgeConnection::instance()->post(path, actionMap.value("body").toMap(), this, "actionFinished", HueBridgeConnection::PriorityInteractive);
+        } else if (method == "DELETE") {
+            HueBridgeConnection::instance()->deleteResource(path, this, "actionFinished", HueBridgeConnection::PriorityInteractive);
+        } else {
+            HueBridgeConnection::instance()->put(path, actionMap.value("body").toMap(), this, "actionFinished", HueBridgeConnection::PriorityInteractive);
+        }
+    }
+    a.lastFired = m_clock.elapsed();
+    emit fired(id, a.lastFired - a.triggeredAt);
+}
+
+void AutomationEngine::schedule(int id, int delay, bool debounce)
+{
+    Deadline deadline;
+    deadline.id = id;
+    deadline.generation = m_automations.value(id).generation;
+    deadline.debounce = debounce;
+    qint64 due = m_clock.elapsed() + delay;
+    m_deadlines.insert(due, deadline);
+    if (m_deadlines.begin().key() == due) {
+        m_timer.start(delay);
+    }
+}
+
+void AutomationEngine::updatePolling()
+{
+    QSet<QString> sensorIds;
+    if (m_running) {
+        foreach (const QString &address, m_byAddress.keys()) {
+            if (address.startsWith("/sensors/") && !m_byAddress.value(address).isEmpty()) {
+                sensorIds.insert(address.section('/', 2, 2));
+            }
+        }
+    }
+
+    foreach (const QString &sensorId, m_sensorPolls.keys()) {
+        if (!sensorIds.contains(sensorId)) {
+            int requestId = m_sensorPolls.take(sensorId).requestId;
+            if (requestId != -1) {
+                m_pollRequests.remove(requestId);
+                HueBridgeConnection::instance()->cancel(requestId);
+            }
+        }
+    }
+    foreach (const QString &sensorId, sensorIds) {
+        if (!m_sensorPolls.contains(sensorId)) {
+            m_sensorPolls.insert(sensorId, SensorPoll());
+        }
+    }
+
+    schedulePoll();
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+
+#ifndef AUTOMATIONENGINE_H
+#define AUTOMATIONENGINE_H
+
+#include "switchevents.h"
+
+#include <QObject>
+#include <QHash>
+#include <QMultiMap>
+#include <QPointer>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVariant>
+
+class Sensors;
+class Lights;
+
+// Runs automations locally instead of as bridge rules. An automation is a map:
+//   trigger:    {sensor, button, event} for switch buttons, event optional, or
+//               {address, operator, value} for state, e.g. /sensors/7/state/presence eq true.
+//               eq, gt and lt trigger when they become true, dx on any change.
+//   conditions: [{address, operator, value}] checked when triggered, eq, gt, lt, in and
+//               not in (time windows on /config/localtime)
+//   actions:    [{address, method, body}] written like bridge rule actions, e.g. /groups/1/action.
+//               method is PUT (default), POST or DELETE
+//   debounce:   ms a state trigger needs to stay true
+//   delay:      ms between trigger and actions, triggering again restarts it
+//   cooldown:   ms to ignore the trigger after the actions ran
+// Automations are indexed by the address or switch they trigger on, so a change only
+// evaluates the automations it concerns and the actions are sent right away at interactive
+// priority. Debounces and delays are kept in one queue ordered by deadline, served by a
+// single timer. Sensors with state triggers are polled one by one every pollInterval
+// instead of refreshing all sensors, longest waiting first and within the PollBudget
+// shared with SwitchEvents. Changes to the Sensors and Lights models are picked up as well.
+class AutomationEngine: public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(Sensors *sensors READ sensors WRITE setSensors NOTIFY sensorsChanged)
+    Q_PROPERTY(Lights *lights READ lights WRITE setLights NOTIFY lightsChanged)
+    Q_PROPERTY(SwitchEvents *switchEvents READ switchEvents WRITE setSwitchEvents NOTIFY switchEventsChanged)
+    Q_PROPERTY(int pollInterval READ pollInterval WRITE setPollInterval NOTIFY pollIntervalChanged)
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+public:
+    AutomationEngine(QObject *parent = 0);
+
+    Sensors *sensors() const;
+    void setSensors(Sensors *sensors);
+    Lights *lights() const;
+    void setLights(Lights *lights);
+    SwitchEvents *switchEvents() const;
+    void setSwitchEvents(SwitchEvents *switchEvents);
+
+    // How often each sensor with a state trigger is polled at most, in ms. Switch buttons are
+    // reported by switchEvents instead.
+    int pollInterval() const;
+    void setPollInterval(int pollInterval);
+
+    bool running() const;
+    int count() const;
+
+    // Returns the id of the automation, or -1 if it is invalid
+    Q_INVOKABLE int addAutomation(const QVariantMap &automation);
+    Q_INVOKABLE void removeAutomation(int id);
+    Q_INVOKABLE void clearAutomations();
+
+    Q_INVOKABLE void start();
+    Q_INVOKABLE void stop();
+
+signals:
+    void sensorsChanged();
+    void lightsChanged();
+    void switchEventsChanged();
+    void pollIntervalChanged();
+    void runningChanged();
+    void countChanged();
+
+    // reactionTime is the time in ms from the trigger to sending the actions, without the
+    // configured debounce and delay. For polled triggers it includes the estimated detection
+    // delay: the change happened between the poll that missed it and the one that saw it.
+    void fired(int id, int reactionTime);
+
+private slots:
+    void sensorsDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void sensorsInserted(const QModelIndex &parent, int first, int last);
+    void lightsDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void lightsInserted(const QModelIndex &parent, int first, int last);
+    void buttonEvent(const QString &sensorId, int button, SwitchEvents::EventType event);
+    void runDue();
+    void actionFinished(int id, const QVariant &response);
+    void pollSensors();
+    void sensorPolled(int id, const QVariant &response);
+
+private:
+    enum Operator {
+        OperatorEq,
+        OperatorGt,
+        OperatorLt,
+        OperatorDx,
+        OperatorIn,
+        OperatorNotIn
+    };
+
+    class Condition
+    {
+    public:
+        QString address;
+        Operator op;
+        QVariant value;
+        int from;
+        int to;
+        int weekdays;
+    };
+
+    class Automation
+    {
+    public:
+        // Either a button or a state trigger
+        QString sensorId;
+        int button;
+        int event;
+        Condition trigger;
+        bool triggerTrue;
+
+        QList<Condition> conditions;
+        QVariantList actions;
+        int debounce;
+        int delay;
+        int cooldown;
+        qint64 lastFired;
+        qint64 triggeredAt;
+        // Bumped to invalidate queued debounces and delays
+        quint32 generation;
+    };
+
+    class SensorPoll
+    {
+    public:
+        SensorPoll(): requestId(-1), lastPoll(-1), pollSent(-1), nextPoll(0) {}
+        int requestId;
+        // When the last poll which didn't see a change was sent
+        qint64 lastPoll;
+        qint64 pollSent;
+        // When the sensor is due again, on m_clock
+        qint64 nextPoll;
+    };
+
+    class Deadline
+    {
+    public:
+        int id;
+        quint32 generation;
+        // Debounce over, otherwise delay over
+        bool debounce;
+    };
+
+    static bool parseCondition(const QVariantMap &map, Condition *condition);
+    bool conditionTrue(const Condition &condition) const;
+    QVariant value(const QString &address) const;
+    void readSensors(int first, int last, bool notify);
+    void readLights(int first, int last, bool notify);
+    // changedAt is when the values changed on m_clock, -1 for now
+    void updateValues(const QString &prefix, const QVariantMap &values, bool notify, qint64 changedAt = -1);
+    void stateChanged(const QString &address, qint64 changedAt);
+    void triggered(int id, qint64 changedAt);
+    void proceed(int id);
+    void dispatch(int id);
+    void schedule(int id, int delay, bool debounce);
+    void updatePolling();
+    void schedulePoll();
+
+    QPointer<Sensors> m_sensors;
+    QPointer<Lights> m_lights;
+    QPointer<SwitchEvents> m_switchEvents;
+    int m_pollInterval;
+    bool m_running;
+
+    QHash<int, Automation> m_automations;
+    int m_nextId;
+    QHash<QString, QList<int> > m_byAddress;
+    QHash<QString, QList<int> > m_bySensor;
+
+    // Last known state by address, e.g. /lights/3/state/on
+    QHash<QString, QVariant> m_values;
+
+    // By sensor id, for the sensors state triggers refer to
+    QHash<QString, SensorPoll> m_sensorPolls;
+    QHash<int, QString> m_pollRequests;
+
+    QMultiMap<qint64, Deadline> m_deadlines;
+    QTimer m_timer;
+    QTimer m_pollTimer;
+    QElapsedTimer m_clock;
+};
+
+#endif
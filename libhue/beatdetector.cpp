@@ -0,0 +1,429 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "beatdetector.h"
+
+#include <math.h>
+#include <string.h>
+
+static const double s_pi = 3.14159265358979323846;
+static const int s_frameSize = 1024;
+static const int s_hopSize = 512;
+// Band edges in Hz
+static const int s_lowBand = 200;
+static const int s_midBand = 2000;
+static const int s_highBand = 8000;
+// Band peaks drop to half within this many seconds
+static const double s_peakHalfLife = 4;
+// Seconds of flux used for the onset threshold and the tempo
+static const double s_fluxHistory = 1;
+static const double s_envelopeHistory = 6;
+static const double s_minBpm = 60;
+static const double s_maxBpm = 180;
+static const double s_minOnsetInterval = 0.1;
+// Onsets on the beat needed before period and phase are fitted to them
+static const int s_minBeatOnsets = 4;
+
+BeatDetector::BeatDetector(int sampleRate):
+    m_sampleRate(sampleRate)
+{
+    m_window.resize(s_frameSize);
+    m_bitReverse.resize(s_frameSize);
+    int bits = 0;
+    while ((1 << bits) < s_frameSize) {
+        ++bits;
+    }
+    for (int i = 0; i < s_frameSize; ++i) {
+        m_window[i] = 0.5 - 0.5 * cos(2 * s_pi * i / (s_frameSize - 1));
+        int reversed = 0;
+        for (int bit = 0; bit < bits; ++bit) {
+            if (i & (1 << bit)) {
+                reversed |= 1 << (bits - 1 - bit);
+            }
+        }
+        m_bitReverse[i] = reversed;
+    }
+    m_cos.resize(s_frameSize / 2);
+    m_sin.resize(s_frameSize / 2);
+    for (int i = 0; i < s_frameSize / 2; ++i) {
+        m_cos[i] = cos(2 * s_pi * i / s_frameSize);
+        m_sin[i] = sin(2 * s_pi * i / s_frameSize);
+    }
+    m_re.resize(s_frameSize);
+    m_im.resize(s_frameSize);
+
+    reset();
+}
+
+int BeatDetector::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+void BeatDetector::setSampleRate(int sampleRate)
+{
+    if (m_sampleRate != sampleRate) {
+        m_sampleRate = sampleRate;
+        reset();
+    }
+}
+
+void BeatDetector::reset()
+{
+    m_framesAnalyzed = 0;
+    m_buffer.clear();
+    m_previousSpectrum.fill(0, s_frameSize / 2);
+
+    int limits[4] = {0, s_lowBand, s_midBand, s_highBand};
+    for (int i = 0; i < 4; ++i) {
+        m_bandEdges[i] = qBound(1, qRound(1.0 * limits[i] * s_frameSize / m_sampleRate), s_frameSize / 2);
+    }
+    for (int i = 0; i < 3; ++i) {
+        m_levels[i] = 0;
+        m_bandPeaks[i] = 0;
+    }
+    double frameRate = 1.0 * m_sampleRate / s_hopSize;
+    m_peakDecay = pow(0.5, 1 / (frameRate * s_peakHalfLife));
+
+    m_flux.fill(0, qMax(2, qRound(frameRate * s_fluxHistory)));
+    m_envelope.fill(0, qMax(2, qRound(frameRate * s_envelopeHistory)));
+    m_previousFlux[0] = 0;
+    m_previousFlux[1] = 0;
+    m_lastOnset = -1;
+    m_onsets.clear();
+    m_beatOnsets.clear();
+
+    m_period = 0;
+    m_beatTime = -1;
+}
+
+void BeatDetector::process(const float *samples, int count)
+{
+    while (count > 0) {
+        int chunk = qMin(count, s_frameSize - m_buffer.count());
+        int size = m_buffer.count();
+        m_buffer.resize(size + chunk);
+        memcpy(m_buffer.data() + size, samples, chunk * sizeof(float));
+        samples += chunk;
+        count -= chunk;
+
+        if (m_buffer.count() == s_frameSize) {
+            analyzeFrame(m_buffer.constData());
+            m_buffer.remove(0, s_hopSize);
+        }
+    }
+}
+
+double BeatDetector::time() const
+{
+    return 1.0 * (m_framesAnalyzed * s_hopSize + m_buffer.count()) / m_sampleRate;
+}
+
+QList<double> BeatDetector::takeOnsets()
+{
+    QList<double> onsets = m_onsets;
+    m_onsets.clear();
+    return onsets;
+}
+
+double BeatDetector::period() const
+{
+    return m_period;
+}
+
+double BeatDetector::beatTime() const
+{
+    return m_beatTime;
+}
+
+double BeatDetector::nextBeat(double time) const
+{
+    if (m_period <= 0 || m_beatTime < 0) {
+        return -1;
+    }
+    return m_beatTime + ceil((time - m_beatTime) / m_period) * m_period;
+}
+
+float BeatDetector::low() const
+{
+    return m_levels[0];
+}
+
+float BeatDetector::mid() const
+{
+    return m_levels[1];
+}
+
+float BeatDetector::high() const
+{
+    return m_levels[2];
+}
+
+void BeatDetector::analyzeFrame(const float *frame)
+{
+    float *re = m_re.data();
+    float *im = m_im.data();
+    for (int i = 0; i < s_frameSize; ++i) {
+        re[i] = frame[i] * m_window.at(i);
+        im[i] = 0;
+    }
+    fft(re, im);
+
+    // Flux over log magnitudes, so quiet passages count as much as loud ones
+    float flux = 0;
+    float energy[3] = {0, 0, 0};
+    float *previous = m_previousSpectrum.data();
+    for (int k = 1; k < s_frameSize / 2; ++k) {
+        float power = re[k] * re[k] + im[k] * im[k];
+        float magnitude = log(1 + sqrt(power));
+        if (magnitude > previous[k]) {
+            flux += magnitude - previous[k];
+        }
+        previous[k] = magnitude;
+        for (int band = 0; band < 3; ++band) {
+            if (k >= m_bandEdges[band] && k < m_bandEdges[band + 1]) {
+                energy[band] += power;
+            }
+        }
+    }
+
+    for (int band = 0; band < 3; ++band) {
+        m_bandPeaks[band] = qMax(energy[band], m_bandPeaks[band] * m_peakDecay);
+        m_levels[band] = m_bandPeaks[band] > 0 ? sqrt(energy[band] / m_bandPeaks[band]) : 0;
+    }
+
+    int historySize = m_flux.count();
+    int filled = qMin<qint64>(m_framesAnalyzed, historySize);
+    float mean = 0;
+    float deviation = 0;
+    for (int i = 0; i < filled; ++i) {
+        mean += m_flux.at(i);
+    }
+    if (filled > 0) {
+        mean /= filled;
+        for (int i = 0; i < filled; ++i) {
+            deviation += (m_flux.at(i) - mean) * (m_flux.at(i) - mean);
+        }
+        deviation = sqrt(deviation / filled);
+    }
+    m_flux[m_framesAnalyzed % historySize] = flux;
+    m_envelope[m_framesAnalyzed % m_envelope.count()] = qMax<float>(0, flux - mean);
+
+    // The previous frame is an onset if it is a local maximum above the threshold
+    float threshold = mean + 1.5 * deviation;
+    double previousTime = 1.0 * ((m_framesAnalyzed - 1) * s_hopSize + s_frameSize / 2) / m_sampleRate;
+    if (filled == historySize && m_previousFlux[0] > threshold
+            && m_previousFlux[0] >= m_previousFlux[1] && m_previousFlux[0] > flux
+            && (m_lastOnset < 0 || previousTime - m_lastOnset >= s_minOnsetInterval)) {
+        m_lastOnset = previousTime;
+        // Somewhere between the frames around the peak
+        float curvature = m_previousFlux[1] - 2 * m_previousFlux[0] + flux;
+        double shift = curvature != 0 ? qBound(-0.5, 0.5 * (m_previousFlux[1] - flux) / curvature, 0.5) : 0;
+        onsetDetected(previousTime + shift * s_hopSize / m_sampleRate);
+    }
+    m_previousFlux[1] = m_previousFlux[0];
+    m_previousFlux[0] = flux;
+
+    ++m_framesAnalyzed;
+
+    // Twice a second is plenty for the tempo
+    int tempoInterval = qMax(1, m_sampleRate / s_hopSize / 2);
+    if (m_framesAnalyzed >= m_envelope.count() / 2 && m_framesAnalyzed % tempoInterval == 0) {
+        estimateTempo();
+    }
+}
+
+// In place radix-2 FFT
+void BeatDetector::fft(float *re, float *im) const
+{
+    for (int i = 0; i < s_frameSize; ++i) {
+        int j = m_bitReverse.at(i);
+        if (j > i) {
+            qSwap(re[i], re[j]);
+            qSwap(im[i], im[j]);
+        }
+    }
+
+    for (int size = 2; size <= s_frameSize; size *= 2) {
+        int half = size / 2;
+        int step = s_frameSize / size;
+        for (int start = 0; start < s_frameSize; start += size) {
+            for (int k = 0; k < half; ++k) {
+                float wr = m_cos.at(k * step);
+                float wi = -m_sin.at(k * step);
+                int a = start + k;
+                int b = a + half;
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+void BeatDetector::estimateTempo()
+{
+    double frameRate = 1.0 * m_sampleRate / s_hopSize;
+    int size = m_envelope.count();
+    int count = qMin<qint64>(m_framesAnalyzed, size);
+    QVector<float> envelope(count);
+    for (int i = 0; i < count; ++i) {
+        envelope[i] = m_envelope.at((m_framesAnalyzed - count + i) % size);
+    }
+
+    int minLag = qMax(2, static_cast<int>(floor(frameRate * 60 / s_maxBpm)));
+    int maxLag = qMin(count / 2, static_cast<int>(ceil(frameRate * 60 / s_minBpm)));
+    if (maxLag <= minLag) {
+        return;
+    }
+
+    QVector<double> correlation(maxLag + 2);
+    for (int lag = minLag - 1; lag <= maxLag + 1; ++lag) {
+        double sum = 0;
+        for (int i = lag; i < count; ++i) {
+            sum += envelope.at(i) * envelope.at(i - lag);
+        }
+        correlation[lag] = sum / (count - lag);
+    }
+
+    int best = -1;
+    double bestScore = 0;
+    for (int lag = minLag; lag <= maxLag; ++lag) {
+        // Octave errors are common, prefer tempos around 120 bpm
+        double octaves = log(60 * frameRate / lag / 120) / log(2.0);
+        double score = correlation.at(lag) * exp(-0.5 * octaves * octaves);
+        if (score > bestScore) {
+            bestScore = score;
+            best = lag;
+        }
+    }
+    if (best < 0) {
+        return;
+    }
+
+    // Refine between the lags
+    double a = correlation.at(best - 1);
+    double b = correlation.at(best);
+    double c = correlation.at(best + 1);
+    double shift = 0;
+    if (a - 2 * b + c != 0) {
+        shift = qBound(-0.5, 0.5 * (a - c) / (a - 2 * b + c), 0.5);
+    }
+    double period = (best + shift) / frameRate;
+
+    if (m_period > 0 && qAbs(period - m_period) < 0.05 * m_period) {
+        // Same tempo. The autocorrelation is limited to whole frames, onsets are more
+        // precise if there are enough of them.
+        if (m_beatOnsets.count() < s_minBeatOnsets) {
+            m_period += 0.25 * (period - m_period);
+        }
+    } else {
+        m_period = period;
+        m_beatOnsets.clear();
+    }
+
+    // The phase is where the flux summed up over all periods is strongest. Onsets refine
+    // it further as they come in, so only take it over if it disagrees.
+    double periodFrames = m_period * frameRate;
+    int bestOffset = 0;
+    double bestSum = -1;
+    for (int offset = 0; offset < periodFrames; ++offset) {
+        double sum = 0;
+        for (double index = count - 1 - offset; index >= 0; index -= periodFrames) {
+            sum += envelope.at(qRound(index));
+        }
+        if (sum > bestSum) {
+            bestSum = sum;
+            bestOffset = offset;
+        }
+    }
+    double beatTime = 1.0 * ((m_framesAnalyzed - 1 - bestOffset) * s_hopSize + s_frameSize / 2) / m_sampleRate;
+    if (m_beatTime < 0) {
+        m_beatTime = beatTime;
+    } else {
+        double beats = (beatTime - m_beatTime) / m_period;
+        if (qAbs(beats - floor(beats + 0.5)) > 0.15) {
+            m_beatTime = beatTime;
+            m_beatOnsets.clear();
+        }
+    }
+}
+
+void BeatDetector::onsetDetected(double time)
+{
+    m_onsets.append(time);
+    if (m_period <= 0 || m_beatTime < 0) {
+        return;
+    }
+
+    // Onsets close to a beat refine the phase, others are off-beats
+    double predicted = m_beatTime + floor((time - m_beatTime) / m_period + 0.5) * m_period;
+    double error = time - predicted;
+    if (qAbs(error) >= 0.1 * m_period) {
+        return;
+    }
+
+    m_beatOnsets.append(time);
+    while (m_beatOnsets.first() < time - s_envelopeHistory) {
+        m_beatOnsets.removeFirst();
+    }
+    if (m_beatOnsets.count() < s_minBeatOnsets) {
+        m_beatTime = predicted + 0.3 * error;
+        return;
+    }
+    fitBeats();
+}
+
+// Least squares line through the onsets on the beat, over their beat numbers
+void BeatDetector::fitBeats()
+{
+    int count = m_beatOnsets.count();
+    double first = m_beatOnsets.first();
+    double sumBeats = 0;
+    double sumTimes = 0;
+    for (int i = 0; i < count; ++i) {
+        sumBeats += floor((m_beatOnsets.at(i) - first) / m_period + 0.5);
+        sumTimes += m_beatOnsets.at(i) - first;
+    }
+    double meanBeat = sumBeats / count;
+    double meanTime = sumTimes / count;
+
+    double covariance = 0;
+    double variance = 0;
+    for (int i = 0; i < count; ++i) {
+        double beat = floor((m_beatOnsets.at(i) - first) / m_period + 0.5) - meanBeat;
+        covariance += beat * (m_beatOnsets.at(i) - first - meanTime);
+        variance += beat * beat;
+    }
+    if (variance <= 0) {
+        return;
+    }
+
+    double period = covariance / variance;
+    if (qAbs(period - m_period) >= 0.05 * m_period) {
+        return;
+    }
+    m_period = period;
+    // The fitted beat closest to the latest onset
+    double lastBeat = floor((m_beatOnsets.last() - first) / m_period + 0.5);
+    m_beatTime = first + meanTime + (lastBeat - meanBeat) * m_period;
+}
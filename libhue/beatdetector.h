@@ -0,0 +1,103 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef BEATDETECTOR_H
+#define BEATDETECTOR_H
+
+#include <QList>
+#include <QVector>
+
+// Finds onsets and the beat in mono audio. The signal is analysed in overlapping windows
+// with an FFT:
+// - onsets are peaks of the spectral flux above an adaptive threshold
+// - the tempo is the strongest periodicity of the flux in the last seconds,
+//   found by autocorrelation and biased towards 120 bpm
+// - the beat phase is where the flux summed up over the periods is strongest
+// - once a few onsets line up with the beat, period and phase are taken from a line fitted
+//   through them, which is far more precise than the flux frames
+// It also keeps the energy in a low, mid and high band, relative to their recent peaks.
+// All times are in seconds since the first sample.
+class BeatDetector
+{
+public:
+    BeatDetector(int sampleRate = 44100);
+
+    int sampleRate() const;
+    // Resets the detector if the rate changes
+    void setSampleRate(int sampleRate);
+
+    void process(const float *samples, int count);
+    void reset();
+
+    // Audio time analysed so far
+    double time() const;
+
+    // Times of the onsets found since the last call
+    QList<double> takeOnsets();
+
+    // Beat period in seconds, 0 until a tempo was found
+    double period() const;
+    // Time of a beat, all other beats are multiples of the period away. Negative while unknown.
+    double beatTime() const;
+    // The first beat after time
+    double nextBeat(double time) const;
+
+    // 0..1
+    float low() const;
+    float mid() const;
+    float high() const;
+
+private:
+    void analyzeFrame(const float *frame);
+    void fft(float *re, float *im) const;
+    void estimateTempo();
+    void onsetDetected(double time);
+    void fitBeats();
+
+    int m_sampleRate;
+    qint64 m_framesAnalyzed;
+    QVector<float> m_buffer;
+
+    QVector<float> m_window;
+    QVector<float> m_cos;
+    QVector<float> m_sin;
+    QVector<int> m_bitReverse;
+    QVector<float> m_re;
+    QVector<float> m_im;
+    QVector<float> m_previousSpectrum;
+    int m_bandEdges[4];
+
+    float m_levels[3];
+    float m_bandPeaks[3];
+    float m_peakDecay;
+
+    // Ring buffers of the spectral flux for onset thresholds and the tempo estimation
+    QVector<float> m_flux;
+    QVector<float> m_envelope;
+    float m_previousFlux[2];
+    double m_lastOnset;
+    QList<double> m_onsets;
+    // Recent onsets close to where a beat was expected
+    QList<double> m_beatOnsets;
+
+    double m_period;
+    double m_beatTime;
+};
+
+#endif
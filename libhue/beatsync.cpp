@@ -0,0 +1,240 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "beatsync.h"
+#include "beatsyncworker.h"
+#include "huebridgeconnection.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <math.h>
+
+// Minimum time between two commands to a light or a group in ms
+static const int s_lightCommandInterval = 100;
+static const int s_groupCommandInterval = 1000;
+// Dimming down is not worth it if there is less time than this left until the next beat
+static const int s_minDecayTime = 200;
+
+BeatSync::BeatSync(QObject *parent):
+    QObject(parent),
+    m_running(false),
+    m_low(0),
+    m_mid(0),
+    m_high(0),
+    m_beatTime(-1),
+    m_period(0),
+    m_nextBeat(-1),
+    m_lastBeat(-1),
+    m_lastCommand(0),
+    m_worker(new BeatSyncWorker())
+{
+    m_beatTimer.setSingleShot(true);
+    m_decayTimer.setSingleShot(true);
+#if QT_VERSION >= 0x050000
+    m_beatTimer.setTimerType(Qt::PreciseTimer);
+#endif
+    connect(&m_beatTimer, SIGNAL(timeout()), this, SLOT(flash()));
+    connect(&m_decayTimer, SIGNAL(timeout()), this, SLOT(decay()));
+
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, SIGNAL(finished()), m_worker, SLOT(deleteLater()));
+    connect(m_worker, SIGNAL(levelsChanged(qreal,qreal,qreal)), this, SLOT(workerLevelsChanged(qreal,qreal,qreal)));
+    connect(m_worker, SIGNAL(beatGridChanged(qreal,qreal)), this, SLOT(workerBeatGridChanged(qreal,qreal)));
+    connect(m_worker, SIGNAL(finished()), this, SLOT(workerFinished()));
+    connect(m_worker, SIGNAL(failed()), this, SLOT(workerFailed()));
+    m_thread.start();
+}
+
+BeatSync::~BeatSync()
+{
+    m_thread.quit();
+    m_thread.wait();
+}
+
+LightInterface *BeatSync::target() const
+{
+    return m_target;
+}
+
+void BeatSync::setTarget(LightInterface *target)
+{
+    if (m_target != target) {
+        m_target = target;
+        emit targetChanged();
+    }
+}
+
+bool BeatSync::running() const
+{
+    return m_running;
+}
+
+qreal BeatSync::bpm() const
+{
+    return m_period > 0 ? 60000 / m_period : 0;
+}
+
+qreal BeatSync::low() const
+{
+    return m_low;
+}
+
+qreal BeatSync::mid() const
+{
+    return m_mid;
+}
+
+qreal BeatSync::high() const
+{
+    return m_high;
+}
+
+void BeatSync::playFile(const QString &fileName)
+{
+    QMetaObject::invokeMethod(m_worker, "playFile", Qt::QueuedConnection, Q_ARG(QString, fileName));
+    setRunning(true);
+}
+
+void BeatSync::start()
+{
+    QMetaObject::invokeMethod(m_worker, "start", Qt::QueuedConnection);
+    setRunning(true);
+}
+
+void BeatSync::stop()
+{
+    QMetaObject::invokeMethod(m_worker, "stop", Qt::QueuedConnection);
+    setRunning(false);
+}
+
+void BeatSync::pushSamples(const float *samples, int count, int sampleRate)
+{
+    m_worker->pushSamples(samples, count, sampleRate);
+}
+
+void BeatSync::setRunning(bool running)
+{
+    m_beatTime = -1;
+    m_period = 0;
+    m_lastBeat = -1;
+    m_beatTimer.stop();
+    m_decayTimer.stop();
+    emit bpmChanged();
+
+    if (m_running != running) {
+        m_running = running;
+        emit runningChanged();
+    }
+}
+
+void BeatSync::workerLevelsChanged(qreal low, qreal mid, qreal high)
+{
+    m_low = low;
+    m_mid = mid;
+    m_high = high;
+    emit levelsChanged();
+}
+
+void BeatSync::workerBeatGridChanged(qreal beatTime, qreal period)
+{
+    if (!m_running) {
+        return;
+    }
+    bool tempoChanged = qRound(bpm()) != qRound(60000 / period);
+    m_beatTime = beatTime;
+    m_period = period;
+    if (tempoChanged) {
+        emit bpmChanged();
+    }
+    scheduleBeat();
+}
+
+void BeatSync::workerFinished()
+{
+    setRunning(false);
+    emit finished();
+}
+
+void BeatSync::workerFailed()
+{
+    setRunning(false);
+    emit error();
+}
+
+int BeatSync::minCommandInterval() const
+{
+    return m_target && m_target->isGroup() ? s_groupCommandInterval : s_lightCommandInterval;
+}
+
+void BeatSync::scheduleBeat()
+{
+    if (!m_running || m_period <= 0) {
+        return;
+    }
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    int lead = HueBridgeConnection::instance()->latency();
+    qreal next = m_beatTime + ceil((now + lead - m_beatTime) / m_period) * m_period;
+    // The grid moves a little with every update, don't flash the same beat twice
+    if (m_lastBeat >= 0 && next - m_lastBeat < m_period / 2) {
+        next += m_period;
+    }
+    m_nextBeat = next;
+    m_beatTimer.start(qMax<qint64>(0, qRound64(next - lead - now)));
+}
+
+void BeatSync::flash()
+{
+    m_lastBeat = m_nextBeat;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    if (m_target && now - m_lastCommand >= minCommandInterval()) {
+        qreal peak = qMax(m_low, qMax(m_mid, m_high));
+        QVariantMap state;
+        state.insert("on", true);
+        state.insert("bri", qRound(96 + 158 * peak));
+        if (peak > 0) {
+            state.insert("color", QColor::fromRgbF(m_low / peak, m_mid / peak, m_high / peak));
+        }
+        m_target->setState(state, 0);
+        m_lastCommand = now;
+        m_decayTimer.start(minCommandInterval());
+    }
+
+    emit beat();
+    scheduleBeat();
+}
+
+void BeatSync::decay()
+{
+    if (!m_target) {
+        return;
+    }
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    int transitionTime = qRound(m_nextBeat - HueBridgeConnection::instance()->latency() - now);
+    if (transitionTime < s_minDecayTime) {
+        return;
+    }
+
+    QVariantMap state;
+    state.insert("bri", qRound(16 + 64 * m_low));
+    m_target->setState(state, transitionTime);
+    m_lastCommand = now;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef BEATSYNC_H
+#define BEATSYNC_H
+
+#include "lightinterface.h"
+
+#include <QObject>
+#include <QPointer>
+#include <QThread>
+#include <QTimer>
+
+class BeatSyncWorker;
+
+// Makes a light or group follow music. The audio is analysed on a separate thread, on
+// every beat the target flashes in a colour mixed from the energy in the low (red), mid
+// (green) and high (blue) bands and then dims down until the next one. Beats are
+// predicted from the tempo, commands go out early by the measured bridge latency so
+// the light changes on the beat.
+// Groups are limited to one command per second by the bridge and skip beats accordingly.
+class BeatSync: public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(LightInterface *target READ target WRITE setTarget NOTIFY targetChanged)
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(qreal bpm READ bpm NOTIFY bpmChanged)
+    Q_PROPERTY(qreal low READ low NOTIFY levelsChanged)
+    Q_PROPERTY(qreal mid READ mid NOTIFY levelsChanged)
+    Q_PROPERTY(qreal high READ high NOTIFY levelsChanged)
+
+public:
+    BeatSync(QObject *parent = 0);
+    ~BeatSync();
+
+    LightInterface *target() const;
+    void setTarget(LightInterface *target);
+
+    bool running() const;
+    // 0 until a tempo was found
+    qreal bpm() const;
+
+    qreal low() const;
+    qreal mid() const;
+    qreal high() const;
+
+    // Plays back a WAV file, mostly for testing
+    Q_INVOKABLE void playFile(const QString &fileName);
+    // Live mode, audio is passed in with pushSamples()
+    Q_INVOKABLE void start();
+    Q_INVOKABLE void stop();
+
+    // Thread safe. Mono samples as they are captured.
+    void pushSamples(const float *samples, int count, int sampleRate);
+
+signals:
+    void targetChanged();
+    void runningChanged();
+    void bpmChanged();
+    void levelsChanged();
+    void beat();
+    void finished();
+    void error();
+
+private slots:
+    void workerLevelsChanged(qreal low, qreal mid, qreal high);
+    void workerBeatGridChanged(qreal beatTime, qreal period);
+    void workerFinished();
+    void workerFailed();
+    void flash();
+    void decay();
+
+private:
+    void setRunning(bool running);
+    void scheduleBeat();
+    int minCommandInterval() const;
+
+    QPointer<LightInterface> m_target;
+    bool m_running;
+    qreal m_low;
+    qreal m_mid;
+    qreal m_high;
+
+    // Beat grid in ms since the epoch
+    qreal m_beatTime;
+    qreal m_period;
+    qreal m_nextBeat;
+    qreal m_lastBeat;
+    qint64 m_lastCommand;
+    QTimer m_beatTimer;
+    QTimer m_decayTimer;
+
+    QThread m_thread;
+    BeatSyncWorker *m_worker;
+};
+
+#endif
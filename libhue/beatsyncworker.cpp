@@ -0,0 +1,144 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "beatsyncworker.h"
+#include "wavfile.h"
+
+#include <QTimer>
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QDebug>
+#include <string.h>
+
+// How often audio is analysed, in ms
+static const int s_processInterval = 20;
+
+BeatSyncWorker::BeatSyncWorker():
+    QObject(),
+    m_timer(new QTimer(this)),
+    m_startTime(-1),
+    m_beatTime(-1),
+    m_period(0),
+    m_filePosition(0),
+    m_pendingRate(44100)
+{
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(processPending()));
+}
+
+void BeatSyncWorker::pushSamples(const float *samples, int count, int sampleRate)
+{
+    QMutexLocker locker(&m_mutex);
+    if (sampleRate != m_pendingRate) {
+        m_pending.clear();
+        m_pendingRate = sampleRate;
+    }
+    int size = m_pending.count();
+    m_pending.resize(size + count);
+    memcpy(m_pending.data() + size, samples, count * sizeof(float));
+}
+
+void BeatSyncWorker::playFile(const QString &fileName)
+{
+    int sampleRate;
+    if (!WavFile::read(fileName, &m_file, &sampleRate)) {
+        emit failed();
+        return;
+    }
+    m_detector.setSampleRate(sampleRate);
+    m_detector.reset();
+    m_filePosition = 0;
+    m_startTime = QDateTime::currentMSecsSinceEpoch();
+    m_beatTime = -1;
+    m_period = 0;
+    m_timer->start(s_processInterval);
+}
+
+void BeatSyncWorker::start()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_pending.clear();
+    }
+    m_file.clear();
+    m_detector.reset();
+    m_startTime = -1;
+    m_beatTime = -1;
+    m_period = 0;
+    m_timer->start(s_processInterval);
+}
+
+void BeatSyncWorker::stop()
+{
+    m_timer->stop();
+    m_file.clear();
+}
+
+void BeatSyncWorker::processPending()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    if (!m_file.isEmpty()) {
+        int due = qMin<qint64>(m_file.count(), (now - m_startTime) * m_detector.sampleRate() / 1000);
+        if (due > m_filePosition) {
+            m_detector.process(m_file.constData() + m_filePosition, due - m_filePosition);
+            m_filePosition = due;
+        }
+        reportResults();
+        if (m_filePosition == m_file.count()) {
+            stop();
+            emit finished();
+        }
+        return;
+    }
+
+    QVector<float> samples;
+    int sampleRate;
+    {
+        QMutexLocker locker(&m_mutex);
+        samples = m_pending;
+        sampleRate = m_pendingRate;
+        m_pending.clear();
+    }
+    if (samples.isEmpty()) {
+        return;
+    }
+
+    if (m_startTime < 0 || sampleRate != m_detector.sampleRate()) {
+        m_detector.setSampleRate(sampleRate);
+        m_detector.reset();
+        m_startTime = now - 1000LL * samples.count() / sampleRate;
+    }
+    m_detector.process(samples.constData(), samples.count());
+    reportResults();
+}
+
+void BeatSyncWorker::reportResults()
+{
+    emit levelsChanged(m_detector.low(), m_detector.mid(), m_detector.high());
+
+    foreach (double time, m_detector.takeOnsets()) {
+        emit onset(m_startTime + time * 1000);
+    }
+
+    if (m_detector.beatTime() >= 0 && (m_detector.beatTime() != m_beatTime || m_detector.period() != m_period)) {
+        m_beatTime = m_detector.beatTime();
+        m_period = m_detector.period();
+        emit beatGridChanged(m_startTime + m_beatTime * 1000, m_period * 1000);
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef BEATSYNCWORKER_H
+#define BEATSYNCWORKER_H
+
+#include "beatdetector.h"
+
+#include <QObject>
+#include <QMutex>
+#include <QVector>
+
+class QTimer;
+
+// Lives in the analysis thread and feeds audio to the BeatDetector, either from a file at
+// playback speed or as it is handed over with pushSamples(). Results are reported with
+// times in ms since the epoch.
+class BeatSyncWorker: public QObject
+{
+    Q_OBJECT
+
+public:
+    BeatSyncWorker();
+
+    // Thread safe. Mono samples, expected to arrive in real time.
+    void pushSamples(const float *samples, int count, int sampleRate);
+
+public slots:
+    void playFile(const QString &fileName);
+    void start();
+    void stop();
+
+signals:
+    void levelsChanged(qreal low, qreal mid, qreal high);
+    void onset(qreal time);
+    void beatGridChanged(qreal beatTime, qreal period);
+    void finished();
+    void failed();
+
+private slots:
+    void processPending();
+
+private:
+    void reportResults();
+
+    QTimer *m_timer;
+    BeatDetector m_detector;
+    // Wall clock time of the first sample, -1 until known
+    qint64 m_startTime;
+    double m_beatTime;
+    double m_period;
+
+    QVector<float> m_file;
+    int m_filePosition;
+
+    QMutex m_mutex;
+    QVector<float> m_pending;
+    int m_pendingRate;
+};
+
+#endif
@@ -0,0 +1,347 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "circadianengine.h"
+#include "group.h"
+#include "light.h"
+#include "lights.h"
+
+#include <QDebug>
+
+static const int s_day = 24 * 60 * 60;
+// Resolution of the segment planning in seconds
+static const int s_planStep = 60;
+// Longest transition the bridge accepts, rounded down to the planning resolution
+static const int s_maxSegmentLength = 6553 / s_planStep * s_planStep;
+// Lights that turn on mid-segment sit still until the next one starts, so segments are
+// kept short enough for that not to be noticeably off
+static const int s_maxSegmentSteps = 4;
+// Transition for catch-up writes in ms
+static const int s_catchUpTransition = 2000;
+static const int s_pollInterval = 30000;
+
+CircadianEngine::CircadianEngine(QObject *parent):
+    QObject(parent),
+    m_running(false),
+    m_ctThreshold(5),
+    m_briThreshold(6),
+    m_segmentStart(0),
+    m_segmentEnd(0)
+{
+    setPoint(QTime(6, 0), 370, 150);
+    setPoint(QTime(9, 0), 250, 254);
+    setPoint(QTime(13, 0), 200, 254);
+    setPoint(QTime(17, 0), 250, 254);
+    setPoint(QTime(20, 0), 370, 180);
+    setPoint(QTime(23, 0), 454, 80);
+
+    m_updateTimer.setSingleShot(true);
+    connect(&m_updateTimer, SIGNAL(timeout()), this, SLOT(update()));
+    m_pollTimer.setInterval(s_pollInterval);
+}
+
+Group *CircadianEngine::group() const
+{
+    return m_group;
+}
+
+void CircadianEngine::setGroup(Group *group)
+{
+    if (m_group != group) {
+        m_group = group;
+        emit groupChanged();
+        trackLights();
+    }
+}
+
+Lights *CircadianEngine::lights() const
+{
+    return m_lights;
+}
+
+void CircadianEngine::setLights(Lights *lights)
+{
+    if (m_lights == lights) {
+        return;
+    }
+    if (m_lights) {
+        disconnect(m_lights, 0, this, 0);
+        disconnect(&m_pollTimer, 0, m_lights, 0);
+    }
+    m_lights = lights;
+    if (m_lights) {
+        connect(m_lights, SIGNAL(countChanged()), this, SLOT(trackLights()));
+        connect(&m_pollTimer, SIGNAL(timeout()), m_lights, SLOT(refresh()));
+    }
+    emit lightsChanged();
+    trackLights();
+}
+
+bool CircadianEngine::running() const
+{
+    return m_running;
+}
+
+int CircadianEngine::ctThreshold() const
+{
+    return m_ctThreshold;
+}
+
+void CircadianEngine::setCtThreshold(int ctThreshold)
+{
+    ctThreshold = qMax(1, ctThreshold);
+    if (m_ctThreshold != ctThreshold) {
+        m_ctThreshold = ctThreshold;
+        emit ctThresholdChanged();
+    }
+}
+
+int CircadianEngine::briThreshold() const
+{
+    return m_briThreshold;
+}
+
+void CircadianEngine::setBriThreshold(int briThreshold)
+{
+    briThreshold = qMax(1, briThreshold);
+    if (m_briThreshold != briThreshold) {
+        m_briThreshold = briThreshold;
+        emit briThresholdChanged();
+    }
+}
+
+QDateTime CircadianEngine::nextUpdate() const
+{
+    if (!m_running) {
+        return QDateTime();
+    }
+    return QDateTime::fromMSecsSinceEpoch(m_segmentEnd);
+}
+
+void CircadianEngine::setPoint(const QTime &time, int ct, int bri)
+{
+    m_points.insert(QTime(0, 0).secsTo(time), Point(qBound(153, ct, 500), qBound(1, bri, 254)));
+}
+
+void CircadianEngine::clearPoints()
+{
+    m_points.clear();
+}
+
+int CircadianEngine::ctAt(const QTime &time) const
+{
+    return qRound(valueAt(QTime(0, 0).secsTo(time)).ct);
+}
+
+int CircadianEngine::briAt(const QTime &time) const
+{
+    return qRound(valueAt(QTime(0, 0).secsTo(time)).bri);
+}
+
+void CircadianEngine::start()
+{
+    if (m_running || !m_group || m_points.isEmpty()) {
+        qWarning() << "Cannot start circadian engine without a group and a curve";
+        return;
+    }
+    m_running = true;
+    emit runningChanged();
+    trackLights();
+    m_pollTimer.start();
+
+    // Bring everything to the curve first, the segments start from there
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    Point current = valueAt(secondsOfDay(now));
+    write(m_group, current, s_catchUpTransition);
+    startSegment(current, current, now, s_catchUpTransition / 1000);
+}
+
+void CircadianEngine::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+    m_updateTimer.stop();
+    m_pollTimer.stop();
+    emit runningChanged();
+    emit nextUpdateChanged();
+}
+
+void CircadianEngine::update()
+{
+    if (!m_running || !m_group || m_points.isEmpty()) {
+        return;
+    }
+
+    // Planned from the actual time, in case the timer was late or the clock changed
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    int seconds = secondsOfDay(now);
+    Point current = trajectoryAt(now);
+    int length = segmentLength(seconds);
+    Point target = valueAt(seconds + length);
+
+    if (perceptible(current, target)) {
+        write(m_group, target, length * 1000);
+        startSegment(current, target, now, length);
+    } else {
+        startSegment(current, current, now, length);
+    }
+}
+
+// The longest time from seconds on that a linear fade stays close enough to the curve
+int CircadianEngine::segmentLength(int seconds) const
+{
+    Point start = valueAt(seconds);
+    int length = s_planStep;
+    for (int t = 2 * s_planStep; t <= s_maxSegmentLength; t += s_planStep) {
+        Point end = valueAt(seconds + t);
+        if (qAbs(end.ct - start.ct) > s_maxSegmentSteps * m_ctThreshold
+                || qAbs(end.bri - start.bri) > s_maxSegmentSteps * m_briThreshold) {
+            break;
+        }
+        bool follows = true;
+        for (int s = s_planStep; s < t && follows; s += s_planStep) {
+            qreal progress = 1.0 * s / t;
+            Point line(start.ct + (end.ct - start.ct) * progress, start.bri + (end.bri - start.bri) * progress);
+            follows = !perceptible(line, valueAt(seconds + s));
+        }
+        if (!follows) {
+            break;
+        }
+        length = t;
+    }
+    return length;
+}
+
+void CircadianEngine::startSegment(const Point &from, const Point &to, qint64 start, int length)
+{
+    m_from = from;
+    m_to = to;
+    m_segmentStart = start;
+    m_segmentEnd = start + length * 1000;
+    m_updateTimer.start(length * 1000);
+    emit nextUpdateChanged();
+}
+
+void CircadianEngine::write(LightInterface *target, const Point &point, int transitionTime)
+{
+    QVariantMap state;
+    state.insert("ct", qRound(point.ct));
+    state.insert("bri", qRound(point.bri));
+    target->setState(state, transitionTime);
+}
+
+void CircadianEngine::trackLights()
+{
+    if (!m_lights) {
+        m_lightActive.clear();
+        return;
+    }
+
+    QHash<int, bool> lightActive;
+    for (int i = 0; i < m_lights->rowCount(); ++i) {
+        Light *light = m_lights->get(i);
+        if (!isMember(light->id())) {
+            disconnect(light, SIGNAL(stateChanged()), this, SLOT(lightStateChanged()));
+            continue;
+        }
+        connect(light, SIGNAL(stateChanged()), this, SLOT(lightStateChanged()), Qt::UniqueConnection);
+        lightActive.insert(light->id(), m_lightActive.value(light->id(), light->on() && light->reachable()));
+    }
+    m_lightActive = lightActive;
+}
+
+void CircadianEngine::lightStateChanged()
+{
+    Light *light = qobject_cast<Light*>(sender());
+    if (!light || !m_lightActive.contains(light->id())) {
+        return;
+    }
+
+    bool active = light->on() && light->reachable();
+    bool wasActive = m_lightActive.value(light->id());
+    m_lightActive.insert(light->id(), active);
+
+    if (m_running && active && !wasActive) {
+        write(light, trajectoryAt(QDateTime::currentMSecsSinceEpoch()), s_catchUpTransition);
+    }
+}
+
+bool CircadianEngine::isMember(int lightId) const
+{
+    if (!m_group) {
+        return false;
+    }
+    // Group 0 always contains all lights
+    return m_group->id() == 0 || m_group->lightIds().contains(lightId);
+}
+
+CircadianEngine::Point CircadianEngine::valueAt(int seconds) const
+{
+    if (m_points.isEmpty()) {
+        return Point();
+    }
+    seconds = (seconds % s_day + s_day) % s_day;
+
+    QMap<int, Point>::const_iterator next = m_points.lowerBound(seconds);
+    QMap<int, Point>::const_iterator previous = next;
+    int nextTime;
+    int previousTime;
+    if (next == m_points.constEnd()) {
+        next = m_points.constBegin();
+        nextTime = next.key() + s_day;
+    } else {
+        nextTime = next.key();
+    }
+    if (previous == m_points.constBegin()) {
+        previous = m_points.constEnd() - 1;
+        previousTime = previous.key() - s_day;
+    } else {
+        --previous;
+        previousTime = previous.key();
+    }
+    if (nextTime == seconds || nextTime == previousTime) {
+        return next.value();
+    }
+
+    qreal progress = 1.0 * (seconds - previousTime) / (nextTime - previousTime);
+    return Point(previous.value().ct + (next.value().ct - previous.value().ct) * progress,
+                 previous.value().bri + (next.value().bri - previous.value().bri) * progress);
+}
+
+// Where the lights following the running fade are at the given time
+CircadianEngine::Point CircadianEngine::trajectoryAt(qint64 time) const
+{
+    if (m_segmentEnd <= m_segmentStart) {
+        return valueAt(secondsOfDay(time));
+    }
+    qreal progress = qBound<qreal>(0, 1.0 * (time - m_segmentStart) / (m_segmentEnd - m_segmentStart), 1);
+    return Point(m_from.ct + (m_to.ct - m_from.ct) * progress, m_from.bri + (m_to.bri - m_from.bri) * progress);
+}
+
+bool CircadianEngine::perceptible(const Point &a, const Point &b) const
+{
+    return qAbs(a.ct - b.ct) >= m_ctThreshold || qAbs(a.bri - b.bri) >= m_briThreshold;
+}
+
+int CircadianEngine::secondsOfDay(qint64 time)
+{
+    return QTime(0, 0).secsTo(QDateTime::fromMSecsSinceEpoch(time).time());
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef CIRCADIANENGINE_H
+#define CIRCADIANENGINE_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QHash>
+#include <QMap>
+#include <QPointer>
+#include <QTime>
+#include <QTimer>
+
+class Group;
+class Light;
+class Lights;
+class LightInterface;
+
+// Follows a daily colour temperature and brightness curve with as few writes as possible.
+// The bridge fades linearly, so the curve is cut into the longest segments a fade can
+// follow without a perceptible deviation and each segment is sent as one group write
+// with a long transition. Segments with no perceptible change aren't sent at all.
+// Lights which turn on or become reachable missed the running fade and get a single
+// catch-up write to where the others are. This needs the lights model, which is
+// refreshed in the background while running.
+// The curve is interpolated linearly between points and wraps around at midnight.
+class CircadianEngine: public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(Group *group READ group WRITE setGroup NOTIFY groupChanged)
+    Q_PROPERTY(Lights *lights READ lights WRITE setLights NOTIFY lightsChanged)
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(int ctThreshold READ ctThreshold WRITE setCtThreshold NOTIFY ctThresholdChanged)
+    Q_PROPERTY(int briThreshold READ briThreshold WRITE setBriThreshold NOTIFY briThresholdChanged)
+    Q_PROPERTY(QDateTime nextUpdate READ nextUpdate NOTIFY nextUpdateChanged)
+
+public:
+    CircadianEngine(QObject *parent = 0);
+
+    Group *group() const;
+    void setGroup(Group *group);
+
+    Lights *lights() const;
+    void setLights(Lights *lights);
+
+    bool running() const;
+
+    // Smallest changes considered perceptible, in mired and brightness steps
+    int ctThreshold() const;
+    void setCtThreshold(int ctThreshold);
+    int briThreshold() const;
+    void setBriThreshold(int briThreshold);
+
+    QDateTime nextUpdate() const;
+
+    // The default curve ramps up to cool white in the morning and down to warm light in the evening
+    Q_INVOKABLE void setPoint(const QTime &time, int ct, int bri);
+    Q_INVOKABLE void clearPoints();
+    Q_INVOKABLE int ctAt(const QTime &time) const;
+    Q_INVOKABLE int briAt(const QTime &time) const;
+
+    Q_INVOKABLE void start();
+    Q_INVOKABLE void stop();
+
+signals:
+    void groupChanged();
+    void lightsChanged();
+    void runningChanged();
+    void ctThresholdChanged();
+    void briThresholdChanged();
+    void nextUpdateChanged();
+
+private slots:
+    void update();
+    void trackLights();
+    void lightStateChanged();
+
+private:
+    class Point
+    {
+    public:
+        Point(qreal ct = 0, qreal bri = 0): ct(ct), bri(bri) {}
+        qreal ct;
+        qreal bri;
+    };
+
+    Point valueAt(int seconds) const;
+    Point trajectoryAt(qint64 time) const;
+    bool perceptible(const Point &a, const Point &b) const;
+    int segmentLength(int seconds) const;
+    void write(LightInterface *target, const Point &point, int transitionTime);
+    void startSegment(const Point &from, const Point &to, qint64 start, int length);
+    bool isMember(int lightId) const;
+
+    static int secondsOfDay(qint64 time);
+
+    QPointer<Group> m_group;
+    QPointer<Lights> m_lights;
+    bool m_running;
+    int m_ctThreshold;
+    int m_briThreshold;
+
+    // Seconds since midnight -> curve point
+    QMap<int, Point> m_points;
+
+    QTimer m_updateTimer;
+    QTimer m_pollTimer;
+
+    // The fade currently running on the lights, times in ms since the epoch
+    Point m_from;
+    Point m_to;
+    qint64 m_segmentStart;
+    qint64 m_segmentEnd;
+
+    // Whether a light was on and reachable when last seen
+    QHash<int, bool> m_lightActive;
+};
+
+#endif
@@ -0,0 +1,390 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "colorconversion.h"
+#include "huebridgeconnection.h"
+
+#include <QStringList>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COLORCONVERSION_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define COLORCONVERSION_NEON
+#endif
+
+// Linear values are looked up in this resolution when converting back to sRGB
+static const int s_inverseGammaTableSize = 4096;
+
+// D65 white point, used for black which has no chromaticity
+static const QPointF s_whitePoint(0.3127, 0.3290);
+
+struct GamutTriangle {
+    QPointF red;
+    QPointF green;
+    QPointF blue;
+};
+
+static const GamutTriangle s_gamutA = { QPointF(0.704, 0.296), QPointF(0.2151, 0.7106), QPointF(0.138, 0.08) };
+static const GamutTriangle s_gamutB = { QPointF(0.675, 0.322), QPointF(0.4091, 0.518), QPointF(0.167, 0.04) };
+static const GamutTriangle s_gamutC = { QPointF(0.6915, 0.3083), QPointF(0.17, 0.7), QPointF(0.1532, 0.0475) };
+
+class GammaTables
+{
+public:
+    GammaTables()
+    {
+        for (int i = 0; i < 256; ++i) {
+            qreal value = i / 255.0;
+            toLinear[i] = value > 0.04045 ? pow((value + 0.055) / 1.055, 2.4) : value / 12.92;
+            toLinearF[i] = toLinear[i];
+        }
+        for (int i = 0; i < s_inverseGammaTableSize; ++i) {
+            qreal value = 1.0 * i / (s_inverseGammaTableSize - 1);
+            qreal encoded = value <= 0.0031308 ? 12.92 * value : 1.055 * pow(value, 1.0 / 2.4) - 0.055;
+            fromLinear[i] = qBound(0, qRound(encoded * 255), 255);
+        }
+    }
+
+    qreal toLinear[256];
+    // Single precision copy for the batch conversion
+    float toLinearF[256];
+    int fromLinear[s_inverseGammaTableSize];
+};
+
+static const GammaTables &gammaTables()
+{
+    static GammaTables tables;
+    return tables;
+}
+
+static const GamutTriangle *triangle(ColorConversion::Gamut gamut)
+{
+    switch (gamut) {
+    case ColorConversion::GamutA:
+        return &s_gamutA;
+    case ColorConversion::GamutB:
+        return &s_gamutB;
+    case ColorConversion::GamutC:
+        return &s_gamutC;
+    case ColorConversion::GamutNone:
+        break;
+    }
+    return 0;
+}
+
+static qreal cross(const QPointF &a, const QPointF &b)
+{
+    return a.x() * b.y() - a.y() * b.x();
+}
+
+static qreal dot(const QPointF &a, const QPointF &b)
+{
+    return a.x() * b.x() + a.y() * b.y();
+}
+
+static QPointF closestPointOnLine(const QPointF &a, const QPointF &b, const QPointF &p)
+{
+    QPointF ab = b - a;
+    qreal t = dot(p - a, ab) / dot(ab, ab);
+    return a + ab * qBound<qreal>(0.0, t, 1.0);
+}
+
+static qreal distanceSquared(const QPointF &a, const QPointF &b)
+{
+    QPointF d = a - b;
+    return dot(d, d);
+}
+
+// Converts 4 linear rgb triplets to xy. Black ends up with x = y = 0 and is fixed up by the caller.
+static inline void linearToXy4(const float *red, const float *green, const float *blue, float *x, float *y)
+{
+#if defined(COLORCONVERSION_SSE2)
+    __m128 r = _mm_loadu_ps(red);
+    __m128 g = _mm_loadu_ps(green);
+    __m128 b = _mm_loadu_ps(blue);
+    __m128 X = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.664511f)), _mm_mul_ps(g, _mm_set1_ps(0.154324f))), _mm_mul_ps(b, _mm_set1_ps(0.162028f)));
+    __m128 Y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.283881f)), _mm_mul_ps(g, _mm_set1_ps(0.668433f))), _mm_mul_ps(b, _mm_set1_ps(0.047685f)));
+    __m128 Z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.000088f)), _mm_mul_ps(g, _mm_set1_ps(0.072310f))), _mm_mul_ps(b, _mm_set1_ps(0.986039f)));
+    __m128 sum = _mm_add_ps(_mm_add_ps(X, Y), Z);
+    // Avoid dividing by 0 for black, the result is masked to 0 instead
+    __m128 valid = _mm_cmpgt_ps(sum, _mm_setzero_ps());
+    __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_or_ps(_mm_and_ps(valid, sum), _mm_andnot_ps(valid, _mm_set1_ps(1.0f))));
+    _mm_storeu_ps(x, _mm_and_ps(valid, _mm_mul_ps(X, inverse)));
+    _mm_storeu_ps(y, _mm_and_ps(valid, _mm_mul_ps(Y, inverse)));
+#elif defined(COLORCONVERSION_NEON)
+    float32x4_t r = vld1q_f32(red);
+    float32x4_t g = vld1q_f32(green);
+    float32x4_t b = vld1q_f32(blue);
+    float32x4_t X = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(r, 0.664511f), g, 0.154324f), b, 0.162028f);
+    float32x4_t Y = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(r, 0.283881f), g, 0.668433f), b, 0.047685f);
+    float32x4_t Z = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(r, 0.000088f), g, 0.072310f), b, 0.986039f);
+    float32x4_t sum = vaddq_f32(vaddq_f32(X, Y), Z);
+    uint32x4_t valid = vcgtq_f32(sum, vdupq_n_f32(0.0f));
+    float32x4_t divisor = vbslq_f32(valid, sum, vdupq_n_f32(1.0f));
+    // Reciprocal estimate refined twice, close enough to a division for 4 decimal places
+    float32x4_t inverse = vrecpeq_f32(divisor);
+    inverse = vmulq_f32(vrecpsq_f32(divisor, inverse), inverse);
+    inverse = vmulq_f32(vrecpsq_f32(divisor, inverse), inverse);
+    vst1q_f32(x, vreinterpretq_f32_u32(vandq_u32(valid, vreinterpretq_u32_f32(vmulq_f32(X, inverse)))));
+    vst1q_f32(y, vreinterpretq_f32_u32(vandq_u32(valid, vreinterpretq_u32_f32(vmulq_f32(Y, inverse)))));
+#else
+    for (int i = 0; i < 4; ++i) {
+        float X = red[i] * 0.664511f + green[i] * 0.154324f + blue[i] * 0.162028f;
+        float Y = red[i] * 0.283881f + green[i] * 0.668433f + blue[i] * 0.047685f;
+        float Z = red[i] * 0.000088f + green[i] * 0.072310f + blue[i] * 0.986039f;
+        float sum = X + Y + Z;
+        x[i] = sum > 0 ? X / sum : 0;
+        y[i] = sum > 0 ? Y / sum : 0;
+    }
+#endif
+}
+
+// Returns a bit mask of the lanes whose xy lies outside the gamut triangle. Same test as
+// inGamut(), in single precision.
+static inline int outOfGamut4(const float *x, const float *y, const GamutTriangle *t)
+{
+    const float rx = t->red.x(), ry = t->red.y();
+    const float gx = t->green.x(), gy = t->green.y();
+    const float bx = t->blue.x(), by = t->blue.y();
+#if defined(COLORCONVERSION_SSE2)
+    __m128 px = _mm_loadu_ps(x);
+    __m128 py = _mm_loadu_ps(y);
+    __m128 d1 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(gx - rx), _mm_sub_ps(py, _mm_set1_ps(ry))), _mm_mul_ps(_mm_set1_ps(gy - ry), _mm_sub_ps(px, _mm_set1_ps(rx))));
+    __m128 d2 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(bx - gx), _mm_sub_ps(py, _mm_set1_ps(gy))), _mm_mul_ps(_mm_set1_ps(by - gy), _mm_sub_ps(px, _mm_set1_ps(gx))));
+    __m128 d3 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(rx - bx), _mm_sub_ps(py, _mm_set1_ps(by))), _mm_mul_ps(_mm_set1_ps(ry - by), _mm_sub_ps(px, _mm_set1_ps(bx))));
+    __m128 zero = _mm_setzero_ps();
+    __m128 negative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(d1, zero), _mm_cmplt_ps(d2, zero)), _mm_cmplt_ps(d3, zero));
+    __m128 positive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(d1, zero), _mm_cmpgt_ps(d2, zero)), _mm_cmpgt_ps(d3, zero));
+    return _mm_movemask_ps(_mm_and_ps(negative, positive));
+#elif defined(COLORCONVERSION_NEON)
+    float32x4_t px = vld1q_f32(x);
+    float32x4_t py = vld1q_f32(y);
+    float32x4_t d1 = vmlsq_n_f32(vmulq_n_f32(vsubq_f32(py, vdupq_n_f32(ry)), gx - rx), vsubq_f32(px, vdupq_n_f32(rx)), gy - ry);
+    float32x4_t d2 = vmlsq_n_f32(vmulq_n_f32(vsubq_f32(py, vdupq_n_f32(gy)), bx - gx), vsubq_f32(px, vdupq_n_f32(gx)), by - gy);
+    float32x4_t d3 = vmlsq_n_f32(vmulq_n_f32(vsubq_f32(py, vdupq_n_f32(by)), rx - bx), vsubq_f32(px, vdupq_n_f32(bx)), ry - by);
+    float32x4_t zero = vdupq_n_f32(0.0f);
+    uint32x4_t negative = vorrq_u32(vorrq_u32(vcltq_f32(d1, zero), vcltq_f32(d2, zero)), vcltq_f32(d3, zero));
+    uint32x4_t positive = vorrq_u32(vorrq_u32(vcgtq_f32(d1, zero), vcgtq_f32(d2, zero)), vcgtq_f32(d3, zero));
+    uint32_t outside[4];
+    vst1q_u32(outside, vandq_u32(negative, positive));
+    return (outside[0] & 1) | (outside[1] & 2) | (outside[2] & 4) | (outside[3] & 8);
+#else
+    int mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        float d1 = (gx - rx) * (y[i] - ry) - (gy - ry) * (x[i] - rx);
+        float d2 = (bx - gx) * (y[i] - gy) - (by - gy) * (x[i] - gx);
+        float d3 = (rx - bx) * (y[i] - by) - (ry - by) * (x[i] - bx);
+        bool hasNegative = d1 < 0 || d2 < 0 || d3 < 0;
+        bool hasPositive = d1 > 0 || d2 > 0 || d3 > 0;
+        if (hasNegative && hasPositive) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+ColorConversion::Gamut ColorConversion::gamutForModel(const QString &modelId)
+{
+    static const QStringList gamutA = QStringList() << "LLC001" << "LLC005" << "LLC006" << "LLC007" << "LLC010"
+                                                    << "LLC011" << "LLC012" << "LLC013" << "LLC014" << "LST001";
+    static const QStringList gamutB = QStringList() << "LCT001" << "LCT002" << "LCT003" << "LCT007" << "LLM001";
+    static const QStringList gamutC = QStringList() << "LCT010" << "LCT011" << "LCT012" << "LCT014" << "LCT015"
+                                                    << "LCT016" << "LLC020" << "LST002";
+
+    if (gamutA.contains(modelId)) {
+        return GamutA;
+    }
+    if (gamutB.contains(modelId)) {
+        return GamutB;
+    }
+    if (gamutC.contains(modelId) || modelId.startsWith("LCA") || modelId.startsWith("LCG")) {
+        return GamutC;
+    }
+    return GamutNone;
+}
+
+ColorConversion::Gamut ColorConversion::gamutForLight(int lightId)
+{
+    return gamutForModel(HueBridgeConnection::instance()->lightModelId(lightId));
+}
+
+ColorConversion::Gamut ColorConversion::gamutForGroup(int groupId)
+{
+    // Only clamp if all lights agree, otherwise we'd cut off colours some of them could show
+    QList<int> lightIds = HueBridgeConnection::instance()->groupLights(groupId);
+    if (lightIds.isEmpty()) {
+        return GamutNone;
+    }
+    Gamut gamut = gamutForLight(lightIds.first());
+    foreach (int lightId, lightIds) {
+        if (gamutForLight(lightId) != gamut) {
+            return GamutNone;
+        }
+    }
+    return gamut;
+}
+
+QPointF ColorConversion::rgbToXy(const QColor &color, Gamut gamut)
+{
+    const GammaTables &tables = gammaTables();
+    QColor rgb = color.toRgb();
+    qreal red = tables.toLinear[rgb.red()];
+    qreal green = tables.toLinear[rgb.green()];
+    qreal blue = tables.toLinear[rgb.blue()];
+
+    // Wide gamut conversion, D65
+    qreal X = red * 0.664511 + green * 0.154324 + blue * 0.162028;
+    qreal Y = red * 0.283881 + green * 0.668433 + blue * 0.047685;
+    qreal Z = red * 0.000088 + green * 0.072310 + blue * 0.986039;
+
+    qreal sum = X + Y + Z;
+    if (sum <= 0) {
+        return s_whitePoint;
+    }
+    return clampToGamut(QPointF(X / sum, Y / sum), gamut);
+}
+
+void ColorConversion::rgbToXy(const QRgb *colors, int count, Gamut gamut, QPointF *xy, quint8 *bri)
+{
+    const GammaTables &tables = gammaTables();
+    const GamutTriangle *t = triangle(gamut);
+    float red[4];
+    float green[4];
+    float blue[4];
+    float x[4];
+    float y[4];
+
+    for (int start = 0; start < count; start += 4) {
+        int blockSize = qMin(4, count - start);
+        // The table lookups are gathers, which SSE2 and NEON don't have. A lookup is still
+        // cheaper than evaluating the gamma curve in registers. Unused lanes are filled with black.
+        for (int i = 0; i < 4; ++i) {
+            QRgb rgb = i < blockSize ? colors[start + i] : 0;
+            red[i] = tables.toLinearF[qRed(rgb)];
+            green[i] = tables.toLinearF[qGreen(rgb)];
+            blue[i] = tables.toLinearF[qBlue(rgb)];
+        }
+
+        linearToXy4(red, green, blue, x, y);
+        // Most colours are inside the gamut, only the others need the edge projection
+        int outside = t ? outOfGamut4(x, y, t) : 0;
+
+        for (int i = 0; i < blockSize; ++i) {
+            QRgb rgb = colors[start + i];
+            if (x[i] == 0 && y[i] == 0) {
+                xy[start + i] = s_whitePoint;
+            } else if (outside & (1 << i)) {
+                xy[start + i] = clampToGamut(QPointF(x[i], y[i]), gamut);
+            } else {
+                xy[start + i] = QPointF(x[i], y[i]);
+            }
+            if (bri) {
+                bri[start + i] = qMax(qRed(rgb), qMax(qGreen(rgb), qBlue(rgb)));
+            }
+        }
+    }
+}
+
+QColor ColorConversion::xyToRgb(const QPointF &xy)
+{
+    if (xy.y() <= 0) {
+        return QColor(Qt::white);
+    }
+
+    qreal Y = 1.0;
+    qreal X = Y / xy.y() * xy.x();
+    qreal Z = Y / xy.y() * (1 - xy.x() - xy.y());
+
+    qreal red = X * 1.656492 - Y * 0.354851 - Z * 0.255038;
+    qreal green = -X * 0.707196 + Y * 1.655397 + Z * 0.036152;
+    qreal blue = X * 0.051713 - Y * 0.121364 + Z * 1.011530;
+
+    // Scale to full brightness, the bridge transports brightness separately
+    red = qMax<qreal>(0.0, red);
+    green = qMax<qreal>(0.0, green);
+    blue = qMax<qreal>(0.0, blue);
+    qreal max = qMax(red, qMax(green, blue));
+    if (max <= 0) {
+        return QColor(Qt::white);
+    }
+
+    const GammaTables &tables = gammaTables();
+    int scale = s_inverseGammaTableSize - 1;
+    return QColor(tables.fromLinear[qRound(red / max * scale)],
+                  tables.fromLinear[qRound(green / max * scale)],
+                  tables.fromLinear[qRound(blue / max * scale)]);
+}
+
+bool ColorConversion::inGamut(const QPointF &xy, Gamut gamut)
+{
+    const GamutTriangle *t = triangle(gamut);
+    if (!t) {
+        return true;
+    }
+
+    qreal d1 = cross(t->green - t->red, xy - t->red);
+    qreal d2 = cross(t->blue - t->green, xy - t->green);
+    qreal d3 = cross(t->red - t->blue, xy - t->blue);
+    bool hasNegative = d1 < 0 || d2 < 0 || d3 < 0;
+    bool hasPositive = d1 > 0 || d2 > 0 || d3 > 0;
+    return !(hasNegative && hasPositive);
+}
+
+QPointF ColorConversion::clampToGamut(const QPointF &xy, Gamut gamut)
+{
+    if (inGamut(xy, gamut)) {
+        return xy;
+    }
+
+    // Move to the closest point on the triangle's edges
+    const GamutTriangle *t = triangle(gamut);
+    QPointF candidates[3] = {
+        closestPointOnLine(t->red, t->green, xy),
+        closestPointOnLine(t->green, t->blue, xy),
+        closestPointOnLine(t->blue, t->red, xy)
+    };
+    QPointF closest = candidates[0];
+    for (int i = 1; i < 3; ++i) {
+        if (distanceSquared(candidates[i], xy) < distanceSquared(closest, xy)) {
+            closest = candidates[i];
+        }
+    }
+    return closest;
+}
+
+QPointF ColorConversion::xyFromVariant(const QVariant &xy)
+{
+    QVariantList xyList = xy.toList();
+    if (xyList.count() != 2) {
+        return xy.toPointF();
+    }
+    return QPointF(xyList.first().toReal(), xyList.last().toReal());
+}
+
+QVariantList ColorConversion::xyToVariant(const QPointF &xy)
+{
+    // The bridge accepts 4 decimal places
+    QVariantList xyList;
+    xyList << qRound(xy.x() * 10000) / 10000.0 << qRound(xy.y() * 10000) / 10000.0;
+    return xyList;
+}
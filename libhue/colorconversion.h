@@ -0,0 +1,59 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef COLORCONVERSION_H
+#define COLORCONVERSION_H
+
+#include <QColor>
+#include <QRgb>
+#include <QPointF>
+#include <QVariant>
+
+// Converts between sRGB and CIE xy the way the bridge expects it. Each light model can
+// only reproduce colours inside its gamut triangle, so xy values are clamped to the
+// gamut of the light (or of all lights of a group) before they are sent out.
+class ColorConversion
+{
+public:
+    enum Gamut {
+        GamutNone,  // Unknown or mixed models, let the bridge clamp
+        GamutA,     // LivingColors, LightStrips
+        GamutB,     // First generation hue bulbs
+        GamutC      // Newer hue bulbs and LightStrips
+    };
+
+    static Gamut gamutForModel(const QString &modelId);
+    // Looks up the model ids the bridge connection knows about
+    static Gamut gamutForLight(int lightId);
+    static Gamut gamutForGroup(int groupId);
+
+    static QPointF rgbToXy(const QColor &color, Gamut gamut);
+    // Converts many colours at once, for effects and streaming. Gives the same results as
+    // the single colour version. bri receives the HSV value and may be 0.
+    static void rgbToXy(const QRgb *colors, int count, Gamut gamut, QPointF *xy, quint8 *bri);
+    static QColor xyToRgb(const QPointF &xy);
+    static QPointF clampToGamut(const QPointF &xy, Gamut gamut);
+    static bool inGamut(const QPointF &xy, Gamut gamut);
+
+    // The API transports xy as a list of two numbers
+    static QPointF xyFromVariant(const QVariant &xy);
+    static QVariantList xyToVariant(const QPointF &xy);
+};
+
+#endif
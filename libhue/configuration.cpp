@@ -31,7 +31,7 @@ Configuration::Configuration(QObject *parent):
 
 void Configuration::refresh()
 {
-    HueBridgeConnection::instance()->get("config", this, "responseReceived");
+    HueBridgeConnection::instance()->get("config", this, "responseReceived", HueBridgeConnection::PriorityBackground);
 }
 
 void Configuration::checkForUpdate()
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "effect.h"
+#include "huebridgeconnection.h"
+
+#include <math.h>
+
+Effect::Effect(QObject *parent):
+    QObject(parent),
+    m_type(TypeFade),
+    m_duration(1000),
+    m_loop(false)
+{
+}
+
+Effect::Type Effect::type() const
+{
+    return m_type;
+}
+
+void Effect::setType(Effect::Type type)
+{
+    if (m_type != type) {
+        m_type = type;
+        emit typeChanged();
+    }
+}
+
+QList<int> Effect::lightIds() const
+{
+    return m_lightIds;
+}
+
+void Effect::setLightIds(const QList<int> &lightIds)
+{
+    if (m_lightIds != lightIds) {
+        m_lightIds = lightIds;
+        emit lightIdsChanged();
+    }
+}
+
+void Effect::setGroup(int groupId)
+{
+    setLightIds(HueBridgeConnection::instance()->groupLights(groupId));
+}
+
+int Effect::duration() const
+{
+    return m_duration;
+}
+
+void Effect::setDuration(int duration)
+{
+    if (m_duration != duration) {
+        m_duration = duration;
+        emit durationChanged();
+    }
+}
+
+bool Effect::loop() const
+{
+    return m_loop;
+}
+
+void Effect::setLoop(bool loop)
+{
+    if (m_loop != loop) {
+        m_loop = loop;
+        emit loopChanged();
+    }
+}
+
+void Effect::addKeyframe(qreal position, const QColor &color)
+{
+    position = qBound<qreal>(0, position, 1);
+    int index = 0;
+    while (index < m_keyframes.count() && m_keyframes.at(index).first <= position) {
+        ++index;
+    }
+    m_keyframes.insert(index, qMakePair(position, color));
+}
+
+void Effect::clearKeyframes()
+{
+    m_keyframes.clear();
+}
+
+QColor Effect::colorAt(int lightIndex, qint64 elapsed) const
+{
+    int count = m_lightIds.count();
+    qreal time = 0;
+    if (m_duration > 0) {
+        time = 1.0 * elapsed / m_duration;
+        time = m_loop ? time - floor(time) : qMin<qreal>(time, 1);
+    }
+
+    qreal position = time;
+    switch (m_type) {
+    case TypeFade:
+        break;
+    case TypeChase:
+        position = time + 1.0 * lightIndex / qMax(1, count);
+        position -= floor(position);
+        break;
+    case TypeGradient:
+        position = count > 1 ? 1.0 * lightIndex / (count - 1) : 0;
+        if (m_duration > 0) {
+            position += time;
+            position -= floor(position);
+        }
+        break;
+    }
+    return sample(position);
+}
+
+bool Effect::finished(qint64 elapsed) const
+{
+    return !m_loop && elapsed >= m_duration;
+}
+
+QColor Effect::sample(qreal position) const
+{
+    if (m_keyframes.isEmpty()) {
+        return QColor(Qt::black);
+    }
+    if (position <= m_keyframes.first().first) {
+        return m_keyframes.first().second;
+    }
+    for (int i = 1; i < m_keyframes.count(); ++i) {
+        const QPair<qreal, QColor> &next = m_keyframes.at(i);
+        if (position > next.first) {
+            continue;
+        }
+        const QPair<qreal, QColor> &previous = m_keyframes.at(i - 1);
+        qreal span = next.first - previous.first;
+        qreal progress = span > 0 ? (position - previous.first) / span : 1;
+        return QColor::fromRgbF(previous.second.redF() + (next.second.redF() - previous.second.redF()) * progress,
+                                previous.second.greenF() + (next.second.greenF() - previous.second.greenF()) * progress,
+                                previous.second.blueF() + (next.second.blueF() - previous.second.blueF()) * progress);
+    }
+    return m_keyframes.last().second;
+}
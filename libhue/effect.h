@@ -0,0 +1,88 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef EFFECT_H
+#define EFFECT_H
+
+#include <QObject>
+#include <QColor>
+#include <QList>
+#include <QPair>
+
+// A keyframed colour animation over a set of lights. Keyframes are placed at positions
+// between 0 and 1. Effects are rendered by the EffectsEngine.
+class Effect: public QObject
+{
+    Q_OBJECT
+    Q_ENUMS(Type)
+
+    Q_PROPERTY(Type type READ type WRITE setType NOTIFY typeChanged)
+    Q_PROPERTY(QList<int> lightIds READ lightIds WRITE setLightIds NOTIFY lightIdsChanged)
+    Q_PROPERTY(int duration READ duration WRITE setDuration NOTIFY durationChanged)
+    Q_PROPERTY(bool loop READ loop WRITE setLoop NOTIFY loopChanged)
+
+public:
+    enum Type {
+        TypeFade,       // All lights run through the keyframes together
+        TypeChase,      // Like fade, with each light shifted in phase by its position
+        TypeGradient    // The keyframes are spread across the lights, moving if duration > 0
+    };
+
+    Effect(QObject *parent = 0);
+
+    Type type() const;
+    void setType(Type type);
+
+    QList<int> lightIds() const;
+    void setLightIds(const QList<int> &lightIds);
+    // Takes the lights of the group, as last reported by the bridge
+    Q_INVOKABLE void setGroup(int groupId);
+
+    // Length of one run through the keyframes in ms
+    int duration() const;
+    void setDuration(int duration);
+
+    bool loop() const;
+    void setLoop(bool loop);
+
+    Q_INVOKABLE void addKeyframe(qreal position, const QColor &color);
+    Q_INVOKABLE void clearKeyframes();
+
+    // Colour of the light at the given index after elapsed ms
+    QColor colorAt(int lightIndex, qint64 elapsed) const;
+    bool finished(qint64 elapsed) const;
+
+signals:
+    void typeChanged();
+    void lightIdsChanged();
+    void durationChanged();
+    void loopChanged();
+
+private:
+    QColor sample(qreal position) const;
+
+    Type m_type;
+    QList<int> m_lightIds;
+    int m_duration;
+    bool m_loop;
+    // Sorted by position
+    QList<QPair<qreal, QColor> > m_keyframes;
+};
+
+#endif
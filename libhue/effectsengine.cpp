@@ -0,0 +1,259 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "effectsengine.h"
+#include "effect.h"
+#include "colorconversion.h"
+#include "huebridgeconnection.h"
+
+#include <QDebug>
+#include <QVector>
+#include <QPointF>
+
+// Colour channels may differ this much before a light is considered out of date
+static const int s_colorTolerance = 2;
+
+EffectsEngine::EffectsEngine(QObject *parent):
+    QObject(parent),
+    m_frameRate(10),
+    m_commandsPerSecond(10),
+    m_lastFrame(0),
+    m_budget(0)
+{
+    m_frameTimer.setInterval(1000 / m_frameRate);
+    connect(&m_frameTimer, SIGNAL(timeout()), this, SLOT(renderFrame()));
+}
+
+int EffectsEngine::frameRate() const
+{
+    return m_frameRate;
+}
+
+void EffectsEngine::setFrameRate(int frameRate)
+{
+    frameRate = qBound(1, frameRate, 60);
+    if (m_frameRate != frameRate) {
+        m_frameRate = frameRate;
+        m_frameTimer.setInterval(1000 / m_frameRate);
+        emit frameRateChanged();
+    }
+}
+
+int EffectsEngine::commandsPerSecond() const
+{
+    return m_commandsPerSecond;
+}
+
+void EffectsEngine::setCommandsPerSecond(int commandsPerSecond)
+{
+    commandsPerSecond = qMax(1, commandsPerSecond);
+    if (m_commandsPerSecond != commandsPerSecond) {
+        m_commandsPerSecond = commandsPerSecond;
+        emit commandsPerSecondChanged();
+    }
+}
+
+bool EffectsEngine::running() const
+{
+    return m_frameTimer.isActive();
+}
+
+void EffectsEngine::start(Effect *effect)
+{
+    if (!effect) {
+        return;
+    }
+
+    if (!m_clock.isValid()) {
+        m_clock.start();
+    }
+
+    m_effects.removeAll(effect);
+    m_effects.append(effect);
+    m_startTimes.insert(effect, m_clock.elapsed());
+    connect(effect, SIGNAL(destroyed(QObject*)), this, SLOT(effectDestroyed(QObject*)), Qt::UniqueConnection);
+
+    updateRunning();
+}
+
+void EffectsEngine::stop(Effect *effect)
+{
+    if (!m_effects.removeAll(effect)) {
+        return;
+    }
+    m_startTimes.remove(effect);
+    disconnect(effect, SIGNAL(destroyed(QObject*)), this, SLOT(effectDestroyed(QObject*)));
+    updateRunning();
+}
+
+void EffectsEngine::stopAll()
+{
+    foreach (Effect *effect, m_effects) {
+        stop(effect);
+    }
+}
+
+void EffectsEngine::effectDestroyed(QObject *effect)
+{
+    // Can't call stop() with a half destroyed object
+    m_effects.removeAll(static_cast<Effect*>(effect));
+    m_startTimes.remove(static_cast<Effect*>(effect));
+    updateRunning();
+}
+
+void EffectsEngine::setLightColors(const QHash<int, QRgb> &colors)
+{
+    if (!m_clock.isValid()) {
+        m_clock.start();
+    }
+
+    m_lightColors = colors;
+    updateRunning();
+}
+
+void EffectsEngine::clearLightColors()
+{
+    m_lightColors.clear();
+    updateRunning();
+}
+
+void EffectsEngine::updateRunning()
+{
+    bool running = !m_effects.isEmpty() || !m_lightColors.isEmpty();
+    if (running == m_frameTimer.isActive()) {
+        return;
+    }
+
+    if (running) {
+        m_lastFrame = m_clock.elapsed();
+        m_budget = 1;
+        m_frameTimer.start();
+        emit runningChanged();
+        renderFrame();
+    } else {
+        m_frameTimer.stop();
+        emit runningChanged();
+    }
+}
+
+void EffectsEngine::renderFrame()
+{
+    qint64 now = m_clock.elapsed();
+
+    // Render all effects. The clock decides what to show, frames we were too late for
+    // are simply never rendered.
+    QHash<int, QRgb> targets = m_lightColors;
+    QList<Effect*> finishedEffects;
+    foreach (Effect *effect, m_effects) {
+        qint64 elapsed = now - m_startTimes.value(effect);
+        QList<int> lightIds = effect->lightIds();
+        for (int i = 0; i < lightIds.count(); ++i) {
+            targets.insert(lightIds.at(i), effect->colorAt(i, elapsed).rgb());
+        }
+        if (effect->finished(elapsed)) {
+            finishedEffects.append(effect);
+        }
+    }
+
+    // Refill the budget, allowing a burst of at most one frame's worth
+    qreal perFrame = 1.0 * m_commandsPerSecond / m_frameRate;
+    m_budget = qMin(m_budget + (now - m_lastFrame) * m_commandsPerSecond / 1000.0, qMax<qreal>(1, perFrame));
+    m_lastFrame = now;
+
+    // Pick the lights which waited longest. Lights with a write still in flight are skipped,
+    // they get a fresh value on one of the next frames.
+    QList<int> candidates;
+    foreach (int lightId, targets.keys()) {
+        const LightState &state = m_lights[lightId];
+        if (state.pendingRequestId != -1) {
+            continue;
+        }
+        QRgb target = targets.value(lightId);
+        if (state.lastSentAt != -1
+                && qAbs(qRed(target) - qRed(state.lastSent)) <= s_colorTolerance
+                && qAbs(qGreen(target) - qGreen(state.lastSent)) <= s_colorTolerance
+                && qAbs(qBlue(target) - qBlue(state.lastSent)) <= s_colorTolerance) {
+            continue;
+        }
+        int index = 0;
+        while (index < candidates.count() && m_lights.value(candidates.at(index)).lastSentAt <= state.lastSentAt) {
+            ++index;
+        }
+        candidates.insert(index, lightId);
+    }
+
+    // Frames are worthless later, don't let them end up in the offline write queue
+    HueBridgeConnection *bridge = HueBridgeConnection::instance();
+    if (bridge->connectedBridge().isEmpty() || !bridge->bridgeReachable()) {
+        candidates.clear();
+    }
+
+    int count = qMin(candidates.count(), static_cast<int>(m_budget));
+    if (count > 0) {
+        QVector<QRgb> colors(count);
+        QVector<QPointF> xy(count);
+        QVector<quint8> bri(count);
+        for (int i = 0; i < count; ++i) {
+            colors[i] = targets.value(candidates.at(i));
+        }
+        ColorConversion::rgbToXy(colors.constData(), count, ColorConversion::GamutNone, xy.data(), bri.data());
+
+        // Until a light gets its next update, all other waiting lights take their turn
+        int nextUpdate = qMax(1000 / m_frameRate, candidates.count() * 1000 / m_commandsPerSecond);
+        int transitionTime = qMax(1, (nextUpdate + 50) / 100);
+
+        for (int i = 0; i < count; ++i) {
+            int lightId = candidates.at(i);
+            QVariantMap params;
+            if (bri.at(i) == 0) {
+                params.insert("on", false);
+            } else {
+                QPointF clamped = ColorConversion::clampToGamut(xy.at(i), ColorConversion::gamutForLight(lightId));
+                params.insert("on", true);
+                params.insert("xy", ColorConversion::xyToVariant(clamped));
+                // The HSV value goes up to 255, the bridge takes 1 to 254
+                params.insert("bri", qBound(1, static_cast<int>(bri.at(i)), 254));
+            }
+            params.insert("transitiontime", transitionTime);
+
+            LightState &state = m_lights[lightId];
+            state.pendingRequestId = bridge->put("lights/" + QString::number(lightId) + "/state", params, this, "setStateFinished", HueBridgeConnection::PriorityAutomation);
+            state.lastSent = colors.at(i);
+            state.lastSentAt = now;
+        }
+        m_budget -= count;
+    }
+
+    foreach (Effect *effect, finishedEffects) {
+        stop(effect);
+        emit effectFinished(effect);
+    }
+}
+
+void EffectsEngine::setStateFinished(int id, const QVariant &response)
+{
+    Q_UNUSED(response)
+    QHash<int, LightState>::iterator it;
+    for (it = m_lights.begin(); it != m_lights.end(); ++it) {
+        if (it.value().pendingRequestId == id) {
+            it.value().pendingRequestId = -1;
+            return;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef EFFECTSENGINE_H
+#define EFFECTSENGINE_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QRgb>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVariant>
+
+class Effect;
+
+// Renders running effects on a frame clock and sends the result to the lights. The bridge
+// only handles a limited number of light commands per second, so each frame only updates
+// the lights which have gone longest without an update. Frames that can't be sent are
+// dropped instead of queued and transition times are stretched to cover the gaps.
+class EffectsEngine: public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(int frameRate READ frameRate WRITE setFrameRate NOTIFY frameRateChanged)
+    Q_PROPERTY(int commandsPerSecond READ commandsPerSecond WRITE setCommandsPerSecond NOTIFY commandsPerSecondChanged)
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+
+public:
+    EffectsEngine(QObject *parent = 0);
+
+    int frameRate() const;
+    void setFrameRate(int frameRate);
+
+    // Light state changes per second we allow ourselves to send to the bridge
+    int commandsPerSecond() const;
+    void setCommandsPerSecond(int commandsPerSecond);
+
+    bool running() const;
+
+    // Effects started later win for lights used by multiple effects
+    Q_INVOKABLE void start(Effect *effect);
+    Q_INVOKABLE void stop(Effect *effect);
+    Q_INVOKABLE void stopAll();
+
+    // Colours computed elsewhere, e.g. by a FrameColorExtractor. They are sent with the same
+    // budget as effects, which are drawn on top of them.
+    void setLightColors(const QHash<int, QRgb> &colors);
+    void clearLightColors();
+
+signals:
+    void frameRateChanged();
+    void commandsPerSecondChanged();
+    void runningChanged();
+    void effectFinished(Effect *effect);
+
+private slots:
+    void renderFrame();
+    void effectDestroyed(QObject *effect);
+    void setStateFinished(int id, const QVariant &response);
+
+private:
+    void updateRunning();
+
+    class LightState
+    {
+    public:
+        LightState(): lastSent(0), lastSentAt(-1), pendingRequestId(-1) {}
+        QRgb lastSent;
+        qint64 lastSentAt;
+        int pendingRequestId;
+    };
+
+    int m_frameRate;
+    int m_commandsPerSecond;
+    QTimer m_frameTimer;
+    QElapsedTimer m_clock;
+    qint64 m_lastFrame;
+    // Token bucket for the command budget
+    qreal m_budget;
+
+    QList<Effect*> m_effects;
+    QHash<Effect*, qint64> m_startTimes;
+    QHash<int, QRgb> m_lightColors;
+    QHash<int, LightState> m_lights;
+};
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "fade.h"
+#include "colorconversion.h"
+
+#include <QDebug>
+
+// Longest transition the bridge accepts (ms)
+static const int s_maxTransitionTime = 65535 * 100;
+// Transitions are set in steps of 100 ms, no need to sample finer
+static const int s_minSampleInterval = 100;
+static const int s_maxSamples = 1024;
+
+Fade::Fade(QObject *parent):
+    QObject(parent),
+    m_tolerance(0.01),
+    m_currentStep(-1)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(nextStep()));
+}
+
+LightInterface *Fade::target() const
+{
+    return m_target;
+}
+
+void Fade::setTarget(LightInterface *target)
+{
+    if (m_target != target) {
+        m_target = target;
+        emit targetChanged();
+    }
+}
+
+qreal Fade::tolerance() const
+{
+    return m_tolerance;
+}
+
+void Fade::setTolerance(qreal tolerance)
+{
+    tolerance = qMax<qreal>(0.001, tolerance);
+    if (m_tolerance != tolerance) {
+        m_tolerance = tolerance;
+        emit toleranceChanged();
+        emit keyframesChanged();
+    }
+}
+
+bool Fade::running() const
+{
+    return m_currentStep != -1;
+}
+
+int Fade::stepCount() const
+{
+    return plan().count();
+}
+
+void Fade::addKeyframe(int time, const QColor &color)
+{
+    time = qMax(0, time);
+    int index = 0;
+    while (index < m_keyframes.count() && m_keyframes.at(index).first <= time) {
+        ++index;
+    }
+    m_keyframes.insert(index, qMakePair(time, color));
+    emit keyframesChanged();
+}
+
+void Fade::clearKeyframes()
+{
+    m_keyframes.clear();
+    emit keyframesChanged();
+}
+
+QColor Fade::colorAt(int time) const
+{
+    if (time <= m_keyframes.first().first) {
+        return m_keyframes.first().second;
+    }
+    for (int i = 1; i < m_keyframes.count(); ++i) {
+        const QPair<int, QColor> &next = m_keyframes.at(i);
+        if (time > next.first) {
+            continue;
+        }
+        const QPair<int, QColor> &previous = m_keyframes.at(i - 1);
+        qreal progress = next.first > previous.first ? 1.0 * (time - previous.first) / (next.first - previous.first) : 1;
+        return QColor::fromRgbF(previous.second.redF() + (next.second.redF() - previous.second.redF()) * progress,
+                                previous.second.greenF() + (next.second.greenF() - previous.second.greenF()) * progress,
+                                previous.second.blueF() + (next.second.blueF() - previous.second.blueF()) * progress);
+    }
+    return m_keyframes.last().second;
+}
+
+static void appendSample(QList<Fade::Sample> *samples, int time)
+{
+    if (!samples->isEmpty() && samples->last().time >= time) {
+        return;
+    }
+    Fade::Sample sample;
+    sample.time = time;
+    samples->append(sample);
+}
+
+QList<Fade::Step> Fade::plan() const
+{
+    QList<Step> steps;
+    if (m_keyframes.isEmpty()) {
+        return steps;
+    }
+
+    // Sample the curve as the bulb sees it: in xy and brightness
+    int start = m_keyframes.first().first;
+    int end = m_keyframes.last().first;
+    int interval = qMax(s_minSampleInterval, (end - start) / s_maxSamples);
+    QList<Sample> samples;
+    int keyframe = 0;
+    for (int time = start; ; time += interval) {
+        time = qMin(time, end);
+        // Keyframes are always sampled exactly, so corners of the curve aren't missed
+        while (keyframe < m_keyframes.count() && m_keyframes.at(keyframe).first <= time) {
+            appendSample(&samples, m_keyframes.at(keyframe).first);
+            ++keyframe;
+        }
+        appendSample(&samples, time);
+        if (time >= end) {
+            break;
+        }
+    }
+    for (int i = 0; i < samples.count(); ++i) {
+        QColor color = colorAt(samples.at(i).time);
+        samples[i].xy = ColorConversion::rgbToXy(color, ColorConversion::GamutNone);
+        samples[i].bri = color.valueF();
+    }
+
+    QList<int> kept;
+    kept.append(0);
+    if (samples.count() > 1) {
+        simplify(samples, 0, samples.count() - 1, &kept);
+        kept.append(samples.count() - 1);
+    }
+
+    // The first step sets the start state, each further one fades to the next kept sample
+    for (int i = 0; i < kept.count(); ++i) {
+        const Sample &sample = samples.at(kept.at(i));
+        Step step;
+        step.startTime = i == 0 ? 0 : samples.at(kept.at(i - 1)).time - start;
+        step.transitionTime = i == 0 ? 0 : sample.time - samples.at(kept.at(i - 1)).time;
+        step.xy = sample.xy;
+        step.bri = qRound(sample.bri * 254);
+        steps.append(step);
+    }
+    return steps;
+}
+
+void Fade::simplify(const QList<Sample> &samples, int first, int last, QList<int> *kept) const
+{
+    // Douglas-Peucker, measuring against where the bulb would be at the same time
+    const Sample &a = samples.at(first);
+    const Sample &b = samples.at(last);
+    qreal worst = 0;
+    int worstIndex = -1;
+    for (int i = first + 1; i < last; ++i) {
+        const Sample &sample = samples.at(i);
+        qreal progress = 1.0 * (sample.time - a.time) / (b.time - a.time);
+        QPointF xy = a.xy + (b.xy - a.xy) * progress;
+        qreal bri = a.bri + (b.bri - a.bri) * progress;
+        qreal error = qMax(qMax(qAbs(sample.xy.x() - xy.x()), qAbs(sample.xy.y() - xy.y())), qAbs(sample.bri - bri));
+        if (error > worst) {
+            worst = error;
+            worstIndex = i;
+        }
+    }
+
+    bool tooLong = b.time - a.time > s_maxTransitionTime;
+    if (worst <= m_tolerance && !tooLong) {
+        return;
+    }
+    if (worstIndex == -1) {
+        if (last - first < 2) {
+            return;
+        }
+        worstIndex = (first + last) / 2;
+    }
+    simplify(samples, first, worstIndex, kept);
+    kept->append(worstIndex);
+    simplify(samples, worstIndex, last, kept);
+}
+
+void Fade::start()
+{
+    stop();
+    if (!m_target) {
+        qWarning() << "Fade has no target";
+        return;
+    }
+
+    m_steps = plan();
+    if (m_steps.isEmpty()) {
+        return;
+    }
+    qDebug() << "fading" << m_target->name() << "in" << m_steps.count() << "steps";
+    m_currentStep = 0;
+    m_clock.start();
+    emit runningChanged();
+    nextStep();
+}
+
+void Fade::stop()
+{
+    if (m_currentStep == -1) {
+        return;
+    }
+    m_timer.stop();
+    m_currentStep = -1;
+    emit runningChanged();
+}
+
+void Fade::nextStep()
+{
+    if (m_currentStep >= m_steps.count()) {
+        stop();
+        emit finished();
+        return;
+    }
+    if (!m_target) {
+        stop();
+        return;
+    }
+
+    const Step &step = m_steps.at(m_currentStep);
+    QVariantMap state;
+    state.insert("on", step.bri > 0);
+    if (step.bri > 0) {
+        state.insert("xy", ColorConversion::xyToVariant(step.xy));
+        state.insert("bri", step.bri);
+    }
+    m_target->setState(state, step.transitionTime);
+
+    ++m_currentStep;
+    if (m_currentStep >= m_steps.count()) {
+        // Finished once the bulbs are done with the last transition
+        m_timer.start(step.transitionTime);
+        return;
+    }
+    // Send each transition when the previous one should be done
+    m_timer.start(qMax<qint64>(0, m_steps.at(m_currentStep).startTime - m_clock.elapsed()));
+}
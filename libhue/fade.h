@@ -0,0 +1,111 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef FADE_H
+#define FADE_H
+
+#include <QObject>
+#include <QColor>
+#include <QPointF>
+#include <QPointer>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "lightinterface.h"
+
+// Runs a long, keyframed fade (e.g. a sunrise) on a light or group with as few requests as
+// possible. The bulbs interpolate linearly between states, so the curve described by the
+// keyframes is split into the fewest linear transitions which stay within the tolerance.
+class Fade: public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(LightInterface *target READ target WRITE setTarget NOTIFY targetChanged)
+    Q_PROPERTY(qreal tolerance READ tolerance WRITE setTolerance NOTIFY toleranceChanged)
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(int stepCount READ stepCount NOTIFY keyframesChanged)
+
+public:
+    class Step
+    {
+    public:
+        int startTime;          // ms after the fade started
+        int transitionTime;     // ms
+        QPointF xy;
+        quint8 bri;
+    };
+
+    // A point of the keyframed curve, as used for planning
+    class Sample
+    {
+    public:
+        int time;
+        QPointF xy;
+        qreal bri;      // 0 to 1
+    };
+
+    Fade(QObject *parent = 0);
+
+    LightInterface *target() const;
+    void setTarget(LightInterface *target);
+
+    // Maximum deviation from the keyframed curve, in xy units. Brightness is held to the
+    // same relative precision.
+    qreal tolerance() const;
+    void setTolerance(qreal tolerance);
+
+    bool running() const;
+    int stepCount() const;
+
+    // time in ms after the start of the fade
+    Q_INVOKABLE void addKeyframe(int time, const QColor &color);
+    Q_INVOKABLE void clearKeyframes();
+
+    QList<Step> plan() const;
+
+public slots:
+    void start();
+    void stop();
+
+signals:
+    void targetChanged();
+    void toleranceChanged();
+    void runningChanged();
+    void keyframesChanged();
+    void finished();
+
+private slots:
+    void nextStep();
+
+private:
+    QColor colorAt(int time) const;
+    void simplify(const QList<Sample> &samples, int first, int last, QList<int> *kept) const;
+
+    QPointer<LightInterface> m_target;
+    qreal m_tolerance;
+    // Sorted by time
+    QList<QPair<int, QColor> > m_keyframes;
+
+    QList<Step> m_steps;
+    int m_currentStep;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+};
+
+#endif
@@ -0,0 +1,353 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "framecolorextractor.h"
+#include "effectsengine.h"
+#include "streamingengine.h"
+
+#include <QDebug>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRAMECOLOREXTRACTOR_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FRAMECOLOREXTRACTOR_NEON
+#endif
+
+// Pixels darker than this in all channels don't count for the dominant colour
+static const int s_blackLevel = 24;
+// 4 bits per channel
+static const int s_histogramBins = 4096;
+
+FrameColorExtractor::FrameColorExtractor(QObject *parent):
+    QObject(parent),
+    m_mode(ModeAverage),
+    m_smoothingTime(200),
+    m_sampleStep(2)
+{
+}
+
+FrameColorExtractor::Mode FrameColorExtractor::mode() const
+{
+    return m_mode;
+}
+
+void FrameColorExtractor::setMode(FrameColorExtractor::Mode mode)
+{
+    if (m_mode != mode) {
+        m_mode = mode;
+        emit modeChanged();
+    }
+}
+
+int FrameColorExtractor::smoothingTime() const
+{
+    return m_smoothingTime;
+}
+
+void FrameColorExtractor::setSmoothingTime(int smoothingTime)
+{
+    smoothingTime = qMax(0, smoothingTime);
+    if (m_smoothingTime != smoothingTime) {
+        m_smoothingTime = smoothingTime;
+        emit smoothingTimeChanged();
+    }
+}
+
+int FrameColorExtractor::sampleStep() const
+{
+    return m_sampleStep;
+}
+
+void FrameColorExtractor::setSampleStep(int sampleStep)
+{
+    sampleStep = qMax(1, sampleStep);
+    if (m_sampleStep != sampleStep) {
+        m_sampleStep = sampleStep;
+        emit sampleStepChanged();
+    }
+}
+
+EffectsEngine *FrameColorExtractor::engine() const
+{
+    return m_engine;
+}
+
+void FrameColorExtractor::setEngine(EffectsEngine *engine)
+{
+    if (m_engine != engine) {
+        if (m_engine) {
+            m_engine->clearLightColors();
+        }
+        m_engine = engine;
+        emit engineChanged();
+    }
+}
+
+StreamingEngine *FrameColorExtractor::streamingEngine() const
+{
+    return m_streamingEngine;
+}
+
+void FrameColorExtractor::setStreamingEngine(StreamingEngine *streamingEngine)
+{
+    if (m_streamingEngine != streamingEngine) {
+        m_streamingEngine = streamingEngine;
+        emit streamingEngineChanged();
+    }
+}
+
+void FrameColorExtractor::setRegion(int lightId, const QRectF &region)
+{
+    Region &entry = m_regions[lightId];
+    entry.rect = region.normalized() & QRectF(0, 0, 1, 1);
+}
+
+void FrameColorExtractor::removeRegion(int lightId)
+{
+    m_regions.remove(lightId);
+}
+
+void FrameColorExtractor::clearRegions()
+{
+    m_regions.clear();
+    if (m_engine) {
+        m_engine->clearLightColors();
+    }
+}
+
+QList<int> FrameColorExtractor::lightIds() const
+{
+    return m_regions.keys();
+}
+
+QColor FrameColorExtractor::color(int lightId) const
+{
+    QHash<int, Region>::const_iterator it = m_regions.find(lightId);
+    if (it == m_regions.constEnd() || !it.value().valid) {
+        return QColor();
+    }
+    return QColor(qRound(it.value().color[0]), qRound(it.value().color[1]), qRound(it.value().color[2]));
+}
+
+void FrameColorExtractor::processFrame(const uchar *data, int width, int height, int bytesPerLine)
+{
+    if (!data || width <= 0 || height <= 0) {
+        return;
+    }
+
+    // Exponential smoothing, weighted by the time since the last frame so the result
+    // doesn't depend on the frame rate
+    qint64 elapsed = 0;
+    if (m_lastFrame.isValid()) {
+        elapsed = m_lastFrame.restart();
+    } else {
+        m_lastFrame.start();
+    }
+    float alpha = m_smoothingTime > 0 ? 1 - exp(-1.0 * elapsed / m_smoothingTime) : 1;
+
+    QList<int> lightIds;
+    QList<QRgb> colors;
+    QHash<int, QRgb> colorHash;
+    QHash<int, Region>::iterator it;
+    for (it = m_regions.begin(); it != m_regions.end(); ++it) {
+        Region &region = it.value();
+        int x0 = qBound(0, qRound(region.rect.left() * width), width);
+        int x1 = qBound(0, qRound(region.rect.right() * width), width);
+        int y0 = qBound(0, qRound(region.rect.top() * height), height);
+        int y1 = qBound(0, qRound(region.rect.bottom() * height), height);
+
+        float color[3];
+        if (!extract(data, bytesPerLine, x0, x1, y0, y1, color)) {
+            continue;
+        }
+
+        // The first sample is taken as is, later ones are smoothed
+        for (int i = 0; i < 3; ++i) {
+            if (region.valid) {
+                region.color[i] += alpha * (color[i] - region.color[i]);
+            } else {
+                region.color[i] = color[i];
+            }
+        }
+        region.valid = true;
+
+        QRgb rgb = qRgb(qRound(region.color[0]), qRound(region.color[1]), qRound(region.color[2]));
+        lightIds.append(it.key());
+        colors.append(rgb);
+        colorHash.insert(it.key(), rgb);
+    }
+
+    if (m_streamingEngine) {
+        m_streamingEngine->setLightColors(lightIds, colors);
+    } else if (m_engine) {
+        m_engine->setLightColors(colorHash);
+    }
+    emit colorsChanged();
+}
+
+void FrameColorExtractor::processImage(const QImage &image)
+{
+    if (image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32 || image.format() == QImage::Format_ARGB32_Premultiplied) {
+        processFrame(image.constBits(), image.width(), image.height(), image.bytesPerLine());
+    } else {
+        QImage converted = image.convertToFormat(QImage::Format_RGB32);
+        processFrame(converted.constBits(), converted.width(), converted.height(), converted.bytesPerLine());
+    }
+}
+
+bool FrameColorExtractor::processFile(const QString &fileName)
+{
+    QImage image(fileName);
+    if (image.isNull()) {
+        qWarning() << "Cannot load image" << fileName;
+        return false;
+    }
+    processImage(image);
+    return true;
+}
+
+void FrameColorExtractor::reset()
+{
+    QHash<int, Region>::iterator it;
+    for (it = m_regions.begin(); it != m_regions.end(); ++it) {
+        it.value().valid = false;
+    }
+    m_lastFrame.invalidate();
+}
+
+bool FrameColorExtractor::extract(const uchar *data, int bytesPerLine, int x0, int x1, int y0, int y1, float *color)
+{
+    if (x0 >= x1 || y0 >= y1) {
+        return false;
+    }
+
+    quint64 totals[3] = {0, 0, 0};
+    int rows = 0;
+    for (int y = y0; y < y1; y += m_sampleStep) {
+        quint32 sums[3];
+        sumRow(reinterpret_cast<const QRgb*>(data + y * bytesPerLine) + x0, x1 - x0, sums);
+        for (int i = 0; i < 3; ++i) {
+            totals[i] += sums[i];
+        }
+        ++rows;
+    }
+    quint64 pixels = static_cast<quint64>(rows) * (x1 - x0);
+    for (int i = 0; i < 3; ++i) {
+        color[i] = 1.0f * totals[i] / pixels;
+    }
+
+    if (m_mode != ModeDominant) {
+        return true;
+    }
+
+    // Coarse histogram holding the pixel count and the channel sums per bin. Sparser
+    // sampling is plenty to find the biggest bin.
+    m_histogram.fill(0, s_histogramBins * 4);
+    quint32 *histogram = m_histogram.data();
+    for (int y = y0; y < y1; y += m_sampleStep) {
+        const QRgb *row = reinterpret_cast<const QRgb*>(data + y * bytesPerLine);
+        for (int x = x0; x < x1; x += m_sampleStep) {
+            QRgb pixel = row[x];
+            int red = qRed(pixel);
+            int green = qGreen(pixel);
+            int blue = qBlue(pixel);
+            if (red < s_blackLevel && green < s_blackLevel && blue < s_blackLevel) {
+                continue;
+            }
+            quint32 *bin = histogram + 4 * (((pixel >> 12) & 0xf00) | ((pixel >> 8) & 0xf0) | ((pixel >> 4) & 0xf));
+            bin[0]++;
+            bin[1] += red;
+            bin[2] += green;
+            bin[3] += blue;
+        }
+    }
+
+    const quint32 *dominant = 0;
+    for (int i = 0; i < s_histogramBins; ++i) {
+        if (histogram[4 * i] > 0 && (!dominant || histogram[4 * i] > dominant[0])) {
+            dominant = histogram + 4 * i;
+        }
+    }
+    if (dominant) {
+        for (int i = 0; i < 3; ++i) {
+            color[i] = 1.0f * dominant[i + 1] / dominant[0];
+        }
+    }
+    return true;
+}
+
+// Sums up the red, green and blue channels of a row of pixels
+void FrameColorExtractor::sumRow(const QRgb *pixels, int count, quint32 *sums)
+{
+    quint32 red = 0;
+    quint32 green = 0;
+    quint32 blue = 0;
+    int i = 0;
+
+#if defined(FRAMECOLOREXTRACTOR_SSE2)
+    const __m128i mask = _mm_set1_epi32(0xff);
+    __m128i r = _mm_setzero_si128();
+    __m128i g = _mm_setzero_si128();
+    __m128i b = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+        b = _mm_add_epi32(b, _mm_and_si128(v, mask));
+        g = _mm_add_epi32(g, _mm_and_si128(_mm_srli_epi32(v, 8), mask));
+        r = _mm_add_epi32(r, _mm_and_si128(_mm_srli_epi32(v, 16), mask));
+    }
+    quint32 lanes[3][4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[0]), r);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[1]), g);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[2]), b);
+    red = lanes[0][0] + lanes[0][1] + lanes[0][2] + lanes[0][3];
+    green = lanes[1][0] + lanes[1][1] + lanes[1][2] + lanes[1][3];
+    blue = lanes[2][0] + lanes[2][1] + lanes[2][2] + lanes[2][3];
+#elif defined(FRAMECOLOREXTRACTOR_NEON)
+    const uint32x4_t mask = vdupq_n_u32(0xff);
+    uint32x4_t r = vdupq_n_u32(0);
+    uint32x4_t g = vdupq_n_u32(0);
+    uint32x4_t b = vdupq_n_u32(0);
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t v = vld1q_u32(pixels + i);
+        b = vaddq_u32(b, vandq_u32(v, mask));
+        g = vaddq_u32(g, vandq_u32(vshrq_n_u32(v, 8), mask));
+        r = vaddq_u32(r, vandq_u32(vshrq_n_u32(v, 16), mask));
+    }
+    quint32 lanes[3][4];
+    vst1q_u32(lanes[0], r);
+    vst1q_u32(lanes[1], g);
+    vst1q_u32(lanes[2], b);
+    red = lanes[0][0] + lanes[0][1] + lanes[0][2] + lanes[0][3];
+    green = lanes[1][0] + lanes[1][1] + lanes[1][2] + lanes[1][3];
+    blue = lanes[2][0] + lanes[2][1] + lanes[2][2] + lanes[2][3];
+#endif
+
+    for (; i < count; ++i) {
+        red += qRed(pixels[i]);
+        green += qGreen(pixels[i]);
+        blue += qBlue(pixels[i]);
+    }
+
+    sums[0] = red;
+    sums[1] = green;
+    sums[2] = blue;
+}
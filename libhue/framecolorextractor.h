@@ -0,0 +1,128 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef FRAMECOLOREXTRACTOR_H
+#define FRAMECOLOREXTRACTOR_H
+
+#include <QObject>
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QPointer>
+#include <QRectF>
+#include <QRgb>
+#include <QVector>
+#include <QElapsedTimer>
+
+class EffectsEngine;
+class StreamingEngine;
+
+// Computes one colour per light from video frames or images, for lighting that follows
+// what's on screen. Each light is mapped to a region of the frame, given in coordinates
+// relative to the frame size. Only every sampleStep-th row is read, rows are summed with
+// SIMD where available. The results are smoothed over time and handed to an EffectsEngine,
+// which sends them within the bridge's command budget, or to a StreamingEngine.
+class FrameColorExtractor: public QObject
+{
+    Q_OBJECT
+    Q_ENUMS(Mode)
+
+    Q_PROPERTY(Mode mode READ mode WRITE setMode NOTIFY modeChanged)
+    Q_PROPERTY(int smoothingTime READ smoothingTime WRITE setSmoothingTime NOTIFY smoothingTimeChanged)
+    Q_PROPERTY(int sampleStep READ sampleStep WRITE setSampleStep NOTIFY sampleStepChanged)
+    Q_PROPERTY(EffectsEngine *engine READ engine WRITE setEngine NOTIFY engineChanged)
+    Q_PROPERTY(StreamingEngine *streamingEngine READ streamingEngine WRITE setStreamingEngine NOTIFY streamingEngineChanged)
+
+public:
+    enum Mode {
+        ModeAverage,
+        // The most common colour in the region, ignoring black. Falls back to the average
+        // for regions which are (nearly) black.
+        ModeDominant
+    };
+
+    FrameColorExtractor(QObject *parent = 0);
+
+    Mode mode() const;
+    void setMode(Mode mode);
+
+    // Time constant of the smoothing in ms, 0 disables it
+    int smoothingTime() const;
+    void setSmoothingTime(int smoothingTime);
+
+    int sampleStep() const;
+    void setSampleStep(int sampleStep);
+
+    EffectsEngine *engine() const;
+    void setEngine(EffectsEngine *engine);
+
+    // Takes precedence over engine if both are set
+    StreamingEngine *streamingEngine() const;
+    void setStreamingEngine(StreamingEngine *streamingEngine);
+
+    Q_INVOKABLE void setRegion(int lightId, const QRectF &region);
+    Q_INVOKABLE void removeRegion(int lightId);
+    Q_INVOKABLE void clearRegions();
+    QList<int> lightIds() const;
+
+    Q_INVOKABLE QColor color(int lightId) const;
+
+    // Pixels are expected in QImage::Format_RGB32 layout, i.e. one 0xffRRGGBB word per pixel.
+    void processFrame(const uchar *data, int width, int height, int bytesPerLine);
+    void processImage(const QImage &image);
+    // Mostly meant for testing region mappings with still images
+    Q_INVOKABLE bool processFile(const QString &fileName);
+
+    // Forgets the smoothed colours, e.g. after a scene cut
+    Q_INVOKABLE void reset();
+
+signals:
+    void modeChanged();
+    void smoothingTimeChanged();
+    void sampleStepChanged();
+    void engineChanged();
+    void streamingEngineChanged();
+    void colorsChanged();
+
+private:
+    class Region
+    {
+    public:
+        Region(): valid(false) { color[0] = color[1] = color[2] = 0; }
+        QRectF rect;
+        bool valid;
+        float color[3];
+    };
+
+    bool extract(const uchar *data, int bytesPerLine, int x0, int x1, int y0, int y1, float *color);
+    static void sumRow(const QRgb *pixels, int count, quint32 *sums);
+
+    Mode m_mode;
+    int m_smoothingTime;
+    int m_sampleStep;
+    QPointer<EffectsEngine> m_engine;
+    QPointer<StreamingEngine> m_streamingEngine;
+
+    QHash<int, Region> m_regions;
+    QElapsedTimer m_lastFrame;
+    // Scratch space for ModeDominant
+    QVector<quint32> m_histogram;
+};
+
+#endif
@@ -19,11 +19,11 @@
 
 #include "group.h"
 #include "huebridgeconnection.h"
+#include "colorconversion.h"
 
 #include <QColor>
 #include <QDebug>
 #include <qabstractitemmodel.h>
-#include <QGenericMatrix>
 
 Group::Group(int id, const QString &name, QObject *parent)
     : LightInterface(parent)
@@ -119,62 +119,26 @@ void Group::setSat(quint8 sat)
 
 QColor Group::color() const
 {
+    if (m_colormode == ColorModeXY) {
+        return ColorConversion::xyToRgb(m_xy);
+    }
     return QColor::fromHsv(hue() * 360 / 65535, sat(), 255);
 }
 
 void Group::setColor(const QColor &color)
 {
-    // Transform from RGB to Hue/Sat
-    quint16 hue = color.hue() * 65535 / 360;
-    quint8 sat = color.saturation();
-
-    // Transform from RGB to XYZ
-    QGenericMatrix<3, 3, qreal> rgb2xyzMatrix;
-    rgb2xyzMatrix(0, 0) = 0.412453;    rgb2xyzMatrix(0, 1) = 0.357580;    rgb2xyzMatrix(0, 2) = 0.180423;
-    rgb2xyzMatrix(1, 0) = 0.212671;    rgb2xyzMatrix(1, 1) = 0.715160;    rgb2xyzMatrix(1, 2) = 0.072169;
-    rgb2xyzMatrix(2, 0) = 0.019334;    rgb2xyzMatrix(2, 1) = 0.119193;    rgb2xyzMatrix(2, 2) = 0.950227;
-
-    QGenericMatrix<1, 3, qreal> rgbMatrix;
-    rgbMatrix(0, 0) = 1.0 * color.red() / 255;
-    rgbMatrix(1, 0) = 1.0 * color.green() / 255;
-    rgbMatrix(2, 0) = 1.0 * color.blue() / 255;
-
-    QGenericMatrix<1, 3, qreal> xyzMatrix = rgb2xyzMatrix * rgbMatrix;
-
-    // transform from XYZ to CIELUV u' and v'
-    qreal u = 4*xyzMatrix(0, 0) / (xyzMatrix(0, 0) + 15*xyzMatrix(1, 0) + 3*xyzMatrix(2, 0));
-    qreal v = 9*xyzMatrix(1, 0) / (xyzMatrix(0, 0) + 15*xyzMatrix(1, 0) + 3*xyzMatrix(2, 0));
-
-    // Transform from CIELUV to (x,y)
-    qreal x = 27*u / (18*u - 48*v + 36);
-    qreal y = 12*v / (18*u - 48*v + 36);
-
-    qDebug() << "setting color" << color << x << y;
-    if (m_busyStateChangeId == -1) {
-        QVariantMap params;
-
-        params.insert("hue", hue);
-        params.insert("sat", sat);
-        // FIXME: There is a bug in the API that it doesn't report back the set state of "sat"
-        // Lets just assume it always succeeds
-        m_sat = sat;
-
-//        QVariantList xyList;
-//        xyList << x << y;
-//        params.insert("xy", xyList);
-
+    qDebug() << "setting color" << color << "busy:" << m_busyStateChangeId;
+    setXy(ColorConversion::rgbToXy(color, ColorConversion::gamutForGroup(m_id)));
+}
 
-        params.insert("on", true);
-        m_busyStateChangeId = HueBridgeConnection::instance()->put("groups/" + QString::number(m_id) + "/action", params, this, "setStateFinished");
-        m_timeout.start();
-    } else {
-        m_dirtyHue = hue;
-        m_hueDirty = true;
-        m_dirtySat = sat;
-        m_satDirty = true;
-//        m_xyDirty = true;
-//        m_dirtyXy = QPointF(x, y);
-    }
+void Group::setXyDirty(const QPointF &xy)
+{
+    // The latest colour wins over colours set in another mode meanwhile
+    m_hueDirty = false;
+    m_satDirty = false;
+    m_ctDirty = false;
+    m_xyDirty = true;
+    m_dirtyXy = xy;
 }
 
 QPointF Group::xy() const
@@ -184,9 +148,15 @@ QPointF Group::xy() const
 
 void Group::setXy(const QPointF &xy)
 {
-    if (m_xy != xy) {
-        m_xy = xy;
-        emit stateChanged();
+    QPointF clamped = ColorConversion::clampToGamut(xy, ColorConversion::gamutForGroup(m_id));
+    if (m_busyStateChangeId == -1) {
+        QVariantMap params;
+        params.insert("xy", ColorConversion::xyToVariant(clamped));
+        params.insert("on", true);
+        m_busyStateChangeId = HueBridgeConnection::instance()->put("groups/" + QString::number(m_id) + "/action", params, this, "setStateFinished");
+        m_timeout.start();
+    } else {
+        setXyDirty(clamped);
     }
 }
 
@@ -206,6 +176,9 @@ void Group::setCt(quint16 ct)
     } else {
         m_dirtyCt = ct;
         m_ctDirty = true;
+        m_hueDirty = false;
+        m_satDirty = false;
+        m_xyDirty = false;
     }
 }
 
@@ -243,6 +216,35 @@ void Group::setEffect(const QString &effect)
     }
 }
 
+void Group::setState(const QVariantMap &state, int transitionTime)
+{
+    QVariantMap params = stateParams(state, transitionTime, ColorConversion::gamutForGroup(m_id));
+    HueBridgeConnection::instance()->put("groups/" + QString::number(m_id) + "/action", params, this, "setStateFinished");
+}
+
+void Group::adjustBri(int delta, int transitionTime)
+{
+    HueBridgeConnection::instance()->put("groups/" + QString::number(m_id) + "/action", incrementParams("bri", delta, transitionTime), this, "setStateFinished");
+}
+
+void Group::adjustCt(int delta, int transitionTime)
+{
+    HueBridgeConnection::instance()->put("groups/" + QString::number(m_id) + "/action", incrementParams("ct", delta, transitionTime), this, "setStateFinished");
+}
+
+void Group::adjustHue(int delta, int transitionTime)
+{
+    HueBridgeConnection::instance()->put("groups/" + QString::number(m_id) + "/action", incrementParams("hue", delta, transitionTime), this, "setStateFinished");
+}
+
+void Group::stopTransition()
+{
+    // An increment of 0 stops ongoing transitions. The bridge only reports the increment
+    // back, so fetch where the light actually ended up.
+    HueBridgeConnection::instance()->put("groups/" + QString::number(m_id) + "/action", incrementParams("bri", 0, 0), this, "setStateFinished");
+    refresh();
+}
+
 LightInterface::ColorMode Group::colorMode() const
 {
     return m_colormode;
@@ -265,7 +267,7 @@ bool Group::isGroup() const
 
 void Group::refresh()
 {
-    HueBridgeConnection::instance()->get("groups/" + QString::number(m_id), this, "responseReceived");
+    HueBridgeConnection::instance()->get("groups/" + QString::number(m_id), this, "responseReceived", HueBridgeConnection::PriorityBackground);
 }
 
 void Group::responseReceived(int id, const QVariant &response)
@@ -279,6 +281,7 @@ void Group::responseReceived(int id, const QVariant &response)
     foreach (const QVariant &lightId, lightsMap) {
         m_lightIds << lightId.toUInt();
     }
+    HueBridgeConnection::instance()->setGroupLights(m_id, m_lightIds);
 
     emit lightsChanged();
 
@@ -288,7 +291,7 @@ void Group::responseReceived(int id, const QVariant &response)
     m_hue = action.value("hue").toUInt();
     m_sat = action.value("sat").toUInt();
 
-    m_xy = action.value("xy").toPointF();
+    m_xy = ColorConversion::xyFromVariant(action.value("xy"));
     m_ct = action.value("ct").toInt();
     m_alert = action.value("alert").toString();
     m_effect = action.value("effect").toString();
@@ -308,7 +311,7 @@ void Group::setDescriptionFinished(int id, const QVariant &response)
 {
     Q_UNUSED(id)
     qDebug() << "setDescription finished" << response;
-    QVariantMap result = response.toList().first().toMap();
+    QVariantMap result = response.toList().value(0).toMap();
 
     if (result.contains("success")) {
         QVariantMap successMap = result.value("success").toMap();
@@ -322,10 +325,17 @@ void Group::setDescriptionFinished(int id, const QVariant &response)
 void Group::setStateFinished(int id, const QVariant &response)
 {
     qDebug() << "set state finished" << response;
+    QVariantMap confirmedAction;
     foreach (const QVariant &resultVariant, response.toList()) {
         QVariantMap result = resultVariant.toMap();
         if (result.contains("success")) {
             QVariantMap successMap = result.value("success").toMap();
+            QString actionPrefix = "/groups/" + QString::number(m_id) + "/action/";
+            foreach (const QString &address, successMap.keys()) {
+                if (address.startsWith(actionPrefix)) {
+                    confirmedAction.insert(address.mid(actionPrefix.length()), successMap.value(address));
+                }
+            }
             if (successMap.contains("/groups/" + QString::number(m_id) + "/action/on")) {
                 m_on = successMap.value("/groups/" + QString::number(m_id) + "/action/on").toBool();
             }
@@ -341,7 +351,7 @@ void Group::setStateFinished(int id, const QVariant &response)
                 m_colormode = ColorModeHS;
             }
             if (successMap.contains("/groups/" + QString::number(m_id) + "/action/xy")) {
-                m_xy = successMap.value("/groups/" + QString::number(m_id) + "/action/xy").toPoint();
+                m_xy = ColorConversion::xyFromVariant(successMap.value("/groups/" + QString::number(m_id) + "/action/xy"));
                 m_colormode = ColorModeXY;
             }
             if (successMap.contains("/groups/" + QString::number(m_id) + "/action/ct")) {
@@ -360,10 +370,12 @@ void Group::setStateFinished(int id, const QVariant &response)
     emit stateChanged();
     emit writeOperationFinished();
 
+    HueBridgeConnection::instance()->confirmGroupAction(m_id, confirmedAction);
+
     if (m_busyStateChangeId == id) {
         m_busyStateChangeId = -1;
         m_timeout.stop();
-        if (m_hueDirty || m_satDirty || m_briDirty) {
+        if (m_hueDirty || m_satDirty || m_briDirty || m_ctDirty || m_xyDirty) {
             QVariantMap params;
             params.insert("transitiontime", 0);
             if (m_hueDirty) {
@@ -373,37 +385,27 @@ void Group::setStateFinished(int id, const QVariant &response)
             if (m_satDirty) {
                 params.insert("sat", m_dirtySat);
                 m_satDirty = false;
+                // FIXME: There is a bug in the API that it doesn't report back the set state of "sat"
+                // Lets just assume it always succeeds
+                m_sat = m_dirtySat;
             }
             if (m_briDirty) {
                 params.insert("bri", m_dirtyBri);
                 m_briDirty = false;
             }
-
-            // FIXME: There is a bug in the API that it doesn't report back the set state of "sat"
-            // Lets just assume it always succeeds
-            m_sat = m_dirtySat;
-
-            m_busyStateChangeId = HueBridgeConnection::instance()->put("groups/" + QString::number(m_id) + "/action", params, this, "setStateFinished");
-            m_timeout.start();
-        } else if(m_ctDirty) {
-            QVariantMap params;
-            params.insert("ct", m_dirtyCt);
-            m_ctDirty = false;
+            if (m_ctDirty) {
+                params.insert("ct", m_dirtyCt);
+                m_ctDirty = false;
+            }
+            if (m_xyDirty) {
+                params.insert("xy", ColorConversion::xyToVariant(m_dirtyXy));
+                m_xyDirty = false;
+            }
 
             m_busyStateChangeId = HueBridgeConnection::instance()->put("groups/" + QString::number(m_id) + "/action", params, this, "setStateFinished");
             m_timeout.start();
-        } else if (m_xyDirty) {
-            QVariantMap params;
-            QVariantList xyList;
-            xyList << m_dirtyXy.x() << m_dirtyXy.y();
-            params.insert("xy", xyList);
-            m_xyDirty = false;
-
-            m_busyStateChangeId = HueBridgeConnection::instance()->put("lights/" + QString::number(m_id) + "/state", params, this, "setStateFinished");
-            m_timeout.start();
         }
     }
-
 }
 
 void Group::timeout()
@@ -68,6 +68,11 @@ public slots:
     void setCt(quint16 ct);
     void setAlert(const QString &alert);
     void setEffect(const QString &effect);
+    void setState(const QVariantMap &state, int transitionTime);
+    void adjustBri(int delta, int transitionTime);
+    void adjustCt(int delta, int transitionTime);
+    void adjustHue(int delta, int transitionTime);
+    void stopTransition();
 
 signals:
     void nameChanged();
@@ -81,6 +86,8 @@ private slots:
 
     void timeout();
 private:
+    void setXyDirty(const QPointF &xy);
+
     int m_id;
     QString m_name;
     QList<int> m_lightIds;
@@ -112,7 +112,7 @@ bool Groups::busy() const
 
 void Groups::refresh()
 {
-    HueBridgeConnection::instance()->get("lights", this, "lightsReceived");
+    HueBridgeConnection::instance()->get("lights", this, "lightsReceived", HueBridgeConnection::PriorityBackground);
     m_busy = true;
     emit busyChanged();
 }
@@ -140,6 +140,7 @@ void Groups::groupsReceived(int id, const QVariant &variant)
     }
 
     foreach (Group *group, removedGroups) {
+        HueBridgeConnection::instance()->setGroupLights(group->id(), QList<int>());
         int index = m_list.indexOf(group);
         beginRemoveRows(QModelIndex(), index, index);
         m_list.takeAt(index)->deleteLater();
@@ -164,6 +165,7 @@ void Groups::groupsReceived(int id, const QVariant &variant)
             group->m_lightIds = lightIds;
             emit group->lightsChanged();
         }
+        HueBridgeConnection::instance()->setGroupLights(group->id(), lightIds);
         emit group->stateChanged();
     }
     m_busy = false;
@@ -259,7 +261,7 @@ void Groups::createGroupFinished(int id, const QVariant &response)
     Q_UNUSED(id)
     qDebug() << "got createGroup result" << response;
 
-    QVariantMap result = response.toList().first().toMap();
+    QVariantMap result = response.toList().value(0).toMap();
 
     if (result.contains("success")) {
         QVariantMap successMap = result.value("success").toMap();
@@ -284,7 +286,7 @@ void Groups::deleteGroupFinished(int id, const QVariant &response)
     Q_UNUSED(id)
     qDebug() << "got deleteGroup result" << response;
 
-    QVariantMap result = response.toList().first().toMap();
+    QVariantMap result = response.toList().value(0).toMap();
 
     if (result.contains("success")) {
         QString success = result.value("success").toString();
@@ -308,7 +310,7 @@ void Groups::lightsReceived(int id, const QVariant &variant)
         m_lights.insert(lightId.toInt(), variant.toMap().value(lightId).toMap().value("state").toMap().value("on").toBool());
     }
 
-    HueBridgeConnection::instance()->get("groups", this, "groupsReceived");
+    HueBridgeConnection::instance()->get("groups", this, "groupsReceived", HueBridgeConnection::PriorityBackground);
 }
 
 void Groups::parseStateMap(Group *group, const QVariantMap &stateMap)
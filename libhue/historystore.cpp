@@ -0,0 +1,556 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+
+#include "historystore.h"
+#include "lights.h"
+#include "light.h"
+#include "sensors.h"
+#include "sensor.h"
+
+#include <QDebug>
+
+#include <string.h>
+
+static const quint32 s_magic = 0x48554548; // "HUEH"
+static const quint32 s_version = 1;
+static const int s_maxSeries = 256;
+static const int s_nameSize = 32;
+static const int s_namesOffset = 64;
+static const int s_recordsOffset = s_namesOffset + s_maxSeries * s_nameSize;
+
+HistoryStore::HistoryStore(QObject *parent):
+    QObject(parent),
+    m_capacity(65536),
+    m_map(0),
+    m_header(0)
+{
+    Q_ASSERT(sizeof(Header) == 64);
+    Q_ASSERT(sizeof(Record) == 16);
+}
+
+HistoryStore::~HistoryStore()
+{
+    close();
+}
+
+QString HistoryStore::fileName() const
+{
+    return m_fileName;
+}
+
+void HistoryStore::setFileName(const QString &fileName)
+{
+    if (m_fileName == fileName) {
+        return;
+    }
+    close();
+    m_fileName = fileName;
+    emit fileNameChanged();
+    if (!m_fileName.isEmpty()) {
+        open();
+    }
+    emit countChanged();
+    emit seriesChanged();
+}
+
+int HistoryStore::capacity() const
+{
+    return m_header ? m_header->capacity : m_capacity;
+}
+
+void HistoryStore::setCapacity(int capacity)
+{
+    if (m_capacity == capacity || capacity < 1) {
+        return;
+    }
+    m_capacity = capacity;
+    emit capacityChanged();
+}
+
+int HistoryStore::count() const
+{
+    return m_header ? m_header->count : 0;
+}
+
+QStringList HistoryStore::series() const
+{
+    QStringList series;
+    foreach (const SeriesIndex &index, m_series) {
+        series.append(index.name);
+    }
+    return series;
+}
+
+Lights *HistoryStore::lights() const
+{
+    return m_lights;
+}
+
+void HistoryStore::setLights(Lights *lights)
+{
+    if (m_lights == lights) {
+        return;
+    }
+    if (m_lights) {
+        disconnect(m_lights, 0, this, 0);
+    }
+    m_lights = lights;
+    if (m_lights) {
+        connect(m_lights, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(lightsDataChanged(QModelIndex,QModelIndex)));
+        connect(m_lights, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(lightsInserted(QModelIndex,int,int)));
+        recordLights(0, m_lights->rowCount(QModelIndex()) - 1);
+    }
+    emit lightsChanged();
+}
+
+Sensors *HistoryStore::sensors() const
+{
+    return m_sensors;
+}
+
+void HistoryStore::setSensors(Sensors *sensors)
+{
+    if (m_sensors == sensors) {
+        return;
+    }
+    if (m_sensors) {
+        disconnect(m_sensors, 0, this, 0);
+    }
+    m_sensors = sensors;
+    if (m_sensors) {
+        connect(m_sensors, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(sensorsDataChanged(QModelIndex,QModelIndex)));
+        connect(m_sensors, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(sensorsInserted(QModelIndex,int,int)));
+        recordSensors(0, m_sensors->rowCount(QModelIndex()) - 1);
+    }
+    emit sensorsChanged();
+}
+
+bool HistoryStore::append(const QString &series, qreal value, qint64 time)
+{
+    if (!m_header) {
+        return false;
+    }
+    int id = seriesId(series, true);
+    if (id < 0) {
+        qWarning() << "History: too many series, dropping" << series;
+        return false;
+    }
+    SeriesIndex &index = m_series[id];
+    if (!index.records.isEmpty() && record(index.records.last())->time > time) {
+        qWarning() << "History: sample for" << series << "is older than the last one, dropping";
+        return false;
+    }
+
+    quint32 slot = m_header->head;
+    if (m_header->count == m_header->capacity) {
+        // Give up the oldest record before overwriting it, so a crash in between doesn't
+        // leave the header pointing at a record from the wrong end of the ring
+        const Record *oldest = record(slot);
+        if (oldest->series < m_series.count()) {
+            QList<quint32> &oldestRecords = m_series[oldest->series].records;
+            if (!oldestRecords.isEmpty() && oldestRecords.first() == slot) {
+                oldestRecords.removeFirst();
+            }
+        }
+        m_header->count--;
+    }
+
+    Record newRecord;
+    memset(&newRecord, 0, sizeof(Record));
+    newRecord.time = time;
+    newRecord.series = id;
+    newRecord.value = value;
+    newRecord.checksum = checksum(newRecord);
+    memcpy(record(slot), &newRecord, sizeof(Record));
+
+    index.records.append(slot);
+    m_header->head = (slot + 1) % m_header->capacity;
+    m_header->count++;
+    emit countChanged();
+    return true;
+}
+
+QVector<HistoryStore::Sample> HistoryStore::samples(const QString &series, qint64 from, qint64 to) const
+{
+    QVector<Sample> samples;
+    if (!m_seriesIds.contains(series)) {
+        return samples;
+    }
+    const SeriesIndex &index = m_series.at(m_seriesIds.value(series));
+    for (int i = lowerBound(index, from); i < index.records.count(); ++i) {
+        const Record *r = record(index.records.at(i));
+        if (r->time >= to) {
+            break;
+        }
+        samples.append(Sample(r->time, r->value));
+    }
+    return samples;
+}
+
+QVector<HistoryStore::Sample> HistoryStore::downsample(const QString &series, qint64 from, qint64 to, int buckets) const
+{
+    QVector<Sample> result;
+    if (!m_seriesIds.contains(series) || buckets < 1 || to <= from) {
+        return result;
+    }
+    const SeriesIndex &index = m_series.at(m_seriesIds.value(series));
+    qint64 width = qMax<qint64>(1, (to - from + buckets - 1) / buckets);
+
+    int bucket = -1;
+    qreal sum = 0;
+    int count = 0;
+    for (int i = lowerBound(index, from); i < index.records.count(); ++i) {
+        const Record *r = record(index.records.at(i));
+        if (r->time >= to) {
+            break;
+        }
+        int recordBucket = (r->time - from) / width;
+        if (recordBucket != bucket) {
+            if (count > 0) {
+                result.append(Sample(from + bucket * width + width / 2, sum / count));
+            }
+            bucket = recordBucket;
+            sum = 0;
+            count = 0;
+        }
+        sum += r->value;
+        count++;
+    }
+    if (count > 0) {
+        result.append(Sample(from + bucket * width + width / 2, sum / count));
+    }
+    return result;
+}
+
+qint64 HistoryStore::activeTime(const QString &series, qint64 from, qint64 to) const
+{
+    if (!m_seriesIds.contains(series)) {
+        return 0;
+    }
+    const SeriesIndex &index = m_series.at(m_seriesIds.value(series));
+    // The value isn't known past the last sample
+    to = qMin(to, QDateTime::currentMSecsSinceEpoch());
+
+    // Start with the value at from, i.e. the last sample before it
+    int i = lowerBound(index, from);
+    bool active = i > 0 && record(index.records.at(i - 1))->value != 0;
+    qint64 since = from;
+    qint64 total = 0;
+    for (; i < index.records.count(); ++i) {
+        const Record *r = record(index.records.at(i));
+        if (r->time >= to) {
+            break;
+        }
+        if (active) {
+            total += r->time - since;
+        }
+        active = r->value != 0;
+        since = r->time;
+    }
+    if (active && to > since) {
+        total += to - since;
+    }
+    return total;
+}
+
+QVariantList HistoryStore::history(const QString &series, const QDateTime &from, const QDateTime &to, int maxPoints) const
+{
+    qint64 fromMs = from.toMSecsSinceEpoch();
+    qint64 toMs = to.toMSecsSinceEpoch();
+    QVector<Sample> points = samples(series, fromMs, toMs);
+    if (maxPoints > 0 && points.count() > maxPoints) {
+        points = downsample(series, fromMs, toMs, maxPoints);
+    }
+
+    QVariantList list;
+    foreach (const Sample &sample, points) {
+        QVariantMap point;
+        point.insert("time", QDateTime::fromMSecsSinceEpoch(sample.time));
+        point.insert("value", sample.value);
+        list.append(point);
+    }
+    return list;
+}
+
+qreal HistoryStore::activeSeconds(const QString &series, const QDateTime &from, const QDateTime &to) const
+{
+    return activeTime(series, from.toMSecsSinceEpoch(), to.toMSecsSinceEpoch()) / 1000.0;
+}
+
+void HistoryStore::clear()
+{
+    if (!m_header) {
+        return;
+    }
+    m_header->count = 0;
+    m_header->head = 0;
+    m_header->seriesCount = 0;
+    m_series.clear();
+    m_seriesIds.clear();
+    emit countChanged();
+    emit seriesChanged();
+}
+
+void HistoryStore::lightsDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    recordLights(topLeft.row(), bottomRight.row());
+}
+
+void HistoryStore::lightsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+    recordLights(first, last);
+}
+
+void HistoryStore::sensorsDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    recordSensors(topLeft.row(), bottomRight.row());
+}
+
+void HistoryStore::sensorsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+    recordSensors(first, last);
+}
+
+bool HistoryStore::open()
+{
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "History: cannot open" << m_fileName << m_file.errorString();
+        return false;
+    }
+
+    Header header;
+    bool valid = m_file.read(reinterpret_cast<char*>(&header), sizeof(Header)) == sizeof(Header)
+            && header.magic == s_magic && header.version == s_version && header.capacity > 0
+            && m_file.size() == s_recordsOffset + qint64(header.capacity) * sizeof(Record);
+    if (!valid) {
+        // New or unusable file, start over
+        memset(&header, 0, sizeof(Header));
+        header.magic = s_magic;
+        header.version = s_version;
+        header.capacity = m_capacity;
+        if (!m_file.resize(0) || !m_file.resize(s_recordsOffset + qint64(header.capacity) * sizeof(Record))) {
+            qWarning() << "History: cannot create" << m_fileName << m_file.errorString();
+            m_file.close();
+            return false;
+        }
+        m_file.seek(0);
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        m_file.flush();
+    }
+
+    m_map = m_file.map(0, m_file.size());
+    if (!m_map) {
+        qWarning() << "History: cannot map" << m_fileName << m_file.errorString();
+        m_file.close();
+        return false;
+    }
+    m_header = reinterpret_cast<Header*>(m_map);
+    if (m_header->capacity != quint32(m_capacity)) {
+        m_capacity = m_header->capacity;
+        emit capacityChanged();
+    }
+    load();
+    return true;
+}
+
+void HistoryStore::close()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+    m_file.close();
+    m_map = 0;
+    m_header = 0;
+    m_series.clear();
+    m_seriesIds.clear();
+}
+
+void HistoryStore::load()
+{
+    m_header->seriesCount = qMin<quint32>(m_header->seriesCount, s_maxSeries);
+    m_header->count = qMin(m_header->count, m_header->capacity);
+    m_header->head %= m_header->capacity;
+
+    for (quint32 i = 0; i < m_header->seriesCount; ++i) {
+        const char *name = reinterpret_cast<const char*>(m_map + s_namesOffset + i * s_nameSize);
+        SeriesIndex index;
+        index.name = QString::fromUtf8(name, qstrnlen(name, s_nameSize));
+        m_seriesIds.insert(index.name, m_series.count());
+        m_series.append(index);
+    }
+
+    // Walk the ring from the oldest record. Torn records and records of series whose name
+    // didn't make it to disk are skipped.
+    quint32 oldest = (m_header->head + m_header->capacity - m_header->count) % m_header->capacity;
+    int dropped = 0;
+    for (quint32 i = 0; i < m_header->count; ++i) {
+        quint32 slot = (oldest + i) % m_header->capacity;
+        const Record *r = record(slot);
+        if (r->checksum != checksum(*r) || r->series >= m_series.count()) {
+            dropped++;
+            continue;
+        }
+        SeriesIndex &index = m_series[r->series];
+        if (!index.records.isEmpty() && record(index.records.last())->time > r->time) {
+            dropped++;
+            continue;
+        }
+        index.records.append(slot);
+    }
+    if (dropped > 0) {
+        qWarning() << "History: dropped" << dropped << "damaged records from" << m_fileName;
+    }
+}
+
+int HistoryStore::seriesId(const QString &series, bool create)
+{
+    QHash<QString, int>::const_iterator it = m_seriesIds.constFind(series);
+    if (it != m_seriesIds.constEnd()) {
+        return it.value();
+    }
+    QByteArray name = series.toUtf8();
+    if (!create || m_series.count() >= s_maxSeries || name.length() > s_nameSize) {
+        return -1;
+    }
+
+    // The name is written before it is counted in the header
+    int id = m_series.count();
+    char *slot = reinterpret_cast<char*>(m_map + s_namesOffset + id * s_nameSize);
+    memset(slot, 0, s_nameSize);
+    memcpy(slot, name.constData(), name.length());
+    m_header->seriesCount = id + 1;
+
+    SeriesIndex index;
+    index.name = series;
+    m_series.append(index);
+    m_seriesIds.insert(series, id);
+    emit seriesChanged();
+    return id;
+}
+
+const HistoryStore::Record *HistoryStore::record(quint32 slot) const
+{
+    return reinterpret_cast<const Record*>(m_map + s_recordsOffset + qint64(slot) * sizeof(Record));
+}
+
+HistoryStore::Record *HistoryStore::record(quint32 slot)
+{
+    return reinterpret_cast<Record*>(m_map + s_recordsOffset + qint64(slot) * sizeof(Record));
+}
+
+int HistoryStore::lowerBound(const SeriesIndex &index, qint64 time) const
+{
+    int low = 0;
+    int high = index.records.count();
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (record(index.records.at(mid))->time < time) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void HistoryStore::recordChange(const QString &series, qreal value, qint64 time)
+{
+    if (!m_header) {
+        return;
+    }
+    QHash<QString, int>::const_iterator it = m_seriesIds.constFind(series);
+    if (it != m_seriesIds.constEnd()) {
+        const SeriesIndex &index = m_series.at(it.value());
+        // Values are stored as float, compare what would be stored
+        if (!index.records.isEmpty() && record(index.records.last())->value == float(value)) {
+            return;
+        }
+    }
+    append(series, value, time);
+}
+
+void HistoryStore::recordLights(int first, int last)
+{
+    if (!m_lights || !m_header) {
+        return;
+    }
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (int i = first; i <= last; ++i) {
+        Light *light = m_lights->get(i);
+        if (!light) {
+            continue;
+        }
+        QString prefix = "lights/" + QString::number(light->id()) + "/";
+        // Unreachable lights report their last known state
+        recordChange(prefix + "on", light->on() && light->reachable() ? 1 : 0, now);
+        recordChange(prefix + "bri", light->bri(), now);
+    }
+}
+
+void HistoryStore::recordSensors(int first, int last)
+{
+    if (!m_sensors || !m_header) {
+        return;
+    }
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (int i = first; i <= last; ++i) {
+        Sensor *sensor = m_sensors->get(i);
+        if (!sensor) {
+            continue;
+        }
+        QString prefix = "sensors/" + sensor->id() + "/";
+        switch (sensor->type()) {
+        case Sensor::TypeZLLTemperature:
+        case Sensor::TypeClipTemperature:
+            recordChange(prefix + "temperature", sensor->temperature(), now);
+            break;
+        case Sensor::TypeZLLLightLevel:
+        case Sensor::TypeClipLightLevel:
+            recordChange(prefix + "lightlevel", sensor->lightLevel(), now);
+            break;
+        case Sensor::TypeZLLPresence:
+        case Sensor::TypeClipPresence:
+            recordChange(prefix + "presence", sensor->presence() ? 1 : 0, now);
+            break;
+        case Sensor::TypeDaylight:
+            recordChange(prefix + "daylight", sensor->daylight() ? 1 : 0, now);
+            break;
+        case Sensor::TypeClipGenericStatus:
+            recordChange(prefix + "status", sensor->status(), now);
+            break;
+        case Sensor::TypeClipGenericFlag:
+            recordChange(prefix + "flag", sensor->flag() ? 1 : 0, now);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+quint16 HistoryStore::checksum(const Record &record)
+{
+    Record copy = record;
+    copy.checksum = 0;
+    // A zeroed slot must not pass as valid
+    return qChecksum(reinterpret_cast<const char*>(&copy), sizeof(Record)) ^ 0xa5a5;
+}
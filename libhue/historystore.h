@@ -0,0 +1,172 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QPointer>
+#include <QStringList>
+#include <QVector>
+#include <QVariant>
+#include <QDateTime>
+#include <QModelIndex>
+
+class Lights;
+class Sensors;
+
+// Records the history of light and sensor values for trend charts. Values are kept in a
+// memory-mapped file holding a fixed number of records, once it is full the oldest ones are
+// overwritten, so the file never grows past its initial size. Records are 16 bytes: time,
+// series and value, with a checksum to drop records torn by a crash while writing them. The
+// header is only updated after a record is complete.
+// Each series ("lights/3/on", "sensors/12/temperature", ...) has an in-memory index of its
+// records in time order, range queries are binary searches on it.
+// When lights and sensors models are set, their values are recorded whenever a refresh
+// changes them.
+class HistoryStore: public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString fileName READ fileName WRITE setFileName NOTIFY fileNameChanged)
+    Q_PROPERTY(int capacity READ capacity WRITE setCapacity NOTIFY capacityChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(QStringList series READ series NOTIFY seriesChanged)
+    Q_PROPERTY(Lights *lights READ lights WRITE setLights NOTIFY lightsChanged)
+    Q_PROPERTY(Sensors *sensors READ sensors WRITE setSensors NOTIFY sensorsChanged)
+
+public:
+    class Sample
+    {
+    public:
+        Sample(): time(0), value(0) {}
+        Sample(qint64 time, qreal value): time(time), value(value) {}
+        // ms since epoch
+        qint64 time;
+        qreal value;
+    };
+
+    HistoryStore(QObject *parent = 0);
+    ~HistoryStore();
+
+    QString fileName() const;
+    void setFileName(const QString &fileName);
+
+    // Number of records. Only used when creating the file, an existing file keeps its size.
+    int capacity() const;
+    void setCapacity(int capacity);
+
+    int count() const;
+    QStringList series() const;
+
+    Lights *lights() const;
+    void setLights(Lights *lights);
+    Sensors *sensors() const;
+    void setSensors(Sensors *sensors);
+
+    // Samples need to be appended in time order per series
+    bool append(const QString &series, qreal value, qint64 time);
+
+    QVector<Sample> samples(const QString &series, qint64 from, qint64 to) const;
+    // Averages the samples into at most buckets points
+    QVector<Sample> downsample(const QString &series, qint64 from, qint64 to, int buckets) const;
+    // Time in ms the value was non-zero, e.g. how long a light was on
+    qint64 activeTime(const QString &series, qint64 from, qint64 to) const;
+
+    // List of {time, value} for charts, downsampled to maxPoints if there are more samples
+    Q_INVOKABLE QVariantList history(const QString &series, const QDateTime &from, const QDateTime &to, int maxPoints = 200) const;
+    Q_INVOKABLE qreal activeSeconds(const QString &series, const QDateTime &from, const QDateTime &to) const;
+
+    Q_INVOKABLE void clear();
+
+signals:
+    void fileNameChanged();
+    void capacityChanged();
+    void countChanged();
+    void seriesChanged();
+    void lightsChanged();
+    void sensorsChanged();
+
+private slots:
+    void lightsDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void lightsInserted(const QModelIndex &parent, int first, int last);
+    void sensorsDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void sensorsInserted(const QModelIndex &parent, int first, int last);
+
+private:
+    class Header
+    {
+    public:
+        quint32 magic;
+        quint32 version;
+        quint32 capacity;
+        quint32 seriesCount;
+        // Slot for the next record
+        quint32 head;
+        quint32 count;
+        quint32 reserved[10];
+    };
+
+    class Record
+    {
+    public:
+        qint64 time;
+        quint16 series;
+        quint16 checksum;
+        float value;
+    };
+
+    class SeriesIndex
+    {
+    public:
+        QString name;
+        // Slots of the records, oldest first
+        QList<quint32> records;
+    };
+
+    bool open();
+    void close();
+    void load();
+    int seriesId(const QString &series, bool create);
+    const Record *record(quint32 slot) const;
+    Record *record(quint32 slot);
+    // Index of the first record of the series at or after time
+    int lowerBound(const SeriesIndex &index, qint64 time) const;
+    // Only appends if the value differs from the last one of the series
+    void recordChange(const QString &series, qreal value, qint64 time);
+    void recordLights(int first, int last);
+    void recordSensors(int first, int last);
+
+    static quint16 checksum(const Record &record);
+
+    QString m_fileName;
+    int m_capacity;
+    QFile m_file;
+    uchar *m_map;
+    Header *m_header;
+    QVector<SeriesIndex> m_series;
+    QHash<QString, int> m_seriesIds;
+
+    QPointer<Lights> m_lights;
+    QPointer<Sensors> m_sensors;
+};
+
+#endif
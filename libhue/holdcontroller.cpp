@@ -0,0 +1,139 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "holdcontroller.h"
+
+HoldController::HoldController(QObject *parent):
+    QObject(parent),
+    m_attribute(AttributeBrightness),
+    m_speed(100),
+    m_direction(0)
+{
+    m_timer.setInterval(500);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(adjust()));
+}
+
+LightInterface *HoldController::target() const
+{
+    return m_target;
+}
+
+void HoldController::setTarget(LightInterface *target)
+{
+    if (m_target != target) {
+        release();
+        m_target = target;
+        emit targetChanged();
+    }
+}
+
+HoldController::Attribute HoldController::attribute() const
+{
+    return m_attribute;
+}
+
+void HoldController::setAttribute(HoldController::Attribute attribute)
+{
+    if (m_attribute != attribute) {
+        release();
+        m_attribute = attribute;
+        emit attributeChanged();
+    }
+}
+
+int HoldController::speed() const
+{
+    return m_speed;
+}
+
+void HoldController::setSpeed(int speed)
+{
+    if (m_speed != speed) {
+        m_speed = speed;
+        emit speedChanged();
+    }
+}
+
+int HoldController::interval() const
+{
+    return m_timer.interval();
+}
+
+void HoldController::setInterval(int interval)
+{
+    // Transition times have a resolution of 100 ms
+    interval = qMax(100, interval / 100 * 100);
+    if (m_timer.interval() != interval) {
+        m_timer.setInterval(interval);
+        emit intervalChanged();
+    }
+}
+
+bool HoldController::holding() const
+{
+    return m_direction != 0;
+}
+
+void HoldController::press(int direction)
+{
+    if (!m_target || direction == 0) {
+        return;
+    }
+    bool wasHolding = holding();
+    m_direction = direction > 0 ? 1 : -1;
+    adjust();
+    m_timer.start();
+    if (!wasHolding) {
+        emit holdingChanged();
+    }
+}
+
+void HoldController::release()
+{
+    if (!holding()) {
+        return;
+    }
+    m_timer.stop();
+    m_direction = 0;
+    if (m_target) {
+        m_target->stopTransition();
+    }
+    emit holdingChanged();
+}
+
+void HoldController::adjust()
+{
+    if (!m_target) {
+        release();
+        return;
+    }
+
+    int delta = m_direction * m_speed * m_timer.interval() / 1000;
+    switch (m_attribute) {
+    case AttributeBrightness:
+        m_target->adjustBri(delta, m_timer.interval());
+        break;
+    case AttributeColorTemperature:
+        m_target->adjustCt(delta, m_timer.interval());
+        break;
+    case AttributeHue:
+        m_target->adjustHue(delta, m_timer.interval());
+        break;
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef HOLDCONTROLLER_H
+#define HOLDCONTROLLER_H
+
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+#include "lightinterface.h"
+
+// Press-and-hold adjustments. While held, one relative change is sent per interval, with
+// a transition time covering the interval, so the bulbs move smoothly on their own no
+// matter how long the bridge takes to answer. Releasing stops the transition.
+class HoldController: public QObject
+{
+    Q_OBJECT
+    Q_ENUMS(Attribute)
+
+    Q_PROPERTY(LightInterface *target READ target WRITE setTarget NOTIFY targetChanged)
+    Q_PROPERTY(Attribute attribute READ attribute WRITE setAttribute NOTIFY attributeChanged)
+    Q_PROPERTY(int speed READ speed WRITE setSpeed NOTIFY speedChanged)
+    Q_PROPERTY(int interval READ interval WRITE setInterval NOTIFY intervalChanged)
+    Q_PROPERTY(bool holding READ holding NOTIFY holdingChanged)
+
+public:
+    enum Attribute {
+        AttributeBrightness,
+        AttributeColorTemperature,
+        AttributeHue
+    };
+
+    HoldController(QObject *parent = 0);
+
+    LightInterface *target() const;
+    void setTarget(LightInterface *target);
+
+    Attribute attribute() const;
+    void setAttribute(Attribute attribute);
+
+    // Change per second while held, in units of the attribute
+    int speed() const;
+    void setSpeed(int speed);
+
+    // Time between two adjustments in ms
+    int interval() const;
+    void setInterval(int interval);
+
+    bool holding() const;
+
+public slots:
+    // direction > 0 increases, < 0 decreases
+    void press(int direction);
+    void release();
+
+signals:
+    void targetChanged();
+    void attributeChanged();
+    void speedChanged();
+    void intervalChanged();
+    void holdingChanged();
+
+private slots:
+    void adjust();
+
+private:
+    QPointer<LightInterface> m_target;
+    Attribute m_attribute;
+    int m_speed;
+    int m_direction;
+    QTimer m_timer;
+};
+
+#endif
@@ -26,6 +26,7 @@
 #include <QNetworkReply>
 #include <QUrl>
 #include <QDebug>
+#include <QMetaEnum>
 #if QT_VERSION >= 0x050000
 #include <QJsonDocument>
 #else
@@ -35,6 +36,49 @@
 
 HueBridgeConnection *HueBridgeConnection::s_instance = 0;
 
+// Keep the queue on our side so unsent requests can still be merged or dropped
+static const int s_maxRequestsInFlight = 3;
+// Background requests wait until there was no interactive request for this long (ms)
+static const int s_interactiveQuietPeriod = 1000;
+// Requests which didn't finish after this time are aborted (ms)
+static const int s_requestTimeout = 8000;
+// Idempotent requests are retried this often, waiting s_retryBaseDelay * 2^n plus jitter (ms)
+static const int s_maxRetries = 3;
+static const int s_retryBaseDelay = 250;
+// Bounds for the pacing applied while the bridge is overloaded (ms)
+static const int s_minPacingInterval = 50;
+static const int s_maxPacingInterval = 1000;
+// While unreachable, the bridge is probed this often (ms)
+static const int s_reachabilityProbeInterval = 5000;
+// Replayed offline writes are fed into the request queue at this rate (ms)
+static const int s_offlineReplayInterval = 100;
+
+static QByteArray serialize(const QVariantMap &params)
+{
+#if QT_VERSION >= 0x050000
+    QJsonDocument jsonDoc = QJsonDocument::fromVariant(params);
+    return jsonDoc.toJson(QJsonDocument::Compact);
+#else
+    QJson::Serializer serializer;
+    return serializer.serialize(params);
+#endif
+}
+
+QString HueBridgeConnection::methodName(Operation operation)
+{
+    switch (operation) {
+    case OperationGet:
+        return "GET";
+    case OperationPut:
+        return "PUT";
+    case OperationPost:
+        return "POST";
+    case OperationDelete:
+        return "DELETE";
+    }
+    return QString();
+}
+
 HueBridgeConnection *HueBridgeConnection::instance()
 {
     if (!s_instance) {
@@ -59,6 +103,7 @@ void HueBridgeConnection::setApiKey(const QString &apiKey)
         m_apiKey = apiKey;
         m_baseApiUrl = "http://" + m_bridge.toString() + "/api/" + m_apiKey + "/";
         emit apiKeyChanged();
+        startOfflineReplay();
     }
 }
 
@@ -86,8 +131,29 @@ HueBridgeConnection::HueBridgeConnection():
     m_nam(new QNetworkAccessManager(this)),
     m_discoveryError(false),
     m_bridgeStatus(BridgeStatusSearching),
-    m_requestCounter(0)
+    m_requestCounter(0),
+    m_sendDeadline(0),
+    m_pacingInterval(0),
+    m_latency(0),
+    m_bridgeReachable(true),
+    m_offlineWriteQueue(new OfflineWriteQueue(this))
 {
+    connect(m_offlineWriteQueue, SIGNAL(countChanged()), this, SIGNAL(pendingOfflineWritesChanged()));
+
+    m_reachabilityProbeTimer.setInterval(s_reachabilityProbeInterval);
+    connect(&m_reachabilityProbeTimer, SIGNAL(timeout()), this, SLOT(probeReachability()));
+
+    m_offlineReplayTimer.setInterval(s_offlineReplayInterval);
+    connect(&m_offlineReplayTimer, SIGNAL(timeout()), this, SLOT(replayOfflineWrite()));
+
+    m_clock.start();
+
+    m_sendTimer.setSingleShot(true);
+    connect(&m_sendTimer, SIGNAL(timeout()), this, SLOT(sendQueuedRequests()));
+
+    m_timeoutTimer.setInterval(1000);
+    connect(&m_timeoutTimer, SIGNAL(timeout()), this, SLOT(checkRequestTimeouts()));
+
     m_discovery = new Discovery(this);
     connect(m_discovery, SIGNAL(error()), this, SLOT(onDiscoveryError()));
     connect(m_discovery, SIGNAL(foundBridge(QHostAddress, QString)), this, SLOT(onFoundBridge(QHostAddress, QString)));
@@ -111,8 +177,11 @@ void HueBridgeConnection::onFoundBridge(QHostAddress bridge, QString bridgeid)
 
     qDebug() << Q_FUNC_INFO << "Found bridge : " << m_bridge.toString() << " with id: " << bridgeid;
 
+    m_offlineWriteQueue->setBridgeId(bridgeid);
+
     if (!m_apiKey.isEmpty()) {
         m_baseApiUrl = "http://" + m_bridge.toString() + "/api/" + m_apiKey + "/";
+        startOfflineReplay();
     }
 
     // Emitting this after we know if we can connect or not to avoid the ui triggering connect dialogs
@@ -176,98 +245,616 @@ void HueBridgeConnection::createUser(const QString &devicetype)
     connect(reply, SIGNAL(finished()), this, SLOT(createUserFinished()));
 }
 
-int HueBridgeConnection::get(const QString &path, QObject *sender, const QString &slot)
+int HueBridgeConnection::get(const QString &path, QObject *sender, const QString &slot, RequestPriority priority)
 {
     if (m_baseApiUrl.isEmpty()) {
         qWarning() << "Not authenticated to bridge, cannot get" << path;
         return -1;
     }
-    QUrl url(m_baseApiUrl + path);
-    QNetworkRequest request;
-    request.setUrl(url);
-    QNetworkReply *reply = m_nam->get(request);
-    connect(reply, SIGNAL(finished()), this, SLOT(slotOpFinished()));
-    m_requestIdMap.insert(reply, m_requestCounter);
-    CallbackObject co(sender, slot);
-    m_requestSenderMap.insert(m_requestCounter, co);
-    return m_requestCounter++;
+    return enqueueRequest(OperationGet, path, QVariantMap(), sender, slot, priority);
 }
 
-int HueBridgeConnection::deleteResource(const QString &path, QObject *sender, const QString &slot)
+int HueBridgeConnection::deleteResource(const QString &path, QObject *sender, const QString &slot, RequestPriority priority)
 {
-    if (m_baseApiUrl.isEmpty()) {
-        qWarning() << "Not authenticated to bridge, cannot delete" << path;
-        return -1;
+    return enqueueRequest(OperationDelete, path, QVariantMap(), sender, slot, priority);
+}
+
+int HueBridgeConnection::post(const QString &path, const QVariantMap &params, QObject *sender, const QString &slot, RequestPriority priority)
+{
+    return enqueueRequest(OperationPost, path, params, sender, slot, priority);
+}
+
+int HueBridgeConnection::put(const QString &path, const QVariantMap &params, QObject *sender, const QString &slot, RequestPriority priority)
+{
+    return enqueueRequest(OperationPut, path, params, sender, slot, priority);
+}
+
+bool HueBridgeConnection::cancel(int requestId)
+{
+    if (!m_requestSenderMap.contains(requestId)) {
+        return false;
     }
-    QUrl url(m_baseApiUrl + path);
-    QNetworkRequest request;
-    request.setUrl(url);
-    QNetworkReply *reply = m_nam->deleteResource(request);
-    connect(reply, SIGNAL(finished()), this, SLOT(slotOpFinished()));
-    m_requestIdMap.insert(reply, m_requestCounter);
-    m_writeOperationList.append(reply);
+    m_requestSenderMap.remove(requestId);
+
+    if (m_offlineWriteQueue->cancel(requestId)) {
+        return true;
+    }
+
+    for (int i = 0; i < m_requestQueue.count(); ++i) {
+        if (m_requestQueue.at(i).requestIds.contains(requestId)) {
+            m_requestQueue[i].requestIds.removeAll(requestId);
+            if (m_requestQueue.at(i).requestIds.isEmpty()) {
+                m_requestQueue.removeAt(i);
+            }
+            return true;
+        }
+    }
+
+    // Already sent out. Reads nobody waits for anymore can be aborted, writes are left alone.
+    dropOrphanedRequests();
+    return true;
+}
+
+int HueBridgeConnection::enqueueRequest(Operation operation, const QString &path, const QVariantMap &params, QObject *sender, const QString &slot, RequestPriority priority)
+{
+    int requestId = m_requestCounter++;
     CallbackObject co(sender, slot);
-    m_requestSenderMap.insert(m_requestCounter, co);
-    return m_requestCounter++;
+    m_requestSenderMap.insert(requestId, co);
+    if (sender) {
+        connect(sender, SIGNAL(destroyed()), this, SLOT(dropOrphanedRequests()),
+                static_cast<Qt::ConnectionType>(Qt::QueuedConnection | Qt::UniqueConnection));
+    }
+
+    if (priority == PriorityInteractive) {
+        m_lastInteractiveRequest.start();
+    }
+
+    // Keep writes while we can't deliver them. Also while a replay is still going on, so
+    // they don't overtake older writes.
+    if (operation != OperationGet && (m_baseApiUrl.isEmpty() || !m_bridgeReachable || !m_offlineWriteQueue->isEmpty())) {
+        qDebug() << "Bridge not available, queueing" << methodName(operation) << path;
+        enqueueOfflineWrite(operation, path, params, requestId);
+        return requestId;
+    }
+
+    QueuedRequest request;
+    request.operation = operation;
+    request.priority = priority;
+    request.path = path;
+    request.params = params;
+    request.requestIds.append(requestId);
+    request.attempts = 0;
+    request.notBefore = 0;
+    request.sentAt = 0;
+    queueRequest(request);
+
+    sendQueuedRequests();
+    return requestId;
 }
 
-int HueBridgeConnection::post(const QString &path, const QVariantMap &params, QObject *sender, const QString &slot)
+void HueBridgeConnection::queueRequest(const QueuedRequest &request)
 {
-    if (m_baseApiUrl.isEmpty()) {
-        qWarning() << "Not authenticated to bridge, cannot post" << path;
-        return -1;
+    // A request for the same resource which is still waiting in the queue absorbs this one.
+    // POSTs create new resources and are never merged.
+    bool merged = false;
+    if (request.operation != OperationPost) {
+        for (int i = 0; i < m_requestQueue.count(); ++i) {
+            QueuedRequest &queued = m_requestQueue[i];
+            if (queued.operation != request.operation || queued.path != request.path) {
+                continue;
+            }
+            if (request.operation == OperationPut) {
+                // Attributes only present in the older write are kept
+                OfflineWriteQueue::mergeParams(&queued.params, request.params);
+            }
+            queued.priority = qMin(queued.priority, request.priority);
+            queued.requestIds.append(request.requestIds);
+            merged = true;
+            break;
+        }
     }
 
-    QUrl url(m_baseApiUrl + path);
-    QNetworkRequest request;
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-    request.setUrl(url);
+    if (!merged) {
+        m_requestQueue.append(request);
+    }
 
-#if QT_VERSION >= 0x050000
-    QJsonDocument jsonDoc = QJsonDocument::fromVariant(params);
-    QByteArray data = jsonDoc.toJson(QJsonDocument::Compact);
-#else
-    QJson::Serializer serializer;
-    QByteArray data = serializer.serialize(params);
-#endif
+    if (request.priority == PriorityInteractive && m_runningRequests.count() >= s_maxRequestsInFlight) {
+        preemptBackgroundRequest();
+    }
+}
 
-    qDebug() << "posting" << jsonDoc.toJson()<< "\nto" << request.url() << "\n" << data;
-    QNetworkReply *reply = m_nam->post(request, data);
-    connect(reply, SIGNAL(finished()), this, SLOT(slotOpFinished()));
-    m_requestIdMap.insert(reply, m_requestCounter);
-    m_writeOperationList.append(reply);
-    CallbackObject co(sender, slot);
-    m_requestSenderMap.insert(m_requestCounter, co);
-    return m_requestCounter++;
+bool HueBridgeConnection::bridgeReachable() const
+{
+    return m_bridgeReachable;
 }
 
-int HueBridgeConnection::put(const QString &path, const QVariantMap &params, QObject *sender, const QString &slot)
+int HueBridgeConnection::pendingOfflineWrites() const
+{
+    return m_offlineWriteQueue->count();
+}
+
+int HueBridgeConnection::latency() const
+{
+    return qRound(m_latency);
+}
+
+void HueBridgeConnection::updateLatency(qint64 roundTrip)
+{
+    int oldLatency = latency();
+    if (m_latency == 0) {
+        m_latency = roundTrip;
+    } else {
+        m_latency += 0.2 * (roundTrip - m_latency);
+    }
+    if (latency() != oldLatency) {
+        emit latencyChanged();
+    }
+}
+
+void HueBridgeConnection::setBridgeReachable(bool reachable)
+{
+    if (m_bridgeReachable == reachable) {
+        return;
+    }
+    m_bridgeReachable = reachable;
+    emit bridgeReachableChanged();
+
+    if (reachable) {
+        qDebug() << "Bridge reachable again," << m_offlineWriteQueue->count() << "offline writes to replay";
+        m_reachabilityProbeTimer.stop();
+        startOfflineReplay();
+        return;
+    }
+
+    qWarning() << "Bridge unreachable, keeping writes until it is back";
+    m_offlineReplayTimer.stop();
+    m_reachabilityProbeTimer.start();
+
+    // Writes which haven't been sent yet would only run into the same problem
+    for (int i = 0; i < m_requestQueue.count(); ++i) {
+        if (m_requestQueue.at(i).operation == OperationGet) {
+            continue;
+        }
+        QueuedRequest request = m_requestQueue.takeAt(i--);
+        enqueueOfflineWrite(request.operation, request.path, request.params, request.requestIds.first());
+        for (int j = 1; j < request.requestIds.count(); ++j) {
+            // Merged requests: the first id took the write, the others just wait for the reply
+            enqueueOfflineWrite(request.operation, request.path, QVariantMap(), request.requestIds.at(j));
+        }
+    }
+}
+
+void HueBridgeConnection::enqueueOfflineWrite(Operation operation, const QString &path, const QVariantMap &params, int requestId)
+{
+    // Writes absorbed by a newer one get its reply. Only writes pushed out of a full
+    // queue are lost, their callers must not wait forever.
+    foreach (int droppedRequestId, m_offlineWriteQueue->enqueue(methodName(operation), path, params, requestId)) {
+        failRequest(droppedRequestId, ErrorDropped);
+    }
+}
+
+void HueBridgeConnection::failRequest(int requestId, RequestError error)
+{
+    if (!m_requestSenderMap.contains(requestId)) {
+        return;
+    }
+    CallbackObject co = m_requestSenderMap.take(requestId);
+    emit requestFailed(requestId, error);
+    if (!co.sender().isNull()) {
+        QMetaObject::invokeMethod(co.sender(), co.slot().toLatin1().data(), Qt::QueuedConnection, Q_ARG(int, requestId), Q_ARG(QVariant, QVariant()));
+    }
+}
+
+void HueBridgeConnection::probeReachability()
 {
     if (m_baseApiUrl.isEmpty()) {
-        qWarning() << "Not authenticated to bridge, cannot put" << path;
-        return -1;
+        return;
     }
+    get("config", this, "reachabilityProbeFinished", PriorityBackground);
+}
 
-    QUrl url(m_baseApiUrl + path);
-    QNetworkRequest request;
-    request.setUrl(url);
+void HueBridgeConnection::reachabilityProbeFinished(int id, const QVariant &response)
+{
+    Q_UNUSED(id)
+    Q_UNUSED(response)
+    // Reachability itself is updated in slotOpFinished, like for any other request
+}
 
-#if QT_VERSION >= 0x050000
-    QJsonDocument jsonDoc = QJsonDocument::fromVariant(params);
-    QByteArray data = jsonDoc.toJson();
-#else
-    QJson::Serializer serializer;
-    QByteArray data = serializer.serialize(params);
-#endif
-//    qDebug() << "putting" << url << data;
+void HueBridgeConnection::startOfflineReplay()
+{
+    if (!m_offlineWriteQueue->isEmpty() && !m_baseApiUrl.isEmpty() && m_bridgeReachable && !m_offlineReplayTimer.isActive()) {
+        m_offlineReplayTimer.start();
+    }
+}
 
-    QNetworkReply *reply = m_nam->put(request, data);
-    connect(reply, SIGNAL(finished()), this, SLOT(slotOpFinished()));
-    m_requestIdMap.insert(reply, m_requestCounter);
-    m_writeOperationList.append(reply);
-    CallbackObject co(sender, slot);
-    m_requestSenderMap.insert(m_requestCounter, co);
-    return m_requestCounter++;
+void HueBridgeConnection::replayOfflineWrite()
+{
+    if (m_offlineWriteQueue->isEmpty() || m_baseApiUrl.isEmpty() || !m_bridgeReachable) {
+        m_offlineReplayTimer.stop();
+        return;
+    }
+
+    OfflineWriteQueue::Write write = m_offlineWriteQueue->takeFirst();
+    qDebug() << "replaying offline write" << write.method << write.path << write.params;
+
+    QueuedRequest request;
+    if (write.method == "PUT") {
+        request.operation = OperationPut;
+    } else if (write.method == "POST") {
+        request.operation = OperationPost;
+    } else {
+        request.operation = OperationDelete;
+    }
+    request.priority = PriorityAutomation;
+    request.path = write.path;
+    request.params = write.params;
+    request.requestIds = write.requestIds;
+    request.attempts = 0;
+    request.notBefore = 0;
+    request.sentAt = 0;
+    // Writes restored from disk have no one waiting for them
+    if (request.requestIds.isEmpty()) {
+        int requestId = m_requestCounter++;
+        m_requestSenderMap.insert(requestId, CallbackObject());
+        request.requestIds.append(requestId);
+    }
+    queueRequest(request);
+    sendQueuedRequests();
+}
+
+int HueBridgeConnection::nextQueuedRequest()
+{
+    qint64 now = m_clock.elapsed();
+    qint64 nextRetry = -1;
+    int next = -1;
+    for (int i = 0; i < m_requestQueue.count(); ++i) {
+        const QueuedRequest &request = m_requestQueue.at(i);
+        if (request.notBefore > now) {
+            if (nextRetry == -1 || request.notBefore < nextRetry) {
+                nextRetry = request.notBefore;
+            }
+            continue;
+        }
+        if (next == -1 || request.priority < m_requestQueue.at(next).priority) {
+            next = i;
+            if (request.priority == PriorityInteractive) {
+                break;
+            }
+        }
+    }
+    if (next == -1 && nextRetry != -1) {
+        scheduleSend(nextRetry - now);
+    }
+    return next;
+}
+
+bool HueBridgeConnection::interactiveTrafficActive() const
+{
+    foreach (const QueuedRequest &request, m_runningRequests) {
+        if (request.priority == PriorityInteractive) {
+            return true;
+        }
+    }
+    return m_lastInteractiveRequest.isValid() && m_lastInteractiveRequest.elapsed() < s_interactiveQuietPeriod;
+}
+
+void HueBridgeConnection::preemptBackgroundRequest()
+{
+    // Writes can't be taken back once they're on the wire, but background reads can be
+    // aborted and put back into the queue to free a slot.
+    foreach (QNetworkReply *reply, m_runningRequests.keys()) {
+        if (m_runningRequests.value(reply).priority != PriorityBackground || m_writeOperationList.contains(reply)) {
+            continue;
+        }
+        QueuedRequest request = m_runningRequests.take(reply);
+        disconnect(reply, 0, this, 0);
+        reply->abort();
+        reply->deleteLater();
+        m_requestQueue.prepend(request);
+        return;
+    }
+}
+
+void HueBridgeConnection::sendQueuedRequests()
+{
+    while (m_runningRequests.count() < s_maxRequestsInFlight) {
+        int next = nextQueuedRequest();
+        if (next == -1) {
+            break;
+        }
+
+        if (m_requestQueue.at(next).priority == PriorityBackground && interactiveTrafficActive()) {
+            scheduleSend(s_interactiveQuietPeriod);
+            break;
+        }
+
+        if (m_pacingInterval > 0 && m_lastRequestSent.isValid() && m_lastRequestSent.elapsed() < m_pacingInterval) {
+            scheduleSend(m_pacingInterval - m_lastRequestSent.elapsed());
+            break;
+        }
+
+        QueuedRequest request = m_requestQueue.takeAt(next);
+
+        if (request.operation == OperationGet && !hasSubscribers(request.requestIds)) {
+            foreach (int requestId, request.requestIds) {
+                m_requestSenderMap.remove(requestId);
+            }
+            continue;
+        }
+
+        QNetworkRequest networkRequest;
+        networkRequest.setUrl(QUrl(m_baseApiUrl + request.path));
+
+        QNetworkReply *reply = 0;
+        switch (request.operation) {
+        case OperationGet:
+            reply = m_nam->get(networkRequest);
+            break;
+        case OperationDelete:
+            reply = m_nam->deleteResource(networkRequest);
+            break;
+        case OperationPost:
+            networkRequest.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+            reply = m_nam->post(networkRequest, serialize(request.params));
+            break;
+        case OperationPut:
+            reply = m_nam->put(networkRequest, serialize(request.params));
+            break;
+        }
+
+        connect(reply, SIGNAL(finished()), this, SLOT(slotOpFinished()));
+        request.sentAt = m_clock.elapsed();
+        m_runningRequests.insert(reply, request);
+        if (request.operation != OperationGet) {
+            m_writeOperationList.append(reply);
+        }
+        m_lastRequestSent.start();
+        if (!m_timeoutTimer.isActive()) {
+            m_timeoutTimer.start();
+        }
+    }
+}
+
+void HueBridgeConnection::scheduleSend(int delay)
+{
+    delay = qMax(0, delay);
+    qint64 deadline = m_clock.elapsed() + delay;
+    if (!m_sendTimer.isActive() || m_sendDeadline > deadline) {
+        m_sendDeadline = deadline;
+        m_sendTimer.start(delay);
+    }
+}
+
+void HueBridgeConnection::checkRequestTimeouts()
+{
+    qint64 now = m_clock.elapsed();
+    foreach (QNetworkReply *reply, m_runningRequests.keys()) {
+        if (m_runningRequests.contains(reply) && now - m_runningRequests.value(reply).sentAt > s_requestTimeout) {
+            m_timedOutReplies.append(reply);
+            reply->abort();
+        }
+    }
+    if (m_runningRequests.isEmpty()) {
+        m_timeoutTimer.stop();
+    }
+}
+
+HueBridgeConnection::RequestError HueBridgeConnection::classifyResponse(const QVariant &response)
+{
+    RequestError result = ErrorNone;
+    foreach (const QVariant &entry, response.toList()) {
+        if (!entry.toMap().contains("error")) {
+            continue;
+        }
+
+        RequestError error;
+        switch (entry.toMap().value("error").toMap().value("type").toInt()) {
+        case 1:
+            error = ErrorUnauthorized;
+            break;
+        case 3:
+        case 4:
+            error = ErrorResourceNotAvailable;
+            break;
+        case 2:
+        case 5:
+        case 6:
+        case 7:
+        case 8:
+            error = ErrorInvalidParameter;
+            break;
+        case 101:
+            error = ErrorLinkButtonNotPressed;
+            break;
+        case 201:
+            error = ErrorDeviceOff;
+            break;
+        case 11:
+        case 301:
+        case 302:
+        case 402:
+        case 501:
+        case 601:
+        case 701:
+            error = ErrorTableFull;
+            break;
+        case 901:
+            error = ErrorBridgeInternal;
+            break;
+        default:
+            error = ErrorBridgeOther;
+        }
+        countError(error);
+
+        // An overloaded bridge is what matters most for retrying and pacing
+        if (result == ErrorNone || error == ErrorBridgeInternal) {
+            result = error;
+        }
+    }
+    return result;
+}
+
+bool HueBridgeConnection::shouldRetry(const QueuedRequest &request, RequestError error) const
+{
+    if (error != ErrorTransport && error != ErrorTimeout && error != ErrorBridgeInternal) {
+        return false;
+    }
+    if (request.attempts >= s_maxRetries) {
+        return false;
+    }
+    return isIdempotentWrite(request);
+}
+
+bool HueBridgeConnection::isIdempotentWrite(const QueuedRequest &request) const
+{
+    // The bridge might have applied a write before the reply got lost. Sending it again
+    // would create another resource or apply relative changes (bri_inc and friends) twice.
+    if (request.operation == OperationPost) {
+        return false;
+    }
+    foreach (const QString &key, request.params.keys()) {
+        if (key.endsWith("_inc")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void HueBridgeConnection::retryRequest(QueuedRequest request)
+{
+    request.attempts++;
+    int backoff = s_retryBaseDelay << (request.attempts - 1);
+    request.notBefore = m_clock.elapsed() + backoff + qrand() % backoff;
+
+    // Something newer for the same resource might have been queued meanwhile
+    for (int i = 0; i < m_requestQueue.count(); ++i) {
+        QueuedRequest &queued = m_requestQueue[i];
+        if (queued.operation != request.operation || queued.path != request.path) {
+            continue;
+        }
+        foreach (const QString &key, request.params.keys()) {
+            if (!queued.params.contains(key)) {
+                queued.params.insert(key, request.params.value(key));
+            }
+        }
+        queued.priority = qMin(queued.priority, request.priority);
+        queued.requestIds = request.requestIds + queued.requestIds;
+        return;
+    }
+    m_requestQueue.prepend(request);
+}
+
+void HueBridgeConnection::countError(RequestError error)
+{
+    m_errorCounters[error]++;
+    emit errorCountersChanged();
+}
+
+QVariantMap HueBridgeConnection::errorCounters() const
+{
+    QMetaEnum metaEnum = staticMetaObject.enumerator(staticMetaObject.indexOfEnumerator("RequestError"));
+    QVariantMap counters;
+    foreach (int error, m_errorCounters.keys()) {
+        counters.insert(metaEnum.valueToKey(error), m_errorCounters.value(error));
+    }
+    return counters;
+}
+
+int HueBridgeConnection::errorCount(RequestError error) const
+{
+    return m_errorCounters.value(error);
+}
+
+void HueBridgeConnection::resetErrorCounters()
+{
+    m_errorCounters.clear();
+    emit errorCountersChanged();
+}
+
+bool HueBridgeConnection::hasSubscribers(const QList<int> &requestIds) const
+{
+    foreach (int requestId, requestIds) {
+        if (!m_requestSenderMap.value(requestId).sender().isNull()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HueBridgeConnection::dropOrphanedRequests()
+{
+    for (int i = m_requestQueue.count() - 1; i >= 0; --i) {
+        const QueuedRequest &request = m_requestQueue.at(i);
+        if (request.operation == OperationGet && !hasSubscribers(request.requestIds)) {
+            foreach (int requestId, request.requestIds) {
+                m_requestSenderMap.remove(requestId);
+            }
+            m_requestQueue.removeAt(i);
+        }
+    }
+
+    foreach (QNetworkReply *reply, m_runningRequests.keys()) {
+        if (!m_writeOperationList.contains(reply) && !hasSubscribers(m_runningRequests.value(reply).requestIds)) {
+            reply->abort();
+        }
+    }
+}
+
+void HueBridgeConnection::setGroupLights(int groupId, const QList<int> &lightIds)
+{
+    if (m_groupLights.contains(groupId) && m_groupLights.value(groupId) == lightIds) {
+        return;
+    }
+
+    foreach (int lightId, m_groupLights.value(groupId)) {
+        m_lightGroups[lightId].removeAll(groupId);
+        if (m_lightGroups.value(lightId).isEmpty()) {
+            m_lightGroups.remove(lightId);
+        }
+    }
+
+    m_groupLights.insert(groupId, lightIds);
+    foreach (int lightId, lightIds) {
+        if (!m_lightGroups.value(lightId).contains(groupId)) {
+            m_lightGroups[lightId].append(groupId);
+        }
+    }
+}
+
+QList<int> HueBridgeConnection::groupLights(int groupId) const
+{
+    return m_groupLights.value(groupId);
+}
+
+QList<int> HueBridgeConnection::lightGroups(int lightId) const
+{
+    return m_lightGroups.value(lightId);
+}
+
+void HueBridgeConnection::setLightModelId(int lightId, const QString &modelId)
+{
+    m_lightModelIds.insert(lightId, modelId);
+}
+
+QString HueBridgeConnection::lightModelId(int lightId) const
+{
+    return m_lightModelIds.value(lightId);
+}
+
+void HueBridgeConnection::confirmGroupAction(int groupId, const QVariantMap &action)
+{
+    if (action.isEmpty()) {
+        return;
+    }
+    emit groupActionConfirmed(groupId, m_groupLights.value(groupId), action);
+}
+
+void HueBridgeConnection::confirmLightStates(const QVariantMap &lightStates)
+{
+    if (lightStates.isEmpty()) {
+        return;
+    }
+    emit lightStatesConfirmed(lightStates);
 }
 
 void HueBridgeConnection::createUserFinished()
@@ -315,6 +902,7 @@ void HueBridgeConnection::createUserFinished()
 
     m_baseApiUrl = "http://" + m_bridge.toString() + "/api/" + m_apiKey + "/";
     emit connectedBridgeChanged();
+    startOfflineReplay();
 }
 
 void HueBridgeConnection::checkForUpdateFinished()
@@ -365,37 +953,97 @@ void HueBridgeConnection::slotOpFinished()
     QNetworkReply *reply = static_cast<QNetworkReply*>(sender());
     reply->deleteLater();
 
-    QByteArray response = reply->readAll();
-    int id = m_requestIdMap.take(reply);
-    CallbackObject co = m_requestSenderMap.take(id);
+    QueuedRequest request = m_runningRequests.take(reply);
+    m_writeOperationList.removeAll(reply);
+    bool timedOut = m_timedOutReplies.removeAll(reply) > 0;
 
-    qDebug() << "reply for" << co.sender() << co.slot();
-//    qDebug() << "response" << response;
+    if (reply->error() == QNetworkReply::OperationCanceledError && !timedOut) {
+        foreach (int requestId, request.requestIds) {
+            m_requestSenderMap.remove(requestId);
+        }
+        sendQueuedRequests();
+        return;
+    }
 
+    RequestError requestError = ErrorNone;
     QVariant rsp;
-#if QT_VERSION >= 0x050000
-    QJsonParseError error;
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(response, &error);
-    if (error.error != QJsonParseError::NoError) {
-        qWarning() << "error parsing get response:" << error.errorString() << response;
+    if (timedOut) {
+        qWarning() << "request timed out:" << reply->url();
+        requestError = ErrorTimeout;
+        countError(requestError);
+    } else if (reply->error() != QNetworkReply::NoError) {
+        qWarning() << "network error:" << reply->errorString();
+        requestError = ErrorTransport;
+        countError(requestError);
     } else {
-        rsp = jsonDoc.toVariant();
-    }
+        QByteArray response = reply->readAll();
+//        qDebug() << "response" << response;
+
+#if QT_VERSION >= 0x050000
+        QJsonParseError error;
+        QJsonDocument jsonDoc = QJsonDocument::fromJson(response, &error);
+        if (error.error != QJsonParseError::NoError) {
+            qWarning() << "error parsing get response:" << error.errorString() << response;
+        } else {
+            rsp = jsonDoc.toVariant();
+        }
 #else
-    QJson::Parser parser;
-    bool ok;
-    rsp = parser.parse(response, &ok);
-    if(!ok) {
-        qWarning() << "slotOpFinished: cannot parse response:" << response;
-    }
+        QJson::Parser parser;
+        bool ok;
+        rsp = parser.parse(response, &ok);
+        if(!ok) {
+            qWarning() << "slotOpFinished: cannot parse response:" << response;
+        }
 #endif
+        requestError = classifyResponse(rsp);
+        updateLatency(m_clock.elapsed() - request.sentAt);
+    }
 
-    if (m_writeOperationList.contains(reply)) {
-        m_writeOperationList.removeAll(reply);
+    // Timeouts and internal errors mean the bridge can't keep up. Slow down and recover slowly.
+    if (requestError == ErrorTimeout || requestError == ErrorBridgeInternal) {
+        m_pacingInterval = qBound(s_minPacingInterval, m_pacingInterval * 2, s_maxPacingInterval);
+    } else if (requestError == ErrorNone && m_pacingInterval > 0) {
+        m_pacingInterval /= 2;
+        if (m_pacingInterval < s_minPacingInterval) {
+            m_pacingInterval = 0;
+        }
     }
 
-    if (!co.sender().isNull()) {
-        QMetaObject::invokeMethod(co.sender(), co.slot().toLatin1().data(), Q_ARG(int, id), Q_ARG(QVariant, rsp));
+    if (shouldRetry(request, requestError)) {
+        qDebug() << "retrying" << request.path << "attempt" << request.attempts + 1;
+        retryRequest(request);
+        sendQueuedRequests();
+        return;
     }
-}
 
+    if (requestError == ErrorTransport || requestError == ErrorTimeout) {
+        setBridgeReachable(false);
+        // Keep the write for later, its callers are notified when it is replayed.
+        // Others fail below, they might have reached the bridge already.
+        if (request.operation != OperationGet && isIdempotentWrite(request)) {
+            OfflineWriteQueue::Write write;
+            write.method = methodName(request.operation);
+            write.path = request.path;
+            write.params = request.params;
+            write.requestIds = request.requestIds;
+            m_offlineWriteQueue->prepend(write);
+            sendQueuedRequests();
+            return;
+        }
+    } else {
+        setBridgeReachable(true);
+    }
+
+    foreach (int requestId, request.requestIds) {
+        CallbackObject co = m_requestSenderMap.take(requestId);
+        qDebug() << "reply for" << co.sender() << co.slot();
+        if (requestError != ErrorNone) {
+            emit requestFailed(requestId, requestError);
+        }
+        if (!co.sender().isNull()) {
+            QMetaObject::invokeMethod(co.sender(), co.slot().toLatin1().data(), Q_ARG(int, requestId), Q_ARG(QVariant, rsp));
+        }
+    }
+
+    sendQueuedRequests();
+}
@@ -27,7 +27,10 @@
 #include <QHostAddress>
 #include <QVariantMap>
 #include <QPointer>
+#include <QTimer>
+#include <QElapsedTimer>
 #include "discovery.h"
+#include "offlinewritequeue.h"
 
 class QNetworkAccessManager;
 class QNetworkReply;
@@ -50,6 +53,8 @@ class HueBridgeConnection: public QObject
 {
     Q_OBJECT
     Q_ENUMS(BridgeStatus)
+    Q_ENUMS(RequestPriority)
+    Q_ENUMS(RequestError)
 
     Q_PROPERTY(QString apiKey READ apiKey WRITE setApiKey NOTIFY apiKeyChanged)
     Q_PROPERTY(bool discoveryError READ discoveryError NOTIFY discoveryErrorChanged)
@@ -57,6 +62,10 @@ class HueBridgeConnection: public QObject
     Q_PROPERTY(bool bridgeFound READ bridgeFound NOTIFY bridgeFoundChanged)
     Q_PROPERTY(QString connectedBridge READ connectedBridge NOTIFY connectedBridgeChanged)
     Q_PROPERTY(BridgeStatus status READ status NOTIFY statusChanged)
+    Q_PROPERTY(QVariantMap errorCounters READ errorCounters NOTIFY errorCountersChanged)
+    Q_PROPERTY(bool bridgeReachable READ bridgeReachable NOTIFY bridgeReachableChanged)
+    Q_PROPERTY(int pendingOfflineWrites READ pendingOfflineWrites NOTIFY pendingOfflineWritesChanged)
+    Q_PROPERTY(int latency READ latency NOTIFY latencyChanged)
 
 public:
     enum BridgeStatus {
@@ -66,6 +75,30 @@ public:
         BridgeStatusConnected
     };
 
+    // Queued requests are sent strictly in this order. Background requests are additionally
+    // held back while there is interactive traffic.
+    enum RequestPriority {
+        PriorityInteractive,
+        PriorityAutomation,
+        PriorityBackground
+    };
+
+    // Bridge errors are mapped from the "type" field of the error objects in a reply
+    enum RequestError {
+        ErrorNone,
+        ErrorTransport,
+        ErrorTimeout,
+        ErrorUnauthorized,          // 1
+        ErrorResourceNotAvailable,  // 3, 4
+        ErrorInvalidParameter,      // 2, 5, 6, 7, 8
+        ErrorLinkButtonNotPressed,  // 101
+        ErrorDeviceOff,             // 201
+        ErrorTableFull,             // 11, 301, 302, 402, 501, 601, 701
+        ErrorBridgeInternal,        // 901
+        ErrorBridgeOther,
+        ErrorDropped                // Discarded from the offline queue without being sent
+    };
+
     static HueBridgeConnection* instance();
     Discovery *m_discovery;
 
@@ -83,10 +116,42 @@ public:
 
     Q_INVOKABLE void createUser(const QString &devicetype);
 
-    int get(const QString &path, QObject *sender, const QString &slot);
-    int deleteResource(const QString &path, QObject *sender, const QString &slot);
-    int post(const QString &path, const QVariantMap &params, QObject *sender, const QString &slot);
-    int put(const QString &path, const QVariantMap &params, QObject *sender, const QString &slot);
+    // The returned request id can be used to cancel the request. Requests are queued and
+    // sent out with a limited number in flight. Queued writes to a resource are superseded
+    // by newer writes to the same resource and GETs are dropped once nobody is listening anymore.
+    // Writes issued while the bridge is unreachable are kept in the offline write queue and
+    // replayed once it is back. Their callbacks are invoked when the replayed write finishes.
+    int get(const QString &path, QObject *sender, const QString &slot, RequestPriority priority = PriorityInteractive);
+    int deleteResource(const QString &path, QObject *sender, const QString &slot, RequestPriority priority = PriorityInteractive);
+    int post(const QString &path, const QVariantMap &params, QObject *sender, const QString &slot, RequestPriority priority = PriorityInteractive);
+    int put(const QString &path, const QVariantMap &params, QObject *sender, const QString &slot, RequestPriority priority = PriorityInteractive);
+
+    bool cancel(int requestId);
+
+    bool bridgeReachable() const;
+    int pendingOfflineWrites() const;
+
+    // Smoothed round trip time of the requests to the bridge in ms, 0 until the first reply
+    int latency() const;
+
+    QVariantMap errorCounters() const;
+    Q_INVOKABLE int errorCount(RequestError error) const;
+    Q_INVOKABLE void resetErrorCounters();
+
+    // Group membership as last reported by the bridge. Kept here so Lights and Groups
+    // models, which are instantiated independently, can share it.
+    void setGroupLights(int groupId, const QList<int> &lightIds);
+    QList<int> groupLights(int groupId) const;
+    QList<int> lightGroups(int lightId) const;
+
+    // Model ids of the lights, needed to pick the colour gamut for lights and groups
+    void setLightModelId(int lightId, const QString &modelId);
+    QString lightModelId(int lightId) const;
+
+    // Called by a Group when the bridge acknowledged a write to its action.
+    void confirmGroupAction(int groupId, const QVariantMap &action);
+    // Called by Scenes when the bridge acknowledged a scene recall, light id -> state
+    void confirmLightStates(const QVariantMap &lightStates);
 
 signals:
     void apiKeyChanged();
@@ -97,6 +162,15 @@ signals:
     void statusChanged();
 
     void createUserFailed(const QString &errorMessage);
+    void errorCountersChanged();
+    void bridgeReachableChanged();
+    void pendingOfflineWritesChanged();
+    void latencyChanged();
+    // Emitted for requests that failed after all retries. The reply, if any, is still passed to the callback.
+    void requestFailed(int requestId, RequestError error);
+
+    void groupActionConfirmed(int groupId, const QList<int> &lightIds, const QVariantMap &action);
+    void lightStatesConfirmed(const QVariantMap &lightStates);
 
 private slots:
     void onDiscoveryError();
@@ -106,11 +180,56 @@ private slots:
     void createUserFinished();
     void checkForUpdateFinished();
     void slotOpFinished();
+    void dropOrphanedRequests();
+    void sendQueuedRequests();
+    void checkRequestTimeouts();
+    void probeReachability();
+    void reachabilityProbeFinished(int id, const QVariant &response);
+    void replayOfflineWrite();
 
 private:
+    enum Operation {
+        OperationGet,
+        OperationPut,
+        OperationPost,
+        OperationDelete
+    };
+
+    struct QueuedRequest {
+        Operation operation;
+        RequestPriority priority;
+        QString path;
+        QVariantMap params;
+        // All requests ids merged into this one. Each of them gets the reply.
+        QList<int> requestIds;
+        int attempts;
+        qint64 notBefore;
+        qint64 sentAt;
+    };
+
     HueBridgeConnection();
     static HueBridgeConnection *s_instance;
 
+    static QString methodName(Operation operation);
+
+    int enqueueRequest(Operation operation, const QString &path, const QVariantMap &params, QObject *sender, const QString &slot, RequestPriority priority);
+    void queueRequest(const QueuedRequest &request);
+    void setBridgeReachable(bool reachable);
+    void startOfflineReplay();
+    int nextQueuedRequest();
+    bool interactiveTrafficActive() const;
+    void preemptBackgroundRequest();
+    void scheduleSend(int delay);
+    RequestError classifyResponse(const QVariant &response);
+    bool shouldRetry(const QueuedRequest &request, RequestError error) const;
+    bool isIdempotentWrite(const QueuedRequest &request) const;
+    void enqueueOfflineWrite(Operation operation, const QString &path, const QVariantMap &params, int requestId);
+    void failRequest(int requestId, RequestError error);
+    void retryRequest(QueuedRequest request);
+    void countError(RequestError error);
+    void updateLatency(qint64 roundTrip);
+    bool hasSubscribers(const QList<int> &requestIds) const;
+
     QNetworkAccessManager *m_nam;
 
     QHostAddress m_bridge;
@@ -121,11 +240,35 @@ private:
     BridgeStatus m_bridgeStatus;
 
     int m_requestCounter;
-    QHash<QNetworkReply*, int> m_requestIdMap;
+    QList<QueuedRequest> m_requestQueue;
+    QHash<QNetworkReply*, QueuedRequest> m_runningRequests;
+    QElapsedTimer m_clock;
+    QElapsedTimer m_lastInteractiveRequest;
+    QElapsedTimer m_lastRequestSent;
+    QTimer m_sendTimer;
+    // When m_sendTimer fires, on m_clock. QTimer::remainingTime() is Qt 5 only.
+    qint64 m_sendDeadline;
+    QTimer m_timeoutTimer;
+    QList<QNetworkReply*> m_timedOutReplies;
+    // Minimum time between two requests, raised when the bridge signals overload (ms)
+    int m_pacingInterval;
+    QHash<int, int> m_errorCounters;
+    qreal m_latency;
+
+    bool m_bridgeReachable;
+    OfflineWriteQueue *m_offlineWriteQueue;
+    QTimer m_reachabilityProbeTimer;
+    QTimer m_offlineReplayTimer;
+
     QHash<int, CallbackObject> m_requestSenderMap;
 
     // This is used to store write operations so clients can be notfied to refresh after those succeed.
     QList<QNetworkReply*> m_writeOperationList;
+
+    QHash<int, QList<int> > m_groupLights;
+    // Reverse index: light id -> ids of the groups containing it
+    QHash<int, QList<int> > m_lightGroups;
+    QHash<int, QString> m_lightModelIds;
 };
 
 #endif
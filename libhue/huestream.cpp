@@ -0,0 +1,83 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "huestream.h"
+
+static const char s_protocolName[] = "HueStream";
+static const int s_headerSize = 16;
+static const int s_lightSize = 9;
+
+static void appendUInt16(QByteArray *data, quint16 value)
+{
+    data->append(static_cast<char>(value >> 8));
+    data->append(static_cast<char>(value & 0xFF));
+}
+
+static quint16 readUInt16(const QByteArray &data, int offset)
+{
+    return (static_cast<quint8>(data.at(offset)) << 8) | static_cast<quint8>(data.at(offset + 1));
+}
+
+QList<QByteArray> HueStream::encode(const QList<LightColor> &lights, ColorSpace colorSpace, quint8 sequence)
+{
+    QList<QByteArray> messages;
+    for (int start = 0; start < lights.count(); start += s_maxLightsPerMessage) {
+        int count = qMin(s_maxLightsPerMessage, lights.count() - start);
+
+        QByteArray message;
+        message.reserve(s_headerSize + count * s_lightSize);
+        message.append(s_protocolName, sizeof(s_protocolName) - 1);
+        message.append(static_cast<char>(0x01));    // Major version
+        message.append(static_cast<char>(0x00));    // Minor version
+        message.append(static_cast<char>(sequence));
+        message.append(2, static_cast<char>(0x00)); // Reserved
+        message.append(static_cast<char>(colorSpace));
+        message.append(static_cast<char>(0x00));    // Reserved
+
+        for (int i = start; i < start + count; ++i) {
+            const LightColor &light = lights.at(i);
+            message.append(static_cast<char>(0x00)); // Device type: light
+            appendUInt16(&message, light.lightId);
+            appendUInt16(&message, light.values[0]);
+            appendUInt16(&message, light.values[1]);
+            appendUInt16(&message, light.values[2]);
+        }
+        messages.append(message);
+    }
+    return messages;
+}
+
+bool HueStream::decode(const QByteArray &message, QList<LightColor> *lights, ColorSpace *colorSpace, quint8 *sequence)
+{
+    if (message.size() < s_headerSize || (message.size() - s_headerSize) % s_lightSize != 0
+            || !message.startsWith(s_protocolName) || message.at(9) != 0x01) {
+        return false;
+    }
+
+    *sequence = static_cast<quint8>(message.at(11));
+    *colorSpace = message.at(14) == ColorSpaceXY ? ColorSpaceXY : ColorSpaceRGB;
+    lights->clear();
+    for (int offset = s_headerSize; offset < message.size(); offset += s_lightSize) {
+        lights->append(LightColor(readUInt16(message, offset + 1),
+                                  readUInt16(message, offset + 3),
+                                  readUInt16(message, offset + 5),
+                                  readUInt16(message, offset + 7)));
+    }
+    return true;
+}
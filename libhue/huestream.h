@@ -0,0 +1,54 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef HUESTREAM_H
+#define HUESTREAM_H
+
+#include <QByteArray>
+#include <QList>
+
+// Encodes and decodes messages of the entertainment streaming protocol (version 1.0):
+// a 16 byte header followed by 9 bytes per light, all values big endian.
+class HueStream
+{
+public:
+    enum ColorSpace {
+        ColorSpaceRGB = 0x00,
+        ColorSpaceXY = 0x01     // x, y, brightness
+    };
+
+    class LightColor
+    {
+    public:
+        LightColor(quint16 lightId = 0, quint16 first = 0, quint16 second = 0, quint16 third = 0):
+            lightId(lightId) { values[0] = first; values[1] = second; values[2] = third; }
+        quint16 lightId;
+        quint16 values[3];
+    };
+
+    // The bridge accepts at most this many lights per message
+    static const int s_maxLightsPerMessage = 10;
+
+    // Returns as many messages as needed for the given lights
+    static QList<QByteArray> encode(const QList<LightColor> &lights, ColorSpace colorSpace, quint8 sequence);
+    // Returns false if the data is not a valid message
+    static bool decode(const QByteArray &message, QList<LightColor> *lights, ColorSpace *colorSpace, quint8 *sequence);
+};
+
+#endif
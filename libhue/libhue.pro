@@ -6,52 +6,102 @@ QT += network
 TARGET = hue
 
 HEADERS += action.h \
+automationengine.h \
+beatdetector.h \
+beatsync.h \
+beatsyncworker.h \
+circadianengine.h \
+colorconversion.h \
 condition.h \
 configuration.h \
 discovery.h \
+effect.h \
+effectsengine.h \
+fade.h \
+framecolorextractor.h \
 group.h \
 groups.h \
+historystore.h \
+holdcontroller.h \
 huebridgeconnection.h \
 huemodel.h \
+huestream.h \
 hueobject.h \
 light.h \
 lightinterface.h \
 lightsfiltermodel.h \
 lights.h \
+offlinewritequeue.h \
+pollbudget.h \
 rule.h \
+ruleoptimizer.h \
 rulesfiltermodel.h \
 rules.h \
+rulesimulator.h \
 scene.h \
 scenesfiltermodel.h \
 scenes.h \
 schedule.h \
 schedulesfiltermodel.h \
+scheduletime.h \
 schedules.h \
 sensor.h \
 sensorsfiltermodel.h \
 sensors.h \
+streamingengine.h \
+streamingworker.h \
+streamtransport.h \
+switchevents.h \
+udpstreamreceiver.h \
+udpstreamtransport.h \
+wavfile.h \
 
 SOURCES += action.cpp \
+automationengine.cpp \
+beatdetector.cpp \
+beatsync.cpp \
+beatsyncworker.cpp \
+circadianengine.cpp \
+colorconversion.cpp \
 condition.cpp \
 configuration.cpp \
 discovery.cpp \
+effect.cpp \
+effectsengine.cpp \
+fade.cpp \
+framecolorextractor.cpp \
 group.cpp \
 groups.cpp \
+historystore.cpp \
+holdcontroller.cpp \
 huebridgeconnection.cpp \
 huemodel.cpp \
+huestream.cpp \
 hueobject.cpp \
 light.cpp \
+lightinterface.cpp \
 lights.cpp \
 lightsfiltermodel.cpp \
+offlinewritequeue.cpp \
+pollbudget.cpp \
 rule.cpp \
+ruleoptimizer.cpp \
 rules.cpp \
 rulesfiltermodel.cpp \
+rulesimulator.cpp \
 scene.cpp \
 scenes.cpp \
 scenesfiltermodel.cpp \
 schedule.cpp \
 schedules.cpp \
 schedulesfiltermodel.cpp \
+scheduletime.cpp \
 sensor.cpp \
 sensors.cpp \
+streamingengine.cpp \
+streamingworker.cpp \
+switchevents.cpp \
+udpstreamreceiver.cpp \
+udpstreamtransport.cpp \
+wavfile.cpp \
 sensorsfiltermodel.cpp \
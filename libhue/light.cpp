@@ -19,11 +19,10 @@
 
 #include "light.h"
 #include "huebridgeconnection.h"
+#include "colorconversion.h"
 
 #include <QColor>
 #include <QDebug>
-#include <QGenericMatrix>
-#include <math.h>
 
 Light::Light(int id, const QString &name, QObject *parent):
     LightInterface(parent),
@@ -69,6 +68,7 @@ void Light::setModelId(const QString &modelId)
 {
     if (m_modelId != modelId) {
         m_modelId = modelId;
+        HueBridgeConnection::instance()->setLightModelId(m_id, m_modelId);
         emit modelIdChanged();
     }
 }
@@ -163,68 +163,23 @@ void Light::setSat(quint8 sat)
 
 QColor Light::color() const
 {
+    if (m_colormode == ColorModeXY) {
+        return ColorConversion::xyToRgb(m_xy);
+    }
     return QColor::fromHsv(m_hue * 360 / 65535, m_sat, 255);
 }
 
 void Light::setColorWithXY(const QColor &color)
 {
-    // For the hue bulb the corners of the triangle are:
-    // -Red: 0.675, 0.322
-    // -Green: 0.4091, 0.518
-    // -Blue: 0.167, 0.04
-    double normalizedToOne[3];
-    float cred, cgreen, cblue;
-    cred = color.redF();
-    cgreen = color.greenF();
-    cblue = color.blueF();
-    normalizedToOne[0] = (cred / 255);
-    normalizedToOne[1] = (cgreen / 255);
-    normalizedToOne[2] = (cblue / 255);
-    float red, green, blue;
-
-    // Make red more vivid
-    if (normalizedToOne[0] > 0.04045) {
-        red = (float) pow(
-                (normalizedToOne[0] + 0.055) / (1.0 + 0.055), 2.4);
-    } else {
-        red = (float) (normalizedToOne[0] / 12.92);
-    }
-
-    // Make green more vivid
-    if (normalizedToOne[1] > 0.04045) {
-        green = (float) pow((normalizedToOne[1] + 0.055)
-                / (1.0 + 0.055), 2.4);
-    } else {
-        green = (float) (normalizedToOne[1] / 12.92);
-    }
-
-    // Make blue more vivid
-    if (normalizedToOne[2] > 0.04045) {
-        blue = (float) pow((normalizedToOne[2] + 0.055)
-                / (1.0 + 0.055), 2.4);
-    } else {
-        blue = (float) (normalizedToOne[2] / 12.92);
-    }
-
-    float X = (float) (red * 0.649926 + green * 0.103455 + blue * 0.197109);
-    float Y = (float) (red * 0.234327 + green * 0.743075 + blue * 0.022598);
-    float Z = (float) (red * 0.0000000 + green * 0.053077 + blue * 1.035763);
-
-    float x = X / (X + Y + Z);
-    float y = Y / (X + Y + Z);
-
-    int bri = color.value();
+    QPointF xy = ColorConversion::rgbToXy(color, ColorConversion::gamutForModel(m_modelId));
+    int bri = color.toHsv().value();
 
     if (m_busyStateChangeId == -1) {
         qDebug() << "setting color" << color << "for light" << QString::number(m_id);
 
         QVariantMap params;
-
-        QVariantList xyList;
-        xyList << x << y;
-        params.insert("xy", xyList);
+        params.insert("xy", ColorConversion::xyToVariant(xy));
         params.insert("bri", bri);
-
         params.insert("on", true);
         qDebug() << "Starting timeout and PUT ... " << "for light" << QString::number(m_id);
         m_timeout.start();
@@ -236,65 +191,24 @@ void Light::setColorWithXY(const QColor &color)
 
         m_briDirty = true;
         m_dirtyBri = bri;
-        m_xyDirty = true;
-        m_dirtyXy = QPointF(x, y);
+        setXyDirty(xy);
     }
 }
 
 void Light::setColor(const QColor &color)
 {
-    // Transform from RGB to Hue/Sat
-    quint16 hue = color.hue() * 65535 / 360;
-    quint8 sat = color.saturation();
-
-    // Transform from RGB to XYZ
-    QGenericMatrix<3, 3, qreal> rgb2xyzMatrix;
-    rgb2xyzMatrix(0, 0) = 0.412453;    rgb2xyzMatrix(0, 1) = 0.357580;    rgb2xyzMatrix(0, 2) = 0.180423;
-    rgb2xyzMatrix(1, 0) = 0.212671;    rgb2xyzMatrix(1, 1) = 0.715160;    rgb2xyzMatrix(1, 2) = 0.072169;
-    rgb2xyzMatrix(2, 0) = 0.019334;    rgb2xyzMatrix(2, 1) = 0.119193;    rgb2xyzMatrix(2, 2) = 0.950227;
-
-    QGenericMatrix<1, 3, qreal> rgbMatrix;
-    rgbMatrix(0, 0) = 1.0 * color.red() / 255;
-    rgbMatrix(1, 0) = 1.0 * color.green() / 255;
-    rgbMatrix(2, 0) = 1.0 * color.blue() / 255;
-
-    QGenericMatrix<1, 3, qreal> xyzMatrix = rgb2xyzMatrix * rgbMatrix;
-
-    // transform from XYZ to CIELUV u' and v'
-    qreal u = 4*xyzMatrix(0, 0) / (xyzMatrix(0, 0) + 15*xyzMatrix(1, 0) + 3*xyzMatrix(2, 0));
-    qreal v = 9*xyzMatrix(1, 0) / (xyzMatrix(0, 0) + 15*xyzMatrix(1, 0) + 3*xyzMatrix(2, 0));
-
-    // Transform from CIELUV to (x,y)
-    qreal x = 27*u / (18*u - 48*v + 36);
-    qreal y = 12*v / (18*u - 48*v + 36);
-
-    qDebug() << "setting color" << color  << "busy:" << m_busyStateChangeId;
-    if (m_busyStateChangeId == -1) {
-        QVariantMap params;
-
-        params.insert("hue", hue);
-        params.insert("sat", sat);
-        // FIXME: There is a bug in the API that it doesn't report back the set state of "sat"
-        // Lets just assume it always succeeds
-        m_sat = sat;
-
-//        QVariantList xyList;
-//        xyList << x << y;
-//        params.insert("xy", xyList);
-        Q_UNUSED(x); Q_UNUSED(y);
-
+    qDebug() << "setting color" << color << "busy:" << m_busyStateChangeId;
+    setXy(ColorConversion::rgbToXy(color, ColorConversion::gamutForModel(m_modelId)));
+}
 
-        params.insert("on", true);
-        m_busyStateChangeId = HueBridgeConnection::instance()->put("lights/" + QString::number(m_id) + "/state", params, this, "setStateFinished");
-        m_timeout.start();
-    } else {
-        m_dirtyHue = hue;
-        m_hueDirty = true;
-        m_dirtySat = sat;
-        m_satDirty = true;
-//        m_xyDirty = true;
-//        m_dirtyXy = QPointF(x, y);
-    }
+void Light::setXyDirty(const QPointF &xy)
+{
+    // The latest colour wins over colours set in another mode meanwhile
+    m_hueDirty = false;
+    m_satDirty = false;
+    m_ctDirty = false;
+    m_xyDirty = true;
+    m_dirtyXy = xy;
 }
 
 QPointF Light::xy() const
@@ -304,9 +218,15 @@ QPointF Light::xy() const
 
 void Light::setXy(const QPointF &xy)
 {
-    if (m_xy != xy) {
-        m_xy = xy;
-        emit stateChanged();
+    QPointF clamped = ColorConversion::clampToGamut(xy, ColorConversion::gamutForModel(m_modelId));
+    if (m_busyStateChangeId == -1) {
+        QVariantMap params;
+        params.insert("xy", ColorConversion::xyToVariant(clamped));
+        params.insert("on", true);
+        m_busyStateChangeId = HueBridgeConnection::instance()->put("lights/" + QString::number(m_id) + "/state", params, this, "setStateFinished");
+        m_timeout.start();
+    } else {
+        setXyDirty(clamped);
     }
 }
 
@@ -326,6 +246,9 @@ void Light::setCt(quint16 ct)
     } else {
         m_dirtyCt = ct;
         m_ctDirty = true;
+        m_hueDirty = false;
+        m_satDirty = false;
+        m_xyDirty = false;
     }
 }
 
@@ -364,6 +287,35 @@ void Light::setEffect(const QString &effect)
     }
 }
 
+void Light::setState(const QVariantMap &state, int transitionTime)
+{
+    QVariantMap params = stateParams(state, transitionTime, ColorConversion::gamutForModel(m_modelId));
+    HueBridgeConnection::instance()->put("lights/" + QString::number(m_id) + "/state", params, this, "setStateFinished");
+}
+
+void Light::adjustBri(int delta, int transitionTime)
+{
+    HueBridgeConnection::instance()->put("lights/" + QString::number(m_id) + "/state", incrementParams("bri", delta, transitionTime), this, "setStateFinished");
+}
+
+void Light::adjustCt(int delta, int transitionTime)
+{
+    HueBridgeConnection::instance()->put("lights/" + QString::number(m_id) + "/state", incrementParams("ct", delta, transitionTime), this, "setStateFinished");
+}
+
+void Light::adjustHue(int delta, int transitionTime)
+{
+    HueBridgeConnection::instance()->put("lights/" + QString::number(m_id) + "/state", incrementParams("hue", delta, transitionTime), this, "setStateFinished");
+}
+
+void Light::stopTransition()
+{
+    // An increment of 0 stops ongoing transitions. The bridge only reports the increment
+    // back, so fetch where the light actually ended up.
+    HueBridgeConnection::instance()->put("lights/" + QString::number(m_id) + "/state", incrementParams("bri", 0, 0), this, "setStateFinished");
+    refresh();
+}
+
 LightInterface::ColorMode Light::colorMode() const
 {
     return m_colormode;
@@ -376,7 +328,7 @@ bool Light::reachable() const
 
 void Light::refresh()
 {
-    HueBridgeConnection::instance()->get("lights/" + QString::number(m_id), this, "responseReceived");
+    HueBridgeConnection::instance()->get("lights/" + QString::number(m_id), this, "responseReceived", HueBridgeConnection::PriorityBackground);
 }
 
 void Light::setReachable(bool reachable)
@@ -401,7 +353,7 @@ void Light::responseReceived(int id, const QVariant &response)
     m_bri = stateMap.value("bri").toInt();
     m_hue = stateMap.value("hue").toInt();
     m_sat = stateMap.value("sat").toInt();
-    m_xy = stateMap.value("xy").toPointF();
+    m_xy = ColorConversion::xyFromVariant(stateMap.value("xy"));
     m_ct = stateMap.value("ct").toInt();
     m_alert = stateMap.value("alert").toString();
     m_effect = stateMap.value("effect").toString();
@@ -422,7 +374,7 @@ void Light::responseReceived(int id, const QVariant &response)
 void Light::setDescriptionFinished(int id, const QVariant &response)
 {
     Q_UNUSED(id)
-    QVariantMap result = response.toList().first().toMap();
+    QVariantMap result = response.toList().value(0).toMap();
 
     if (result.contains("success")) {
         QVariantMap successMap = result.value("success").toMap();
@@ -455,7 +407,7 @@ void Light::setStateFinished(int id, const QVariant &response)
                 m_colormode = ColorModeHS;
             }
             if (successMap.contains("/lights/" + QString::number(m_id) + "/state/xy")) {
-                m_xy = successMap.value("/lights/" + QString::number(m_id) + "/state/xy").toPoint();
+                m_xy = ColorConversion::xyFromVariant(successMap.value("/lights/" + QString::number(m_id) + "/state/xy"));
                 m_colormode = ColorModeXY;
             }
             if (successMap.contains("/lights/" + QString::number(m_id) + "/state/ct")) {
@@ -476,7 +428,7 @@ void Light::setStateFinished(int id, const QVariant &response)
     if (m_busyStateChangeId == id) {
         m_busyStateChangeId = -1;
         m_timeout.stop();
-        if (m_hueDirty || m_satDirty || m_briDirty) {
+        if (m_hueDirty || m_satDirty || m_briDirty || m_ctDirty || m_xyDirty) {
             QVariantMap params;
             if (m_hueDirty) {
                 params.insert("hue", m_dirtyHue);
@@ -485,31 +437,22 @@ void Light::setStateFinished(int id, const QVariant &response)
             if (m_satDirty) {
                 params.insert("sat", m_dirtySat);
                 m_satDirty = false;
+                // FIXME: There is a bug in the API that it doesn't report back the set state of "sat"
+                // Lets just assume it always succeeds
+                m_sat = m_dirtySat;
             }
             if (m_briDirty) {
                 params.insert("bri", m_dirtyBri);
                 m_briDirty = false;
             }
-
-            // FIXME: There is a bug in the API that it doesn't report back the set state of "sat"
-            // Lets just assume it always succeeds
-            m_sat = m_dirtySat;
-
-            m_busyStateChangeId = HueBridgeConnection::instance()->put("lights/" + QString::number(m_id) + "/state", params, this, "setStateFinished");
-            m_timeout.start();
-        } else if(m_ctDirty) {
-            QVariantMap params;
-            params.insert("ct", m_dirtyCt);
-            m_ctDirty = false;
-
-            m_busyStateChangeId = HueBridgeConnection::instance()->put("lights/" + QString::number(m_id) + "/state", params, this, "setStateFinished");
-            m_timeout.start();
-        } else if (m_xyDirty) {
-            QVariantMap params;
-            QVariantList xyList;
-            xyList << m_dirtyXy.x() << m_dirtyXy.y();
-            params.insert("xy", xyList);
-            m_xyDirty = false;
+            if (m_ctDirty) {
+                params.insert("ct", m_dirtyCt);
+                m_ctDirty = false;
+            }
+            if (m_xyDirty) {
+                params.insert("xy", ColorConversion::xyToVariant(m_dirtyXy));
+                m_xyDirty = false;
+            }
 
             m_busyStateChangeId = HueBridgeConnection::instance()->put("lights/" + QString::number(m_id) + "/state", params, this, "setStateFinished");
             m_timeout.start();
@@ -77,6 +77,11 @@ public slots:
     void setCt(quint16 ct);
     void setAlert(const QString &alert);
     void setEffect(const QString &effect);
+    void setState(const QVariantMap &state, int transitionTime);
+    void adjustBri(int delta, int transitionTime);
+    void adjustCt(int delta, int transitionTime);
+    void adjustHue(int delta, int transitionTime);
+    void stopTransition();
 
 signals:
     void modelIdChanged();
@@ -92,6 +97,7 @@ private slots:
 
 private:
     void setReachable(bool reachable);
+    void setXyDirty(const QPointF &xy);
 
     int m_id;
     QString m_name;
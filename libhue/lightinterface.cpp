@@ -0,0 +1,62 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "lightinterface.h"
+#include "colorconversion.h"
+
+QVariantMap LightInterface::stateParams(const QVariantMap &state, int transitionTime, int gamut)
+{
+    ColorConversion::Gamut colorGamut = static_cast<ColorConversion::Gamut>(gamut);
+
+    QVariantMap params;
+    if (state.contains("on")) {
+        params.insert("on", state.value("on").toBool());
+    }
+    if (state.contains("bri")) {
+        params.insert("bri", qBound(0, state.value("bri").toInt(), 254));
+    }
+    if (state.contains("hue")) {
+        params.insert("hue", qBound(0, state.value("hue").toInt(), 65535));
+    }
+    if (state.contains("sat")) {
+        params.insert("sat", qBound(0, state.value("sat").toInt(), 254));
+    }
+    if (state.contains("ct")) {
+        params.insert("ct", qBound(153, state.value("ct").toInt(), 500));
+    }
+    if (state.contains("xy")) {
+        QPointF xy = ColorConversion::xyFromVariant(state.value("xy"));
+        params.insert("xy", ColorConversion::xyToVariant(ColorConversion::clampToGamut(xy, colorGamut)));
+    }
+    if (state.contains("color")) {
+        QColor color = state.value("color").value<QColor>();
+        params.insert("xy", ColorConversion::xyToVariant(ColorConversion::rgbToXy(color, colorGamut)));
+    }
+    params.insert("transitiontime", qBound(0, qRound(transitionTime / 100.0), 65535));
+    return params;
+}
+
+QVariantMap LightInterface::incrementParams(const QString &attribute, int delta, int transitionTime)
+{
+    int limit = attribute == "bri" ? 254 : 65534;
+    QVariantMap params;
+    params.insert(attribute + "_inc", qBound(-limit, delta, limit));
+    params.insert("transitiontime", qBound(0, qRound(transitionTime / 100.0), 65535));
+    return params;
+}
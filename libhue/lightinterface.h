@@ -28,6 +28,7 @@
 #include <QPointF>
 #include <QColor>
 #include <QTimer>
+#include <QVariantMap>
 
 class LightInterface: public HueObject
 {
@@ -42,7 +43,7 @@ class LightInterface: public HueObject
     Q_PROPERTY(quint16 hue READ hue NOTIFY stateChanged)
     Q_PROPERTY(quint8 sat READ sat NOTIFY stateChanged)
     Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY stateChanged)
-    Q_PROPERTY(QPointF xy READ xy NOTIFY stateChanged)
+    Q_PROPERTY(QPointF xy READ xy WRITE setXy NOTIFY stateChanged)
     Q_PROPERTY(quint16 ct READ ct WRITE setCt NOTIFY stateChanged)
     Q_PROPERTY(QString alert READ alert WRITE setAlert NOTIFY stateChanged)
     Q_PROPERTY(QString effect READ effect WRITE setEffect NOTIFY stateChanged)
@@ -93,10 +94,27 @@ public slots:
     virtual void setAlert(const QString &alert) = 0;
     virtual void setEffect(const QString &effect) = 0;
 
+    // Sets any of "on", "bri", "hue", "sat", "xy", "ct" and "color" at once. The bulbs fade
+    // to the new state within transitionTime ms (in steps of 100 ms, up to 6553500 ms).
+    virtual void setState(const QVariantMap &state, int transitionTime) = 0;
+
+    // Relative changes, applied by the bridge to whatever the current value is. An
+    // adjustment with a transition keeps going until it is done or stopTransition() is called.
+    virtual void adjustBri(int delta, int transitionTime) = 0;
+    virtual void adjustCt(int delta, int transitionTime) = 0;
+    virtual void adjustHue(int delta, int transitionTime) = 0;
+    virtual void stopTransition() = 0;
+
 signals:
     void nameChanged();
     void stateChanged();
     void writeOperationFinished();
+
+protected:
+    // Translates a state for setState() into parameters for the bridge
+    static QVariantMap stateParams(const QVariantMap &state, int transitionTime, int gamut);
+    // attribute is one of "bri", "ct" or "hue"
+    static QVariantMap incrementParams(const QString &attribute, int delta, int transitionTime);
 };
 
 #endif
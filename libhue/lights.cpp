@@ -21,16 +21,22 @@
 #include "light.h"
 
 #include "huebridgeconnection.h"
+#include "colorconversion.h"
 
 #include <QDebug>
 
 Lights::Lights(QObject *parent) :
     HueModel(parent),
-    m_busy(false)
+    m_busy(false),
+    m_applyingGroupAction(false)
 {
 #if QT_VERSION < 0x050000
     setRoleNames(roleNames());
 #endif
+    connect(HueBridgeConnection::instance(), SIGNAL(groupActionConfirmed(int,QList<int>,QVariantMap)),
+            this, SLOT(groupActionConfirmed(int,QList<int>,QVariantMap)));
+    connect(HueBridgeConnection::instance(), SIGNAL(lightStatesConfirmed(QVariantMap)),
+            this, SLOT(lightStatesConfirmed(QVariantMap)));
 }
 
 int Lights::rowCount(const QModelIndex &parent) const
@@ -129,7 +135,7 @@ bool Lights::busy() const
 
 void Lights::refresh()
 {
-    HueBridgeConnection::instance()->get("lights", this, "lightsReceived");
+    HueBridgeConnection::instance()->get("lights", this, "lightsReceived", HueBridgeConnection::PriorityBackground);
     m_busy = true;
     emit busyChanged();
 }
@@ -168,6 +174,7 @@ void Lights::lightsReceived(int id, const QVariant &variant)
             light->m_modelId = lights.value(lightId).toMap().value("modelid").toString();
             newLights.append(light);
         }
+        HueBridgeConnection::instance()->setLightModelId(light->id(), light->m_modelId);
         qDebug() << "have modelid" << light->m_modelId;
         QVariantMap stateMap = lights.value(lightId).toMap().value("state").toMap();
         parseStateMap(light, stateMap);
@@ -206,6 +213,11 @@ void Lights::lightDescriptionChanged()
 
 void Lights::lightStateChanged()
 {
+    // Group actions emit their own, more precise, dataChanged
+    if (m_applyingGroupAction) {
+        return;
+    }
+
     Light *light = static_cast<Light*>(sender());
     int idx = m_list.indexOf(light);
     QModelIndex modelIndex = index(idx);
@@ -235,6 +247,47 @@ void Lights::searchStarted(int id, const QVariant &response)
     qDebug() << "search started" << response;
 }
 
+void Lights::groupActionConfirmed(int groupId, const QList<int> &lightIds, const QVariantMap &action)
+{
+    Q_UNUSED(groupId)
+
+    foreach (int lightId, lightIds) {
+        applyConfirmedState(lightId, action);
+    }
+}
+
+void Lights::lightStatesConfirmed(const QVariantMap &lightStates)
+{
+    foreach (const QString &lightId, lightStates.keys()) {
+        applyConfirmedState(lightId.toInt(), lightStates.value(lightId).toMap());
+    }
+}
+
+void Lights::applyConfirmedState(int lightId, const QVariantMap &state)
+{
+    Light *light = findLight(lightId);
+    if (!light) {
+        return;
+    }
+
+    QVector<int> roles = applyGroupAction(light, state);
+    if (roles.isEmpty()) {
+        return;
+    }
+
+    m_applyingGroupAction = true;
+    emit light->stateChanged();
+    m_applyingGroupAction = false;
+
+    int idx = m_list.indexOf(light);
+    QModelIndex modelIndex = index(idx);
+#if QT_VERSION >= 0x050000
+    emit dataChanged(modelIndex, modelIndex, roles);
+#else
+    emit dataChanged(modelIndex, modelIndex);
+#endif
+}
+
 Light *Lights::createLight(int id, const QString &name)
 {
     Light *light = new Light(id, name, this);
@@ -255,7 +308,7 @@ void Lights::parseStateMap(Light *light, const QVariantMap &stateMap)
     light->m_bri = stateMap.value("bri").toInt();
     light->m_hue = stateMap.value("hue").toInt();
     light->m_sat = stateMap.value("sat").toInt();
-    light->m_xy = stateMap.value("xy").toPointF();
+    light->m_xy = ColorConversion::xyFromVariant(stateMap.value("xy"));
     light->m_ct = stateMap.value("ct").toInt();
     light->m_alert = stateMap.value("alert").toString();
     light->m_effect = stateMap.value("effect").toString();
@@ -270,3 +323,60 @@ void Lights::parseStateMap(Light *light, const QVariantMap &stateMap)
     light->m_reachable = stateMap.value("reachable").toBool();
     emit light->stateChanged();
 }
+
+QVector<int> Lights::applyGroupAction(Light *light, const QVariantMap &action)
+{
+    QVector<int> roles;
+    Light::ColorMode colorMode = light->m_colormode;
+
+    if (action.contains("on") && light->m_on != action.value("on").toBool()) {
+        light->m_on = action.value("on").toBool();
+        roles << RoleOn;
+    }
+    if (action.contains("bri") && light->m_bri != action.value("bri").toInt()) {
+        light->m_bri = action.value("bri").toInt();
+        roles << RoleBrightness;
+    }
+    if (action.contains("hue")) {
+        colorMode = Light::ColorModeHS;
+        if (light->m_hue != action.value("hue").toInt()) {
+            light->m_hue = action.value("hue").toInt();
+            roles << RoleHue;
+        }
+    }
+    if (action.contains("sat")) {
+        colorMode = Light::ColorModeHS;
+        if (light->m_sat != action.value("sat").toInt()) {
+            light->m_sat = action.value("sat").toInt();
+            roles << RoleSaturation;
+        }
+    }
+    if (action.contains("xy")) {
+        colorMode = Light::ColorModeXY;
+        QPointF xy = ColorConversion::xyFromVariant(action.value("xy"));
+        if (light->m_xy != xy) {
+            light->m_xy = xy;
+            roles << RoleXY;
+        }
+    }
+    if (action.contains("ct")) {
+        colorMode = Light::ColorModeCT;
+        if (light->m_ct != action.value("ct").toInt()) {
+            light->m_ct = action.value("ct").toInt();
+            roles << RoleCt;
+        }
+    }
+    if (action.contains("alert") && light->m_alert != action.value("alert").toString()) {
+        light->m_alert = action.value("alert").toString();
+        roles << RoleAlert;
+    }
+    if (action.contains("effect") && light->m_effect != action.value("effect").toString()) {
+        light->m_effect = action.value("effect").toString();
+        roles << RoleEffect;
+    }
+    if (light->m_colormode != colorMode) {
+        light->m_colormode = colorMode;
+        roles << RoleColorMode;
+    }
+    return roles;
+}
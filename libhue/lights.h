@@ -68,6 +68,8 @@ private slots:
     void lightDescriptionChanged();
     void lightStateChanged();
     void searchStarted(int id, const QVariant &response);
+    void groupActionConfirmed(int groupId, const QList<int> &lightIds, const QVariantMap &action);
+    void lightStatesConfirmed(const QVariantMap &lightStates);
 
 signals:
     void countChanged();
@@ -75,10 +77,13 @@ signals:
 private:
     Light* createLight(int id, const QString &name);
     void parseStateMap(Light *light, const QVariantMap &stateMap);
+    QVector<int> applyGroupAction(Light *light, const QVariantMap &action);
+    void applyConfirmedState(int lightId, const QVariantMap &state);
 
 private:
     QList<Light*> m_list;
     bool m_busy;
+    bool m_applyingGroupAction;
 };
 
 #endif // LIGHTS_H
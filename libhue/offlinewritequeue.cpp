@@ -0,0 +1,256 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "offlinewritequeue.h"
+
+#if QT_VERSION >= 0x050000
+#include <QStandardPaths>
+#else
+#include <QDesktopServices>
+#endif
+#include <QDebug>
+
+// Oldest writes are dropped beyond this. Compaction usually keeps the queue far below.
+static const int s_maxWrites = 256;
+static const int s_saveDelay = 500;
+
+OfflineWriteQueue::OfflineWriteQueue(QObject *parent):
+    QObject(parent),
+#if QT_VERSION >= 0x050000
+    m_settings(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/offlinewrites.conf", QSettings::IniFormat)
+#else
+    m_settings(QDesktopServices::storageLocation(QDesktopServices::DataLocation) + "/offlinewrites.conf", QSettings::IniFormat)
+#endif
+{
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(s_saveDelay);
+    connect(&m_saveTimer, SIGNAL(timeout()), this, SLOT(save()));
+
+    load();
+}
+
+OfflineWriteQueue::~OfflineWriteQueue()
+{
+    if (m_saveTimer.isActive()) {
+        save();
+    }
+}
+
+QString OfflineWriteQueue::bridgeId() const
+{
+    return m_bridgeId;
+}
+
+void OfflineWriteQueue::setBridgeId(const QString &bridgeId)
+{
+    if (m_bridgeId == bridgeId) {
+        return;
+    }
+
+    // Writes queued before we knew which bridge we're talking to belong to this one.
+    // Writes stored for another bridge are useless.
+    if (!m_bridgeId.isEmpty() && !m_writes.isEmpty()) {
+        qWarning() << "Discarding" << m_writes.count() << "offline writes queued for bridge" << m_bridgeId;
+        m_writes.clear();
+        emit countChanged();
+    }
+    m_bridgeId = bridgeId;
+    save();
+}
+
+int OfflineWriteQueue::count() const
+{
+    return m_writes.count();
+}
+
+bool OfflineWriteQueue::isEmpty() const
+{
+    return m_writes.isEmpty();
+}
+
+QList<int> OfflineWriteQueue::enqueue(const QString &method, const QString &path, const QVariantMap &params, int requestId)
+{
+    QList<int> obsoleteRequestIds;
+
+    if (method == "PUT") {
+        for (int i = m_writes.count() - 1; i >= 0; --i) {
+            Write &write = m_writes[i];
+            if (write.method == "DELETE" && isSameOrBelow(path, write.path)) {
+                break;
+            }
+            if (write.method == "PUT" && write.path == path) {
+                mergeParams(&write.params, params);
+                write.requestIds.append(requestId);
+                scheduleSave();
+                return obsoleteRequestIds;
+            }
+        }
+    }
+
+    QList<int> absorbedRequestIds;
+    if (method == "DELETE") {
+        for (int i = m_writes.count() - 1; i >= 0; --i) {
+            if (m_writes.at(i).method == "DELETE" && m_writes.at(i).path == path) {
+                m_writes[i].requestIds.append(absorbedRequestIds);
+                m_writes[i].requestIds.append(requestId);
+                scheduleSave();
+                emit countChanged();
+                return obsoleteRequestIds;
+            }
+            if (m_writes.at(i).method == "PUT" && isSameOrBelow(m_writes.at(i).path, path)) {
+                absorbedRequestIds.append(m_writes.takeAt(i).requestIds);
+            }
+        }
+    }
+
+    Write write;
+    write.method = method;
+    write.path = path;
+    write.params = params;
+    write.requestIds = absorbedRequestIds;
+    write.requestIds.append(requestId);
+    m_writes.append(write);
+
+    while (m_writes.count() > s_maxWrites) {
+        obsoleteRequestIds.append(m_writes.takeFirst().requestIds);
+    }
+
+    scheduleSave();
+    emit countChanged();
+    return obsoleteRequestIds;
+}
+
+void OfflineWriteQueue::prepend(const OfflineWriteQueue::Write &write)
+{
+    m_writes.prepend(write);
+    scheduleSave();
+    emit countChanged();
+}
+
+OfflineWriteQueue::Write OfflineWriteQueue::takeFirst()
+{
+    Write write = m_writes.takeFirst();
+    // Don't let a drained queue come back after a crash
+    if (m_writes.isEmpty()) {
+        save();
+    } else {
+        scheduleSave();
+    }
+    emit countChanged();
+    return write;
+}
+
+bool OfflineWriteQueue::cancel(int requestId)
+{
+    for (int i = 0; i < m_writes.count(); ++i) {
+        if (!m_writes.at(i).requestIds.contains(requestId)) {
+            continue;
+        }
+        m_writes[i].requestIds.removeAll(requestId);
+        // A merged PUT still carries the intent of its other callers
+        if (m_writes.at(i).requestIds.isEmpty()) {
+            m_writes.removeAt(i);
+            scheduleSave();
+            emit countChanged();
+        }
+        return true;
+    }
+    return false;
+}
+
+void OfflineWriteQueue::load()
+{
+    m_bridgeId = m_settings.value("bridgeId").toString();
+    int count = m_settings.beginReadArray("writes");
+    for (int i = 0; i < count; ++i) {
+        m_settings.setArrayIndex(i);
+        Write write;
+        write.method = m_settings.value("method").toString();
+        write.path = m_settings.value("path").toString();
+        write.params = m_settings.value("params").toMap();
+        m_writes.append(write);
+    }
+    m_settings.endArray();
+}
+
+void OfflineWriteQueue::scheduleSave()
+{
+    if (!m_saveTimer.isActive()) {
+        m_saveTimer.start();
+    }
+}
+
+void OfflineWriteQueue::save()
+{
+    m_saveTimer.stop();
+    m_settings.setValue("bridgeId", m_bridgeId);
+    m_settings.remove("writes");
+    m_settings.beginWriteArray("writes", m_writes.count());
+    for (int i = 0; i < m_writes.count(); ++i) {
+        m_settings.setArrayIndex(i);
+        m_settings.setValue("method", m_writes.at(i).method);
+        m_settings.setValue("path", m_writes.at(i).path);
+        m_settings.setValue("params", m_writes.at(i).params);
+    }
+    m_settings.endArray();
+    m_settings.sync();
+}
+
+void OfflineWriteQueue::mergeParams(QVariantMap *params, const QVariantMap &update)
+{
+    foreach (const QString &key, update.keys()) {
+        if (!key.endsWith("_inc")) {
+            params->insert(key, update.value(key));
+            // An absolute value replaces any change relative to the old one
+            params->remove(key + "_inc");
+            continue;
+        }
+
+        int increment = update.value(key).toInt();
+        QString attribute = key.left(key.length() - 4);
+        if (params->contains(attribute)) {
+            // Within the range the bridge accepts, hue wraps around like it does on the bridge
+            int value = params->value(attribute).toInt() + increment;
+            if (attribute == "bri") {
+                value = qBound(1, value, 254);
+            } else if (attribute == "sat") {
+                value = qBound(0, value, 254);
+            } else if (attribute == "ct") {
+                value = qBound(153, value, 500);
+            } else if (attribute == "hue") {
+                value = ((value % 65536) + 65536) % 65536;
+            } else {
+                // xy_inc, the bridge would ignore it next to xy as well
+                continue;
+            }
+            params->insert(attribute, value);
+        } else if (increment != 0 && params->contains(key)) {
+            // Relative changes add up, except for 0 which stops a running transition
+            int limit = attribute == "bri" || attribute == "sat" ? 254 : 65534;
+            params->insert(key, qBound(-limit, params->value(key).toInt() + increment, limit));
+        } else {
+            params->insert(key, increment);
+        }
+    }
+}
+
+bool OfflineWriteQueue::isSameOrBelow(const QString &path, const QString &parent)
+{
+    return path == parent || path.startsWith(parent + "/");
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef OFFLINEWRITEQUEUE_H
+#define OFFLINEWRITEQUEUE_H
+
+#include <QObject>
+#include <QVariantMap>
+#include <QSettings>
+#include <QTimer>
+
+// Holds writes issued while the bridge can't be reached. The queue is stored on disk so
+// pending writes survive a restart and is compacted as writes come in:
+// - PUTs to the same resource are merged per attribute, the last write wins and
+//   relative changes (*_inc) add up or are folded into a queued absolute value
+// - a DELETE discards queued updates to the deleted resource and its sub-resources,
+//   their callers get the DELETE's reply
+// - cancelling a queued create (POST) removes it before it is ever sent
+class OfflineWriteQueue: public QObject
+{
+    Q_OBJECT
+
+public:
+    class Write
+    {
+    public:
+        QString method;
+        QString path;
+        QVariantMap params;
+        // Callers waiting for the reply. Not persisted.
+        QList<int> requestIds;
+    };
+
+    OfflineWriteQueue(QObject *parent = 0);
+    ~OfflineWriteQueue();
+
+    // Writes are only valid for the bridge they were issued for
+    QString bridgeId() const;
+    void setBridgeId(const QString &bridgeId);
+
+    int count() const;
+    bool isEmpty() const;
+
+    // Returns the ids of requests dropped without being sent because the queue is full
+    QList<int> enqueue(const QString &method, const QString &path, const QVariantMap &params, int requestId);
+    void prepend(const Write &write);
+    Write takeFirst();
+    bool cancel(int requestId);
+
+    // Merges the parameters of a newer PUT into an older one for the same resource. Newer
+    // values win, relative changes add up or are folded into an absolute value already
+    // in params, as the bridge ignores bri_inc next to bri.
+    static void mergeParams(QVariantMap *params, const QVariantMap &update);
+
+signals:
+    void countChanged();
+
+private slots:
+    void save();
+
+private:
+    void load();
+    void scheduleSave();
+
+    static bool isSameOrBelow(const QString &path, const QString &parent);
+
+    QSettings m_settings;
+    QString m_bridgeId;
+    QList<Write> m_writes;
+    // Writes come in bursts while offline (e.g. slider moves), the file is only
+    // rewritten once they settle
+    QTimer m_saveTimer;
+};
+
+#endif
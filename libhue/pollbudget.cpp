@@ -0,0 +1,66 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "pollbudget.h"
+
+#include <qmath.h>
+
+// Poll requests per second for all pollers together
+static const int s_maxPollsPerSecond = 5;
+// Polls which may go out at once after the budget wasn't used for a while
+static const int s_maxPollBurst = 2;
+
+PollBudget *PollBudget::instance()
+{
+    static PollBudget budget;
+    return &budget;
+}
+
+PollBudget::PollBudget():
+    m_budget(s_maxPollBurst),
+    m_updated(0)
+{
+    m_clock.start();
+}
+
+bool PollBudget::take()
+{
+    refill();
+    if (m_budget < 1) {
+        return false;
+    }
+    m_budget -= 1;
+    return true;
+}
+
+int PollBudget::wait()
+{
+    refill();
+    if (m_budget >= 1) {
+        return 0;
+    }
+    return qCeil((1 - m_budget) * 1000 / s_maxPollsPerSecond);
+}
+
+void PollBudget::refill()
+{
+    qint64 now = m_clock.elapsed();
+    m_budget = qMin<qreal>(s_maxPollBurst, m_budget + (now - m_updated) * s_maxPollsPerSecond / 1000.0);
+    m_updated = now;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef POLLBUDGET_H
+#define POLLBUDGET_H
+
+#include <QElapsedTimer>
+
+// Token bucket for polling requests. Everything that polls the bridge on its own
+// (SwitchEvents, AutomationEngine) draws from the one instance, so together they stay
+// below what the bridge sustains next to interactive traffic.
+class PollBudget
+{
+public:
+    static PollBudget *instance();
+
+    // Takes one request from the budget. Returns false if none is available right now.
+    bool take();
+    // ms until the next request is available, 0 if there is one now
+    int wait();
+
+private:
+    PollBudget();
+    void refill();
+
+    QElapsedTimer m_clock;
+    qreal m_budget;
+    qint64 m_updated;
+};
+
+#endif
@@ -28,6 +28,7 @@ Rule::Rule(const QString &id, const QString &name, QObject *parent)
     : QObject(parent)
     , m_id(id)
     , m_name(name)
+    , m_enabled(true)
 {
 //    refresh();
 }
@@ -76,6 +77,19 @@ void Rule::setActions(const QVariantList &actions)
     }
 }
 
+bool Rule::enabled() const
+{
+    return m_enabled;
+}
+
+void Rule::setEnabled(bool enabled)
+{
+    if (m_enabled != enabled) {
+        m_enabled = enabled;
+        emit enabledChanged();
+    }
+}
+
 void Rule::refresh()
 {
 }
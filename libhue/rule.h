@@ -31,6 +31,7 @@ class Rule: public QObject
     Q_PROPERTY(QString name READ name WRITE setName NOTIFY nameChanged)
     Q_PROPERTY(QVariantList conditions READ conditions NOTIFY conditionsChanged)
     Q_PROPERTY(QVariantList actions READ actions NOTIFY actionsChanged)
+    Q_PROPERTY(bool enabled READ enabled NOTIFY enabledChanged)
 
 public:
     Rule(const QString &id, const QString &name, QObject *parent = 0);
@@ -46,6 +47,10 @@ public:
     QVariantList actions() const;
     void setActions(const QVariantList &actions);
 
+    // The rule's status on the bridge, disabled rules are never triggered
+    bool enabled() const;
+    void setEnabled(bool enabled);
+
 public slots:
     void refresh();
 
@@ -53,12 +58,14 @@ signals:
     void nameChanged();
     void conditionsChanged();
     void actionsChanged();
+    void enabledChanged();
 
 private:
     QString m_id;
     QString m_name;
     QVariantList m_conditions;
     QVariantList m_actions;
+    bool m_enabled;
 };
 
 #endif
@@ -0,0 +1,625 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+
+#include "ruleoptimizer.h"
+#include "rules.h"
+#include "rule.h"
+#include "groups.h"
+#include "group.h"
+#include "sensors.h"
+#include "sensor.h"
+#include "huebridgeconnection.h"
+
+#include <QDebug>
+#include <QSet>
+
+// Rule names are limited on the bridge
+static const int s_maxNameLength = 32;
+
+RuleOptimizer::RuleOptimizer(QObject *parent):
+    QObject(parent),
+    m_maxRules(200),
+    m_maxConditions(8),
+    m_maxActions(8)
+{
+}
+
+Rules *RuleOptimizer::rules() const
+{
+    return m_rules;
+}
+
+void RuleOptimizer::setRules(Rules *rules)
+{
+    if (m_rules != rules) {
+        m_rules = rules;
+        emit rulesChanged();
+    }
+}
+
+Groups *RuleOptimizer::groups() const
+{
+    return m_groups;
+}
+
+void RuleOptimizer::setGroups(Groups *groups)
+{
+    if (m_groups != groups) {
+        m_groups = groups;
+        emit groupsChanged();
+    }
+}
+
+Sensors *RuleOptimizer::sensors() const
+{
+    return m_sensors;
+}
+
+void RuleOptimizer::setSensors(Sensors *sensors)
+{
+    if (m_sensors != sensors) {
+        m_sensors = sensors;
+        emit sensorsChanged();
+    }
+}
+
+QVariantMap RuleOptimizer::sceneStates() const
+{
+    return m_sceneStates;
+}
+
+void RuleOptimizer::setSceneStates(const QVariantMap &sceneStates)
+{
+    if (m_sceneStates != sceneStates) {
+        m_sceneStates = sceneStates;
+        emit sceneStatesChanged();
+    }
+}
+
+int RuleOptimizer::maxRules() const
+{
+    return m_maxRules;
+}
+
+void RuleOptimizer::setMaxRules(int maxRules)
+{
+    if (m_maxRules != maxRules) {
+        m_maxRules = maxRules;
+        emit limitsChanged();
+    }
+}
+
+int RuleOptimizer::maxConditions() const
+{
+    return m_maxConditions;
+}
+
+void RuleOptimizer::setMaxConditions(int maxConditions)
+{
+    if (m_maxConditions != maxConditions) {
+        m_maxConditions = maxConditions;
+        emit limitsChanged();
+    }
+}
+
+int RuleOptimizer::maxActions() const
+{
+    return m_maxActions;
+}
+
+void RuleOptimizer::setMaxActions(int maxActions)
+{
+    if (m_maxActions != maxActions && maxActions > 0) {
+        m_maxActions = maxActions;
+        emit limitsChanged();
+    }
+}
+
+QVariantMap RuleOptimizer::report() const
+{
+    return m_report;
+}
+
+bool RuleOptimizer::busy() const
+{
+    return !m_pendingRequests.isEmpty();
+}
+
+void RuleOptimizer::optimize()
+{
+    m_changedRules.clear();
+    m_removedRules.clear();
+    m_removedSensors.clear();
+
+    QList<RuleData> before = currentRules();
+    QStringList unusedSensors;
+    QHash<QString, QString> aliases = helperSensorAliases(&unusedSensors, before);
+    m_removedSensors = aliases.keys() + unusedSensors;
+
+    // Rules with the same conditions and status are merged into the one with the lowest id
+    QList<RuleData> merged;
+    QHash<QString, int> byConditions;
+    // Sorted conditions as they are on the bridge, to leave rules alone which only differ in order
+    QHash<QString, QString> originalConditions;
+    foreach (const RuleData &rule, before) {
+        // A map sorts and deduplicates the conditions
+        QMap<QString, QVariant> conditions;
+        QMap<QString, QVariant> original;
+        foreach (const QVariant &condition, rule.conditions) {
+            QVariantMap map = condition.toMap();
+            original.insert(canonical(map), map);
+            map.insert("address", remapAddress(map.value("address").toString(), aliases));
+            conditions.insert(canonical(map), map);
+        }
+        originalConditions.insert(rule.id, canonical(original.values()));
+        QVariantList actions;
+        foreach (const QVariant &action, rule.actions) {
+            QVariantMap map = action.toMap();
+            map.insert("address", remapAddress(map.value("address").toString(), aliases));
+            actions.append(map);
+        }
+
+        // Merging would switch the actions of one of them on or off
+        QString key = (rule.enabled ? "enabled\n" : "disabled\n") + canonical(conditions.values());
+        if (byConditions.contains(key)) {
+            RuleData &target = merged[byConditions.value(key)];
+            target.actions += actions;
+            m_removedRules.append(rule.id);
+            continue;
+        }
+        RuleData normalized = rule;
+        normalized.conditions = conditions.values();
+        normalized.actions = actions;
+        byConditions.insert(key, merged.count());
+        merged.append(normalized);
+    }
+
+    QList<RuleData> after;
+    QHash<QString, QVariantList> originalActions;
+    foreach (const RuleData &rule, before) {
+        originalActions.insert(rule.id, rule.actions);
+    }
+    foreach (RuleData rule, merged) {
+        rule.actions = mergeActions(substituteGroups(substituteScenes(rule.actions)));
+
+        QList<RuleData> parts;
+        if (rule.actions.count() > m_maxActions && !changesOwnConditions(rule)) {
+            for (int i = 0; i < rule.actions.count(); i += m_maxActions) {
+                RuleData part = rule;
+                part.actions = rule.actions.mid(i, m_maxActions);
+                if (i > 0) {
+                    QString suffix = " " + QString::number(i / m_maxActions + 1);
+                    part.id.clear();
+                    part.name = rule.name.left(s_maxNameLength - suffix.length()) + suffix;
+                }
+                parts.append(part);
+            }
+        } else {
+            parts.append(rule);
+        }
+
+        foreach (const RuleData &part, parts) {
+            if (part.id.isEmpty() || canonical(part.conditions) != originalConditions.value(part.id)
+                    || canonical(part.actions) != canonical(originalActions.value(part.id))) {
+                m_changedRules.append(part);
+            }
+            after.append(part);
+        }
+    }
+
+    m_report = usage(before, "Before");
+    QVariantMap afterUsage = usage(after, "After");
+    foreach (const QString &key, afterUsage.keys()) {
+        m_report.insert(key, afterUsage.value(key));
+    }
+    int helperSensors = 0;
+    if (m_sensors) {
+        for (int i = 0; i < m_sensors->rowCount(QModelIndex()); ++i) {
+            if (m_sensors->get(i)->modelId() == "shine-helper-status") {
+                helperSensors++;
+            }
+        }
+    }
+    m_report.insert("helperSensorsBefore", helperSensors);
+    m_report.insert("helperSensorsAfter", helperSensors - m_removedSensors.count());
+    m_report.insert("changedRules", m_changedRules.count());
+    m_report.insert("removedRules", m_removedRules.count());
+    m_report.insert("removedSensors", m_removedSensors.count());
+    emit reportChanged();
+}
+
+void RuleOptimizer::apply()
+{
+    if (busy()) {
+        return;
+    }
+    HueBridgeConnection *bridge = HueBridgeConnection::instance();
+    // Changed rules go first so merged actions are in place before their old rules are deleted
+    foreach (const RuleData &rule, m_changedRules) {
+        QVariantMap params;
+        params.insert("name", rule.name);
+        params.insert("conditions", rule.conditions);
+        params.insert("actions", rule.actions);
+        if (rule.id.isEmpty()) {
+            params.insert("status", rule.enabled ? "enabled" : "disabled");
+            m_pendingRequests.append(bridge->post("rules", params, this, "requestFinished", HueBridgeConnection::PriorityAutomation));
+        } else {
+            m_pendingRequests.append(bridge->put("rules/" + rule.id, params, this, "requestFinished", HueBridgeConnection::PriorityAutomation));
+        }
+    }
+    foreach (const QString &id, m_removedRules) {
+        m_pendingRequests.append(bridge->deleteResource("rules/" + id, this, "requestFinished", HueBridgeConnection::PriorityAutomation));
+    }
+    foreach (const QString &id, m_removedSensors) {
+        m_pendingRequests.append(bridge->deleteResource("sensors/" + id, this, "requestFinished", HueBridgeConnection::PriorityAutomation));
+    }
+    m_changedRules.clear();
+    m_removedRules.clear();
+    m_removedSensors.clear();
+
+    if (!m_pendingRequests.isEmpty()) {
+        emit busyChanged();
+    }
+}
+
+void RuleOptimizer::requestFinished(int id, const QVariant &response)
+{
+    if (!m_pendingRequests.removeOne(id)) {
+        return;
+    }
+    foreach (const QVariant &result, response.toList()) {
+        if (result.toMap().contains("error")) {
+            qWarning() << "RuleOptimizer: bridge rejected change:" << result;
+        }
+    }
+    if (m_pendingRequests.isEmpty()) {
+        emit busyChanged();
+        if (m_rules) {
+            m_rules->refresh();
+        }
+        if (m_sensors) {
+            m_sensors->refresh();
+        }
+        emit applied();
+    }
+}
+
+static bool ruleLessThan(const QString &a, const QString &b)
+{
+    return a.toInt() < b.toInt();
+}
+
+QList<RuleOptimizer::RuleData> RuleOptimizer::currentRules() const
+{
+    QList<RuleData> rules;
+    if (!m_rules) {
+        return rules;
+    }
+    // Oldest rules first, merges keep their ids
+    QStringList ids;
+    for (int i = 0; i < m_rules->rowCount(QModelIndex()); ++i) {
+        ids.append(m_rules->get(i)->id());
+    }
+    qSort(ids.begin(), ids.end(), ruleLessThan);
+    foreach (const QString &id, ids) {
+        Rule *rule = m_rules->findRule(id);
+        RuleData data;
+        data.id = rule->id();
+        data.name = rule->name();
+        data.conditions = rule->conditions();
+        data.actions = rule->actions();
+        data.enabled = rule->enabled();
+        rules.append(data);
+    }
+    return rules;
+}
+
+QHash<QString, QString> RuleOptimizer::helperSensorAliases(QStringList *unused, const QList<RuleData> &rules) const
+{
+    QHash<QString, QString> aliases;
+    if (!m_sensors) {
+        return aliases;
+    }
+
+    // Concurrent lookups could create the same helper more than once
+    QHash<QString, QString> helpers;
+    QStringList helperIds;
+    for (int i = 0; i < m_sensors->rowCount(QModelIndex()); ++i) {
+        Sensor *sensor = m_sensors->get(i);
+        if (sensor->modelId() != "shine-helper-status") {
+            continue;
+        }
+        QString key = sensor->name() + '\n' + sensor->uniqueId();
+        QString existing = helpers.value(key);
+        if (existing.isEmpty()) {
+            helpers.insert(key, sensor->id());
+        } else if (sensor->id().toInt() < existing.toInt()) {
+            aliases.insert(existing, sensor->id());
+            helpers.insert(key, sensor->id());
+        } else {
+            aliases.insert(sensor->id(), existing);
+        }
+        helperIds.append(sensor->id());
+    }
+    // Chains from replacing a kept sensor with one with a lower id
+    foreach (const QString &id, aliases.keys()) {
+        QString target = aliases.value(id);
+        while (aliases.contains(target)) {
+            target = aliases.value(target);
+        }
+        aliases.insert(id, target);
+    }
+
+    QSet<QString> used;
+    foreach (const RuleData &rule, rules) {
+        foreach (const QVariant &item, rule.conditions + rule.actions) {
+            QStringList parts = remapAddress(item.toMap().value("address").toString(), aliases).split('/');
+            if (parts.count() > 2 && parts.at(1) == "sensors") {
+                used.insert(parts.at(2));
+            }
+        }
+    }
+    foreach (const QString &id, helperIds) {
+        if (!aliases.contains(id) && !used.contains(id)) {
+            unused->append(id);
+        }
+    }
+    return aliases;
+}
+
+QVariantList RuleOptimizer::substituteScenes(const QVariantList &actions) const
+{
+    QVariantList result = actions;
+    foreach (const QString &sceneId, m_sceneStates.keys()) {
+        QVariantMap states = m_sceneStates.value(sceneId).toMap();
+        if (states.count() < 2) {
+            continue;
+        }
+        // Every light of the scene needs to be set to its scene state
+        QList<int> matches;
+        foreach (const QString &light, states.keys()) {
+            QString state = canonical(states.value(light));
+            int match = -1;
+            for (int i = 0; i < result.count(); ++i) {
+                QVariantMap action = result.at(i).toMap();
+                if (lightId(action) == light.toInt() && canonical(action.value("body")) == state) {
+                    match = i;
+                    break;
+                }
+            }
+            if (match == -1) {
+                break;
+            }
+            matches.append(match);
+        }
+        if (matches.count() != states.count()) {
+            continue;
+        }
+
+        qSort(matches);
+        QVariantMap body;
+        body.insert("scene", sceneId);
+        QVariantMap sceneAction;
+        sceneAction.insert("address", "/groups/0/action");
+        sceneAction.insert("method", "PUT");
+        sceneAction.insert("body", body);
+        for (int i = matches.count() - 1; i > 0; --i) {
+            result.removeAt(matches.at(i));
+        }
+        result[matches.first()] = sceneAction;
+    }
+    return result;
+}
+
+QVariantList RuleOptimizer::substituteGroups(const QVariantList &actions) const
+{
+    if (!m_groups) {
+        return actions;
+    }
+
+    // Lights getting the same state
+    QHash<QString, QSet<int> > lightsByBody;
+    for (int i = 0; i < actions.count(); ++i) {
+        QVariantMap action = actions.at(i).toMap();
+        int light = lightId(action);
+        if (light >= 0) {
+            lightsByBody[canonical(action.value("body"))].insert(light);
+        }
+    }
+
+    // Largest groups first, they save the most actions
+    QMap<int, Group*> groups;
+    for (int i = 0; i < m_groups->rowCount(QModelIndex()); ++i) {
+        Group *group = m_groups->get(i);
+        if (group->lightIds().count() > 1) {
+            groups.insertMulti(-group->lightIds().count(), group);
+        }
+    }
+    QHash<QString, QList<int> > groupsByBody;
+    foreach (Group *group, groups) {
+        QSet<int> lights = group->lightIds().toSet();
+        foreach (const QString &body, lightsByBody.keys()) {
+            if (lightsByBody.value(body).contains(lights)) {
+                lightsByBody[body].subtract(lights);
+                groupsByBody[body].append(group->id());
+            }
+        }
+    }
+    if (groupsByBody.isEmpty()) {
+        return actions;
+    }
+
+    // Group actions take the place of the first light action with the same state
+    QVariantList result;
+    QSet<QString> placed;
+    foreach (const QVariant &item, actions) {
+        QVariantMap action = item.toMap();
+        int light = lightId(action);
+        QString body = canonical(action.value("body"));
+        if (light < 0 || !groupsByBody.contains(body)) {
+            result.append(action);
+            continue;
+        }
+        if (!placed.contains(body)) {
+            placed.insert(body);
+            foreach (int groupId, groupsByBody.value(body)) {
+                QVariantMap groupAction = action;
+                groupAction.insert("address", "/groups/" + QString::number(groupId) + "/action");
+                result.append(groupAction);
+            }
+        }
+        if (lightsByBody.value(body).contains(light)) {
+            result.append(action);
+        }
+    }
+    return result;
+}
+
+QVariantList RuleOptimizer::mergeActions(const QVariantList &actions) const
+{
+    QVariantList result;
+    QSet<QString> seen;
+    foreach (const QVariant &item, actions) {
+        QString key = canonical(item);
+        if (seen.contains(key)) {
+            continue;
+        }
+        seen.insert(key);
+
+        // Writes to the same resource go into one body. Relative changes add up and scenes
+        // are recalled as a whole, those are left alone.
+        QVariantMap action = item.toMap();
+        QVariantMap body = action.value("body").toMap();
+        bool merged = false;
+        for (int i = 0; i < result.count() && !merged; ++i) {
+            QVariantMap other = result.at(i).toMap();
+            if (other.value("address") != action.value("address") || other.value("method") != "PUT" || action.value("method") != "PUT") {
+                continue;
+            }
+            QVariantMap otherBody = other.value("body").toMap();
+            bool conflict = body.contains("scene") || otherBody.contains("scene");
+            foreach (const QString &key, body.keys()) {
+                conflict |= key.endsWith("_inc") && otherBody.contains(key);
+            }
+            if (conflict) {
+                continue;
+            }
+            foreach (const QString &key, body.keys()) {
+                otherBody.insert(key, body.value(key));
+            }
+            other.insert("body", otherBody);
+            result[i] = other;
+            merged = true;
+        }
+        if (!merged) {
+            result.append(action);
+        }
+    }
+    return result;
+}
+
+bool RuleOptimizer::changesOwnConditions(const RuleData &rule) const
+{
+    QSet<QString> read;
+    foreach (const QVariant &condition, rule.conditions) {
+        read.insert(condition.toMap().value("address").toString());
+    }
+    foreach (const QVariant &item, rule.actions) {
+        QVariantMap action = item.toMap();
+        QVariantMap body = action.value("body").toMap();
+        foreach (const QString &key, body.keys()) {
+            QString attribute = key.endsWith("_inc") ? key.left(key.length() - 4) : key;
+            if (read.contains(action.value("address").toString() + "/" + attribute)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+QVariantMap RuleOptimizer::usage(const QList<RuleData> &rules, const QString &suffix) const
+{
+    int conditions = 0;
+    int actions = 0;
+    int maxConditions = 0;
+    int maxActions = 0;
+    foreach (const RuleData &rule, rules) {
+        conditions += rule.conditions.count();
+        actions += rule.actions.count();
+        maxConditions = qMax(maxConditions, rule.conditions.count());
+        maxActions = qMax(maxActions, rule.actions.count());
+    }
+    QVariantMap usage;
+    usage.insert("rules" + suffix, rules.count());
+    usage.insert("conditions" + suffix, conditions);
+    usage.insert("actions" + suffix, actions);
+    usage.insert("maxConditions" + suffix, maxConditions);
+    usage.insert("maxActions" + suffix, maxActions);
+    usage.insert("overLimit" + suffix, rules.count() > m_maxRules || maxConditions > m_maxConditions || maxActions > m_maxActions);
+    return usage;
+}
+
+QString RuleOptimizer::canonical(const QVariant &value)
+{
+    // QVariantMap is sorted by key, equal contents give equal strings
+    switch (value.type()) {
+    case QVariant::Map: {
+        QVariantMap map = value.toMap();
+        QString result = "{";
+        foreach (const QString &key, map.keys()) {
+            result += key + ":" + canonical(map.value(key)) + ",";
+        }
+        return result + "}";
+    }
+    case QVariant::List: {
+        QString result = "[";
+        foreach (const QVariant &item, value.toList()) {
+            result += canonical(item) + ",";
+        }
+        return result + "]";
+    }
+    default:
+        return value.toString();
+    }
+}
+
+QString RuleOptimizer::remapAddress(const QString &address, const QHash<QString, QString> &aliases)
+{
+    if (aliases.isEmpty()) {
+        return address;
+    }
+    QStringList parts = address.split('/');
+    if (parts.count() > 2 && parts.at(1) == "sensors" && aliases.contains(parts.at(2))) {
+        parts[2] = aliases.value(parts.at(2));
+        return parts.join("/");
+    }
+    return address;
+}
+
+int RuleOptimizer::lightId(const QVariantMap &action)
+{
+    QStringList parts = action.value("address").toString().split('/');
+    if (action.value("method") != "PUT" || parts.count() != 4 || parts.at(1) != "lights" || parts.at(3) != "state") {
+        return -1;
+    }
+    bool ok;
+    int id = parts.at(2).toInt(&ok);
+    return ok ? id : -1;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+
+#ifndef RULEOPTIMIZER_H
+#define RULEOPTIMIZER_H
+
+#include <QObject>
+#include <QHash>
+#include <QPointer>
+#include <QStringList>
+#include <QVariant>
+
+class Rules;
+class Groups;
+class Sensors;
+
+// Compacts the rules on the bridge to stay within its limits on rules, conditions and
+// actions per rule:
+// - duplicated helper sensors (same name and unique id) are folded into one
+// - conditions are sorted and deduplicated, rules with the same conditions are merged
+// - per-light actions are replaced by a scene action if they set exactly the lights of a
+//   scene to its states, or by group actions where a group's lights all get the same state
+// - rules with more than maxActions actions are split, unless they change their own
+//   conditions
+// optimize() only computes the result and the report, apply() writes it to the bridge.
+class RuleOptimizer: public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(Rules *rules READ rules WRITE setRules NOTIFY rulesChanged)
+    Q_PROPERTY(Groups *groups READ groups WRITE setGroups NOTIFY groupsChanged)
+    Q_PROPERTY(Sensors *sensors READ sensors WRITE setSensors NOTIFY sensorsChanged)
+    // sceneId -> { lightId -> state }, scenes without known states aren't used
+    Q_PROPERTY(QVariantMap sceneStates READ sceneStates WRITE setSceneStates NOTIFY sceneStatesChanged)
+    Q_PROPERTY(int maxRules READ maxRules WRITE setMaxRules NOTIFY limitsChanged)
+    Q_PROPERTY(int maxConditions READ maxConditions WRITE setMaxConditions NOTIFY limitsChanged)
+    Q_PROPERTY(int maxActions READ maxActions WRITE setMaxActions NOTIFY limitsChanged)
+    Q_PROPERTY(QVariantMap report READ report NOTIFY reportChanged)
+    Q_PROPERTY(bool busy READ busy NOTIFY busyChanged)
+
+public:
+    RuleOptimizer(QObject *parent = 0);
+
+    Rules *rules() const;
+    void setRules(Rules *rules);
+    Groups *groups() const;
+    void setGroups(Groups *groups);
+    Sensors *sensors() const;
+    void setSensors(Sensors *sensors);
+
+    QVariantMap sceneStates() const;
+    void setSceneStates(const QVariantMap &sceneStates);
+
+    int maxRules() const;
+    void setMaxRules(int maxRules);
+    int maxConditions() const;
+    void setMaxConditions(int maxConditions);
+    int maxActions() const;
+    void setMaxActions(int maxActions);
+
+    // Resource usage before and after, e.g. rulesBefore and rulesAfter, and what apply() does
+    QVariantMap report() const;
+    bool busy() const;
+
+    Q_INVOKABLE void optimize();
+    Q_INVOKABLE void apply();
+
+signals:
+    void rulesChanged();
+    void groupsChanged();
+    void sensorsChanged();
+    void sceneStatesChanged();
+    void limitsChanged();
+    void reportChanged();
+    void busyChanged();
+    void applied();
+
+private slots:
+    void requestFinished(int id, const QVariant &response);
+
+private:
+    class RuleData
+    {
+    public:
+        // Empty for rules which need to be created
+        QString id;
+        QString name;
+        QVariantList conditions;
+        QVariantList actions;
+        // Rules are only merged with rules of the same status
+        bool enabled;
+    };
+
+    QList<RuleData> currentRules() const;
+    QHash<QString, QString> helperSensorAliases(QStringList *unused, const QList<RuleData> &rules) const;
+    QVariantList substituteScenes(const QVariantList &actions) const;
+    QVariantList substituteGroups(const QVariantList &actions) const;
+    QVariantList mergeActions(const QVariantList &actions) const;
+    bool changesOwnConditions(const RuleData &rule) const;
+    QVariantMap usage(const QList<RuleData> &rules, const QString &suffix) const;
+
+    static QString canonical(const QVariant &value);
+    static QString remapAddress(const QString &address, const QHash<QString, QString> &aliases);
+    static int lightId(const QVariantMap &action);
+
+    QPointer<Rules> m_rules;
+    QPointer<Groups> m_groups;
+    QPointer<Sensors> m_sensors;
+    QVariantMap m_sceneStates;
+    int m_maxRules;
+    int m_maxConditions;
+    int m_maxActions;
+
+    QVariantMap m_report;
+    QList<RuleData> m_changedRules;
+    QStringList m_removedRules;
+    QStringList m_removedSensors;
+    QList<int> m_pendingRequests;
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include "rule.h"
 
 #include "huebridgeconnection.h"
+#include "colorconversion.h"
 
 #include <QDebug>
 #include <QUuid>
@@ -87,9 +88,24 @@ Rule* Rules::findRule(const QString &id) const
     return 0;
 }
 
+QStringList Rules::rulesForCondition(const QVariantMap &condition) const
+{
+    return ruleIdsForCondition(condition).toList();
+}
+
+QStringList Rules::rulesForAddress(const QString &address) const
+{
+    return m_rulesByAddress.value(address).toList();
+}
+
+QSet<QString> Rules::ruleIdsForCondition(const QVariantMap &condition) const
+{
+    return m_rulesByCondition.value(conditionKey(condition));
+}
+
 void Rules::deleteRule(int ruleId)
 {
-    HueBridgeConnection::instance()->deleteResource("rules/" + QString::number(ruleId), this, "ruleDeleted");
+    HueBridgeConnection::instance()->deleteResource("rules/" + QString::number(ruleId), this, "ruleDeleted", HueBridgeConnection::PriorityAutomation);
 }
 
 void Rules::createRule(const QString &name, const QVariantList &conditions, const QVariantList &actions)
@@ -99,7 +115,7 @@ void Rules::createRule(const QString &name, const QVariantList &conditions, cons
     params.insert("status", "enabled");
     params.insert("conditions", conditions);
     params.insert("actions", actions);
-    HueBridgeConnection::instance()->post("rules", params, this, "createRuleFinished");
+    HueBridgeConnection::instance()->post("rules", params, this, "createRuleFinished", HueBridgeConnection::PriorityAutomation);
 }
 
 QVariantMap Rules::createHelperCondition(int helperSensorId, const QString &op, const QString &value)
@@ -194,17 +210,14 @@ QVariantMap Rules::createLightDimmerAction(int lightId, Rules::DimAction dimActi
 
 QVariantMap Rules::createLightColorAction(int lightId, const QColor &color, int bri)
 {
-    // Transform from RGB to Hue/Sat
-    quint16 hue = color.hue() * 65535 / 360;
-    quint8 sat = color.saturation();
+    QPointF xy = ColorConversion::rgbToXy(color, ColorConversion::gamutForLight(lightId));
 
     QVariantMap action;
     action.insert("address", "/lights/" + QString::number(lightId) + "/state");
     action.insert("method", "PUT");
     QVariantMap body;
     body.insert("on", true);
-    body.insert("hue", hue);
-    body.insert("sat", sat);
+    body.insert("xy", ColorConversion::xyToVariant(xy));
     body.insert("bri", bri);
     action.insert("body", body);
     return action;
@@ -236,17 +249,14 @@ QVariantMap Rules::createGroupDimmerAction(int lightId, Rules::DimAction dimActi
 
 QVariantMap Rules::createGroupColorAction(int groupId, const QColor &color, int bri)
 {
-    // Transform from RGB to Hue/Sat
-    quint16 hue = color.hue() * 65535 / 360;
-    quint8 sat = color.saturation();
+    QPointF xy = ColorConversion::rgbToXy(color, ColorConversion::gamutForGroup(groupId));
 
     QVariantMap action;
     action.insert("address", "/groups/" + QString::number(groupId) + "/action");
     action.insert("method", "PUT");
     QVariantMap body;
     body.insert("on", true);
-    body.insert("hue", hue);
-    body.insert("sat", sat);
+    body.insert("xy", ColorConversion::xyToVariant(xy));
     body.insert("bri", bri);
     action.insert("body", body);
     return action;
@@ -310,7 +320,7 @@ bool Rules::busy() const
 
 void Rules::refresh()
 {
-    HueBridgeConnection::instance()->get("rules", this, "rulesReceived");
+    HueBridgeConnection::instance()->get("rules", this, "rulesReceived", HueBridgeConnection::PriorityBackground);
     m_busy = true;
     emit busyChanged();
 }
@@ -329,10 +339,12 @@ void Rules::rulesReceived(int id, const QVariant &variant)
 
     foreach (Rule *rule, removedRules) {
         int index = m_list.indexOf(rule);
+        unindexConditions(rule);
         beginRemoveRows(QModelIndex(), index, index);
         m_list.takeAt(index)->deleteLater();
         endRemoveRows();
     }
+    bool indexChanged = !removedRules.isEmpty();
 
     foreach (const QString &ruleId, rules.keys()) {
         Rule *rule = findRule(ruleId);
@@ -340,8 +352,19 @@ void Rules::rulesReceived(int id, const QVariant &variant)
         if (!rule) {
             rule = createRuleInternal(ruleId, ruleMap.value("name").toString());
         }
-        rule->setConditions(ruleMap.value("conditions").toList());
+        QVariantList conditions = ruleMap.value("conditions").toList();
+        if (rule->conditions() != conditions) {
+            // Only rules whose conditions changed are re-indexed
+            unindexConditions(rule);
+            rule->setConditions(conditions);
+            indexConditions(rule);
+            indexChanged = true;
+        }
         rule->setActions(ruleMap.value("actions").toList());
+        rule->setEnabled(ruleMap.value("status").toString() != "disabled");
+    }
+    if (indexChanged) {
+        emit conditionIndexChanged();
     }
     m_busy = false;
     emit busyChanged();
@@ -363,6 +386,38 @@ void Rules::createRuleFinished(int id, const QVariant &response)
 //    HueBridgeConnection::instance()->deleteResource("schedules/" + id, this, "deleteScheduleFinished");
 //}
 
+void Rules::indexConditions(Rule *rule)
+{
+    foreach (const QVariant &condition, rule->conditions()) {
+        QVariantMap conditionMap = condition.toMap();
+        m_rulesByCondition[conditionKey(conditionMap)].insert(rule->id());
+        m_rulesByAddress[conditionMap.value("address").toString()].insert(rule->id());
+    }
+}
+
+void Rules::unindexConditions(Rule *rule)
+{
+    foreach (const QVariant &condition, rule->conditions()) {
+        QVariantMap conditionMap = condition.toMap();
+        QString key = conditionKey(conditionMap);
+        m_rulesByCondition[key].remove(rule->id());
+        if (m_rulesByCondition.value(key).isEmpty()) {
+            m_rulesByCondition.remove(key);
+        }
+        QString address = conditionMap.value("address").toString();
+        m_rulesByAddress[address].remove(rule->id());
+        if (m_rulesByAddress.value(address).isEmpty()) {
+            m_rulesByAddress.remove(address);
+        }
+    }
+}
+
+QString Rules::conditionKey(const QVariantMap &condition)
+{
+    // Values are strings on the bridge but may be passed as numbers or bools
+    return condition.value("address").toString() + '\n' + condition.value("operator").toString() + '\n' + condition.value("value").toString();
+}
+
 Rule* Rules::createRuleInternal(const QString &id, const QString &name)
 {
     Rule *rule = new Rule(id, name, this);
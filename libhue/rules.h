@@ -23,6 +23,8 @@
 #include "huemodel.h"
 
 #include <QTimer>
+#include <QSet>
+#include <QStringList>
 
 class Rule;
 
@@ -50,6 +52,12 @@ public:
     QHash<int, QByteArray> roleNames() const;
     Q_INVOKABLE Rule* get(int index) const;
     Q_INVOKABLE Rule* findRule(const QString &id) const;
+
+    // Ids of the rules with this condition (address, operator and value)
+    Q_INVOKABLE QStringList rulesForCondition(const QVariantMap &condition) const;
+    // Ids of the rules with any condition on this address, e.g. /sensors/5/state/buttonevent
+    Q_INVOKABLE QStringList rulesForAddress(const QString &address) const;
+    QSet<QString> ruleIdsForCondition(const QVariantMap &condition) const;
     Q_INVOKABLE void deleteRule(int ruleId);
 
     Q_INVOKABLE void createRule(const QString &name, const QVariantList &conditions, const QVariantList &actions);
@@ -74,6 +82,9 @@ public:
 public slots:
     void refresh();
 
+signals:
+    void conditionIndexChanged();
+
 private slots:
     void rulesReceived(int id, const QVariant &variant);
 
@@ -82,8 +93,14 @@ private slots:
 
 private:
     Rule* createRuleInternal(const QString &id, const QString &name);
+    void indexConditions(Rule *rule);
+    void unindexConditions(Rule *rule);
+    static QString conditionKey(const QVariantMap &condition);
 
     QList<Rule*> m_list;
+    // Condition key -> rule ids and address -> rule ids, kept up to date in rulesReceived()
+    QHash<QString, QSet<QString> > m_rulesByCondition;
+    QHash<QString, QSet<QString> > m_rulesByAddress;
     bool m_busy;
 };
 
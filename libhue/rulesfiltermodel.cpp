@@ -23,11 +23,14 @@ void RulesFilterModel::setRules(Rules *rules)
     if (m_rules != rules) {
         if (m_rules) {
             disconnect(m_rules, SIGNAL(countChanged()), this, SIGNAL(countChanged()));
+            disconnect(m_rules, SIGNAL(conditionIndexChanged()), this, SLOT(updateMatches()));
         }
         m_rules = rules;
+        m_matchingRuleIds = m_rules ? m_rules->ruleIdsForCondition(m_conditionFilter) : QSet<QString>();
         setSourceModel(rules);
         emit rulesChanged();
         connect(m_rules, SIGNAL(countChanged()), this, SIGNAL(countChanged()));
+        connect(m_rules, SIGNAL(conditionIndexChanged()), this, SLOT(updateMatches()));
         emit countChanged();
     }
 }
@@ -42,6 +45,7 @@ void RulesFilterModel::setConditionFilter(const QVariantMap &conditionFilter)
     if (m_conditionFilter != conditionFilter) {
         m_conditionFilter = conditionFilter;
         emit conditionFilterChanged();
+        m_matchingRuleIds = m_rules ? m_rules->ruleIdsForCondition(m_conditionFilter) : QSet<QString>();
         invalidateFilter();
         emit countChanged();
     }
@@ -58,15 +62,19 @@ bool RulesFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex &source
     Q_UNUSED(sourceParent)
 
     if (!m_conditionFilter.isEmpty()) {
-        bool match = false;
-        foreach (const QVariant &condition, m_rules->get(sourceRow)->conditions()) {
-            if (condition.toMap() == m_conditionFilter) {
-                match = true;
-            }
-        }
-        if (!match) {
-            return false;
-        }
+        return m_matchingRuleIds.contains(m_rules->get(sourceRow)->id());
     }
     return true;
 }
+
+void RulesFilterModel::updateMatches()
+{
+    QSet<QString> matchingRuleIds = m_rules->ruleIdsForCondition(m_conditionFilter);
+    if (matchingRuleIds == m_matchingRuleIds) {
+        // Rules with other conditions changed, nothing to filter again
+        return;
+    }
+    m_matchingRuleIds = matchingRuleIds;
+    invalidateFilter();
+    emit countChanged();
+}
@@ -2,6 +2,7 @@
 #define RULESFILTERMODEL_H
 
 #include <QSortFilterProxyModel>
+#include <QSet>
 
 class Rule;
 class Rules;
@@ -35,9 +36,14 @@ signals:
     void rulesChanged();
     void conditionFilterChanged();
 
+private slots:
+    void updateMatches();
+
 private:
     Rules *m_rules;
     QVariantMap m_conditionFilter;
+    // Rules matching the condition filter, looked up in the index of Rules
+    QSet<QString> m_matchingRuleIds;
 };
 
 #endif
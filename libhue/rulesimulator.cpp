@@ -0,0 +1,494 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+
+#include "rulesimulator.h"
+#include "rules.h"
+#include "rule.h"
+#include "sensors.h"
+#include "sensor.h"
+#include "lights.h"
+#include "light.h"
+
+#include <QDateTime>
+#include <QDebug>
+
+// Actions triggering rules triggering actions... the bridge gives up at some point as well
+static const int s_maxCascade = 16;
+
+static bool eventLessThan(const RuleSimulator::Event &a, const RuleSimulator::Event &b)
+{
+    return a.time < b.time;
+}
+
+RuleSimulator::RuleSimulator(QObject *parent):
+    QObject(parent),
+    m_useRuleMaps(false),
+    m_step(0)
+{
+}
+
+Rules *RuleSimulator::rules() const
+{
+    return m_rules;
+}
+
+void RuleSimulator::setRules(Rules *rules)
+{
+    if (m_rules == rules) {
+        return;
+    }
+    m_rules = rules;
+    emit rulesChanged();
+    reset();
+}
+
+Sensors *RuleSimulator::sensors() const
+{
+    return m_sensors;
+}
+
+void RuleSimulator::setSensors(Sensors *sensors)
+{
+    if (m_sensors == sensors) {
+        return;
+    }
+    m_sensors = sensors;
+    emit sensorsChanged();
+    reset();
+}
+
+Lights *RuleSimulator::lights() const
+{
+    return m_lights;
+}
+
+void RuleSimulator::setLights(Lights *lights)
+{
+    if (m_lights == lights) {
+        return;
+    }
+    m_lights = lights;
+    emit lightsChanged();
+    reset();
+}
+
+QStringList RuleSimulator::problems() const
+{
+    return m_problems;
+}
+
+void RuleSimulator::reset()
+{
+    m_addressIds.clear();
+    m_addresses.clear();
+    m_values.clear();
+    m_changeCounts.clear();
+    m_changedStep.clear();
+    m_rulesByAddress.clear();
+    m_compiled.clear();
+    m_delayed.clear();
+    m_problems.clear();
+
+    loadState();
+    if (m_useRuleMaps) {
+        foreach (const QString &id, m_ruleMaps.keys()) {
+            QVariantMap rule = m_ruleMaps.value(id).toMap();
+            compile(id, rule.value("name").toString(), rule.value("conditions").toList(), rule.value("actions").toList());
+        }
+    } else if (m_rules) {
+        for (int i = 0; i < m_rules->rowCount(QModelIndex()); ++i) {
+            Rule *rule = m_rules->get(i);
+            compile(rule->id(), rule->name(), rule->conditions(), rule->actions());
+        }
+    }
+    emit problemsChanged();
+}
+
+void RuleSimulator::setRuleMaps(const QVariantMap &rules)
+{
+    m_ruleMaps = rules;
+    m_useRuleMaps = true;
+    reset();
+}
+
+void RuleSimulator::clearRuleMaps()
+{
+    m_ruleMaps.clear();
+    m_useRuleMaps = false;
+    reset();
+}
+
+QVariant RuleSimulator::value(const QString &address) const
+{
+    int id = m_addressIds.value(address, -1);
+    return id >= 0 ? m_values.at(id) : QVariant();
+}
+
+void RuleSimulator::setValue(const QString &address, const QVariant &value)
+{
+    m_values[addressId(address)] = value;
+}
+
+QList<RuleSimulator::Firing> RuleSimulator::replay(const QList<Event> &events, qint64 until)
+{
+    QList<Firing> firings;
+    foreach (const Event &event, events) {
+        runDelayed(event.time, &firings);
+        int address = addressId(event.address);
+        if (change(address, event.value, event.time)) {
+            step(event.time, QList<int>() << address, 0, &firings);
+        }
+    }
+    runDelayed(until == -1 ? Q_INT64_C(0x7fffffffffffffff) : until, &firings);
+    return firings;
+}
+
+QVariantList RuleSimulator::simulate(const QVariantList &events)
+{
+    QList<Event> eventList;
+    foreach (const QVariant &variant, events) {
+        QVariantMap map = variant.toMap();
+        QVariant time = map.value("time");
+        eventList.append(Event(time.type() == QVariant::DateTime ? time.toDateTime().toMSecsSinceEpoch() : time.toLongLong(),
+                               map.value("address").toString(), map.value("value")));
+    }
+    qStableSort(eventList.begin(), eventList.end(), eventLessThan);
+
+    QVariantList result;
+    foreach (const Firing &firing, replay(eventList)) {
+        QVariantMap map;
+        map.insert("time", QDateTime::fromMSecsSinceEpoch(firing.time));
+        map.insert("ruleId", firing.ruleId);
+        map.insert("ruleName", firing.ruleName);
+        map.insert("actions", firing.actions);
+        result.append(map);
+    }
+    return result;
+}
+
+void RuleSimulator::compile(const QString &id, const QString &name, const QVariantList &conditions, const QVariantList &actions)
+{
+    CompiledRule rule;
+    rule.id = id;
+    rule.name = name;
+    rule.actions = actions;
+    rule.triggered = false;
+    rule.wasTrue = false;
+    rule.evaluated = 0;
+
+    foreach (const QVariant &variant, conditions) {
+        QVariantMap map = variant.toMap();
+        QString address = map.value("address").toString();
+        QString op = map.value("operator").toString();
+
+        Condition condition;
+        condition.address = addressId(address);
+        condition.text = map.value("value").toString();
+        condition.number = condition.text.toDouble(&condition.isNumber);
+        condition.delay = 0;
+        condition.from = 0;
+        condition.to = 0;
+        condition.weekdays = 0x7f;
+
+        bool valid = true;
+        if (op == "eq") {
+            condition.op = OperatorEq;
+        } else if (op == "gt") {
+            condition.op = OperatorGt;
+            valid = condition.isNumber;
+        } else if (op == "lt") {
+            condition.op = OperatorLt;
+            valid = condition.isNumber;
+        } else if (op == "dx") {
+            condition.op = OperatorDx;
+            rule.triggered = true;
+        } else if (op == "ddx") {
+            condition.op = OperatorDdx;
+            valid = parseDuration(condition.text, &condition.delay);
+            rule.triggered = true;
+        } else if (op == "in" || op == "not in") {
+            condition.op = op == "in" ? OperatorIn : OperatorNotIn;
+            valid = address == "/config/localtime" && parseWindow(condition.text, &condition.from, &condition.to, &condition.weekdays);
+        } else {
+            m_problems.append(QString("Rule %1 (%2): unsupported operator \"%3\"").arg(id, name, op));
+            return;
+        }
+        if (!valid) {
+            m_problems.append(QString("Rule %1 (%2): invalid value \"%3\" for %4 on %5").arg(id, name, condition.text, op, address));
+            return;
+        }
+        if (m_values.at(condition.address).isNull() && condition.op != OperatorIn && condition.op != OperatorNotIn
+                && ((address.startsWith("/sensors/") && m_sensors) || (address.startsWith("/lights/") && m_lights))) {
+            m_problems.append(QString("Rule %1 (%2): %3 doesn't exist").arg(id, name, address));
+        }
+        rule.conditions.append(condition);
+    }
+
+    int ruleIndex = m_compiled.count();
+    foreach (const Condition &condition, rule.conditions) {
+        // Only changes of sensor and light state trigger rules
+        if (condition.op == OperatorIn || condition.op == OperatorNotIn) {
+            continue;
+        }
+        QVector<int> &rules = m_rulesByAddress[condition.address];
+        if (rules.isEmpty() || rules.last() != ruleIndex) {
+            rules.append(ruleIndex);
+        }
+    }
+    m_compiled.append(rule);
+}
+
+int RuleSimulator::addressId(const QString &address)
+{
+    QHash<QString, int>::const_iterator it = m_addressIds.constFind(address);
+    if (it != m_addressIds.constEnd()) {
+        return it.value();
+    }
+    int id = m_addresses.count();
+    m_addressIds.insert(address, id);
+    m_addresses.append(address);
+    m_values.append(QVariant());
+    m_changeCounts.append(0);
+    m_changedStep.append(0);
+    m_rulesByAddress.append(QVector<int>());
+    return id;
+}
+
+void RuleSimulator::loadState()
+{
+    if (m_sensors) {
+        for (int i = 0; i < m_sensors->rowCount(QModelIndex()); ++i) {
+            Sensor *sensor = m_sensors->get(i);
+            QString prefix = "/sensors/" + sensor->id() + "/state/";
+            QVariantMap stateMap = sensor->stateMap();
+            foreach (const QString &key, stateMap.keys()) {
+                setValue(prefix + key, stateMap.value(key));
+            }
+        }
+    }
+    if (m_lights) {
+        for (int i = 0; i < m_lights->rowCount(QModelIndex()); ++i) {
+            Light *light = m_lights->get(i);
+            QString prefix = "/lights/" + QString::number(light->id()) + "/state/";
+            setValue(prefix + "on", light->on());
+            setValue(prefix + "bri", light->bri());
+            setValue(prefix + "reachable", light->reachable());
+        }
+    }
+}
+
+bool RuleSimulator::change(int address, const QVariant &value, qint64 time)
+{
+    if (m_values.at(address) == value) {
+        return false;
+    }
+    m_values[address] = value;
+    quint32 changeCount = ++m_changeCounts[address];
+
+    // ddx conditions become true if nothing changes for their delay
+    foreach (int ruleIndex, m_rulesByAddress.at(address)) {
+        foreach (const Condition &condition, m_compiled.at(ruleIndex).conditions) {
+            if (condition.op == OperatorDdx && condition.address == address) {
+                DelayedCheck check;
+                check.rule = ruleIndex;
+                check.address = address;
+                check.changeCount = changeCount;
+                m_delayed.insert(time + condition.delay, check);
+            }
+        }
+    }
+    return true;
+}
+
+void RuleSimulator::step(qint64 time, const QList<int> &changed, const DelayedCheck *ddx, QList<Firing> *firings)
+{
+    QList<int> addresses = changed;
+    for (int depth = 0; depth < s_maxCascade; ++depth) {
+        m_step++;
+        QVector<int> candidates;
+        if (ddx) {
+            candidates.append(ddx->rule);
+        }
+        foreach (int address, addresses) {
+            m_changedStep[address] = m_step;
+            candidates += m_rulesByAddress.at(address);
+        }
+
+        QList<int> next;
+        foreach (int ruleIndex, candidates) {
+            CompiledRule &rule = m_compiled[ruleIndex];
+            if (rule.evaluated == m_step) {
+                continue;
+            }
+            rule.evaluated = m_step;
+
+            bool allTrue = true;
+            foreach (const Condition &condition, rule.conditions) {
+                if (!conditionTrue(condition, time, ddx, ruleIndex)) {
+                    allTrue = false;
+                    break;
+                }
+            }
+            if (allTrue && (rule.triggered || !rule.wasTrue)) {
+                Firing firing;
+                firing.time = time;
+                firing.ruleId = rule.id;
+                firing.ruleName = rule.name;
+                firing.actions = rule.actions;
+                firings->append(firing);
+                applyActions(rule.actions, time, &next);
+            }
+            rule.wasTrue = allTrue;
+        }
+
+        if (next.isEmpty()) {
+            return;
+        }
+        addresses = next;
+        ddx = 0;
+    }
+    qWarning() << "RuleSimulator: rules keep triggering each other, stopping after" << s_maxCascade << "rounds";
+}
+
+void RuleSimulator::runDelayed(qint64 until, QList<Firing> *firings)
+{
+    while (!m_delayed.isEmpty() && m_delayed.begin().key() <= until) {
+        qint64 time = m_delayed.begin().key();
+        DelayedCheck check = m_delayed.take(time);
+        // Anything changed in the meantime restarts the delay
+        if (m_changeCounts.at(check.address) == check.changeCount) {
+            step(time, QList<int>(), &check, firings);
+        }
+    }
+}
+
+bool RuleSimulator::conditionTrue(const Condition &condition, qint64 time, const DelayedCheck *ddx, int rule) const
+{
+    const QVariant &value = m_values.at(condition.address);
+    switch (condition.op) {
+    case OperatorEq:
+        if (value.type() == QVariant::Bool) {
+            return value.toBool() == (condition.text == "true");
+        }
+        if (condition.isNumber) {
+            bool ok;
+            double number = value.toDouble(&ok);
+            return ok && number == condition.number;
+        }
+        return value.toString() == condition.text;
+    case OperatorGt:
+        return value.isValid() && value.toDouble() > condition.number;
+    case OperatorLt:
+        return value.isValid() && value.toDouble() < condition.number;
+    case OperatorDx:
+        return m_changedStep.at(condition.address) == m_step;
+    case OperatorDdx:
+        return ddx && ddx->rule == rule && ddx->address == condition.address;
+    case OperatorIn:
+    case OperatorNotIn: {
+        bool inside = inWindow(QDateTime::fromMSecsSinceEpoch(time), condition.from, condition.to, condition.weekdays);
+        return condition.op == OperatorIn ? inside : !inside;
+    }
+    }
+    return false;
+}
+
+void RuleSimulator::applyActions(const QVariantList &actions, qint64 time, QList<int> *changed)
+{
+    foreach (const QVariant &variant, actions) {
+        QVariantMap action = variant.toMap();
+        QString address = action.value("address").toString();
+        if (!address.startsWith("/sensors/") && !address.startsWith("/lights/") && !address.startsWith("/groups/")) {
+            // Schedules and the like don't have state we track
+            continue;
+        }
+        QVariantMap body = action.value("body").toMap();
+        foreach (const QString &key, body.keys()) {
+            int target;
+            QVariant value = body.value(key);
+            if (key.endsWith("_inc")) {
+                target = addressId(address + "/" + key.left(key.length() - 4));
+                value = m_values.at(target).toInt() + value.toInt();
+            } else {
+                target = addressId(address + "/" + key);
+            }
+            if (change(target, value, time)) {
+                changed->append(target);
+            }
+        }
+        // Writing to a CLIP sensor updates it, even with the same value
+        if (address.startsWith("/sensors/")) {
+            int lastUpdated = addressId(address + "/lastupdated");
+            if (change(lastUpdated, QDateTime::fromMSecsSinceEpoch(time).toUTC().toString(Qt::ISODate), time)) {
+                changed->append(lastUpdated);
+            }
+        }
+    }
+}
+
+bool RuleSimulator::parseDuration(const QString &duration, qint64 *ms)
+{
+    if (!duration.startsWith("PT")) {
+        return false;
+    }
+    QTime time = QTime::fromString(duration.mid(2), "hh:mm:ss");
+    if (!time.isValid()) {
+        return false;
+    }
+    *ms = QTime(0, 0).msecsTo(time);
+    return true;
+}
+
+bool RuleSimulator::parseWindow(const QString &window, int *from, int *to, int *weekdays)
+{
+    // [W<bits>/]T<hh:mm:ss>/T<hh:mm:ss>
+    QStringList parts = window.split('/');
+    if (parts.count() == 3 && parts.first().startsWith('W')) {
+        bool ok;
+        *weekdays = parts.takeFirst().mid(1).toInt(&ok);
+        if (!ok) {
+            return false;
+        }
+    }
+    if (parts.count() != 2 || !parts.at(0).startsWith('T') || !parts.at(1).startsWith('T')) {
+        return false;
+    }
+    QTime fromTime = QTime::fromString(parts.at(0).mid(1), "hh:mm:ss");
+    QTime toTime = QTime::fromString(parts.at(1).mid(1), "hh:mm:ss");
+    if (!fromTime.isValid() || !toTime.isValid()) {
+        return false;
+    }
+    *from = QTime(0, 0).secsTo(fromTime);
+    *to = QTime(0, 0).secsTo(toTime);
+    return true;
+}
+
+bool RuleSimulator::inWindow(const QDateTime &localTime, int from, int to, int weekdays)
+{
+    int seconds = QTime(0, 0).secsTo(localTime.time());
+    bool inside;
+    if (from <= to) {
+        inside = seconds >= from && seconds < to;
+    } else {
+        // Window across midnight
+        inside = seconds >= from || seconds < to;
+    }
+    return inside && (weekdays & (1 << (7 - localTime.date().dayOfWeek())));
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+
+#ifndef RULESIMULATOR_H
+#define RULESIMULATOR_H
+
+#include <QObject>
+#include <QHash>
+#include <QMultiMap>
+#include <QPointer>
+#include <QStringList>
+#include <QVector>
+#include <QVariant>
+#include <QDateTime>
+
+class Rules;
+class Sensors;
+class Lights;
+
+// Evaluates bridge rules locally to find out what a rule set does without deploying it.
+// Rules are compiled once: condition addresses become indexes into a flat state table and
+// each address lists the rules referring to it, so an event only evaluates the rules it
+// can trigger. Actions are applied to the state table and may trigger further rules, like
+// on the bridge.
+// Supported operators are eq, gt, lt, dx, ddx, in and not in. A rule fires when one of its
+// addresses changed and all conditions are true, either because of a dx/ddx condition or
+// because the conditions just became true. Time windows (in/not in on /config/localtime)
+// are checked against the simulated time but don't trigger rules on their own.
+class RuleSimulator: public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(Rules *rules READ rules WRITE setRules NOTIFY rulesChanged)
+    Q_PROPERTY(Sensors *sensors READ sensors WRITE setSensors NOTIFY sensorsChanged)
+    Q_PROPERTY(Lights *lights READ lights WRITE setLights NOTIFY lightsChanged)
+    Q_PROPERTY(QStringList problems READ problems NOTIFY problemsChanged)
+
+public:
+    class Event
+    {
+    public:
+        Event(): time(0) {}
+        Event(qint64 time, const QString &address, const QVariant &value): time(time), address(address), value(value) {}
+        // ms since epoch
+        qint64 time;
+        // e.g. /sensors/5/state/buttonevent
+        QString address;
+        QVariant value;
+    };
+
+    class Firing
+    {
+    public:
+        qint64 time;
+        QString ruleId;
+        QString ruleName;
+        QVariantList actions;
+    };
+
+    RuleSimulator(QObject *parent = 0);
+
+    Rules *rules() const;
+    void setRules(Rules *rules);
+    Sensors *sensors() const;
+    void setSensors(Sensors *sensors);
+    Lights *lights() const;
+    void setLights(Lights *lights);
+
+    // Rules which can't be evaluated, e.g. because of an unknown operator
+    QStringList problems() const;
+
+    // Compiles the rules and copies the current sensor and light state
+    Q_INVOKABLE void reset();
+    // Rules given as the bridge returns them, for rule sets which aren't deployed. They are
+    // simulated instead of the rules model until clearRuleMaps() is called.
+    void setRuleMaps(const QVariantMap &rules);
+    void clearRuleMaps();
+
+    Q_INVOKABLE QVariant value(const QString &address) const;
+    // Changes the state without evaluating any rules
+    Q_INVOKABLE void setValue(const QString &address, const QVariant &value);
+
+    // Delayed conditions are followed up to until, or until all of them are resolved if it
+    // is -1. Starts from the current state, call reset() to start over.
+    QList<Firing> replay(const QList<Event> &events, qint64 until = -1);
+    // Events are {time, address, value} maps with time as date or ms since epoch. Returns
+    // {time, ruleId, ruleName, actions} maps.
+    Q_INVOKABLE QVariantList simulate(const QVariantList &events);
+
+    // Bridge time formats: PThh:mm:ss durations and [W<bits>/]Thh:mm:ss/Thh:mm:ss windows,
+    // window times in seconds since midnight, weekdays with Monday = 64 and Sunday = 1
+    static bool parseDuration(const QString &duration, qint64 *ms);
+    static bool parseWindow(const QString &window, int *from, int *to, int *weekdays);
+    static bool inWindow(const QDateTime &localTime, int from, int to, int weekdays);
+
+signals:
+    void rulesChanged();
+    void sensorsChanged();
+    void lightsChanged();
+    void problemsChanged();
+
+private:
+    enum Operator {
+        OperatorEq,
+        OperatorGt,
+        OperatorLt,
+        OperatorDx,
+        OperatorDdx,
+        OperatorIn,
+        OperatorNotIn
+    };
+
+    class Condition
+    {
+    public:
+        int address;
+        Operator op;
+        QString text;
+        bool isNumber;
+        double number;
+        // ddx delay in ms
+        qint64 delay;
+        // in/not in window, seconds since midnight and weekday bits (Monday = 64, Sunday = 1)
+        int from;
+        int to;
+        int weekdays;
+    };
+
+    class CompiledRule
+    {
+    public:
+        QString id;
+        QString name;
+        QVector<Condition> conditions;
+        QVariantList actions;
+        // Has a dx or ddx condition
+        bool triggered;
+        bool wasTrue;
+        // Step in which the rule was evaluated last
+        quint32 evaluated;
+    };
+
+    class DelayedCheck
+    {
+    public:
+        int rule;
+        int address;
+        quint32 changeCount;
+    };
+
+    void compile(const QString &id, const QString &name, const QVariantList &conditions, const QVariantList &actions);
+    int addressId(const QString &address);
+    void loadState();
+    bool change(int address, const QVariant &value, qint64 time);
+    void step(qint64 time, const QList<int> &changed, const DelayedCheck *ddx, QList<Firing> *firings);
+    void runDelayed(qint64 until, QList<Firing> *firings);
+    bool conditionTrue(const Condition &condition, qint64 time, const DelayedCheck *ddx, int rule) const;
+    void applyActions(const QVariantList &actions, qint64 time, QList<int> *changed);
+
+    QPointer<Rules> m_rules;
+    QPointer<Sensors> m_sensors;
+    QPointer<Lights> m_lights;
+    QVariantMap m_ruleMaps;
+    bool m_useRuleMaps;
+
+    QHash<QString, int> m_addressIds;
+    QStringList m_addresses;
+    QVector<QVariant> m_values;
+    QVector<quint32> m_changeCounts;
+    // Step in which the address changed last, for dx
+    QVector<quint32> m_changedStep;
+    QVector<QVector<int> > m_rulesByAddress;
+
+    QVector<CompiledRule> m_compiled;
+    QMultiMap<qint64, DelayedCheck> m_delayed;
+    quint32 m_step;
+    QStringList m_problems;
+};
+
+#endif
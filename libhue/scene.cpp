@@ -28,6 +28,8 @@ Scene::Scene(const QString &id, const QString &name, QObject *parent)
     : QObject(parent)
     , m_id(id)
     , m_name(name)
+    , m_lightStatesKnown(false)
+    , m_fetchRequest(-1)
 {
 //    refresh();
 }
@@ -59,6 +61,7 @@ void Scene::setLights(const QList<int> lights)
 {
     if (lights != m_lightIds) {
         m_lightIds = lights;
+        invalidateLightStates();
         emit lightsChanged();
     }
 }
@@ -76,6 +79,78 @@ int Scene::lightsCount() const
     return m_lightIds.count();
 }
 
+QString Scene::lastUpdated() const
+{
+    return m_lastUpdated;
+}
+
+void Scene::setLastUpdated(const QString &lastUpdated)
+{
+    if (m_lastUpdated != lastUpdated) {
+        m_lastUpdated = lastUpdated;
+        invalidateLightStates();
+    }
+}
+
+QVariantMap Scene::lightStates() const
+{
+    return m_lightStates;
+}
+
+bool Scene::lightStatesKnown() const
+{
+    return m_lightStatesKnown;
+}
+
+QVariantMap Scene::lightState(int lightId) const
+{
+    return m_lightStates.value(QString::number(lightId)).toMap();
+}
+
 void Scene::refresh()
 {
+    invalidateLightStates();
+    fetchLightStates();
+}
+
+void Scene::fetchLightStates()
+{
+    if (m_lightStatesKnown || m_fetchRequest != -1) {
+        return;
+    }
+    m_fetchRequest = HueBridgeConnection::instance()->get("scenes/" + m_id, this, "detailsReceived", HueBridgeConnection::PriorityBackground);
+}
+
+void Scene::detailsReceived(int id, const QVariant &response)
+{
+    // A reply to a request issued before the cache got invalidated is outdated
+    if (id != m_fetchRequest) {
+        return;
+    }
+    m_fetchRequest = -1;
+
+    QVariantMap sceneMap = response.toMap();
+    if (!sceneMap.contains("lightstates")) {
+        qWarning() << "Could not fetch light states of scene" << m_id << response;
+        emit lightStatesFailed();
+        return;
+    }
+
+    m_lastUpdated = sceneMap.value("lastupdated").toString();
+    m_lightStates = sceneMap.value("lightstates").toMap();
+    m_lightStatesKnown = true;
+    emit lightStatesChanged();
+}
+
+void Scene::invalidateLightStates()
+{
+    if (m_fetchRequest != -1) {
+        m_fetchRequest = -1;
+        emit lightStatesFailed();
+    }
+    if (m_lightStatesKnown) {
+        m_lightStates.clear();
+        m_lightStatesKnown = false;
+        emit lightStatesChanged();
+    }
 }
@@ -22,6 +22,7 @@
 
 #include <QObject>
 #include <QAbstractListModel>
+#include <QVariantMap>
 
 class Scene: public QObject
 {
@@ -30,6 +31,8 @@ class Scene: public QObject
     Q_PROPERTY(QString id READ id CONSTANT)
     Q_PROPERTY(QString name READ name WRITE setName NOTIFY nameChanged)
     Q_PROPERTY(int lightsCount READ lightsCount NOTIFY lightsChanged)
+    Q_PROPERTY(QVariantMap lightStates READ lightStates NOTIFY lightStatesChanged)
+    Q_PROPERTY(bool lightStatesKnown READ lightStatesKnown NOTIFY lightStatesChanged)
 
 public:
     Scene(const QString &id, const QString &name, QObject *parent = 0);
@@ -45,17 +48,41 @@ public:
     int lightsCount() const;
     Q_INVOKABLE int light(int index) const;
 
+    // The bridge bumps lastupdated whenever the scene is stored again.
+    // A changed value drops the cached light states.
+    QString lastUpdated() const;
+    void setLastUpdated(const QString &lastUpdated);
+
+    // Light id -> state the scene sets. Only the scenes list is polled, so the states
+    // are fetched on demand with fetchLightStates() and cached until the scene changes.
+    QVariantMap lightStates() const;
+    bool lightStatesKnown() const;
+    Q_INVOKABLE QVariantMap lightState(int lightId) const;
+
 public slots:
     void refresh();
+    void fetchLightStates();
 
 signals:
     void nameChanged();
     void lightsChanged();
+    void lightStatesChanged();
+    // A fetch failed or was abandoned because the scene changed meanwhile
+    void lightStatesFailed();
+
+private slots:
+    void detailsReceived(int id, const QVariant &response);
 
 private:
+    void invalidateLightStates();
+
     QString m_id;
     QString m_name;
     QList<int> m_lightIds;
+    QString m_lastUpdated;
+    QVariantMap m_lightStates;
+    bool m_lightStatesKnown;
+    int m_fetchRequest;
 };
 
 #endif
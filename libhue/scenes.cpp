@@ -83,7 +83,26 @@ void Scenes::recallScene(const QString &id)
 {
     QVariantMap params;
     params.insert("scene", id);
-    HueBridgeConnection::instance()->put("groups/0/action", params, this, "recallSceneFinished");
+    int requestId = HueBridgeConnection::instance()->put("groups/0/action", params, this, "recallSceneFinished");
+    m_recallRequests.insert(requestId, id);
+    m_applyOnFetch.remove(id);
+
+    // Warm the cache while the recall is on its way
+    Scene *scene = findScene(id);
+    if (scene) {
+        scene->fetchLightStates();
+    }
+}
+
+QVariantMap Scenes::knownLightStates() const
+{
+    QVariantMap states;
+    foreach (Scene *scene, m_list) {
+        if (scene->lightStatesKnown()) {
+            states.insert(scene->id(), scene->lightStates());
+        }
+    }
+    return states;
 }
 
 bool Scenes::busy() const
@@ -93,7 +112,7 @@ bool Scenes::busy() const
 
 void Scenes::refresh()
 {
-    HueBridgeConnection::instance()->get("scenes", this, "scenesReceived");
+    HueBridgeConnection::instance()->get("scenes", this, "scenesReceived", HueBridgeConnection::PriorityBackground);
     m_busy = true;
     emit busyChanged();
 }
@@ -117,12 +136,14 @@ void Scenes::scenesReceived(int id, const QVariant &variant)
                 lights << light.toInt();
             }
             scene->setLights(lights);
+            scene->setLastUpdated(sceneMap.value("lastupdated").toString());
         }
     }
 
     foreach (Scene *scene, removedScenes) {
         int index = m_list.indexOf(scene);
         beginRemoveRows(QModelIndex(), index, index);
+        m_applyOnFetch.remove(scene->id());
         m_list.takeAt(index)->deleteLater();
         endRemoveRows();
     }
@@ -134,7 +155,8 @@ void Scenes::scenesReceived(int id, const QVariant &variant)
             foreach (const QVariant &light, sceneMap.value("lights").toList()) {
                 lights << light.toInt();
             }
-            createSceneInternal(sceneId, sceneMap.value("name").toString(), lights);
+            Scene *scene = createSceneInternal(sceneId, sceneMap.value("name").toString(), lights);
+            scene->setLastUpdated(sceneMap.value("lastupdated").toString());
 //            qDebug() << "creating scene with lights" << lights << scene->lightsCount();
         }
     }
@@ -159,6 +181,22 @@ void Scenes::sceneNameChanged()
 #endif
 }
 
+void Scenes::sceneLightStatesChanged()
+{
+    Scene *scene = static_cast<Scene*>(sender());
+    // Invalidated states belong to a changed scene, not to the recall which is waiting
+    if (m_applyOnFetch.remove(scene->id()) && scene->lightStatesKnown()) {
+        HueBridgeConnection::instance()->confirmLightStates(scene->lightStates());
+    }
+}
+
+void Scenes::sceneLightStatesFailed()
+{
+    // A later fetch, e.g. for a preview, must not apply this recall anymore
+    Scene *scene = static_cast<Scene*>(sender());
+    m_applyOnFetch.remove(scene->id());
+}
+
 void Scenes::createScene(const QString &name, const QList<int> &lights)
 {
     const QString possibleCharacters("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789");
@@ -193,6 +231,8 @@ Scene *Scenes::createSceneInternal(const QString &id, const QString &name, const
     scene->setLights(lights);
 
     connect(scene, SIGNAL(nameChanged()), this, SLOT(sceneNameChanged()));
+    connect(scene, SIGNAL(lightStatesChanged()), this, SLOT(sceneLightStatesChanged()));
+    connect(scene, SIGNAL(lightStatesFailed()), this, SLOT(sceneLightStatesFailed()));
 
     beginInsertRows(QModelIndex(), m_list.count(), m_list.count());
     m_list.append(scene);
@@ -205,7 +245,7 @@ void Scenes::createSceneFinished(int id, const QVariant &response)
     Q_UNUSED(id)
     qDebug() << "got createScene result" << response;
 
-    QVariantMap result = response.toList().first().toMap();
+    QVariantMap result = response.toList().value(0).toMap();
 
     if (result.contains("success")) {
         //TODO: could be added without refrshing, but we don't know the name at this point.
@@ -216,5 +256,29 @@ void Scenes::createSceneFinished(int id, const QVariant &response)
 
 void Scenes::recallSceneFinished(int id, const QVariant &variant)
 {
-    qDebug() << "scene recalled" << variant;
+    QString sceneId = m_recallRequests.take(id);
+    Scene *scene = findScene(sceneId);
+    if (!scene) {
+        return;
+    }
+
+    bool success = false;
+    foreach (const QVariant &result, variant.toList()) {
+        if (result.toMap().contains("success")) {
+            success = true;
+        } else if (result.toMap().contains("error")) {
+            qWarning() << "Recalling scene" << sceneId << "failed" << variant;
+            return;
+        }
+    }
+    if (!success) {
+        return;
+    }
+
+    if (scene->lightStatesKnown()) {
+        HueBridgeConnection::instance()->confirmLightStates(scene->lightStates());
+    } else {
+        m_applyOnFetch.insert(sceneId);
+        scene->fetchLightStates();
+    }
 }
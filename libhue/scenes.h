@@ -22,6 +22,8 @@
 
 #include "huemodel.h"
 
+#include <QSet>
+
 class Scene;
 
 class Scenes: public HueModel
@@ -41,8 +43,13 @@ public:
     Q_INVOKABLE Scene* get(int index) const;
     Q_INVOKABLE Scene *findScene(const QString &id) const;
 
+    // Once the bridge acknowledged the recall the scene's light states are applied
+    // to the local lights, fetching them first if they aren't cached yet.
     Q_INVOKABLE void recallScene(const QString &id);
 
+    // Scene id -> light states for all scenes with cached light states
+    Q_INVOKABLE QVariantMap knownLightStates() const;
+
     bool busy() const;
 
 public slots:
@@ -57,6 +64,8 @@ private slots:
 //    void deleteGroupFinished(int id, const QVariant &variant);
     void scenesReceived(int id, const QVariant &variant);
     void sceneNameChanged();
+    void sceneLightStatesChanged();
+    void sceneLightStatesFailed();
 //    void groupLightsChanged();
 
 private:
@@ -64,6 +73,11 @@ private:
 
     QList<Scene*> m_list;
     bool m_busy;
+
+    // recall request id -> scene id
+    QHash<int, QString> m_recallRequests;
+    // Recalled scenes waiting for their light states to be fetched
+    QSet<QString> m_applyOnFetch;
 };
 
 #endif // SCENES_H
@@ -132,6 +132,57 @@ void Schedule::setRecurring(bool recurring)
     }
 }
 
+ScheduleTime Schedule::scheduleTime() const
+{
+    return m_scheduleTime;
+}
+
+void Schedule::setScheduleTime(const ScheduleTime &scheduleTime, const QDateTime &timerStart)
+{
+    m_scheduleTime = scheduleTime;
+    m_timerStart = timerStart;
+
+    // Times of day and durations are passed on as a time on the epoch date
+    QDateTime dateTime = QDateTime::fromMSecsSinceEpoch(0);
+    dateTime.setTime(scheduleTime.time());
+    switch (scheduleTime.kind()) {
+    case ScheduleTime::KindInvalid:
+        break;
+    case ScheduleTime::KindAbsolute:
+        setType(TypeAlarm);
+        setRecurring(false);
+        setDateTime(scheduleTime.dateTime());
+        break;
+    case ScheduleTime::KindRecurring:
+        setType(TypeAlarm);
+        setRecurring(true);
+        setWeekdays(QString("0%1").arg(scheduleTime.weekdays(), 7, 2, QChar('0')));
+        setDateTime(dateTime);
+        break;
+    case ScheduleTime::KindTimer:
+        setType(TypeTimer);
+        setRecurring(false);
+        setDateTime(dateTime);
+        break;
+    }
+}
+
+QDateTime Schedule::nextFire() const
+{
+    return m_nextFire;
+}
+
+bool Schedule::updateNextFire(const QDateTime &now)
+{
+    QDateTime nextFire = m_enabled ? m_scheduleTime.nextFire(now, m_timerStart) : QDateTime();
+    if (m_nextFire == nextFire) {
+        return false;
+    }
+    m_nextFire = nextFire;
+    emit nextFireChanged();
+    return true;
+}
+
 void Schedule::refresh()
 {
 //    HueBridgeConnection::instance()->get("groups/" + QString::number(m_id), this, "responseReceived");
@@ -24,6 +24,8 @@
 #include <QAbstractListModel>
 #include <QDateTime>
 
+#include "scheduletime.h"
+
 class Schedule: public QObject
 {
     Q_OBJECT
@@ -37,6 +39,7 @@ class Schedule: public QObject
     Q_PROPERTY(bool enabled READ enabled NOTIFY enabledChanged)
     Q_PROPERTY(bool autodelete READ autodelete NOTIFY autodeleteChanged)
     Q_PROPERTY(bool recurring READ recurring NOTIFY recurringChanged)
+    Q_PROPERTY(QDateTime nextFire READ nextFire NOTIFY nextFireChanged)
 
 public:
     enum Type {
@@ -69,6 +72,15 @@ public:
     bool recurring() const;
     void setRecurring(bool recurring);
 
+    // Sets type, dateTime, weekdays and recurring from the localtime of the schedule
+    ScheduleTime scheduleTime() const;
+    void setScheduleTime(const ScheduleTime &scheduleTime, const QDateTime &timerStart);
+
+    // Invalid for disabled schedules and schedules which won't fire any more
+    QDateTime nextFire() const;
+    // Returns whether nextFire changed
+    bool updateNextFire(const QDateTime &now);
+
 public slots:
     void refresh();
 
@@ -80,6 +92,7 @@ signals:
     void enabledChanged();
     void autodeleteChanged();
     void recurringChanged();
+    void nextFireChanged();
 
 private slots:
 //    void responseReceived(int id, const QVariant &response);
@@ -96,6 +109,9 @@ private:
     bool m_enabled;
     bool m_autodelete;
     bool m_recurring;
+    ScheduleTime m_scheduleTime;
+    QDateTime m_timerStart;
+    QDateTime m_nextFire;
 };
 
 #endif
@@ -21,6 +21,7 @@
 #include "schedule.h"
 
 #include "huebridgeconnection.h"
+#include "colorconversion.h"
 
 #include <QDebug>
 #include <QUuid>
@@ -30,6 +31,8 @@ Schedules::Schedules(QObject *parent):
     HueModel(parent),
     m_busy(false)
 {
+    m_timelineTimer.setSingleShot(true);
+    connect(&m_timelineTimer, SIGNAL(timeout()), this, SLOT(advanceTimeline()));
 
 #if QT_VERSION < 0x050000
     setRoleNames(roleNames());
@@ -58,6 +61,8 @@ QVariant Schedules::data(const QModelIndex &index, int role) const
         return schedule->recurring();
     case RoleWeekdays:
         return schedule->weekdays();
+    case RoleNextFire:
+        return schedule->nextFire();
     }
 
     return QVariant();
@@ -72,6 +77,7 @@ QHash<int, QByteArray> Schedules::roleNames() const
     roles.insert(RoleType, "type");
     roles.insert(RoleRecurring, "recurring");
     roles.insert(RoleWeekdays, "weekdays");
+    roles.insert(RoleNextFire, "nextFire");
     return roles;
 }
 
@@ -93,6 +99,21 @@ Schedule *Schedules::findSchedule(const QString &id) const
     return 0;
 }
 
+QStringList Schedules::upcoming(const QDateTime &from, const QDateTime &to) const
+{
+    QStringList ids;
+    QMultiMap<QDateTime, Schedule*>::const_iterator end = m_timeline.lowerBound(to);
+    for (QMultiMap<QDateTime, Schedule*>::const_iterator it = m_timeline.lowerBound(from); it != end; ++it) {
+        ids.append(it.value()->id());
+    }
+    return ids;
+}
+
+Schedule *Schedules::nextSchedule() const
+{
+    return m_timeline.isEmpty() ? 0 : m_timeline.begin().value();
+}
+
 bool Schedules::busy() const
 {
     return m_busy;
@@ -163,7 +184,7 @@ void Schedules::createSingleAlarmForLight(const QString &name, int lightId, bool
 
 void Schedules::refresh()
 {
-    HueBridgeConnection::instance()->get("schedules", this, "schedulesReceived");
+    HueBridgeConnection::instance()->get("schedules", this, "schedulesReceived", HueBridgeConnection::PriorityBackground);
     m_busy = true;
     emit busyChanged();
 }
@@ -186,9 +207,7 @@ void Schedules::createScheduleForLight(const QString &name, int lightId, bool on
     QVariantMap commandParams;
     commandParams.insert("on", on);
     commandParams.insert("bri", bri);
-    // Transform from RGB to Hue/Sat
-    commandParams.insert("hue", color.hue() * 65535 / 360);
-    commandParams.insert("sat", color.saturation());
+    commandParams.insert("xy", ColorConversion::xyToVariant(ColorConversion::rgbToXy(color, ColorConversion::gamutForLight(lightId))));
 
     QVariantMap command;
     command.insert("address", "/api/" + HueBridgeConnection::instance()->apiKey() + "/lights/" + QString::number(lightId) + "/state");
@@ -203,9 +222,7 @@ void Schedules::createScheduleForGroup(const QString &name, int groupId, bool on
     QVariantMap commandParams;
     commandParams.insert("on", on);
     commandParams.insert("bri", bri);
-    // Transform from RGB to Hue/Sat
-    commandParams.insert("hue", color.hue() * 65535 / 360);
-    commandParams.insert("sat", color.saturation());
+    commandParams.insert("xy", ColorConversion::xyToVariant(ColorConversion::rgbToXy(color, ColorConversion::gamutForGroup(groupId))));
 
     QVariantMap command;
     command.insert("address", "/api/" + HueBridgeConnection::instance()->apiKey() + "/groups/" + QString::number(groupId) + "/action");
@@ -221,7 +238,7 @@ void Schedules::createSchedule(const QString &name, const QVariantMap &command,
     params.insert("name", name);
     params.insert("command", command);
     params.insert("localtime", timeString);
-    HueBridgeConnection::instance()->post("schedules", params, this, "createScheduleFinished");
+    HueBridgeConnection::instance()->post("schedules", params, this, "createScheduleFinished", HueBridgeConnection::PriorityAutomation);
 }
 
 void Schedules::schedulesReceived(int id, const QVariant &variant)
@@ -236,11 +253,7 @@ void Schedules::schedulesReceived(int id, const QVariant &variant)
             removedSchedules.append(schedule);
         } else {
 //            qDebug() << "updating schedule" << schedule->id();
-            QVariantMap scheduleMap = schedules.value(schedule->id()).toMap();
-            schedule->setName(scheduleMap.value("name").toString());
-            schedule->setEnabled(scheduleMap.value("status").toString() == "enabled");
-            schedule->setAutoDelete(scheduleMap.value("autodelete").toBool());
-            schedule->setDateTime(scheduleMap.value("time").toDateTime());
+            updateSchedule(schedule, schedules.value(schedule->id()).toMap());
         }
     }
 
@@ -256,36 +269,104 @@ void Schedules::schedulesReceived(int id, const QVariant &variant)
         if (findSchedule(scheduleId) == 0) {
             QVariantMap scheduleMap = schedules.value(scheduleId).toMap();
             Schedule *schedule = createScheduleInternal(scheduleId, scheduleMap.value("name").toString());
-            schedule->setEnabled(scheduleMap.value("status").toString() == "enabled");
-            schedule->setAutoDelete(scheduleMap.value("autodelete").toBool());
-            QString timeString = scheduleMap.value("localtime").toString();
-            if (timeString.startsWith("W")) {
-                schedule->setRecurring(true);
-                timeString = timeString.right(timeString.length() - 1);
-                schedule->setWeekdays(QString("0%1").arg(timeString.left(3).toInt(), 7, 2, QChar('0')));
-                timeString = timeString.right(timeString.length() - 5);
-                QDateTime dateTime = QDateTime::fromMSecsSinceEpoch(0);
-                dateTime.setTime(QTime::fromString(timeString));
-                schedule->setDateTime(dateTime);
-            } else if (timeString.contains("PT")){
-                schedule->setType(Schedule::TypeTimer);
-                QDateTime dateTime = QDateTime::fromMSecsSinceEpoch(0);
-                dateTime.setTime(QTime::fromString(timeString.remove("PT")));
-                schedule->setDateTime(dateTime);
-            } else {
-                schedule->setDateTime(scheduleMap.value("localtime").toDateTime());
-            }
+            updateSchedule(schedule, scheduleMap);
         }
     }
     emit countChanged();
+    updateTimeline();
 
     m_busy = false;
     emit busyChanged();
 }
 
+void Schedules::updateSchedule(Schedule *schedule, const QVariantMap &scheduleMap)
+{
+    schedule->setName(scheduleMap.value("name").toString());
+    schedule->setEnabled(scheduleMap.value("status").toString() == "enabled");
+    schedule->setAutoDelete(scheduleMap.value("autodelete").toBool());
+
+    QString localtime = scheduleMap.value("localtime").toString();
+    if (localtime.isEmpty()) {
+        // Old bridges only have time, which is in UTC
+        localtime = scheduleMap.value("time").toString();
+        QDateTime utc = QDateTime::fromString(localtime, Qt::ISODate);
+        if (utc.isValid()) {
+            utc.setTimeSpec(Qt::UTC);
+            localtime = utc.toLocalTime().toString("yyyy-MM-ddThh:mm:ss");
+        }
+    }
+    ScheduleTime scheduleTime = ScheduleTime::parse(localtime);
+    if (!scheduleTime.isValid()) {
+        qWarning() << "Cannot parse time of schedule" << schedule->id() << localtime;
+    }
+    QDateTime timerStart = QDateTime::fromString(scheduleMap.value("starttime").toString(), Qt::ISODate);
+    timerStart.setTimeSpec(Qt::UTC);
+    schedule->setScheduleTime(scheduleTime, timerStart);
+}
+
+void Schedules::updateTimeline()
+{
+    QDateTime now = QDateTime::currentDateTime();
+    m_timeline.clear();
+    foreach (Schedule *schedule, m_list) {
+        if (schedule->updateNextFire(now)) {
+            nextFireChanged(schedule);
+        }
+        if (schedule->nextFire().isValid()) {
+            m_timeline.insert(schedule->nextFire(), schedule);
+        }
+    }
+    scheduleTimelineTimer();
+    emit timelineChanged();
+}
+
+void Schedules::advanceTimeline()
+{
+    // Only the schedules which fired move to their next time
+    QDateTime now = QDateTime::currentDateTime();
+    QList<Schedule*> fired;
+    while (!m_timeline.isEmpty() && m_timeline.begin().key() <= now) {
+        fired.append(m_timeline.begin().value());
+        m_timeline.erase(m_timeline.begin());
+    }
+    foreach (Schedule *schedule, fired) {
+        if (schedule->updateNextFire(now)) {
+            nextFireChanged(schedule);
+        }
+        if (schedule->nextFire().isValid()) {
+            m_timeline.insert(schedule->nextFire(), schedule);
+        }
+    }
+    scheduleTimelineTimer();
+    if (!fired.isEmpty()) {
+        emit timelineChanged();
+    }
+}
+
+void Schedules::scheduleTimelineTimer()
+{
+    if (m_timeline.isEmpty()) {
+        m_timelineTimer.stop();
+        return;
+    }
+    // Capped, long intervals overflow the timer and drift with clock changes
+    qint64 msecs = QDateTime::currentDateTime().msecsTo(m_timeline.begin().key());
+    m_timelineTimer.start(qBound<qint64>(0, msecs, 60 * 60 * 1000));
+}
+
+void Schedules::nextFireChanged(Schedule *schedule)
+{
+    QModelIndex modelIndex = index(m_list.indexOf(schedule));
+#if QT_VERSION >= 0x050000
+    emit dataChanged(modelIndex, modelIndex, QVector<int>() << RoleNextFire);
+#else
+    emit dataChanged(modelIndex, modelIndex);
+#endif
+}
+
 void Schedules::deleteSchedule(const QString &id)
 {
-    HueBridgeConnection::instance()->deleteResource("schedules/" + id, this, "deleteScheduleFinished");
+    HueBridgeConnection::instance()->deleteResource("schedules/" + id, this, "deleteScheduleFinished", HueBridgeConnection::PriorityAutomation);
 }
 
 Schedule *Schedules::createScheduleInternal(const QString &id, const QString &name)
@@ -303,7 +384,7 @@ void Schedules::createScheduleFinished(int id, const QVariant &response)
     Q_UNUSED(id)
     qDebug() << "got createScene result" << response;
 
-    QVariantMap result = response.toList().first().toMap();
+    QVariantMap result = response.toList().value(0).toMap();
 
     if (result.contains("success")) {
         //TODO: could be added without refrshing, but we don't know the name at this point.
@@ -317,7 +398,7 @@ void Schedules::deleteScheduleFinished(int id, const QVariant &response)
     Q_UNUSED(id)
     qDebug() << "got deleteSchedule result" << response;
 
-    QVariantMap result = response.toList().first().toMap();
+    QVariantMap result = response.toList().value(0).toMap();
 
     if (result.contains("success")) {
         //TODO: could be deleted without refrshing
@@ -23,6 +23,10 @@
 #include "huemodel.h"
 
 #include <QTimer>
+#include <QMultiMap>
+#include <QDateTime>
+#include <QStringList>
+
 class Schedule;
 
 class Schedules: public HueModel
@@ -35,7 +39,8 @@ public:
         RoleDateTime,
         RoleType,
         RoleRecurring,
-        RoleWeekdays
+        RoleWeekdays,
+        RoleNextFire
     };
 
     explicit Schedules(QObject *parent = 0);
@@ -46,6 +51,10 @@ public:
     Q_INVOKABLE Schedule* get(int index) const;
     Q_INVOKABLE Schedule* findSchedule(const QString &id) const;
 
+    // Ids of the schedules firing in [from, to), in order
+    Q_INVOKABLE QStringList upcoming(const QDateTime &from, const QDateTime &to) const;
+    Q_INVOKABLE Schedule* nextSchedule() const;
+
     bool busy() const;
 
 public slots:
@@ -65,6 +74,7 @@ public slots:
 
 signals:
     void countChanged();
+    void timelineChanged();
 
 private slots:
     void createAlarmForScene(const QString &name, const QString &sceneId, const QString &timeString);
@@ -75,12 +85,19 @@ private slots:
     void createScheduleFinished(int id, const QVariant &variant);
     void deleteScheduleFinished(int id, const QVariant &variant);
     void schedulesReceived(int id, const QVariant &variant);
+    void advanceTimeline();
 
 private:
     Schedule* createScheduleInternal(const QString &id, const QString &name);
+    void updateSchedule(Schedule *schedule, const QVariantMap &scheduleMap);
+    void updateTimeline();
+    void scheduleTimelineTimer();
+    void nextFireChanged(Schedule *schedule);
 
     QList<Schedule*> m_list;
     bool m_busy;
+    QMultiMap<QDateTime, Schedule*> m_timeline;
+    QTimer m_timelineTimer;
 };
 
 #endif
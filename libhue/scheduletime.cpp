@@ -0,0 +1,193 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+
+#include "scheduletime.h"
+
+#include <QStringList>
+
+static const QString s_timeFormat = "hh:mm:ss";
+
+ScheduleTime::ScheduleTime():
+    m_kind(KindInvalid),
+    m_weekdays(0),
+    m_repeat(-1),
+    m_randomSeconds(0)
+{
+}
+
+ScheduleTime ScheduleTime::parse(const QString &localtime)
+{
+    ScheduleTime result;
+    QString string = localtime;
+
+    // Randomization applies to all forms
+    int random = string.indexOf('A');
+    if (random != -1) {
+        QTime window = QTime::fromString(string.mid(random + 1), s_timeFormat);
+        if (!window.isValid()) {
+            return ScheduleTime();
+        }
+        result.m_randomSeconds = QTime(0, 0).secsTo(window);
+        string = string.left(random);
+    }
+
+    if (string.startsWith('W')) {
+        QStringList parts = string.split('/');
+        bool ok;
+        result.m_weekdays = parts.first().mid(1).toInt(&ok);
+        if (!ok || parts.count() < 2 || !parts.at(1).startsWith('T') || result.m_weekdays <= 0 || result.m_weekdays > 0x7f) {
+            return ScheduleTime();
+        }
+        result.m_time = QTime::fromString(parts.at(1).mid(1), s_timeFormat);
+        result.m_kind = KindRecurring;
+    } else if (string.startsWith('R') || string.startsWith("PT")) {
+        if (string.startsWith('R')) {
+            int slash = string.indexOf('/');
+            if (slash == -1) {
+                return ScheduleTime();
+            }
+            bool ok = true;
+            result.m_repeat = slash > 1 ? string.mid(1, slash - 1).toInt(&ok) : 0;
+            if (!ok || result.m_repeat < 0) {
+                return ScheduleTime();
+            }
+            string = string.mid(slash + 1);
+        }
+        if (!string.startsWith("PT")) {
+            return ScheduleTime();
+        }
+        result.m_time = QTime::fromString(string.mid(2), s_timeFormat);
+        result.m_kind = KindTimer;
+    } else {
+        result.m_dateTime = QDateTime::fromString(string, Qt::ISODate);
+        result.m_time = result.m_dateTime.time();
+        result.m_kind = KindAbsolute;
+        if (!result.m_dateTime.isValid()) {
+            return ScheduleTime();
+        }
+    }
+
+    if (!result.m_time.isValid()) {
+        return ScheduleTime();
+    }
+    return result;
+}
+
+QString ScheduleTime::toString() const
+{
+    QString string;
+    switch (m_kind) {
+    case KindInvalid:
+        return QString();
+    case KindAbsolute:
+        string = m_dateTime.toString("yyyy-MM-ddThh:mm:ss");
+        break;
+    case KindRecurring:
+        string = "W" + QString::number(m_weekdays) + "/T" + m_time.toString(s_timeFormat);
+        break;
+    case KindTimer:
+        if (m_repeat >= 0) {
+            string = "R" + (m_repeat > 0 ? QString::number(m_repeat) : QString()) + "/";
+        }
+        string += "PT" + m_time.toString(s_timeFormat);
+        break;
+    }
+    if (m_randomSeconds > 0) {
+        string += "A" + QTime(0, 0).addSecs(m_randomSeconds).toString(s_timeFormat);
+    }
+    return string;
+}
+
+bool ScheduleTime::isValid() const
+{
+    return m_kind != KindInvalid;
+}
+
+ScheduleTime::Kind ScheduleTime::kind() const
+{
+    return m_kind;
+}
+
+QDateTime ScheduleTime::dateTime() const
+{
+    return m_dateTime;
+}
+
+QTime ScheduleTime::time() const
+{
+    return m_time;
+}
+
+int ScheduleTime::weekdays() const
+{
+    return m_weekdays;
+}
+
+int ScheduleTime::repeat() const
+{
+    return m_repeat;
+}
+
+int ScheduleTime::randomSeconds() const
+{
+    return m_randomSeconds;
+}
+
+QDateTime ScheduleTime::nextFire(const QDateTime &after, const QDateTime &timerStart) const
+{
+    switch (m_kind) {
+    case KindInvalid:
+        break;
+    case KindAbsolute:
+        if (m_dateTime > after) {
+            return m_dateTime;
+        }
+        break;
+    case KindRecurring: {
+        QDateTime local = after.toLocalTime();
+        // Today, if it didn't pass yet, up to the same weekday next week
+        for (int day = 0; day <= 7; ++day) {
+            QDate date = local.date().addDays(day);
+            if (!(m_weekdays & (1 << (7 - date.dayOfWeek())))) {
+                continue;
+            }
+            QDateTime candidate(date, m_time);
+            if (candidate > local) {
+                return candidate;
+            }
+        }
+        break;
+    }
+    case KindTimer: {
+        qint64 duration = QTime(0, 0).msecsTo(m_time);
+        if (!timerStart.isValid() || duration <= 0) {
+            break;
+        }
+        qint64 elapsed = timerStart.msecsTo(after);
+        qint64 count = elapsed < 0 ? 1 : elapsed / duration + 1;
+        int runs = m_repeat == -1 ? 1 : m_repeat;
+        if (runs > 0 && count > runs) {
+            break;
+        }
+        return timerStart.addMSecs(count * duration);
+    }
+    }
+    return QDateTime();
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+
+#ifndef SCHEDULETIME_H
+#define SCHEDULETIME_H
+
+#include <QDateTime>
+#include <QString>
+
+// The localtime of a schedule, in one of the bridge formats:
+//   absolute   YYYY-MM-DDThh:mm:ss[A hh:mm:ss]
+//   recurring  W<bits>/Thh:mm:ss[Ahh:mm:ss], weekday bits with Monday = 64 and Sunday = 1
+//   timer      [R[nn]/]PThh:mm:ss[Ahh:mm:ss], R without count repeats forever
+// The A suffix makes the bridge fire at a random time up to that much later.
+class ScheduleTime
+{
+public:
+    enum Kind {
+        KindInvalid,
+        KindAbsolute,
+        KindRecurring,
+        KindTimer
+    };
+
+    ScheduleTime();
+
+    static ScheduleTime parse(const QString &localtime);
+    QString toString() const;
+
+    bool isValid() const;
+    Kind kind() const;
+
+    // Absolute: the date and time. Recurring: the time of day. Timer: the duration.
+    QDateTime dateTime() const;
+    QTime time() const;
+    int weekdays() const;
+    // Timers only: -1 if not repeating, 0 for forever
+    int repeat() const;
+    // Length of the random window in seconds, 0 if not randomized
+    int randomSeconds() const;
+
+    // The next time after after the schedule fires, invalid if it won't any more. Timers
+    // count from timerStart, the bridge reports it as starttime. For randomized schedules
+    // this is the start of the window.
+    QDateTime nextFire(const QDateTime &after, const QDateTime &timerStart = QDateTime()) const;
+
+private:
+    Kind m_kind;
+    QDateTime m_dateTime;
+    QTime m_time;
+    int m_weekdays;
+    int m_repeat;
+    int m_randomSeconds;
+};
+
+#endif
@@ -29,6 +29,14 @@ Sensor::Sensor(const QString &id, const QString &name, QObject *parent)
     , m_id(id)
     , m_name(name)
     , m_type(TypeUnknown)
+    , m_buttonEvent(0)
+    , m_presence(false)
+    , m_temperature(0)
+    , m_lightLevel(0)
+    , m_dark(false)
+    , m_daylight(false)
+    , m_status(0)
+    , m_flag(false)
 {
 }
 
@@ -103,12 +111,131 @@ QVariantMap Sensor::stateMap() const
     return m_stateMap;
 }
 
-void Sensor::setStateMap(const QVariantMap &stateMap)
+template <typename T>
+static bool updateField(T &field, const T &value)
 {
-    if (m_stateMap != stateMap) {
-        m_stateMap = stateMap;
-        emit stateMapChanged();
+    if (field == value) {
+        return false;
     }
+    field = value;
+    return true;
+}
+
+Sensor::StateFields Sensor::setStateMap(const QVariantMap &stateMap)
+{
+    if (m_stateMap == stateMap) {
+        return StateFieldNone;
+    }
+    m_stateMap = stateMap;
+
+    StateFields changed;
+    if (stateMap.contains("buttonevent") && updateField(m_buttonEvent, stateMap.value("buttonevent").toInt())) {
+        changed |= StateFieldButtonEvent;
+    }
+    if (stateMap.contains("presence") && updateField(m_presence, stateMap.value("presence").toBool())) {
+        changed |= StateFieldPresence;
+    }
+    // Reported in hundredths of a degree
+    if (stateMap.contains("temperature") && updateField(m_temperature, stateMap.value("temperature").toInt() / 100.0)) {
+        changed |= StateFieldTemperature;
+    }
+    if (stateMap.contains("lightlevel") && updateField(m_lightLevel, stateMap.value("lightlevel").toInt())) {
+        changed |= StateFieldLightLevel;
+    }
+    if (stateMap.contains("dark") && updateField(m_dark, stateMap.value("dark").toBool())) {
+        changed |= StateFieldDark;
+    }
+    if (stateMap.contains("daylight") && updateField(m_daylight, stateMap.value("daylight").toBool())) {
+        changed |= StateFieldDaylight;
+    }
+    if (stateMap.contains("status") && updateField(m_status, stateMap.value("status").toInt())) {
+        changed |= StateFieldStatus;
+    }
+    if (stateMap.contains("flag") && updateField(m_flag, stateMap.value("flag").toBool())) {
+        changed |= StateFieldFlag;
+    }
+    // "none" for sensors which never reported anything
+    QDateTime lastUpdated = QDateTime::fromString(stateMap.value("lastupdated").toString(), Qt::ISODate);
+    lastUpdated.setTimeSpec(Qt::UTC);
+    if (updateField(m_lastUpdated, lastUpdated)) {
+        changed |= StateFieldLastUpdated;
+    }
+
+    // All fields are updated before anybody is notified
+    emit stateMapChanged();
+    if (changed.testFlag(StateFieldButtonEvent)) {
+        emit buttonEventChanged();
+    }
+    if (changed.testFlag(StateFieldPresence)) {
+        emit presenceChanged();
+    }
+    if (changed.testFlag(StateFieldTemperature)) {
+        emit temperatureChanged();
+    }
+    if (changed.testFlag(StateFieldLightLevel)) {
+        emit lightLevelChanged();
+    }
+    if (changed.testFlag(StateFieldDark)) {
+        emit darkChanged();
+    }
+    if (changed.testFlag(StateFieldDaylight)) {
+        emit daylightChanged();
+    }
+    if (changed.testFlag(StateFieldStatus)) {
+        emit statusChanged();
+    }
+    if (changed.testFlag(StateFieldFlag)) {
+        emit flagChanged();
+    }
+    if (changed.testFlag(StateFieldLastUpdated)) {
+        emit lastUpdatedChanged();
+    }
+    return changed;
+}
+
+int Sensor::buttonEvent() const
+{
+    return m_buttonEvent;
+}
+
+bool Sensor::presence() const
+{
+    return m_presence;
+}
+
+qreal Sensor::temperature() const
+{
+    return m_temperature;
+}
+
+int Sensor::lightLevel() const
+{
+    return m_lightLevel;
+}
+
+bool Sensor::dark() const
+{
+    return m_dark;
+}
+
+bool Sensor::daylight() const
+{
+    return m_daylight;
+}
+
+int Sensor::status() const
+{
+    return m_status;
+}
+
+bool Sensor::flag() const
+{
+    return m_flag;
+}
+
+QDateTime Sensor::lastUpdated() const
+{
+    return m_lastUpdated;
 }
 
 Sensor::Type Sensor::typeStringToType(const QString &typeString)
@@ -117,8 +244,28 @@ Sensor::Type Sensor::typeStringToType(const QString &typeString)
         return TypeZGPSwitch;
     } else if (typeString == "ZLLSwitch") {
         return TypeZLLSwitch;
+    } else if (typeString == "ZLLPresence") {
+        return TypeZLLPresence;
+    } else if (typeString == "ZLLTemperature") {
+        return TypeZLLTemperature;
+    } else if (typeString == "ZLLLightLevel") {
+        return TypeZLLLightLevel;
+    } else if (typeString == "CLIPSwitch") {
+        return TypeClipSwitch;
+    } else if (typeString == "CLIPOpenClose") {
+        return TypeClipOpenClose;
+    } else if (typeString == "CLIPPresence") {
+        return TypeClipPresence;
+    } else if (typeString == "CLIPTemperature") {
+        return TypeClipTemperature;
+    } else if (typeString == "CLIPHumidity") {
+        return TypeClipHumidity;
+    } else if (typeString == "CLIPLightLevel") {
+        return TypeClipLightLevel;
     } else if (typeString == "Daylight") {
         return TypeDaylight;
+    } else if (typeString == "CLIPGenericFlag") {
+        return TypeClipGenericFlag;
     } else if (typeString == "CLIPGenericStatus") {
         return TypeClipGenericStatus;
     }
@@ -133,10 +280,32 @@ QString Sensor::typeToString(Sensor::Type type)
         return "ZGPSwitch";
     case Sensor::TypeZLLSwitch:
         return "ZLLSwitch";
+    case Sensor::TypeZLLPresence:
+        return "ZLLPresence";
+    case Sensor::TypeZLLTemperature:
+        return "ZLLTemperature";
+    case Sensor::TypeZLLLightLevel:
+        return "ZLLLightLevel";
+    case Sensor::TypeClipSwitch:
+        return "CLIPSwitch";
+    case Sensor::TypeClipOpenClose:
+        return "CLIPOpenClose";
+    case Sensor::TypeClipPresence:
+        return "CLIPPresence";
+    case Sensor::TypeClipTemperature:
+        return "CLIPTemperature";
+    case Sensor::TypeClipHumidity:
+        return "CLIPHumidity";
+    case Sensor::TypeClipLightLevel:
+        return "CLIPLightLevel";
     case Sensor::TypeDaylight:
         return "Daylight";
+    case Sensor::TypeClipGenericFlag:
+        return "CLIPGenericFlag";
     case Sensor::TypeClipGenericStatus:
         return "CLIPGenericStatus";
+    default:
+        break;
     }
     return QString("Unkown");
 }
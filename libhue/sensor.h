@@ -34,6 +34,17 @@ class Sensor: public QObject
     Q_PROPERTY(QString name READ name WRITE setName NOTIFY nameChanged)
     Q_PROPERTY(Type type READ type NOTIFY typeChanged)
     Q_PROPERTY(QVariantMap stateMap READ stateMap NOTIFY stateMapChanged)
+
+    // Typed state. Only the fields reported by the type of the sensor are set.
+    Q_PROPERTY(int buttonEvent READ buttonEvent NOTIFY buttonEventChanged)
+    Q_PROPERTY(bool presence READ presence NOTIFY presenceChanged)
+    Q_PROPERTY(qreal temperature READ temperature NOTIFY temperatureChanged)
+    Q_PROPERTY(int lightLevel READ lightLevel NOTIFY lightLevelChanged)
+    Q_PROPERTY(bool dark READ dark NOTIFY darkChanged)
+    Q_PROPERTY(bool daylight READ daylight NOTIFY daylightChanged)
+    Q_PROPERTY(int status READ status NOTIFY statusChanged)
+    Q_PROPERTY(bool flag READ flag NOTIFY flagChanged)
+    Q_PROPERTY(QDateTime lastUpdated READ lastUpdated NOTIFY lastUpdatedChanged)
     Q_PROPERTY(QString modelId READ modelId CONSTANT)
     Q_PROPERTY(QString manufacturerName READ manufacturerName CONSTANT)
     Q_PROPERTY(QString uniqueId READ uniqueId CONSTANT)
@@ -51,10 +62,29 @@ public:
         TypeDaylight = 0x080,
         TypeClipGenericFlag = 0x100,
         TypeClipGenericStatus = 0x200,
+        TypeZLLPresence = 0x400,
+        TypeZLLTemperature = 0x800,
+        TypeZLLLightLevel = 0x1000,
+        TypeClipLightLevel = 0x2000,
         TypeAll = 0xffff
     };
     Q_DECLARE_FLAGS(Types, Type)
 
+    // Fields of the state which changed in an update
+    enum StateField {
+        StateFieldNone = 0x000,
+        StateFieldButtonEvent = 0x001,
+        StateFieldPresence = 0x002,
+        StateFieldTemperature = 0x004,
+        StateFieldLightLevel = 0x008,
+        StateFieldDark = 0x010,
+        StateFieldDaylight = 0x020,
+        StateFieldStatus = 0x040,
+        StateFieldFlag = 0x080,
+        StateFieldLastUpdated = 0x100
+    };
+    Q_DECLARE_FLAGS(StateFields, StateField)
+
     Sensor(const QString &id, const QString &name, QObject *parent = 0);
 
     QString id() const;
@@ -76,7 +106,20 @@ public:
     void setUniqueId(const QString &uniqueId);
 
     QVariantMap stateMap() const;
-    void setStateMap(const QVariantMap &stateMap);
+    // Parses the state as received from the bridge and returns which fields changed
+    StateFields setStateMap(const QVariantMap &stateMap);
+
+    int buttonEvent() const;
+    bool presence() const;
+    // Degrees Celsius
+    qreal temperature() const;
+    // 10000 * log10(lux) + 1, as reported by the bridge
+    int lightLevel() const;
+    bool dark() const;
+    bool daylight() const;
+    int status() const;
+    bool flag() const;
+    QDateTime lastUpdated() const;
 
     static Type typeStringToType(const QString &typeString);
     static QString typeToString(Type type);
@@ -85,6 +128,15 @@ signals:
     void nameChanged();
     void typeChanged();
     void stateMapChanged();
+    void buttonEventChanged();
+    void presenceChanged();
+    void temperatureChanged();
+    void lightLevelChanged();
+    void darkChanged();
+    void daylightChanged();
+    void statusChanged();
+    void flagChanged();
+    void lastUpdatedChanged();
 
 private:
     QString m_id;
@@ -94,6 +146,16 @@ private:
     QString m_manufacturerName;
     QString m_uniqueId;
     QVariantMap m_stateMap;
+
+    int m_buttonEvent;
+    bool m_presence;
+    qreal m_temperature;
+    int m_lightLevel;
+    bool m_dark;
+    bool m_daylight;
+    int m_status;
+    bool m_flag;
+    QDateTime m_lastUpdated;
 };
 
 #endif
@@ -25,11 +25,12 @@
 #include <QDebug>
 #include <QUuid>
 #include <QColor>
-#include <QCoreApplication>
 
 Sensors::Sensors(QObject *parent):
     HueModel(parent),
-    m_busy(false)
+    m_busy(false),
+    m_loaded(false),
+    m_helperRequestCounter(0)
 {
 #if QT_VERSION < 0x050000
     setRoleNames(roleNames());
@@ -62,6 +63,24 @@ QVariant Sensors::data(const QModelIndex &index, int role) const
         return sensor->stateMap();
     case RoleModelId:
         return sensor->modelId();
+    case RoleButtonEvent:
+        return sensor->buttonEvent();
+    case RolePresence:
+        return sensor->presence();
+    case RoleTemperature:
+        return sensor->temperature();
+    case RoleLightLevel:
+        return sensor->lightLevel();
+    case RoleDark:
+        return sensor->dark();
+    case RoleDaylight:
+        return sensor->daylight();
+    case RoleStatus:
+        return sensor->status();
+    case RoleFlag:
+        return sensor->flag();
+    case RoleLastUpdated:
+        return sensor->lastUpdated();
     }
 
     return QVariant();
@@ -77,7 +96,16 @@ QHash<int, QByteArray> Sensors::roleNames() const
     roles.insert(RoleModelId, "modelId");
     roles.insert(RoleManufacturerName, "manufacturerName");
     roles.insert(RoleUniqueId, "uniqueId");
-    roles.insert(RoleTypeString, "stateMap");
+    roles.insert(RoleStateMap, "stateMap");
+    roles.insert(RoleButtonEvent, "buttonEvent");
+    roles.insert(RolePresence, "presence");
+    roles.insert(RoleTemperature, "temperature");
+    roles.insert(RoleLightLevel, "lightLevel");
+    roles.insert(RoleDark, "dark");
+    roles.insert(RoleDaylight, "daylight");
+    roles.insert(RoleStatus, "status");
+    roles.insert(RoleFlag, "flag");
+    roles.insert(RoleLastUpdated, "lastUpdated");
     return roles;
 }
 
@@ -100,6 +128,11 @@ Sensor *Sensors::findSensor(const QString &id) const
 }
 
 void Sensors::createSensor(const QString &name, const QString &uniqueId)
+{
+    HueBridgeConnection::instance()->post("sensors", helperSensorParams(name, uniqueId), this, "sensorCreated", HueBridgeConnection::PriorityAutomation);
+}
+
+QVariantMap Sensors::helperSensorParams(const QString &name, const QString &uniqueId)
 {
     QVariantMap params;
     params.insert("name", name);
@@ -111,7 +144,7 @@ void Sensors::createSensor(const QString &name, const QString &uniqueId)
     QVariantMap stateMap;
     stateMap.insert("status", 0);
     params.insert("state", stateMap);
-    HueBridgeConnection::instance()->post("sensors", params, this, "sensorCreated");
+    return params;
 }
 
 Sensor *Sensors::findHelperSensor(const QString &name, const QString &uniqueId)
@@ -124,21 +157,64 @@ Sensor *Sensors::findHelperSensor(const QString &name, const QString &uniqueId)
     return 0;
 }
 
-Sensor *Sensors::findOrCreateHelperSensor(const QString &name, const QString &uniqueId)
+int Sensors::findOrCreateHelperSensor(const QString &name, const QString &uniqueId)
 {
-    Sensor *sensor = findHelperSensor(name, uniqueId);
-    if (!sensor) {
-        createSensor(name, uniqueId);
+    int requestId = m_helperRequestCounter++;
+
+    // Don't create the same sensor twice if it is already being looked for
+    for (int i = 0; i < m_helperRequests.count(); ++i) {
+        if (m_helperRequests.at(i).name == name && m_helperRequests.at(i).uniqueId == uniqueId) {
+            m_helperRequests[i].requestIds.append(requestId);
+            return requestId;
+        }
+    }
+
+    HelperRequest request;
+    request.name = name;
+    request.uniqueId = uniqueId;
+    request.requestIds.append(requestId);
+    request.createId = -1;
+    m_helperRequests.append(request);
+
+    // Without the list of sensors we can't know if it exists already
+    if (m_loaded) {
+        QMetaObject::invokeMethod(this, "resolveHelperRequests", Qt::QueuedConnection);
+    } else {
+        refresh();
     }
-    QDateTime endTime = QDateTime::currentDateTime().addSecs(10);
-    while (endTime > QDateTime::currentDateTime()) {
-        sensor = findHelperSensor(name, uniqueId);
+    return requestId;
+}
+
+void Sensors::resolveHelperRequests()
+{
+    for (int i = m_helperRequests.count() - 1; i >= 0; --i) {
+        HelperRequest &request = m_helperRequests[i];
+        if (request.createId != -1) {
+            continue;
+        }
+        Sensor *sensor = findHelperSensor(request.name, request.uniqueId);
         if (sensor) {
-            return sensor;
+            QList<int> requestIds = m_helperRequests.takeAt(i).requestIds;
+            foreach (int requestId, requestIds) {
+                emit helperSensorReady(requestId, sensor);
+            }
+        } else {
+            request.createId = HueBridgeConnection::instance()->post("sensors", helperSensorParams(request.name, request.uniqueId), this, "sensorCreated", HueBridgeConnection::PriorityAutomation);
+        }
+    }
+}
+
+void Sensors::failHelperLookups()
+{
+    // Requests which already POSTed their sensor are answered by sensorCreated()
+    for (int i = m_helperRequests.count() - 1; i >= 0; --i) {
+        if (m_helperRequests.at(i).createId != -1) {
+            continue;
+        }
+        foreach (int requestId, m_helperRequests.takeAt(i).requestIds) {
+            emit helperSensorFailed(requestId);
         }
-        qApp->processEvents();
     }
-    return sensor;
 }
 
 bool Sensors::busy() const
@@ -148,7 +224,7 @@ bool Sensors::busy() const
 
 void Sensors::refresh()
 {
-    HueBridgeConnection::instance()->get("sensors", this, "sensorsReceived");
+    HueBridgeConnection::instance()->get("sensors", this, "sensorsReceived", HueBridgeConnection::PriorityBackground);
     m_busy = true;
     emit busyChanged();
 }
@@ -157,6 +233,20 @@ void Sensors::sensorsReceived(int id, const QVariant &variant)
 {
 //    qDebug() << "**** sensors received" << variant;
     Q_UNUSED(id)
+
+    // Transport failures give an invalid variant, bridge errors a list. Neither means the
+    // sensors are gone, and without the list helper sensors can't be looked up.
+    if (variant.type() != QVariant::Map) {
+        qWarning() << "Could not refresh sensors" << variant;
+        m_busy = false;
+        emit busyChanged();
+        // With an earlier list, queued lookups are still resolved against that one
+        if (!m_loaded) {
+            failHelperLookups();
+        }
+        return;
+    }
+
     QVariantMap sensors = variant.toMap();
     QList<Sensor*> removedSensors;
     foreach (Sensor *sensor, m_list) {
@@ -165,6 +255,10 @@ void Sensors::sensorsReceived(int id, const QVariant &variant)
         } else {
             QVariantMap sensorMap = sensors.value(sensor->id()).toMap();
             sensor->setName(sensorMap.value("name").toString());
+            QVariantMap stateMap = sensorMap.value("state").toMap();
+            if (sensor->stateMap() != stateMap) {
+                sensorStateChanged(sensor, sensor->setStateMap(stateMap));
+            }
         }
     }
 
@@ -179,23 +273,97 @@ void Sensors::sensorsReceived(int id, const QVariant &variant)
         Sensor *sensor = findSensor(sensorId);
         QVariantMap sensorMap = sensors.value(sensorId).toMap();
         if (!sensor) {
-            sensor = new Sensor(sensorId, sensorMap.value("name").toString(), this);
-            sensor->setType(Sensor::typeStringToType(sensorMap.value("type").toString()));
-            sensor->setStateMap(sensorMap.value("state").toMap());
-            sensor->setModelId(sensorMap.value("modelid").toString());
-            sensor->setManufacturerName(sensorMap.value("manufacturername").toString());
-            sensor->setUniqueId(sensorMap.value("uniqueid").toString());
-
-            beginInsertRows(QModelIndex(), m_list.count(), m_list.count());
-            m_list.append(sensor);
-            endInsertRows();
+            addSensor(sensorId, sensorMap);
         }
     }
-    m_busy = true;
+    m_busy = false;
     emit busyChanged();
+
+    m_loaded = true;
+    resolveHelperRequests();
+}
+
+void Sensors::sensorStateChanged(Sensor *sensor, Sensor::StateFields changed)
+{
+    QModelIndex modelIndex = index(m_list.indexOf(sensor));
+#if QT_VERSION >= 0x050000
+    // Only the roles which actually changed, views don't need to re-evaluate the rest
+    QVector<int> roles = QVector<int>() << RoleStateMap;
+    if (changed.testFlag(Sensor::StateFieldButtonEvent)) {
+        roles << RoleButtonEvent;
+    }
+    if (changed.testFlag(Sensor::StateFieldPresence)) {
+        roles << RolePresence;
+    }
+    if (changed.testFlag(Sensor::StateFieldTemperature)) {
+        roles << RoleTemperature;
+    }
+    if (changed.testFlag(Sensor::StateFieldLightLevel)) {
+        roles << RoleLightLevel;
+    }
+    if (changed.testFlag(Sensor::StateFieldDark)) {
+        roles << RoleDark;
+    }
+    if (changed.testFlag(Sensor::StateFieldDaylight)) {
+        roles << RoleDaylight;
+    }
+    if (changed.testFlag(Sensor::StateFieldStatus)) {
+        roles << RoleStatus;
+    }
+    if (changed.testFlag(Sensor::StateFieldFlag)) {
+        roles << RoleFlag;
+    }
+    if (changed.testFlag(Sensor::StateFieldLastUpdated)) {
+        roles << RoleLastUpdated;
+    }
+
+    emit dataChanged(modelIndex, modelIndex, roles);
+#else
+    Q_UNUSED(changed)
+    emit dataChanged(modelIndex, modelIndex);
+#endif
+}
+
+Sensor *Sensors::addSensor(const QString &id, const QVariantMap &sensorMap)
+{
+    Sensor *sensor = new Sensor(id, sensorMap.value("name").toString(), this);
+    sensor->setType(Sensor::typeStringToType(sensorMap.value("type").toString()));
+    sensor->setStateMap(sensorMap.value("state").toMap());
+    sensor->setModelId(sensorMap.value("modelid").toString());
+    sensor->setManufacturerName(sensorMap.value("manufacturername").toString());
+    sensor->setUniqueId(sensorMap.value("uniqueid").toString());
+
+    beginInsertRows(QModelIndex(), m_list.count(), m_list.count());
+    m_list.append(sensor);
+    endInsertRows();
+    return sensor;
 }
 
 void Sensors::sensorCreated(int id, const QVariant &response)
 {
     qDebug() << "sensor created" << response;
+
+    for (int i = 0; i < m_helperRequests.count(); ++i) {
+        if (m_helperRequests.at(i).createId != id) {
+            continue;
+        }
+        HelperRequest request = m_helperRequests.takeAt(i);
+
+        // The reply carries the new id, the sensor is added right away instead of waiting for a refresh
+        QString sensorId = response.toList().value(0).toMap().value("success").toMap().value("id").toString();
+        if (sensorId.isEmpty()) {
+            foreach (int requestId, request.requestIds) {
+                emit helperSensorFailed(requestId);
+            }
+            return;
+        }
+        Sensor *sensor = findSensor(sensorId);
+        if (!sensor) {
+            sensor = addSensor(sensorId, helperSensorParams(request.name, request.uniqueId));
+        }
+        foreach (int requestId, request.requestIds) {
+            emit helperSensorReady(requestId, sensor);
+        }
+        return;
+    }
 }
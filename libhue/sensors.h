@@ -21,11 +21,10 @@
 #define SENSORS_H
 
 #include "huemodel.h"
+#include "sensor.h"
 
 #include <QTimer>
 
-class Sensor;
-
 class Sensors: public HueModel
 {
     Q_OBJECT
@@ -38,7 +37,16 @@ public:
         RoleModelId,
         RoleManufacturerName,
         RoleUniqueId,
-        RoleStateMap
+        RoleStateMap,
+        RoleButtonEvent,
+        RolePresence,
+        RoleTemperature,
+        RoleLightLevel,
+        RoleDark,
+        RoleDaylight,
+        RoleStatus,
+        RoleFlag,
+        RoleLastUpdated
     };
 
     explicit Sensors(QObject *parent = 0);
@@ -51,20 +59,47 @@ public:
     Q_INVOKABLE void createSensor(const QString &name, const QString &uniqueId);
 
     Q_INVOKABLE Sensor* findHelperSensor(const QString &name, const QString &uniqueId);
-    Q_INVOKABLE Sensor* findOrCreateHelperSensor(const QString &name, const QString &uniqueId);
+    // Looks up the helper sensor and creates it on the bridge if it doesn't exist yet. The
+    // result is delivered with helperSensorReady() or helperSensorFailed() for the returned id.
+    Q_INVOKABLE int findOrCreateHelperSensor(const QString &name, const QString &uniqueId);
 
     bool busy() const;
 
 public slots:
     void refresh();
 
+signals:
+    void helperSensorReady(int requestId, Sensor *sensor);
+    void helperSensorFailed(int requestId);
+
 private slots:
     void sensorsReceived(int id, const QVariant &variant);
     void sensorCreated(int id, const QVariant &response);
+    void resolveHelperRequests();
 
 private:
+    class HelperRequest
+    {
+    public:
+        QString name;
+        QString uniqueId;
+        // Callers waiting for this sensor
+        QList<int> requestIds;
+        // Id of the create request, -1 while not sent
+        int createId;
+    };
+
+    void failHelperLookups();
+    static QVariantMap helperSensorParams(const QString &name, const QString &uniqueId);
+    Sensor *addSensor(const QString &id, const QVariantMap &sensorMap);
+    void sensorStateChanged(Sensor *sensor, Sensor::StateFields changed);
+
     QList<Sensor*> m_list;
     bool m_busy;
+    // Whether the sensors were received at least once
+    bool m_loaded;
+    QList<HelperRequest> m_helperRequests;
+    int m_helperRequestCounter;
 };
 
 #endif // SCENES_H
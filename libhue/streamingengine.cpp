@@ -0,0 +1,266 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "streamingengine.h"
+#include "streamingworker.h"
+#include "colorconversion.h"
+#include "huebridgeconnection.h"
+
+#include <QVector>
+#include <QPointF>
+#include <QDebug>
+
+StreamingEngine::StreamingEngine(QObject *parent):
+    QObject(parent),
+    m_groupId(-1),
+    m_rate(25),
+    m_colorSpace(ColorSpaceRGB),
+    m_port(2100),
+    m_active(false),
+    m_starting(false),
+    m_streamActivated(false),
+    m_activateRequest(-1),
+    m_worker(new StreamingWorker())
+{
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, SIGNAL(finished()), m_worker, SLOT(deleteLater()));
+    connect(m_worker, SIGNAL(started()), this, SLOT(workerStarted()));
+    connect(m_worker, SIGNAL(failed()), this, SLOT(workerFailed()));
+    m_thread.start();
+}
+
+StreamingEngine::~StreamingEngine()
+{
+    stop();
+    m_thread.quit();
+    m_thread.wait();
+}
+
+int StreamingEngine::groupId() const
+{
+    return m_groupId;
+}
+
+void StreamingEngine::setGroupId(int groupId)
+{
+    if (m_groupId != groupId) {
+        m_groupId = groupId;
+        m_worker->clearLights();
+        emit groupIdChanged();
+    }
+}
+
+int StreamingEngine::rate() const
+{
+    return m_rate;
+}
+
+void StreamingEngine::setRate(int rate)
+{
+    rate = qBound(25, rate, 50);
+    if (m_rate != rate) {
+        m_rate = rate;
+        emit rateChanged();
+    }
+}
+
+StreamingEngine::ColorSpace StreamingEngine::colorSpace() const
+{
+    return m_colorSpace;
+}
+
+void StreamingEngine::setColorSpace(StreamingEngine::ColorSpace colorSpace)
+{
+    if (m_colorSpace != colorSpace) {
+        m_colorSpace = colorSpace;
+        // Values already handed over are in the other colour space. The worker encodes
+        // everything from now on with the new one, also while streaming.
+        m_worker->setColorSpace(m_colorSpace);
+        emit colorSpaceChanged();
+    }
+}
+
+QString StreamingEngine::host() const
+{
+    return m_host;
+}
+
+void StreamingEngine::setHost(const QString &host)
+{
+    if (m_host != host) {
+        m_host = host;
+        emit hostChanged();
+    }
+}
+
+int StreamingEngine::port() const
+{
+    return m_port;
+}
+
+void StreamingEngine::setPort(int port)
+{
+    if (m_port != port) {
+        m_port = port;
+        emit portChanged();
+    }
+}
+
+bool StreamingEngine::active() const
+{
+    return m_active;
+}
+
+void StreamingEngine::setTransport(StreamTransport *transport)
+{
+    if (m_active) {
+        qWarning() << "Cannot change the transport while streaming";
+        return;
+    }
+    m_worker->setTransport(transport);
+}
+
+void StreamingEngine::start()
+{
+    if (m_active || m_starting) {
+        return;
+    }
+
+    if (!m_host.isEmpty()) {
+        m_starting = true;
+        startWorker(m_host);
+        return;
+    }
+
+    if (m_groupId < 0 || HueBridgeConnection::instance()->connectedBridge().isEmpty()) {
+        qWarning() << "Cannot stream without a connected bridge and an entertainment group";
+        emit error();
+        return;
+    }
+    m_starting = true;
+    setStreamActive(true);
+}
+
+void StreamingEngine::stop()
+{
+    if (!m_active && !m_starting) {
+        return;
+    }
+    // Queued behind a start() the worker might not have processed yet
+    QMetaObject::invokeMethod(m_worker, "stop", Qt::QueuedConnection);
+    // Also deactivate if the activation is still on its way, the PUTs go out in order
+    if (m_streamActivated || m_activateRequest != -1) {
+        setStreamActive(false);
+        m_streamActivated = false;
+        m_activateRequest = -1;
+    }
+    m_starting = false;
+    if (m_active) {
+        m_active = false;
+        emit activeChanged();
+    }
+}
+
+void StreamingEngine::setLightColor(int lightId, const QColor &color)
+{
+    setLightColors(QList<int>() << lightId, QList<QRgb>() << color.rgb());
+}
+
+void StreamingEngine::setLightColors(const QList<int> &lightIds, const QList<QRgb> &colors)
+{
+    int count = qMin(lightIds.count(), colors.count());
+    if (m_colorSpace == ColorSpaceRGB) {
+        for (int i = 0; i < count; ++i) {
+            QRgb rgb = colors.at(i);
+            m_worker->setLightColor(HueStream::LightColor(lightIds.at(i), qRed(rgb) * 257, qGreen(rgb) * 257, qBlue(rgb) * 257));
+        }
+        return;
+    }
+
+    QVector<QRgb> rgb = colors.mid(0, count).toVector();
+    QVector<QPointF> xy(count);
+    QVector<quint8> bri(count);
+    ColorConversion::rgbToXy(rgb.constData(), count, ColorConversion::GamutNone, xy.data(), bri.data());
+    for (int i = 0; i < count; ++i) {
+        QPointF clamped = ColorConversion::clampToGamut(xy.at(i), ColorConversion::gamutForLight(lightIds.at(i)));
+        m_worker->setLightColor(HueStream::LightColor(lightIds.at(i), qRound(clamped.x() * 65535), qRound(clamped.y() * 65535), bri.at(i) * 257));
+    }
+}
+
+void StreamingEngine::activateStreamFinished(int id, const QVariant &response)
+{
+    // Stopped meanwhile
+    if (id != m_activateRequest) {
+        return;
+    }
+    m_activateRequest = -1;
+
+    QVariantMap result = response.toList().value(0).toMap();
+    if (!result.contains("success")) {
+        qWarning() << "Cannot activate streaming on group" << m_groupId << response;
+        m_starting = false;
+        emit error();
+        return;
+    }
+    m_streamActivated = true;
+    startWorker(HueBridgeConnection::instance()->connectedBridge());
+}
+
+void StreamingEngine::startWorker(const QString &host)
+{
+    QMetaObject::invokeMethod(m_worker, "start", Qt::QueuedConnection,
+                              Q_ARG(QString, host), Q_ARG(int, m_port), Q_ARG(int, m_rate), Q_ARG(int, m_colorSpace));
+}
+
+void StreamingEngine::workerStarted()
+{
+    // The stop() queued behind the start takes care of the worker
+    if (!m_starting) {
+        return;
+    }
+    m_starting = false;
+    m_active = true;
+    emit activeChanged();
+}
+
+void StreamingEngine::workerFailed()
+{
+    if (!m_starting) {
+        return;
+    }
+    m_starting = false;
+    if (m_streamActivated) {
+        setStreamActive(false);
+        m_streamActivated = false;
+    }
+    emit error();
+}
+
+void StreamingEngine::setStreamActive(bool active)
+{
+    QVariantMap stream;
+    stream.insert("active", active);
+    QVariantMap params;
+    params.insert("stream", stream);
+    // Only activating needs to wait for the reply
+    int requestId = HueBridgeConnection::instance()->put("groups/" + QString::number(m_groupId), params, active ? this : 0, "activateStreamFinished");
+    if (active) {
+        m_activateRequest = requestId;
+    }
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef STREAMINGENGINE_H
+#define STREAMINGENGINE_H
+
+#include "huestream.h"
+
+#include <QObject>
+#include <QColor>
+#include <QRgb>
+#include <QThread>
+#include <QVariant>
+
+class StreamingWorker;
+class StreamTransport;
+
+// Streams colours to the lights of an entertainment group. Frames are sent at a fixed
+// rate from a separate thread, setLightColor() only updates what goes out next.
+class StreamingEngine: public QObject
+{
+    Q_OBJECT
+    Q_ENUMS(ColorSpace)
+
+    Q_PROPERTY(int groupId READ groupId WRITE setGroupId NOTIFY groupIdChanged)
+    Q_PROPERTY(int rate READ rate WRITE setRate NOTIFY rateChanged)
+    Q_PROPERTY(ColorSpace colorSpace READ colorSpace WRITE setColorSpace NOTIFY colorSpaceChanged)
+    Q_PROPERTY(QString host READ host WRITE setHost NOTIFY hostChanged)
+    Q_PROPERTY(int port READ port WRITE setPort NOTIFY portChanged)
+    Q_PROPERTY(bool active READ active NOTIFY activeChanged)
+
+public:
+    enum ColorSpace {
+        ColorSpaceRGB = HueStream::ColorSpaceRGB,
+        ColorSpaceXY = HueStream::ColorSpaceXY
+    };
+
+    StreamingEngine(QObject *parent = 0);
+    ~StreamingEngine();
+
+    // The entertainment group to stream to
+    int groupId() const;
+    void setGroupId(int groupId);
+
+    // Frames per second, 25 to 50
+    int rate() const;
+    void setRate(int rate);
+
+    ColorSpace colorSpace() const;
+    void setColorSpace(ColorSpace colorSpace);
+
+    // Empty to stream to the connected bridge. Any other host, like a UdpStreamReceiver,
+    // is streamed to directly without activating streaming on the bridge.
+    QString host() const;
+    void setHost(const QString &host);
+
+    int port() const;
+    void setPort(int port);
+
+    bool active() const;
+
+    // Replaces the default UdpStreamTransport. Takes ownership, only while not active.
+    void setTransport(StreamTransport *transport);
+
+    Q_INVOKABLE void start();
+    Q_INVOKABLE void stop();
+
+    Q_INVOKABLE void setLightColor(int lightId, const QColor &color);
+    void setLightColors(const QList<int> &lightIds, const QList<QRgb> &colors);
+
+signals:
+    void groupIdChanged();
+    void rateChanged();
+    void colorSpaceChanged();
+    void hostChanged();
+    void portChanged();
+    void activeChanged();
+    void error();
+
+private slots:
+    void activateStreamFinished(int id, const QVariant &response);
+    void workerStarted();
+    void workerFailed();
+
+private:
+    void startWorker(const QString &host);
+    void setStreamActive(bool active);
+
+    int m_groupId;
+    int m_rate;
+    ColorSpace m_colorSpace;
+    QString m_host;
+    int m_port;
+    bool m_active;
+    // Between start() and the worker reporting back
+    bool m_starting;
+    bool m_streamActivated;
+    int m_activateRequest;
+
+    QThread m_thread;
+    StreamingWorker *m_worker;
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "streamingworker.h"
+#include "streamtransport.h"
+#include "udpstreamtransport.h"
+
+#include <QTimer>
+#include <QMutexLocker>
+#include <QDebug>
+
+StreamingWorker::StreamingWorker():
+    QObject(),
+    m_timer(new QTimer(this)),
+    m_transport(new UdpStreamTransport()),
+    m_colorSpace(HueStream::ColorSpaceRGB),
+    m_sequence(0)
+{
+#if QT_VERSION >= 0x050000
+    m_timer->setTimerType(Qt::PreciseTimer);
+#endif
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(sendFrame()));
+}
+
+StreamingWorker::~StreamingWorker()
+{
+    if (m_transport) {
+        m_transport->close();
+    }
+    delete m_transport;
+}
+
+void StreamingWorker::setTransport(StreamTransport *transport)
+{
+    QMutexLocker locker(&m_mutex);
+    delete m_transport;
+    m_transport = transport;
+}
+
+void StreamingWorker::setLightColor(const HueStream::LightColor &color)
+{
+    QMutexLocker locker(&m_mutex);
+    m_frame.insert(color.lightId, color);
+}
+
+void StreamingWorker::clearLights()
+{
+    QMutexLocker locker(&m_mutex);
+    m_frame.clear();
+}
+
+void StreamingWorker::setColorSpace(int colorSpace)
+{
+    QMutexLocker locker(&m_mutex);
+    m_frame.clear();
+    m_colorSpace = static_cast<HueStream::ColorSpace>(colorSpace);
+}
+
+void StreamingWorker::start(const QString &host, int port, int rate, int colorSpace)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_transport || !m_transport->open(host, port)) {
+            qWarning() << "Cannot open stream to" << host << port;
+            emit failed();
+            return;
+        }
+        m_colorSpace = static_cast<HueStream::ColorSpace>(colorSpace);
+    }
+    m_timer->start(1000 / qMax(1, rate));
+    emit started();
+}
+
+void StreamingWorker::stop()
+{
+    m_timer->stop();
+    QMutexLocker locker(&m_mutex);
+    if (m_transport) {
+        m_transport->close();
+    }
+}
+
+void StreamingWorker::sendFrame()
+{
+    QList<HueStream::LightColor> lights;
+    {
+        QMutexLocker locker(&m_mutex);
+        lights = m_frame.values();
+    }
+    if (lights.isEmpty()) {
+        return;
+    }
+
+    // The same frame is repeated until there is a newer one, the bridge ends the stream
+    // if it doesn't receive anything for a while.
+    QMutexLocker locker(&m_mutex);
+    foreach (const QByteArray &message, HueStream::encode(lights, m_colorSpace, m_sequence++)) {
+        if (!m_transport->send(message)) {
+            qWarning() << "Failed to send stream message";
+        }
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef STREAMINGWORKER_H
+#define STREAMINGWORKER_H
+
+#include "huestream.h"
+
+#include <QObject>
+#include <QMutex>
+#include <QHash>
+
+class QTimer;
+class StreamTransport;
+
+// Lives in the streaming thread and sends the latest frame at a fixed rate. Frames are
+// handed over from the main thread through setLightColor(), only the newest values count.
+class StreamingWorker: public QObject
+{
+    Q_OBJECT
+
+public:
+    StreamingWorker();
+    ~StreamingWorker();
+
+    // Thread safe. Only to be called while not streaming, takes ownership.
+    void setTransport(StreamTransport *transport);
+
+    // Thread safe
+    void setLightColor(const HueStream::LightColor &color);
+    void clearLights();
+    // Thread safe. Drops the current frame, its values are in the old colour space.
+    void setColorSpace(int colorSpace);
+
+public slots:
+    void start(const QString &host, int port, int rate, int colorSpace);
+    void stop();
+
+signals:
+    void started();
+    void failed();
+
+private slots:
+    void sendFrame();
+
+private:
+    QTimer *m_timer;
+    StreamTransport *m_transport;
+    HueStream::ColorSpace m_colorSpace;
+    quint8 m_sequence;
+
+    QMutex m_mutex;
+    QHash<quint16, HueStream::LightColor> m_frame;
+};
+
+#endif
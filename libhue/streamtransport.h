@@ -0,0 +1,38 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef STREAMTRANSPORT_H
+#define STREAMTRANSPORT_H
+
+#include <QByteArray>
+#include <QString>
+
+// Delivers streaming messages to the bridge. All methods are called from the streaming
+// thread, so implementations should create their sockets in open().
+class StreamTransport
+{
+public:
+    virtual ~StreamTransport() {}
+
+    virtual bool open(const QString &host, quint16 port) = 0;
+    virtual bool send(const QByteArray &message) = 0;
+    virtual void close() = 0;
+};
+
+#endif
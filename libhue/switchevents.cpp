@@ -0,0 +1,330 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "switchevents.h"
+#include "huebridgeconnection.h"
+#include "pollbudget.h"
+
+#include <QDebug>
+#include <QMultiMap>
+
+// A switch stays on the fast interval this long after it was used (ms)
+static const int s_activeTime = 10000;
+static const int s_discoveryInterval = 60000;
+
+// Hue Tap buttons 1 to 4
+static const int s_tapButtons[] = { 34, 16, 17, 18 };
+
+SwitchEvents::SwitchEvents(QObject *parent):
+    QObject(parent),
+    m_running(false),
+    m_fastInterval(200),
+    m_idleInterval(1000),
+    m_discoveryRequestId(-1),
+    m_latencySum(0),
+    m_latencyCount(0),
+    m_maxLatency(0)
+{
+    m_clock.start();
+    m_pollTimer.setSingleShot(true);
+#if QT_VERSION >= 0x050000
+    m_pollTimer.setTimerType(Qt::PreciseTimer);
+#endif
+    connect(&m_pollTimer, SIGNAL(timeout()), this, SLOT(poll()));
+    m_discoveryTimer.setInterval(s_discoveryInterval);
+    connect(&m_discoveryTimer, SIGNAL(timeout()), this, SLOT(discover()));
+}
+
+bool SwitchEvents::running() const
+{
+    return m_running;
+}
+
+QStringList SwitchEvents::sensorIds() const
+{
+    return m_switches.keys();
+}
+
+int SwitchEvents::fastInterval() const
+{
+    return m_fastInterval;
+}
+
+void SwitchEvents::setFastInterval(int fastInterval)
+{
+    fastInterval = qMax(50, fastInterval);
+    if (m_fastInterval != fastInterval) {
+        m_fastInterval = fastInterval;
+        emit fastIntervalChanged();
+    }
+}
+
+int SwitchEvents::idleInterval() const
+{
+    return m_idleInterval;
+}
+
+void SwitchEvents::setIdleInterval(int idleInterval)
+{
+    idleInterval = qMax(50, idleInterval);
+    if (m_idleInterval != idleInterval) {
+        m_idleInterval = idleInterval;
+        emit idleIntervalChanged();
+    }
+}
+
+int SwitchEvents::averageLatency() const
+{
+    return m_latencyCount > 0 ? m_latencySum / m_latencyCount : 0;
+}
+
+int SwitchEvents::maxLatency() const
+{
+    return m_maxLatency;
+}
+
+void SwitchEvents::resetLatency()
+{
+    m_latencySum = 0;
+    m_latencyCount = 0;
+    m_maxLatency = 0;
+    emit latencyChanged();
+}
+
+int SwitchEvents::eventLatency(const QString &sensorId) const
+{
+    return m_switches.value(sensorId).eventLatency;
+}
+
+void SwitchEvents::start()
+{
+    if (m_running) {
+        return;
+    }
+    m_running = true;
+    emit runningChanged();
+    m_discoveryTimer.start();
+    discover();
+    schedulePoll();
+}
+
+void SwitchEvents::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+    m_pollTimer.stop();
+    m_discoveryTimer.stop();
+    foreach (int requestId, m_requests.keys()) {
+        HueBridgeConnection::instance()->cancel(requestId);
+    }
+    m_requests.clear();
+    QHash<QString, Switch>::iterator it;
+    for (it = m_switches.begin(); it != m_switches.end(); ++it) {
+        it.value().requestId = -1;
+        it.value().lastPoll = -1;
+    }
+    emit runningChanged();
+}
+
+bool SwitchEvents::decodeButtonEvent(Sensor::Type type, int buttonEvent, int *button, EventType *event)
+{
+    if (type == Sensor::TypeZGPSwitch) {
+        for (int i = 0; i < 4; ++i) {
+            if (s_tapButtons[i] == buttonEvent) {
+                *button = i + 1;
+                *event = EventPress;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Dimmer switches report button * 1000 + event type
+    if (type == Sensor::TypeZLLSwitch && buttonEvent >= 1000 && buttonEvent % 1000 <= 3) {
+        *button = buttonEvent / 1000;
+        *event = static_cast<EventType>(EventInitialPress + buttonEvent % 1000);
+        return true;
+    }
+    return false;
+}
+
+void SwitchEvents::discover()
+{
+    if (m_discoveryRequestId == -1) {
+        m_discoveryRequestId = HueBridgeConnection::instance()->get("sensors", this, "sensorsReceived", HueBridgeConnection::PriorityBackground);
+    }
+}
+
+void SwitchEvents::sensorsReceived(int id, const QVariant &response)
+{
+    Q_UNUSED(id)
+    m_discoveryRequestId = -1;
+    if (response.type() != QVariant::Map) {
+        return;
+    }
+
+    qint64 now = m_clock.elapsed();
+    QVariantMap sensors = response.toMap();
+    QHash<QString, Switch> switches;
+    foreach (const QString &sensorId, sensors.keys()) {
+        QVariantMap sensorMap = sensors.value(sensorId).toMap();
+        QString typeString = sensorMap.value("type").toString();
+        if (typeString != Sensor::typeToString(Sensor::TypeZLLSwitch) && typeString != Sensor::typeToString(Sensor::TypeZGPSwitch)) {
+            continue;
+        }
+        Switch sw = m_switches.value(sensorId);
+        if (sw.id.isEmpty()) {
+            sw.id = sensorId;
+            sw.type = Sensor::typeStringToType(typeString);
+            sw.interval = m_idleInterval;
+            sw.nextPoll = now;
+        }
+        // Changes seen by discovery can't be timed. sw is a copy, listeners look at m_switches.
+        sw.eventLatency = 0;
+        if (m_switches.contains(sensorId)) {
+            m_switches[sensorId].eventLatency = 0;
+        }
+        updateState(sw, sensorMap.value("state").toMap());
+        switches.insert(sensorId, sw);
+    }
+
+    bool changed = switches.keys().toSet() != m_switches.keys().toSet();
+    m_switches = switches;
+    if (changed) {
+        emit sensorIdsChanged();
+    }
+    schedulePoll();
+}
+
+bool SwitchEvents::isActive(const Switch &sw, qint64 now) const
+{
+    return sw.lastEvent >= 0 && now - sw.lastEvent <= s_activeTime;
+}
+
+void SwitchEvents::schedulePoll()
+{
+    if (!m_running) {
+        return;
+    }
+
+    qint64 now = m_clock.elapsed();
+    qint64 next = -1;
+    foreach (const Switch &sw, m_switches) {
+        if (sw.requestId == -1 && (next == -1 || sw.nextPoll < next)) {
+            next = sw.nextPoll;
+        }
+    }
+    if (next == -1) {
+        m_pollTimer.stop();
+        return;
+    }
+
+    // Due switches wait for the budget to allow the next request
+    next = qMax<qint64>(next, now + PollBudget::instance()->wait());
+    m_pollTimer.start(qMax<qint64>(0, next - now));
+}
+
+void SwitchEvents::poll()
+{
+    qint64 now = m_clock.elapsed();
+
+    // Active switches first, so a switch in use stays fast however many switches there are.
+    // An idle switch left waiting for a whole idle interval gets its turn anyway.
+    QMultiMap<qint64, QString> due;
+    QHash<QString, Switch>::const_iterator it;
+    for (it = m_switches.constBegin(); it != m_switches.constEnd(); ++it) {
+        const Switch &sw = it.value();
+        // Only one request per switch at a time, a slow bridge slows down polling
+        if (sw.requestId != -1 || sw.nextPoll > now) {
+            continue;
+        }
+        bool first = isActive(sw, now) || now - sw.nextPoll >= m_idleInterval;
+        due.insert(sw.nextPoll - (first ? s_activeTime + m_idleInterval : 0), sw.id);
+    }
+
+    foreach (const QString &sensorId, due.values()) {
+        if (!PollBudget::instance()->take()) {
+            break;
+        }
+        Switch &sw = m_switches[sensorId];
+        sw.requestId = HueBridgeConnection::instance()->get("sensors/" + sw.id, this, "sensorReceived", HueBridgeConnection::PriorityAutomation);
+        sw.pollSent = now;
+        m_requests.insert(sw.requestId, sw.id);
+    }
+    schedulePoll();
+}
+
+void SwitchEvents::sensorReceived(int id, const QVariant &response)
+{
+    QString sensorId = m_requests.take(id);
+    if (!m_switches.contains(sensorId)) {
+        return;
+    }
+
+    qint64 now = m_clock.elapsed();
+    Switch &sw = m_switches[sensorId];
+    sw.requestId = -1;
+
+    // Known before updateState() reports the event, so listeners can ask for it
+    sw.eventLatency = sw.lastPoll >= 0 ? now - (sw.lastPoll + sw.pollSent) / 2 : 0;
+    if (response.type() == QVariant::Map && updateState(sw, response.toMap().value("state").toMap())) {
+        if (sw.lastPoll >= 0) {
+            int latency = sw.eventLatency;
+            m_latencySum += latency;
+            m_latencyCount++;
+            m_maxLatency = qMax(m_maxLatency, latency);
+            emit latencyMeasured(sw.id, latency);
+            emit latencyChanged();
+        }
+        sw.lastEvent = now;
+        sw.interval = m_fastInterval;
+    } else if (sw.lastEvent < 0 || now - sw.lastEvent > s_activeTime) {
+        sw.interval = qMin(m_idleInterval, sw.interval * 3 / 2);
+    }
+    sw.lastPoll = sw.pollSent;
+    sw.nextPoll = qMax(now, sw.pollSent + sw.interval);
+    schedulePoll();
+}
+
+// Returns true if the state changed since it was last seen
+bool SwitchEvents::updateState(Switch &sw, const QVariantMap &state)
+{
+    QString lastUpdated = state.value("lastupdated").toString();
+    int value = state.value("buttonevent").toInt();
+    if (sw.known && lastUpdated == sw.lastUpdated && value == sw.buttonEvent) {
+        return false;
+    }
+
+    bool report = sw.known;
+    sw.known = true;
+    sw.lastUpdated = lastUpdated;
+    sw.buttonEvent = value;
+    if (!report) {
+        return false;
+    }
+
+    int button;
+    EventType event;
+    if (decodeButtonEvent(sw.type, value, &button, &event)) {
+        emit buttonEvent(sw.id, button, event);
+    }
+    return true;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef SWITCHEVENTS_H
+#define SWITCHEVENTS_H
+
+#include "sensor.h"
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVariant>
+
+// Reports button presses on Hue dimmer switches and Hue Taps as they happen. Switches are
+// polled one by one instead of fetching all sensors, a switch that was just used is polled
+// fast and backs off to idleInterval when left alone. A press shows up as a change of
+// state/lastupdated or state/buttonevent. The bridge only keeps the latest event, so a
+// short press and release within one poll interval is reported as the release only.
+// The press to detection latency is estimated from the poll times: the press happened
+// between the last poll that didn't see it and the one that did.
+class SwitchEvents: public QObject
+{
+    Q_OBJECT
+    Q_ENUMS(EventType)
+
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(QStringList sensorIds READ sensorIds NOTIFY sensorIdsChanged)
+    Q_PROPERTY(int fastInterval READ fastInterval WRITE setFastInterval NOTIFY fastIntervalChanged)
+    Q_PROPERTY(int idleInterval READ idleInterval WRITE setIdleInterval NOTIFY idleIntervalChanged)
+    Q_PROPERTY(int averageLatency READ averageLatency NOTIFY latencyChanged)
+    Q_PROPERTY(int maxLatency READ maxLatency NOTIFY latencyChanged)
+
+public:
+    enum EventType {
+        // Hue Tap buttons only report presses
+        EventPress,
+        EventInitialPress,
+        EventHold,
+        EventShortRelease,
+        EventLongRelease
+    };
+
+    SwitchEvents(QObject *parent = 0);
+
+    bool running() const;
+    QStringList sensorIds() const;
+
+    // Poll intervals per switch in ms. Polling all switches together is further limited
+    // to a few requests per second, shared with other pollers (see PollBudget), to leave
+    // room for other traffic. Switches which were
+    // used recently get that budget first, idle ones are polled with what is left.
+    int fastInterval() const;
+    void setFastInterval(int fastInterval);
+    int idleInterval() const;
+    void setIdleInterval(int idleInterval);
+
+    // Estimated press to detection latency in ms
+    int averageLatency() const;
+    int maxLatency() const;
+    Q_INVOKABLE void resetLatency();
+    // Of the event just reported by buttonEvent() for this switch, 0 if unknown
+    Q_INVOKABLE int eventLatency(const QString &sensorId) const;
+
+    Q_INVOKABLE void start();
+    Q_INVOKABLE void stop();
+
+    // Translates the buttonevent of a ZLL (dimmer) or ZGP (Tap) switch. Returns false for
+    // values that aren't button events.
+    static bool decodeButtonEvent(Sensor::Type type, int buttonEvent, int *button, EventType *event);
+
+signals:
+    void runningChanged();
+    void sensorIdsChanged();
+    void fastIntervalChanged();
+    void idleIntervalChanged();
+    void latencyChanged();
+
+    // Qualified type, string based connections need to spell it the same way
+    void buttonEvent(const QString &sensorId, int button, SwitchEvents::EventType event);
+    void latencyMeasured(const QString &sensorId, int latency);
+
+private slots:
+    void discover();
+    void sensorsReceived(int id, const QVariant &response);
+    void poll();
+    void sensorReceived(int id, const QVariant &response);
+
+private:
+    class Switch
+    {
+    public:
+        Switch(): type(Sensor::TypeUnknown), buttonEvent(0), known(false), interval(0),
+            lastPoll(-1), pollSent(-1), nextPoll(0), lastEvent(-1), eventLatency(0), requestId(-1) {}
+        QString id;
+        Sensor::Type type;
+        QString lastUpdated;
+        int buttonEvent;
+        bool known;
+        int interval;
+        // When the last poll which didn't see a change was sent
+        qint64 lastPoll;
+        qint64 pollSent;
+        qint64 nextPoll;
+        qint64 lastEvent;
+        int eventLatency;
+        int requestId;
+    };
+
+    bool updateState(Switch &sw, const QVariantMap &state);
+    void schedulePoll();
+    bool isActive(const Switch &sw, qint64 now) const;
+
+    bool m_running;
+    int m_fastInterval;
+    int m_idleInterval;
+
+    QHash<QString, Switch> m_switches;
+    QHash<int, QString> m_requests;
+    int m_discoveryRequestId;
+    QTimer m_pollTimer;
+    QTimer m_discoveryTimer;
+    QElapsedTimer m_clock;
+
+    qint64 m_latencySum;
+    int m_latencyCount;
+    int m_maxLatency;
+};
+
+#endif
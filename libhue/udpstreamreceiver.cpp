@@ -0,0 +1,101 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "udpstreamreceiver.h"
+#include "huestream.h"
+
+#include <QUdpSocket>
+#include <QDebug>
+
+UdpStreamReceiver::UdpStreamReceiver(QObject *parent):
+    QObject(parent),
+    m_socket(new QUdpSocket(this)),
+    m_port(2100),
+    m_framesReceived(0)
+{
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(readDatagrams()));
+}
+
+int UdpStreamReceiver::port() const
+{
+    return m_port;
+}
+
+void UdpStreamReceiver::setPort(int port)
+{
+    if (m_port != port) {
+        m_port = port;
+        emit portChanged();
+    }
+}
+
+bool UdpStreamReceiver::listening() const
+{
+    return m_socket->state() == QAbstractSocket::BoundState;
+}
+
+int UdpStreamReceiver::framesReceived() const
+{
+    return m_framesReceived;
+}
+
+bool UdpStreamReceiver::listen()
+{
+    close();
+    if (!m_socket->bind(QHostAddress::LocalHost, m_port)) {
+        qWarning() << "Cannot listen for stream on port" << m_port << m_socket->errorString();
+        return false;
+    }
+    emit listeningChanged();
+    return true;
+}
+
+void UdpStreamReceiver::close()
+{
+    if (m_socket->state() != QAbstractSocket::UnconnectedState) {
+        m_socket->close();
+        emit listeningChanged();
+    }
+}
+
+void UdpStreamReceiver::readDatagrams()
+{
+    while (m_socket->hasPendingDatagrams()) {
+        QByteArray datagram;
+        datagram.resize(m_socket->pendingDatagramSize());
+        m_socket->readDatagram(datagram.data(), datagram.size());
+
+        QList<HueStream::LightColor> lights;
+        HueStream::ColorSpace colorSpace;
+        quint8 sequence;
+        if (!HueStream::decode(datagram, &lights, &colorSpace, &sequence)) {
+            qWarning() << "Received invalid stream message" << datagram.toHex();
+            continue;
+        }
+
+        QVariantMap lightMap;
+        foreach (const HueStream::LightColor &light, lights) {
+            QVariantList values;
+            values << light.values[0] << light.values[1] << light.values[2];
+            lightMap.insert(QString::number(light.lightId), values);
+        }
+        ++m_framesReceived;
+        emit frameReceived(sequence, colorSpace, lightMap);
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef UDPSTREAMRECEIVER_H
+#define UDPSTREAMRECEIVER_H
+
+#include <QObject>
+#include <QVariantMap>
+
+class QUdpSocket;
+
+// Listens for an unencrypted stream like a bridge would, to test streaming without one
+class UdpStreamReceiver: public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(int port READ port WRITE setPort NOTIFY portChanged)
+    Q_PROPERTY(bool listening READ listening NOTIFY listeningChanged)
+    Q_PROPERTY(int framesReceived READ framesReceived NOTIFY frameReceived)
+
+public:
+    UdpStreamReceiver(QObject *parent = 0);
+
+    int port() const;
+    void setPort(int port);
+
+    bool listening() const;
+    int framesReceived() const;
+
+    Q_INVOKABLE bool listen();
+    Q_INVOKABLE void close();
+
+signals:
+    void portChanged();
+    void listeningChanged();
+    // lights maps light ids to lists of the three values sent for them
+    void frameReceived(int sequence, int colorSpace, const QVariantMap &lights);
+
+private slots:
+    void readDatagrams();
+
+private:
+    QUdpSocket *m_socket;
+    int m_port;
+    int m_framesReceived;
+};
+
+#endif
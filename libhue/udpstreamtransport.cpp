@@ -0,0 +1,61 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "udpstreamtransport.h"
+
+#include <QUdpSocket>
+#include <QDebug>
+
+UdpStreamTransport::UdpStreamTransport():
+    m_socket(0),
+    m_port(0)
+{
+}
+
+UdpStreamTransport::~UdpStreamTransport()
+{
+    close();
+}
+
+bool UdpStreamTransport::open(const QString &host, quint16 port)
+{
+    close();
+    m_host = QHostAddress(host);
+    m_port = port;
+    if (m_host.isNull()) {
+        qWarning() << "Cannot stream to invalid address" << host;
+        return false;
+    }
+    m_socket = new QUdpSocket();
+    return true;
+}
+
+bool UdpStreamTransport::send(const QByteArray &message)
+{
+    if (!m_socket) {
+        return false;
+    }
+    return m_socket->writeDatagram(message, m_host, m_port) == message.size();
+}
+
+void UdpStreamTransport::close()
+{
+    delete m_socket;
+    m_socket = 0;
+}
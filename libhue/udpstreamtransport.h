@@ -0,0 +1,47 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef UDPSTREAMTRANSPORT_H
+#define UDPSTREAMTRANSPORT_H
+
+#include "streamtransport.h"
+
+#include <QHostAddress>
+
+class QUdpSocket;
+
+// Sends the stream unencrypted. Real bridges require DTLS, this is meant for the local
+// UdpStreamReceiver and for tests.
+class UdpStreamTransport: public StreamTransport
+{
+public:
+    UdpStreamTransport();
+    ~UdpStreamTransport();
+
+    bool open(const QString &host, quint16 port);
+    bool send(const QByteArray &message);
+    void close();
+
+private:
+    QUdpSocket *m_socket;
+    QHostAddress m_host;
+    quint16 m_port;
+};
+
+#endif
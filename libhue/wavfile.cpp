@@ -0,0 +1,120 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "wavfile.h"
+
+#include <QFile>
+#include <QtEndian>
+#include <QDebug>
+#include <string.h>
+
+static const int s_formatPcm = 1;
+static const int s_formatFloat = 3;
+static const int s_formatExtensible = 0xfffe;
+
+bool WavFile::read(const QString &fileName, QVector<float> *samples, int *sampleRate)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot open" << fileName;
+        return false;
+    }
+    QByteArray contents = file.readAll();
+    const uchar *data = reinterpret_cast<const uchar*>(contents.constData());
+    int size = contents.size();
+
+    if (size < 12 || contents.left(4) != "RIFF" || contents.mid(8, 4) != "WAVE") {
+        qWarning() << fileName << "is not a WAVE file";
+        return false;
+    }
+
+    int format = 0;
+    int channels = 0;
+    int bitsPerSample = 0;
+    int rate = 0;
+    const uchar *sampleData = 0;
+    int sampleDataSize = 0;
+
+    int offset = 12;
+    while (offset + 8 <= size) {
+        QByteArray chunkId = contents.mid(offset, 4);
+        int chunkSize = qMin<quint32>(qFromLittleEndian<quint32>(data + offset + 4), size - offset - 8);
+        const uchar *chunk = data + offset + 8;
+        if (chunkId == "fmt " && chunkSize >= 16) {
+            format = qFromLittleEndian<quint16>(chunk);
+            channels = qFromLittleEndian<quint16>(chunk + 2);
+            rate = qFromLittleEndian<quint32>(chunk + 4);
+            bitsPerSample = qFromLittleEndian<quint16>(chunk + 14);
+            // The actual format is in the first two bytes of the sub format GUID
+            if (format == s_formatExtensible && chunkSize >= 26) {
+                format = qFromLittleEndian<quint16>(chunk + 24);
+            }
+        } else if (chunkId == "data") {
+            sampleData = chunk;
+            sampleDataSize = chunkSize;
+        }
+        // Chunks are padded to an even size
+        offset += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    bool supported = (format == s_formatPcm && (bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32))
+            || (format == s_formatFloat && bitsPerSample == 32);
+    if (!sampleData || channels <= 0 || rate <= 0 || !supported) {
+        qWarning() << "Unsupported WAVE file" << fileName << "format" << format << "bits" << bitsPerSample;
+        return false;
+    }
+
+    int bytesPerSample = bitsPerSample / 8;
+    int frames = sampleDataSize / (bytesPerSample * channels);
+    samples->resize(frames);
+    float *out = samples->data();
+    const uchar *in = sampleData;
+    for (int i = 0; i < frames; ++i) {
+        float sum = 0;
+        for (int channel = 0; channel < channels; ++channel) {
+            switch (bitsPerSample) {
+            case 8:
+                // 8 bit samples are unsigned
+                sum += (in[0] - 128) / 128.0f;
+                break;
+            case 16:
+                sum += qFromLittleEndian<qint16>(in) / 32768.0f;
+                break;
+            case 24:
+                sum += (static_cast<qint32>(quint32(in[0]) << 8 | quint32(in[1]) << 16 | quint32(in[2]) << 24) >> 8) / 8388608.0f;
+                break;
+            case 32:
+                if (format == s_formatFloat) {
+                    quint32 bits = qFromLittleEndian<quint32>(in);
+                    float value;
+                    memcpy(&value, &bits, sizeof(value));
+                    sum += value;
+                } else {
+                    sum += qFromLittleEndian<qint32>(in) / 2147483648.0f;
+                }
+                break;
+            }
+            in += bytesPerSample;
+        }
+        out[i] = sum / channels;
+    }
+
+    *sampleRate = rate;
+    return true;
+}
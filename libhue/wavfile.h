@@ -0,0 +1,34 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef WAVFILE_H
+#define WAVFILE_H
+
+#include <QString>
+#include <QVector>
+
+// Minimal reader for RIFF WAVE files with integer PCM (8, 16, 24 or 32 bit) or 32 bit
+// float samples. All channels are mixed down to mono.
+class WavFile
+{
+public:
+    static bool read(const QString &fileName, QVector<float> *samples, int *sampleRate);
+};
+
+#endif
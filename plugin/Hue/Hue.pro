@@ -1,6 +1,7 @@
 TEMPLATE = lib
 
 QT += network
+greaterThan(QT_MAJOR_VERSION, 4): QT += qml quick
 CONFIG += plugin c++11
 
 TARGET = hueplugin
@@ -9,6 +10,12 @@ HEADERS += hueplugin.h \
 
 SOURCES += hueplugin.cpp \
 
+# Scene graph items need Qt Quick 2
+greaterThan(QT_MAJOR_VERSION, 4) {
+    HEADERS += ciecolorpicker.h
+    SOURCES += ciecolorpicker.cpp
+}
+
 LIBS += -L../../libhue -lhue
 
 OTHER_FILES = qmldir \
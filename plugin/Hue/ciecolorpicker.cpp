@@ -0,0 +1,260 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "ciecolorpicker.h"
+#include "../../libhue/colorconversion.h"
+
+#include <QMouseEvent>
+#include <QQuickWindow>
+#include <QSGSimpleTextureNode>
+#include <QSGTexture>
+
+// The visible part of the chart, in xy
+static const qreal s_maxX = 0.75;
+static const qreal s_maxY = 0.85;
+
+CieColorPicker::CieColorPicker(QQuickItem *parent):
+    QQuickItem(parent),
+    m_gamut(GamutNone),
+    m_gamutSet(false),
+    m_xy(0.3127, 0.3290),
+    m_pressed(false),
+    m_chartGamut(-1),
+    m_chartChanged(false)
+{
+    setFlag(ItemHasContents, true);
+    setAcceptedMouseButtons(Qt::LeftButton);
+}
+
+LightInterface *CieColorPicker::target() const
+{
+    return m_target;
+}
+
+void CieColorPicker::setTarget(LightInterface *target)
+{
+    if (m_target == target) {
+        return;
+    }
+    if (m_target) {
+        disconnect(m_target, 0, this, 0);
+    }
+    m_target = target;
+    if (m_target) {
+        connect(m_target, SIGNAL(stateChanged()), this, SLOT(targetStateChanged()));
+        targetStateChanged();
+    }
+    if (!m_gamutSet) {
+        polish();
+    }
+    emit targetChanged();
+}
+
+CieColorPicker::Gamut CieColorPicker::gamut() const
+{
+    return static_cast<Gamut>(effectiveGamut());
+}
+
+void CieColorPicker::setGamut(CieColorPicker::Gamut gamut)
+{
+    m_gamutSet = true;
+    if (m_gamut != gamut) {
+        m_gamut = gamut;
+        polish();
+        emit gamutChanged();
+    }
+}
+
+QPointF CieColorPicker::xy() const
+{
+    return m_xy;
+}
+
+void CieColorPicker::setXy(const QPointF &xy)
+{
+    if (m_xy != xy) {
+        m_xy = xy;
+        emit xyChanged();
+    }
+}
+
+QColor CieColorPicker::color() const
+{
+    return ColorConversion::xyToRgb(m_xy);
+}
+
+bool CieColorPicker::pressed() const
+{
+    return m_pressed;
+}
+
+QPointF CieColorPicker::positionToXy(qreal x, qreal y) const
+{
+    if (width() <= 0 || height() <= 0) {
+        return QPointF();
+    }
+    return QPointF(x / width() * s_maxX, (1 - y / height()) * s_maxY);
+}
+
+QPointF CieColorPicker::xyToPosition(const QPointF &xy) const
+{
+    return QPointF(xy.x() / s_maxX * width(), (1 - xy.y() / s_maxY) * height());
+}
+
+int CieColorPicker::effectiveGamut() const
+{
+    if (m_gamutSet || !m_target) {
+        return m_gamut;
+    }
+    if (m_target->isGroup()) {
+        return ColorConversion::gamutForGroup(m_target->id());
+    }
+    return ColorConversion::gamutForLight(m_target->id());
+}
+
+void CieColorPicker::targetStateChanged()
+{
+    // Don't jump around under the finger when the bridge reports back
+    if (!m_pressed && m_target->colorMode() == LightInterface::ColorModeXY) {
+        setXy(m_target->xy());
+    }
+}
+
+void CieColorPicker::renderChart()
+{
+    QSize size = QSize(width(), height());
+    int gamut = effectiveGamut();
+    if (size == m_chartSize && gamut == m_chartGamut) {
+        return;
+    }
+    m_chartSize = size;
+    m_chartGamut = gamut;
+
+    m_chart = QImage(size, QImage::Format_ARGB32_Premultiplied);
+    m_chart.fill(Qt::transparent);
+
+    // Without a known gamut, show everything the widest gamut covers
+    ColorConversion::Gamut shownGamut = gamut == ColorConversion::GamutNone ? ColorConversion::GamutC : static_cast<ColorConversion::Gamut>(gamut);
+    for (int y = 0; y < size.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb*>(m_chart.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            QPointF xy = positionToXy(x + 0.5, y + 0.5);
+            if (ColorConversion::inGamut(xy, shownGamut)) {
+                line[x] = ColorConversion::xyToRgb(xy).rgba();
+            }
+        }
+    }
+    m_chartChanged = true;
+}
+
+void CieColorPicker::updatePolish()
+{
+    if (width() >= 1 && height() >= 1) {
+        renderChart();
+    }
+    if (m_chartChanged) {
+        update();
+    }
+}
+
+QSGNode *CieColorPicker::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data)
+{
+    Q_UNUSED(data)
+
+    // Runs on the render thread while the GUI thread is blocked, so m_chart can be read
+    if (width() < 1 || height() < 1 || m_chart.isNull()) {
+        delete oldNode;
+        return 0;
+    }
+
+    QSGSimpleTextureNode *node = static_cast<QSGSimpleTextureNode*>(oldNode);
+    if (!node) {
+        node = new QSGSimpleTextureNode();
+#if QT_VERSION >= 0x050400
+        node->setOwnsTexture(true);
+#endif
+    }
+
+    if (m_chartChanged || !node->texture()) {
+#if QT_VERSION < 0x050400
+        delete node->texture();
+#endif
+        node->setTexture(window()->createTextureFromImage(m_chart));
+        m_chartChanged = false;
+    }
+    node->setRect(boundingRect());
+    return node;
+}
+
+void CieColorPicker::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QQuickItem::geometryChanged(newGeometry, oldGeometry);
+    if (newGeometry.size() != oldGeometry.size()) {
+        polish();
+    }
+}
+
+void CieColorPicker::mousePressEvent(QMouseEvent *event)
+{
+    setPressed(true);
+    pick(event->localPos());
+}
+
+void CieColorPicker::mouseMoveEvent(QMouseEvent *event)
+{
+    pick(event->localPos());
+}
+
+void CieColorPicker::mouseReleaseEvent(QMouseEvent *event)
+{
+    pick(event->localPos());
+    setPressed(false);
+}
+
+void CieColorPicker::mouseUngrabEvent()
+{
+    setPressed(false);
+}
+
+void CieColorPicker::touchUngrabEvent()
+{
+    setPressed(false);
+}
+
+void CieColorPicker::setPressed(bool pressed)
+{
+    if (m_pressed != pressed) {
+        m_pressed = pressed;
+        emit pressedChanged();
+    }
+}
+
+void CieColorPicker::pick(const QPointF &position)
+{
+    ColorConversion::Gamut gamut = static_cast<ColorConversion::Gamut>(effectiveGamut());
+    QPointF xy = ColorConversion::clampToGamut(positionToXy(position.x(), position.y()),
+                                               gamut == ColorConversion::GamutNone ? ColorConversion::GamutC : gamut);
+    if (xy == m_xy) {
+        return;
+    }
+    setXy(xy);
+    if (m_target) {
+        m_target->setXy(xy);
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#ifndef CIECOLORPICKER_H
+#define CIECOLORPICKER_H
+
+#include <QQuickItem>
+#include <QPointer>
+#include <QImage>
+
+#include "../../libhue/lightinterface.h"
+
+// Shows the part of the CIE xy chart a light can reproduce and lets the user pick from it.
+// The chart is rendered on the GUI thread while polishing and cached for the current size
+// and gamut. The render thread only uploads it as a texture when it changed.
+// Picked positions are converted to xy here and written through the target's setXy(),
+// which coalesces writes while a request is in flight.
+class CieColorPicker: public QQuickItem
+{
+    Q_OBJECT
+    Q_ENUMS(Gamut)
+
+    Q_PROPERTY(LightInterface *target READ target WRITE setTarget NOTIFY targetChanged)
+    Q_PROPERTY(Gamut gamut READ gamut WRITE setGamut NOTIFY gamutChanged)
+    Q_PROPERTY(QPointF xy READ xy WRITE setXy NOTIFY xyChanged)
+    Q_PROPERTY(QColor color READ color NOTIFY xyChanged)
+    Q_PROPERTY(bool pressed READ pressed NOTIFY pressedChanged)
+
+public:
+    // Same values as ColorConversion::Gamut
+    enum Gamut {
+        GamutNone,
+        GamutA,
+        GamutB,
+        GamutC
+    };
+
+    CieColorPicker(QQuickItem *parent = 0);
+
+    LightInterface *target() const;
+    void setTarget(LightInterface *target);
+
+    // Follows the target's lights unless set explicitly
+    Gamut gamut() const;
+    void setGamut(Gamut gamut);
+
+    QPointF xy() const;
+    void setXy(const QPointF &xy);
+
+    QColor color() const;
+    bool pressed() const;
+
+    // Mapping between item coordinates and xy, e.g. to place handles for lights
+    Q_INVOKABLE QPointF positionToXy(qreal x, qreal y) const;
+    Q_INVOKABLE QPointF xyToPosition(const QPointF &xy) const;
+
+signals:
+    void targetChanged();
+    void gamutChanged();
+    void xyChanged();
+    void pressedChanged();
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data);
+    void updatePolish();
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry);
+    void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+    // Another item took the grab, e.g. a Flickable, no release event follows
+    void mouseUngrabEvent();
+    void touchUngrabEvent();
+
+private slots:
+    void targetStateChanged();
+
+private:
+    void pick(const QPointF &position);
+    void setPressed(bool pressed);
+    void renderChart();
+    int effectiveGamut() const;
+
+    QPointer<LightInterface> m_target;
+    Gamut m_gamut;
+    bool m_gamutSet;
+    QPointF m_xy;
+    bool m_pressed;
+
+    QImage m_chart;
+    QSize m_chartSize;
+    int m_chartGamut;
+    // Set when m_chart was redone and still needs to be uploaded
+    bool m_chartChanged;
+};
+
+#endif
@@ -35,12 +35,27 @@
 #include "../../libhue/sensor.h"
 #include "../../libhue/sensors.h"
 #include "../../libhue/sensorsfiltermodel.h"
+#include "../../libhue/switchevents.h"
+#include "../../libhue/automationengine.h"
+#include "../../libhue/historystore.h"
 #include "../../libhue/rule.h"
 #include "../../libhue/rules.h"
 #include "../../libhue/rulesfiltermodel.h"
+#include "../../libhue/rulesimulator.h"
+#include "../../libhue/ruleoptimizer.h"
+#include "../../libhue/effect.h"
+#include "../../libhue/effectsengine.h"
+#include "../../libhue/fade.h"
+#include "../../libhue/beatsync.h"
+#include "../../libhue/circadianengine.h"
+#include "../../libhue/framecolorextractor.h"
+#include "../../libhue/holdcontroller.h"
+#include "../../libhue/streamingengine.h"
+#include "../../libhue/udpstreamreceiver.h"
 
 #if QT_VERSION >= 0x050000
 #include <QtQml/qqml.h>
+#include "ciecolorpicker.h"
 #else
 #include <QtDeclarative>
 #include <QDeclarativeContext>
@@ -60,6 +75,7 @@ void HuePlugin::registerTypes(const char *uri)
 
 #if QT_VERSION >= 0x050000
     qmlRegisterSingletonType<HueBridgeConnection>(uri, 0, 1, "HueBridge", hueBridgeInstance);
+    qmlRegisterType<CieColorPicker>(uri, 0, 1, "CieColorPicker");
 #endif
     qmlRegisterType<Lights>(uri, 0, 1, "Lights");
     qmlRegisterUncreatableType<Light>(uri, 0, 1, "Light", "Cannot create lights. Get them from the Lights model.");
@@ -77,9 +93,23 @@ void HuePlugin::registerTypes(const char *uri)
     qmlRegisterType<Sensors>(uri, 0, 1, "Sensors");
     qmlRegisterType<SensorsFilterModel>(uri, 0, 1, "SensorsFilterModel");
     qmlRegisterUncreatableType<Sensor>(uri, 0, 1, "Sensor", "Cannot create Sensor objects. Get them from the Sensors model.");
+    qmlRegisterType<SwitchEvents>(uri, 0, 1, "SwitchEvents");
+    qmlRegisterType<AutomationEngine>(uri, 0, 1, "AutomationEngine");
+    qmlRegisterType<HistoryStore>(uri, 0, 1, "HistoryStore");
     qmlRegisterType<Rules>(uri, 0, 1, "Rules");
     qmlRegisterType<RulesFilterModel>(uri, 0, 1, "RulesFilterModel");
     qmlRegisterUncreatableType<Rule>(uri, 0, 1, "Rule", "Cannot create Rule objects. Get them from the Rules model.");
+    qmlRegisterType<RuleSimulator>(uri, 0, 1, "RuleSimulator");
+    qmlRegisterType<RuleOptimizer>(uri, 0, 1, "RuleOptimizer");
+    qmlRegisterType<Effect>(uri, 0, 1, "Effect");
+    qmlRegisterType<EffectsEngine>(uri, 0, 1, "EffectsEngine");
+    qmlRegisterType<Fade>(uri, 0, 1, "Fade");
+    qmlRegisterType<FrameColorExtractor>(uri, 0, 1, "FrameColorExtractor");
+    qmlRegisterType<HoldController>(uri, 0, 1, "HoldController");
+    qmlRegisterType<BeatSync>(uri, 0, 1, "BeatSync");
+    qmlRegisterType<CircadianEngine>(uri, 0, 1, "CircadianEngine");
+    qmlRegisterType<StreamingEngine>(uri, 0, 1, "StreamingEngine");
+    qmlRegisterType<UdpStreamReceiver>(uri, 0, 1, "UdpStreamReceiver");
 }
 
 
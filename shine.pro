@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS += libhue plugin apps
+SUBDIRS += libhue plugin apps tests
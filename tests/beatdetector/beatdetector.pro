@@ -0,0 +1,11 @@
+TEMPLATE = app
+
+QT += network testlib
+CONFIG += testcase
+
+TARGET = tst_beatdetector
+
+INCLUDEPATH += ../../libhue
+LIBS += -L../../libhue -lhue
+
+SOURCES += tst_beatdetector.cpp
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "beatdetector.h"
+
+#include <QtTest>
+#include <math.h>
+
+static const double s_pi = 3.14159265358979323846;
+
+// Feeds synthetic click tracks through the detector and checks the tempo and beat phase
+// it settles on.
+class TestBeatDetector: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void clickTrack_data();
+    void clickTrack();
+
+private:
+    static QVector<float> clicks(int sampleRate, double bpm, double firstBeat, double length);
+};
+
+// Short decaying 1 kHz bursts on every beat over a little noise
+QVector<float> TestBeatDetector::clicks(int sampleRate, double bpm, double firstBeat, double length)
+{
+    double period = 60 / bpm;
+    QVector<float> samples(qRound(length * sampleRate));
+
+    // Fixed seed, so failures are reproducible
+    quint32 seed = 0x5eed;
+    for (int i = 0; i < samples.count(); ++i) {
+        seed = seed * 1664525 + 1013904223;
+        float sample = ((seed >> 8) / 16777216.0f - 0.5f) * 0.002f;
+
+        double time = 1.0 * i / sampleRate - firstBeat;
+        if (time >= 0) {
+            double sinceBeat = time - floor(time / period) * period;
+            if (sinceBeat < 0.02) {
+                sample += sin(2 * s_pi * 1000 * sinceBeat) * exp(-sinceBeat / 0.004);
+            }
+        }
+        samples[i] = sample;
+    }
+    return samples;
+}
+
+void TestBeatDetector::clickTrack_data()
+{
+    QTest::addColumn<int>("sampleRate");
+    QTest::addColumn<double>("bpm");
+    QTest::addColumn<double>("firstBeat");
+
+    QTest::newRow("90 bpm") << 44100 << 90.0 << 0.237;
+    QTest::newRow("100 bpm") << 44100 << 100.0 << 0.1;
+    QTest::newRow("120 bpm") << 44100 << 120.0 << 0.1;
+    QTest::newRow("120 bpm, 48 kHz") << 48000 << 120.0 << 0.1;
+    QTest::newRow("128 bpm") << 44100 << 128.0 << 0.237;
+    QTest::newRow("140 bpm") << 44100 << 140.0 << 0.3;
+}
+
+void TestBeatDetector::clickTrack()
+{
+    QFETCH(int, sampleRate);
+    QFETCH(double, bpm);
+    QFETCH(double, firstBeat);
+
+    QVector<float> samples = clicks(sampleRate, bpm, firstBeat, 20);
+    BeatDetector detector(sampleRate);
+    // In blocks like they come from an audio device
+    for (int i = 0; i < samples.count(); i += 1024) {
+        detector.process(samples.constData() + i, qMin(1024, samples.count() - i));
+    }
+
+    double period = 60 / bpm;
+    QVERIFY2(qAbs(detector.period() - period) <= 0.005 * period,
+             qPrintable(QString("period %1 s, expected %2 s").arg(detector.period()).arg(period)));
+
+    // Distance to the closest click
+    QVERIFY(detector.beatTime() >= 0);
+    double error = detector.beatTime() - firstBeat;
+    error -= floor(error / period + 0.5) * period;
+    QVERIFY2(qAbs(error) <= 0.005, qPrintable(QString("beat %1 ms off").arg(error * 1000)));
+}
+
+QTEST_APPLESS_MAIN(TestBeatDetector)
+
+#include "tst_beatdetector.moc"
@@ -0,0 +1,11 @@
+TEMPLATE = app
+
+QT += network testlib
+CONFIG += testcase
+
+TARGET = tst_colorconversion
+
+INCLUDEPATH += ../../libhue
+LIBS += -L../../libhue -lhue
+
+SOURCES += tst_colorconversion.cpp
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "colorconversion.h"
+
+#include <QtTest>
+
+// Compares the batch conversion used for effects and streaming (SSE2/NEON where available)
+// against the single colour conversion.
+class TestColorConversion: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void batchMatchesScalar_data();
+    void batchMatchesScalar();
+
+    void benchmarkBatch();
+    void benchmarkScalar();
+
+private:
+    static QVector<QRgb> testColors();
+};
+
+QVector<QRgb> TestColorConversion::testColors()
+{
+    QVector<QRgb> colors;
+
+    // Black, white, primaries and the values around the ends of the gamma curve
+    QList<int> levels = QList<int>() << 0 << 1 << 10 << 11 << 127 << 254 << 255;
+    foreach (int red, levels) {
+        foreach (int green, levels) {
+            foreach (int blue, levels) {
+                colors.append(qRgb(red, green, blue));
+            }
+        }
+    }
+
+    // Fixed seed, so failures are reproducible
+    quint32 seed = 0x5eed;
+    for (int i = 0; i < 4096; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        colors.append(seed >> 8);
+    }
+
+    // Not a multiple of 4, so the tail block is covered too
+    colors.append(qRgb(255, 0, 0));
+    return colors;
+}
+
+void TestColorConversion::batchMatchesScalar_data()
+{
+    QTest::addColumn<int>("gamut");
+
+    QTest::newRow("none") << static_cast<int>(ColorConversion::GamutNone);
+    QTest::newRow("A") << static_cast<int>(ColorConversion::GamutA);
+    QTest::newRow("B") << static_cast<int>(ColorConversion::GamutB);
+    QTest::newRow("C") << static_cast<int>(ColorConversion::GamutC);
+}
+
+void TestColorConversion::batchMatchesScalar()
+{
+    QFETCH(int, gamut);
+
+    QVector<QRgb> colors = testColors();
+    QVector<QPointF> xy(colors.count());
+    QVector<quint8> bri(colors.count());
+    ColorConversion::rgbToXy(colors.constData(), colors.count(), static_cast<ColorConversion::Gamut>(gamut), xy.data(), bri.data());
+
+    // The bridge takes 4 decimal places, single precision has to be well below that
+    const qreal tolerance = 0.0001;
+    for (int i = 0; i < colors.count(); ++i) {
+        QColor color(colors.at(i));
+        QPointF expected = ColorConversion::rgbToXy(color, static_cast<ColorConversion::Gamut>(gamut));
+        if (qAbs(xy.at(i).x() - expected.x()) > tolerance || qAbs(xy.at(i).y() - expected.y()) > tolerance) {
+            QFAIL(qPrintable(QString("%1: got %2,%3 expected %4,%5").arg(color.name())
+                             .arg(xy.at(i).x()).arg(xy.at(i).y()).arg(expected.x()).arg(expected.y())));
+        }
+        QCOMPARE(static_cast<int>(bri.at(i)), color.value());
+    }
+}
+
+void TestColorConversion::benchmarkBatch()
+{
+    QVector<QRgb> colors = testColors();
+    QVector<QPointF> xy(colors.count());
+    QVector<quint8> bri(colors.count());
+
+    QBENCHMARK {
+        ColorConversion::rgbToXy(colors.constData(), colors.count(), ColorConversion::GamutC, xy.data(), bri.data());
+    }
+}
+
+void TestColorConversion::benchmarkScalar()
+{
+    QVector<QRgb> colors = testColors();
+    QVector<QPointF> xy(colors.count());
+
+    QBENCHMARK {
+        for (int i = 0; i < colors.count(); ++i) {
+            xy[i] = ColorConversion::rgbToXy(QColor(colors.at(i)), ColorConversion::GamutC);
+        }
+    }
+}
+
+QTEST_APPLESS_MAIN(TestColorConversion)
+
+#include "tst_colorconversion.moc"
@@ -0,0 +1,237 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "framecolorextractor.h"
+
+#include <QtTest>
+
+// Compares the region colours of FrameColorExtractor, whose row sums use SSE2/NEON where
+// available, against a plain per pixel computation.
+class TestFrameColorExtractor: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void averageMatchesScalar_data();
+    void averageMatchesScalar();
+    void dominantMatchesScalar_data();
+    void dominantMatchesScalar();
+    void dominantFallsBackToAverage();
+
+    void benchmarkAverage();
+    void benchmarkDominant();
+
+private:
+    static void addRegions();
+    static QImage testFrame(int width, int height);
+    static QRect pixelRect(const QRectF &region, const QImage &image);
+    static QColor scalarAverage(const QImage &image, const QRect &rect, int sampleStep);
+    static QColor scalarDominant(const QImage &image, const QRect &rect, int sampleStep);
+};
+
+void TestFrameColorExtractor::addRegions()
+{
+    QTest::addColumn<QRectF>("region");
+    QTest::addColumn<int>("sampleStep");
+
+    QTest::newRow("full frame") << QRectF(0, 0, 1, 1) << 1;
+    QTest::newRow("full frame, every 2nd row") << QRectF(0, 0, 1, 1) << 2;
+    QTest::newRow("left edge") << QRectF(0, 0, 0.1, 1) << 2;
+    QTest::newRow("top edge, every 3rd row") << QRectF(0, 0, 1, 0.15) << 3;
+    // Odd start and width, so rows start unaligned and end in a partial SIMD block
+    QTest::newRow("unaligned") << QRectF(0.0143, 0.27, 0.339, 0.41) << 1;
+    QTest::newRow("narrower than a block") << QRectF(0.5, 0.5, 0.004, 0.2) << 1;
+    QTest::newRow("dominant block") << QRectF(0.5, 0, 0.5, 0.5) << 2;
+}
+
+// Noise with a block of one jittered colour in the top right quarter and a black band
+// at the bottom, so there is a clear dominant colour and a region without any.
+QImage TestFrameColorExtractor::testFrame(int width, int height)
+{
+    QImage image(width, height, QImage::Format_RGB32);
+
+    // Fixed seed, so failures are reproducible
+    quint32 seed = 0x5eed;
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            seed = seed * 1664525 + 1013904223;
+            if (y >= height * 9 / 10) {
+                row[x] = qRgb(seed >> 28, seed >> 24 & 0xf, seed >> 20 & 0xf);
+            } else if (x >= width / 2 && y < height / 2 && (seed >> 30) != 0) {
+                row[x] = qRgb(200 + (seed >> 28), 40 + (seed >> 24 & 0xf), 120 + (seed >> 20 & 0xf));
+            } else {
+                row[x] = 0xff000000 | (seed >> 8);
+            }
+        }
+    }
+    return image;
+}
+
+QRect TestFrameColorExtractor::pixelRect(const QRectF &region, const QImage &image)
+{
+    int x0 = qRound(region.left() * image.width());
+    int x1 = qRound(region.right() * image.width());
+    int y0 = qRound(region.top() * image.height());
+    int y1 = qRound(region.bottom() * image.height());
+    return QRect(x0, y0, x1 - x0, y1 - y0);
+}
+
+QColor TestFrameColorExtractor::scalarAverage(const QImage &image, const QRect &rect, int sampleStep)
+{
+    quint64 totals[3] = {0, 0, 0};
+    quint64 pixels = 0;
+    for (int y = rect.top(); y <= rect.bottom(); y += sampleStep) {
+        const QRgb *row = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for (int x = rect.left(); x <= rect.right(); ++x) {
+            totals[0] += qRed(row[x]);
+            totals[1] += qGreen(row[x]);
+            totals[2] += qBlue(row[x]);
+            ++pixels;
+        }
+    }
+    return QColor(qRound(1.0f * totals[0] / pixels), qRound(1.0f * totals[1] / pixels), qRound(1.0f * totals[2] / pixels));
+}
+
+QColor TestFrameColorExtractor::scalarDominant(const QImage &image, const QRect &rect, int sampleStep)
+{
+    // Same binning as the extractor: 4 bits per channel, near black ignored
+    QHash<int, QList<QRgb> > bins;
+    for (int y = rect.top(); y <= rect.bottom(); y += sampleStep) {
+        const QRgb *row = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for (int x = rect.left(); x <= rect.right(); x += sampleStep) {
+            QRgb pixel = row[x];
+            if (qRed(pixel) < 24 && qGreen(pixel) < 24 && qBlue(pixel) < 24) {
+                continue;
+            }
+            bins[(qRed(pixel) >> 4) << 8 | (qGreen(pixel) >> 4) << 4 | qBlue(pixel) >> 4].append(pixel);
+        }
+    }
+
+    // Ties go to the lowest bin
+    int dominant = -1;
+    foreach (int bin, bins.keys()) {
+        if (dominant == -1 || bins.value(bin).count() > bins.value(dominant).count()
+                || (bins.value(bin).count() == bins.value(dominant).count() && bin < dominant)) {
+            dominant = bin;
+        }
+    }
+    if (dominant == -1) {
+        return scalarAverage(image, rect, sampleStep);
+    }
+
+    quint64 totals[3] = {0, 0, 0};
+    foreach (QRgb pixel, bins.value(dominant)) {
+        totals[0] += qRed(pixel);
+        totals[1] += qGreen(pixel);
+        totals[2] += qBlue(pixel);
+    }
+    int count = bins.value(dominant).count();
+    return QColor(qRound(1.0f * totals[0] / count), qRound(1.0f * totals[1] / count), qRound(1.0f * totals[2] / count));
+}
+
+void TestFrameColorExtractor::averageMatchesScalar_data()
+{
+    addRegions();
+}
+
+void TestFrameColorExtractor::averageMatchesScalar()
+{
+    QFETCH(QRectF, region);
+    QFETCH(int, sampleStep);
+
+    QImage image = testFrame(643, 361);
+    FrameColorExtractor extractor;
+    extractor.setSampleStep(sampleStep);
+    extractor.setRegion(1, region);
+    extractor.processImage(image);
+
+    QCOMPARE(extractor.color(1), scalarAverage(image, pixelRect(region, image), sampleStep));
+}
+
+void TestFrameColorExtractor::dominantMatchesScalar_data()
+{
+    addRegions();
+}
+
+void TestFrameColorExtractor::dominantMatchesScalar()
+{
+    QFETCH(QRectF, region);
+    QFETCH(int, sampleStep);
+
+    QImage image = testFrame(643, 361);
+    FrameColorExtractor extractor;
+    extractor.setMode(FrameColorExtractor::ModeDominant);
+    extractor.setSampleStep(sampleStep);
+    extractor.setRegion(1, region);
+    extractor.processImage(image);
+
+    QCOMPARE(extractor.color(1), scalarDominant(image, pixelRect(region, image), sampleStep));
+}
+
+void TestFrameColorExtractor::dominantFallsBackToAverage()
+{
+    QImage image = testFrame(643, 361);
+    QRectF region(0, 0.92, 1, 0.08);
+
+    FrameColorExtractor extractor;
+    extractor.setMode(FrameColorExtractor::ModeDominant);
+    extractor.setRegion(1, region);
+    extractor.processImage(image);
+
+    QCOMPARE(extractor.color(1), scalarAverage(image, pixelRect(region, image), extractor.sampleStep()));
+}
+
+void TestFrameColorExtractor::benchmarkAverage()
+{
+    QImage image = testFrame(1920, 1080);
+    FrameColorExtractor extractor;
+    // Ambilight style: a strip along each edge, split in a few segments
+    for (int i = 0; i < 4; ++i) {
+        extractor.setRegion(i, QRectF(0.25 * i, 0, 0.25, 0.15));
+        extractor.setRegion(4 + i, QRectF(0.25 * i, 0.85, 0.25, 0.15));
+    }
+    extractor.setRegion(8, QRectF(0, 0, 0.1, 1));
+    extractor.setRegion(9, QRectF(0.9, 0, 0.1, 1));
+
+    QBENCHMARK {
+        extractor.processImage(image);
+    }
+}
+
+void TestFrameColorExtractor::benchmarkDominant()
+{
+    QImage image = testFrame(1920, 1080);
+    FrameColorExtractor extractor;
+    extractor.setMode(FrameColorExtractor::ModeDominant);
+    for (int i = 0; i < 4; ++i) {
+        extractor.setRegion(i, QRectF(0.25 * i, 0, 0.25, 0.15));
+        extractor.setRegion(4 + i, QRectF(0.25 * i, 0.85, 0.25, 0.15));
+    }
+    extractor.setRegion(8, QRectF(0, 0, 0.1, 1));
+    extractor.setRegion(9, QRectF(0.9, 0, 0.1, 1));
+
+    QBENCHMARK {
+        extractor.processImage(image);
+    }
+}
+
+QTEST_APPLESS_MAIN(TestFrameColorExtractor)
+
+#include "tst_framecolorextractor.moc"
@@ -0,0 +1,315 @@
+/*
+ * Copyright 2015 Michael Zanetti
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *      Michael Zanetti <michael_zanetti@gmx.net>
+ */
+
+#include "rulesimulator.h"
+
+#include <QtTest>
+
+// Replays events against rule sets given as the bridge returns them and checks which rules
+// fire when.
+class TestRuleSimulator: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void eq();
+    void dx();
+    void ddx();
+    void ddxRestartsOnChange();
+    void in();
+    void cascade();
+    void cascadeLimit();
+    void unsupportedOperator();
+
+    void benchmarkReplay();
+
+private:
+    static QVariantMap rule(const QString &name, const QVariantList &conditions, const QVariantList &actions = QVariantList());
+    static QVariantMap condition(const QString &address, const QString &op, const QString &value = QString());
+    static QVariantMap action(const QString &address, const QVariantMap &body);
+    static QStringList ruleIds(const QList<RuleSimulator::Firing> &firings);
+};
+
+QVariantMap TestRuleSimulator::rule(const QString &name, const QVariantList &conditions, const QVariantList &actions)
+{
+    QVariantMap rule;
+    rule.insert("name", name);
+    rule.insert("conditions", conditions);
+    rule.insert("actions", actions);
+    return rule;
+}
+
+QVariantMap TestRuleSimulator::condition(const QString &address, const QString &op, const QString &value)
+{
+    QVariantMap condition;
+    condition.insert("address", address);
+    condition.insert("operator", op);
+    if (!value.isNull()) {
+        condition.insert("value", value);
+    }
+    return condition;
+}
+
+QVariantMap TestRuleSimulator::action(const QString &address, const QVariantMap &body)
+{
+    QVariantMap action;
+    action.insert("address", address);
+    action.insert("method", "PUT");
+    action.insert("body", body);
+    return action;
+}
+
+QStringList TestRuleSimulator::ruleIds(const QList<RuleSimulator::Firing> &firings)
+{
+    QStringList ids;
+    foreach (const RuleSimulator::Firing &firing, firings) {
+        ids.append(firing.ruleId);
+    }
+    return ids;
+}
+
+void TestRuleSimulator::eq()
+{
+    QVariantMap rules;
+    rules.insert("1", rule("Button 2", QVariantList() << condition("/sensors/1/state/buttonevent", "eq", "2002")));
+
+    RuleSimulator simulator;
+    simulator.setRuleMaps(rules);
+    QVERIFY(simulator.problems().isEmpty());
+
+    // Fires when the condition becomes true, not again while it stays true
+    QList<RuleSimulator::Event> events;
+    events << RuleSimulator::Event(1000, "/sensors/1/state/buttonevent", 1002)
+           << RuleSimulator::Event(2000, "/sensors/1/state/buttonevent", 2002)
+           << RuleSimulator::Event(3000, "/sensors/1/state/buttonevent", 2002)
+           << RuleSimulator::Event(4000, "/sensors/1/state/buttonevent", 3002)
+           << RuleSimulator::Event(5000, "/sensors/1/state/buttonevent", 2002);
+    QList<RuleSimulator::Firing> firings = simulator.replay(events);
+
+    QCOMPARE(firings.count(), 2);
+    QCOMPARE(firings.at(0).time, Q_INT64_C(2000));
+    QCOMPARE(firings.at(0).ruleName, QString("Button 2"));
+    QCOMPARE(firings.at(1).time, Q_INT64_C(5000));
+}
+
+void TestRuleSimulator::dx()
+{
+    QVariantMap rules;
+    rules.insert("1", rule("Button 2", QVariantList()
+                           << condition("/sensors/1/state/buttonevent", "eq", "2002")
+                           << condition("/sensors/1/state/lastupdated", "dx")));
+
+    RuleSimulator simulator;
+    simulator.setRuleMaps(rules);
+
+    // Fires on every press, also when the button event stays the same
+    QList<RuleSimulator::Event> events;
+    events << RuleSimulator::Event(1000, "/sensors/1/state/buttonevent", 2002)
+           << RuleSimulator::Event(1000, "/sensors/1/state/lastupdated", "2016-03-01T10:00:01")
+           << RuleSimulator::Event(2000, "/sensors/1/state/lastupdated", "2016-03-01T10:00:02")
+           << RuleSimulator::Event(3000, "/sensors/1/state/buttonevent", 1002)
+           << RuleSimulator::Event(3000, "/sensors/1/state/lastupdated", "2016-03-01T10:00:03");
+    QList<RuleSimulator::Firing> firings = simulator.replay(events);
+
+    QCOMPARE(firings.count(), 2);
+    QCOMPARE(firings.at(0).time, Q_INT64_C(1000));
+    QCOMPARE(firings.at(1).time, Q_INT64_C(2000));
+}
+
+void TestRuleSimulator::ddx()
+{
+    QVariantMap rules;
+    rules.insert("1", rule("No motion", QVariantList()
+                           << condition("/sensors/2/state/presence", "eq", "false")
+                           << condition("/sensors/2/state/presence", "ddx", "PT00:00:30")));
+
+    RuleSimulator simulator;
+    simulator.setRuleMaps(rules);
+    QVERIFY(simulator.problems().isEmpty());
+
+    QList<RuleSimulator::Event> events;
+    events << RuleSimulator::Event(0, "/sensors/2/state/presence", true)
+           << RuleSimulator::Event(10000, "/sensors/2/state/presence", false);
+
+    // Nothing before the delay is over
+    QVERIFY(simulator.replay(events, 39999).isEmpty());
+
+    simulator.reset();
+    QList<RuleSimulator::Firing> firings = simulator.replay(events);
+    QCOMPARE(firings.count(), 1);
+    QCOMPARE(firings.at(0).time, Q_INT64_C(40000));
+}
+
+void TestRuleSimulator::ddxRestartsOnChange()
+{
+    QVariantMap rules;
+    rules.insert("1", rule("No motion", QVariantList()
+                           << condition("/sensors/2/state/presence", "eq", "false")
+                           << condition("/sensors/2/state/presence", "ddx", "PT00:00:30")));
+
+    RuleSimulator simulator;
+    simulator.setRuleMaps(rules);
+
+    QList<RuleSimulator::Event> events;
+    events << RuleSimulator::Event(0, "/sensors/2/state/presence", true)
+           << RuleSimulator::Event(10000, "/sensors/2/state/presence", false)
+           << RuleSimulator::Event(20000, "/sensors/2/state/presence", true)
+           << RuleSimulator::Event(25000, "/sensors/2/state/presence", false);
+    QList<RuleSimulator::Firing> firings = simulator.replay(events);
+
+    QCOMPARE(firings.count(), 1);
+    QCOMPARE(firings.at(0).time, Q_INT64_C(55000));
+}
+
+void TestRuleSimulator::in()
+{
+    QVariantMap rules;
+    rules.insert("day", rule("Day", QVariantList()
+                             << condition("/sensors/1/state/buttonevent", "eq", "1002")
+                             << condition("/config/localtime", "in", "T08:00:00/T20:00:00")));
+    rules.insert("night", rule("Night", QVariantList()
+                               << condition("/sensors/1/state/buttonevent", "eq", "1002")
+                               << condition("/config/localtime", "not in", "T08:00:00/T20:00:00")));
+
+    RuleSimulator simulator;
+    simulator.setRuleMaps(rules);
+    QVERIFY(simulator.problems().isEmpty());
+
+    qint64 noon = QDateTime(QDate(2016, 3, 1), QTime(12, 0)).toMSecsSinceEpoch();
+    qint64 evening = QDateTime(QDate(2016, 3, 1), QTime(22, 0)).toMSecsSinceEpoch();
+    QList<RuleSimulator::Event> events;
+    events << RuleSimulator::Event(noon, "/sensors/1/state/buttonevent", 1002)
+           << RuleSimulator::Event(noon + 1000, "/sensors/1/state/buttonevent", 4002)
+           << RuleSimulator::Event(evening, "/sensors/1/state/buttonevent", 1002);
+    QList<RuleSimulator::Firing> firings = simulator.replay(events);
+
+    QCOMPARE(ruleIds(firings), QStringList() << "day" << "night");
+    QCOMPARE(firings.at(0).time, noon);
+    QCOMPARE(firings.at(1).time, evening);
+}
+
+void TestRuleSimulator::cascade()
+{
+    QVariantMap status;
+    status.insert("status", 1);
+    QVariantMap on;
+    on.insert("on", true);
+
+    QVariantMap rules;
+    rules.insert("1", rule("Set status", QVariantList() << condition("/sensors/1/state/buttonevent", "eq", "1002"),
+                           QVariantList() << action("/sensors/10/state", status)));
+    rules.insert("2", rule("Status 1", QVariantList() << condition("/sensors/10/state/status", "eq", "1"),
+                           QVariantList() << action("/groups/0/action", on)));
+
+    RuleSimulator simulator;
+    simulator.setRuleMaps(rules);
+
+    QList<RuleSimulator::Firing> firings = simulator.replay(QList<RuleSimulator::Event>()
+                                                            << RuleSimulator::Event(1000, "/sensors/1/state/buttonevent", 1002));
+
+    QCOMPARE(ruleIds(firings), QStringList() << "1" << "2");
+    QCOMPARE(firings.at(1).time, Q_INT64_C(1000));
+    QCOMPARE(simulator.value("/groups/0/action/on"), QVariant(true));
+}
+
+void TestRuleSimulator::cascadeLimit()
+{
+    // Increments its own trigger, so it would trigger itself forever
+    QVariantMap increment;
+    increment.insert("status_inc", 1);
+
+    QVariantMap rules;
+    rules.insert("1", rule("Loop", QVariantList() << condition("/sensors/10/state/status", "dx"),
+                           QVariantList() << action("/sensors/10/state", increment)));
+
+    RuleSimulator simulator;
+    simulator.setRuleMaps(rules);
+
+    QTest::ignoreMessage(QtWarningMsg, "RuleSimulator: rules keep triggering each other, stopping after 16 rounds");
+    QList<RuleSimulator::Firing> firings = simulator.replay(QList<RuleSimulator::Event>()
+                                                            << RuleSimulator::Event(1000, "/sensors/10/state/status", 0));
+
+    QCOMPARE(firings.count(), 16);
+    QCOMPARE(simulator.value("/sensors/10/state/status").toInt(), 16);
+}
+
+void TestRuleSimulator::unsupportedOperator()
+{
+    QVariantMap rules;
+    rules.insert("1", rule("Broken", QVariantList() << condition("/sensors/1/state/buttonevent", "stddev", "2")));
+    rules.insert("2", rule("Bad duration", QVariantList() << condition("/sensors/1/state/buttonevent", "ddx", "30s")));
+
+    RuleSimulator simulator;
+    simulator.setRuleMaps(rules);
+    QCOMPARE(simulator.problems().count(), 2);
+
+    QVERIFY(simulator.replay(QList<RuleSimulator::Event>()
+                             << RuleSimulator::Event(1000, "/sensors/1/state/buttonevent", 2)).isEmpty());
+}
+
+void TestRuleSimulator::benchmarkReplay()
+{
+    // 20 switches with 4 buttons, each press switching 2 of 160 groups, and 40 motion
+    // timeouts on top
+    QVariantMap rules;
+    for (int i = 0; i < 160; ++i) {
+        QString sensor = "/sensors/" + QString::number(i % 20) + "/state/";
+        QVariantMap on;
+        on.insert("on", true);
+        rules.insert("button" + QString::number(i), rule("Button", QVariantList()
+                                                         << condition(sensor + "buttonevent", "eq", QString::number((i / 20 % 4 + 1) * 1000 + 2))
+                                                         << condition(sensor + "lastupdated", "dx"),
+                                                         QVariantList() << action("/groups/" + QString::number(i) + "/action", on)));
+    }
+    for (int i = 0; i < 40; ++i) {
+        QString sensor = "/sensors/" + QString::number(100 + i) + "/state/";
+        QVariantMap off;
+        off.insert("on", false);
+        rules.insert("motion" + QString::number(i), rule("No motion", QVariantList()
+                                                         << condition(sensor + "presence", "eq", "false")
+                                                         << condition(sensor + "presence", "ddx", "PT00:05:00"),
+                                                         QVariantList() << action("/groups/" + QString::number(i) + "/action", off)));
+    }
+
+    RuleSimulator simulator;
+    simulator.setRuleMaps(rules);
+    QCOMPARE(simulator.problems().count(), 0);
+
+    // A day of events, one every 10 s
+    QList<RuleSimulator::Event> events;
+    for (int i = 0; i < 8640; ++i) {
+        qint64 time = i * 10000;
+        if (i % 2 == 0) {
+            QString sensor = "/sensors/" + QString::number(i / 2 % 20) + "/state/";
+            events << RuleSimulator::Event(time, sensor + "buttonevent", (i / 40 % 4 + 1) * 1000 + 2)
+                   << RuleSimulator::Event(time, sensor + "lastupdated", time);
+        } else {
+            events << RuleSimulator::Event(time, "/sensors/" + QString::number(100 + i / 2 % 40) + "/state/presence", i / 80 % 2 == 0);
+        }
+    }
+
+    QBENCHMARK {
+        simulator.reset();
+        simulator.replay(events);
+    }
+}
+
+QTEST_APPLESS_MAIN(TestRuleSimulator)
+
+#include "tst_rulesimulator.moc"
@@ -0,0 +1,6 @@
+TEMPLATE = subdirs
+
+SUBDIRS = beatdetector \
+    colorconversion \
+    framecolorextractor \
+    rulesimulator